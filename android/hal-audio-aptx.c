@@ -18,6 +18,8 @@
 
 #define APTX_SO_NAME	"libbt-aptx.so"
 
+#define APTX_CHUNK_FRAMES	64
+
 struct aptx_data {
 	a2dp_aptx_t aptx;
 
@@ -205,20 +207,31 @@ static ssize_t aptx_encode_mediapacket(void *codec_data, const uint8_t *buffer,
 	size_t bytes_in = 0;
 	size_t bytes_out = 0;
 
+	/*
+	 * Encoder consumes 4 stereo frames (16 bytes) per call and produces
+	 * 4 bytes, split input in larger chunks so deinterleaving can be
+	 * vectorized.
+	 */
 	while ((len - bytes_in) >= 16 && (mp_data_len - bytes_out) >= 4) {
-		int pcm_l[4], pcm_r[4];
-		int i;
+		int pcm_l[APTX_CHUNK_FRAMES], pcm_r[APTX_CHUNK_FRAMES];
+		size_t blocks, i;
 
-		for (i = 0; i < 4; i++) {
-			pcm_l[i] = ptr[0];
-			pcm_r[i] = ptr[1];
-			ptr += 2;
-		}
+		blocks = (len - bytes_in) / 16;
+		if (blocks > (mp_data_len - bytes_out) / 4)
+			blocks = (mp_data_len - bytes_out) / 4;
+		if (blocks > APTX_CHUNK_FRAMES / 4)
+			blocks = APTX_CHUNK_FRAMES / 4;
+
+		pcm_deinterleave_s16(pcm_l, pcm_r, ptr, blocks * 4);
 
-		aptx_encode(aptx_data->enc, pcm_l, pcm_r, &mp->data[bytes_out]);
+		for (i = 0; i < blocks; i++) {
+			aptx_encode(aptx_data->enc, &pcm_l[i * 4], &pcm_r[i * 4],
+							&mp->data[bytes_out]);
+			bytes_out += 4;
+		}
 
-		bytes_in += 16;
-		bytes_out += 4;
+		ptr += blocks * 8;
+		bytes_in += blocks * 16;
 	}
 
 	*written = bytes_out;
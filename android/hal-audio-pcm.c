@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2026 BlueZ contributors
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <endian.h>
+
+#include "audio-msg.h"
+#include "hal-audio.h"
+#include "hal-utils.h"
+
+/*
+ * The kernels below are written with generic compiler vector types so the
+ * same source turns into SSE2 on x86 and NEON on ARM without intrinsics.
+ * One stereo S16 frame is loaded as a single 32-bit lane, so left sample
+ * ends up in the low half and right one in the high half on little endian
+ * hosts. Big endian hosts and compilers without __builtin_convertvector
+ * use the scalar loops only.
+ */
+#if __BYTE_ORDER == __LITTLE_ENDIAN && defined(__has_builtin)
+#if __has_builtin(__builtin_convertvector)
+#define PCM_VECTOR
+#endif
+#endif
+
+#ifdef PCM_VECTOR
+
+#define PCM_LANES 8
+
+typedef int32_t v8si __attribute__((vector_size(PCM_LANES * 4)));
+typedef uint32_t v8su __attribute__((vector_size(PCM_LANES * 4)));
+typedef int16_t v8hi __attribute__((vector_size(PCM_LANES * 2)));
+
+static inline void pcm_split(const int16_t *in, v8si *l, v8si *r)
+{
+	v8su w;
+
+	/* Unaligned load, PCM buffers come straight from AudioFlinger */
+	memcpy(&w, in, sizeof(w));
+
+	*l = (v8si) (w << 16) >> 16;
+	*r = (v8si) w >> 16;
+}
+
+static size_t downmix_vector(int16_t *out, const int16_t *in, size_t frames)
+{
+	size_t i;
+
+	for (i = 0; i + PCM_LANES <= frames; i += PCM_LANES) {
+		v8si l, r, s;
+		v8hi m;
+
+		pcm_split(&in[i * 2], &l, &r);
+
+		/* Round towards zero to match (l + r) / 2 of the scalar path */
+		s = l + r;
+		s = (s + ((s >> 31) & 1)) >> 1;
+
+		m = __builtin_convertvector(s, v8hi);
+		memcpy(&out[i], &m, sizeof(m));
+	}
+
+	return i;
+}
+
+static size_t deinterleave_vector(int *left, int *right, const int16_t *in,
+								size_t frames)
+{
+	size_t i;
+
+	if (sizeof(int) != sizeof(int32_t))
+		return 0;
+
+	for (i = 0; i + PCM_LANES <= frames; i += PCM_LANES) {
+		v8si l, r;
+
+		pcm_split(&in[i * 2], &l, &r);
+
+		memcpy(&left[i], &l, sizeof(l));
+		memcpy(&right[i], &r, sizeof(r));
+	}
+
+	return i;
+}
+
+#else
+
+static size_t downmix_vector(int16_t *out, const int16_t *in, size_t frames)
+{
+	return 0;
+}
+
+static size_t deinterleave_vector(int *left, int *right, const int16_t *in,
+								size_t frames)
+{
+	return 0;
+}
+
+#endif
+
+void pcm_downmix_s16le(int16_t *out, const int16_t *in, size_t frames)
+{
+	size_t i;
+
+	for (i = downmix_vector(out, in, frames); i < frames; i++) {
+		int16_t l = get_le16(&in[i * 2]);
+		int16_t r = get_le16(&in[i * 2 + 1]);
+
+		put_le16((l + r) / 2, &out[i]);
+	}
+}
+
+void pcm_deinterleave_s16(int *left, int *right, const int16_t *in,
+								size_t frames)
+{
+	size_t i;
+
+	for (i = deinterleave_vector(left, right, in, frames); i < frames;
+									i++) {
+		left[i] = in[i * 2];
+		right[i] = in[i * 2 + 1];
+	}
+}
@@ -573,17 +573,12 @@ static void downmix_to_mono(struct a2dp_stream_out *out, const uint8_t *buffer,
 {
 	const int16_t *input = (const void *) buffer;
 	int16_t *output = (void *) out->downmix_buf;
-	size_t i, frames;
+	size_t frames;
 
 	/* PCM 16bit stereo */
 	frames = bytes / (2 * sizeof(int16_t));
 
-	for (i = 0; i < frames; i++) {
-		int16_t l = get_le16(&input[i * 2]);
-		int16_t r = get_le16(&input[i * 2 + 1]);
-
-		put_le16((l + r) / 2, &output[i]);
-	}
+	pcm_downmix_s16le(output, input, frames);
 }
 
 static bool wait_for_endpoint(struct audio_endpoint *ep, bool *writable)
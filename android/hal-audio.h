@@ -89,3 +89,7 @@ typedef const struct audio_codec * (*audio_codec_get_t) (void);
 
 const struct audio_codec *codec_sbc(void);
 const struct audio_codec *codec_aptx(void);
+
+void pcm_downmix_s16le(int16_t *out, const int16_t *in, size_t frames);
+void pcm_deinterleave_s16(int *left, int *right, const int16_t *in,
+								size_t frames);
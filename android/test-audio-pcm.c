@@ -0,0 +1,380 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "android/audio-msg.h"
+#include "android/hal-audio.h"
+#include "android/hal-utils.h"
+#include "profiles/audio/a2dp-codecs.h"
+
+/* 10 seconds of 48kHz audio plus a tail not multiple of vector width */
+#define FIXTURE_FRAMES	(48000 * 10 + 7)
+
+#define BENCH_ROUNDS	20
+
+#define PACKET_MTU	672
+#define PAYLOAD_LEN	(PACKET_MTU - sizeof(struct rtp_header))
+
+struct test_data {
+	const char *name;
+	void (*fill)(int16_t *pcm, size_t frames);
+};
+
+static uint32_t lcg_state;
+
+static int16_t lcg_next(void)
+{
+	lcg_state = lcg_state * 1103515245 + 12345;
+
+	return lcg_state >> 16;
+}
+
+static void fill_silence(int16_t *pcm, size_t frames)
+{
+	memset(pcm, 0, frames * 2 * sizeof(*pcm));
+}
+
+static void fill_noise(int16_t *pcm, size_t frames)
+{
+	size_t i;
+
+	lcg_state = 0x5eed;
+
+	for (i = 0; i < frames * 2; i++)
+		put_le16(lcg_next(), &pcm[i]);
+}
+
+static void fill_triangle(int16_t *pcm, size_t frames)
+{
+	int32_t l = 0, r = 0;
+	int dl = 97, dr = -131;
+	size_t i;
+
+	for (i = 0; i < frames; i++) {
+		if (l + dl > INT16_MAX || l + dl < INT16_MIN)
+			dl = -dl;
+		if (r + dr > INT16_MAX || r + dr < INT16_MIN)
+			dr = -dr;
+
+		l += dl;
+		r += dr;
+
+		put_le16(l, &pcm[i * 2]);
+		put_le16(r, &pcm[i * 2 + 1]);
+	}
+}
+
+static void fill_extremes(int16_t *pcm, size_t frames)
+{
+	static const int16_t values[] = {
+		INT16_MIN, INT16_MIN + 1, -2, -1, 0, 1, 2, INT16_MAX - 1,
+		INT16_MAX,
+	};
+	const size_t count = sizeof(values) / sizeof(values[0]);
+	size_t i;
+
+	/* Every left/right pair, odd negative sums are the tricky ones */
+	for (i = 0; i < frames; i++) {
+		put_le16(values[i % count], &pcm[i * 2]);
+		put_le16(values[(i / count) % count], &pcm[i * 2 + 1]);
+	}
+}
+
+static const struct test_data fixture_silence = {
+	.name = "silence",
+	.fill = fill_silence,
+};
+
+static const struct test_data fixture_noise = {
+	.name = "noise",
+	.fill = fill_noise,
+};
+
+static const struct test_data fixture_triangle = {
+	.name = "triangle",
+	.fill = fill_triangle,
+};
+
+static const struct test_data fixture_extremes = {
+	.name = "extremes",
+	.fill = fill_extremes,
+};
+
+/* Reference implementations, kept identical to the former scalar code */
+static void ref_downmix(int16_t *out, const int16_t *in, size_t frames)
+{
+	size_t i;
+
+	for (i = 0; i < frames; i++) {
+		int16_t l = get_le16(&in[i * 2]);
+		int16_t r = get_le16(&in[i * 2 + 1]);
+
+		put_le16((l + r) / 2, &out[i]);
+	}
+}
+
+static void ref_deinterleave(int *left, int *right, const int16_t *in,
+								size_t frames)
+{
+	size_t i;
+
+	for (i = 0; i < frames; i++) {
+		left[i] = in[i * 2];
+		right[i] = in[i * 2 + 1];
+	}
+}
+
+static int16_t *fixture_new(const struct test_data *test)
+{
+	/* One spare frame so tests can run on a misaligned buffer too */
+	int16_t *pcm = g_new0(int16_t, (FIXTURE_FRAMES + 1) * 2);
+
+	test->fill(pcm + 1, FIXTURE_FRAMES);
+
+	return pcm;
+}
+
+static void bench_report(const char *what, const struct test_data *test,
+							double elapsed)
+{
+	double rate;
+
+	if (elapsed <= 0)
+		return;
+
+	rate = (double) FIXTURE_FRAMES * BENCH_ROUNDS / elapsed;
+
+	g_test_message("%s/%s: %.1f Mframes/s (%.0fx realtime at 48kHz)",
+				what, test->name, rate / 1e6, rate / 48000);
+}
+
+static void test_downmix(gconstpointer data)
+{
+	const struct test_data *test = data;
+	int16_t *pcm = fixture_new(test);
+	int16_t *ref = g_new0(int16_t, FIXTURE_FRAMES);
+	int16_t *out = g_new0(int16_t, FIXTURE_FRAMES);
+	size_t frames;
+	int i;
+
+	/* Cover every tail length as well as the full fixture */
+	for (frames = 0; frames < 32; frames++) {
+		ref_downmix(ref, pcm + 1, frames);
+		pcm_downmix_s16le(out, pcm + 1, frames);
+		g_assert(!memcmp(ref, out, frames * sizeof(*out)));
+	}
+
+	ref_downmix(ref, pcm + 1, FIXTURE_FRAMES);
+	pcm_downmix_s16le(out, pcm + 1, FIXTURE_FRAMES);
+	g_assert(!memcmp(ref, out, FIXTURE_FRAMES * sizeof(*out)));
+
+	/* Misaligned input and output */
+	pcm_downmix_s16le(out + 1, pcm, FIXTURE_FRAMES - 1);
+	ref_downmix(ref + 1, pcm, FIXTURE_FRAMES - 1);
+	g_assert(!memcmp(ref, out, FIXTURE_FRAMES * sizeof(*out)));
+
+	if (g_test_perf()) {
+		g_test_timer_start();
+		for (i = 0; i < BENCH_ROUNDS; i++)
+			ref_downmix(ref, pcm + 1, FIXTURE_FRAMES);
+		bench_report("downmix-ref", test, g_test_timer_elapsed());
+
+		g_test_timer_start();
+		for (i = 0; i < BENCH_ROUNDS; i++)
+			pcm_downmix_s16le(out, pcm + 1, FIXTURE_FRAMES);
+		bench_report("downmix", test, g_test_timer_elapsed());
+	}
+
+	g_free(out);
+	g_free(ref);
+	g_free(pcm);
+}
+
+static void test_deinterleave(gconstpointer data)
+{
+	const struct test_data *test = data;
+	int16_t *pcm = fixture_new(test);
+	int *ref_l = g_new0(int, FIXTURE_FRAMES);
+	int *ref_r = g_new0(int, FIXTURE_FRAMES);
+	int *out_l = g_new0(int, FIXTURE_FRAMES);
+	int *out_r = g_new0(int, FIXTURE_FRAMES);
+	size_t frames;
+	int i;
+
+	for (frames = 0; frames < 32; frames++) {
+		ref_deinterleave(ref_l, ref_r, pcm + 1, frames);
+		pcm_deinterleave_s16(out_l, out_r, pcm + 1, frames);
+		g_assert(!memcmp(ref_l, out_l, frames * sizeof(int)));
+		g_assert(!memcmp(ref_r, out_r, frames * sizeof(int)));
+	}
+
+	ref_deinterleave(ref_l, ref_r, pcm + 1, FIXTURE_FRAMES);
+	pcm_deinterleave_s16(out_l, out_r, pcm + 1, FIXTURE_FRAMES);
+	g_assert(!memcmp(ref_l, out_l, FIXTURE_FRAMES * sizeof(int)));
+	g_assert(!memcmp(ref_r, out_r, FIXTURE_FRAMES * sizeof(int)));
+
+	if (g_test_perf()) {
+		g_test_timer_start();
+		for (i = 0; i < BENCH_ROUNDS; i++)
+			ref_deinterleave(ref_l, ref_r, pcm + 1,
+							FIXTURE_FRAMES);
+		bench_report("deinterleave-ref", test, g_test_timer_elapsed());
+
+		g_test_timer_start();
+		for (i = 0; i < BENCH_ROUNDS; i++)
+			pcm_deinterleave_s16(out_l, out_r, pcm + 1,
+							FIXTURE_FRAMES);
+		bench_report("deinterleave", test, g_test_timer_elapsed());
+	}
+
+	g_free(out_r);
+	g_free(out_l);
+	g_free(ref_r);
+	g_free(ref_l);
+	g_free(pcm);
+}
+
+static const a2dp_sbc_t sbc_mono = {
+	.frequency = SBC_SAMPLING_FREQ_48000,
+	.channel_mode = SBC_CHANNEL_MODE_MONO,
+	.subbands = SBC_SUBBANDS_8,
+	.allocation_method = SBC_ALLOCATION_LOUDNESS,
+	.block_length = SBC_BLOCK_LENGTH_16,
+	.min_bitpool = 2,
+	.max_bitpool = 53,
+};
+
+static size_t sbc_encode_all(const struct audio_codec *codec,
+				void *codec_data, const int16_t *pcm,
+				size_t frames, uint8_t *out)
+{
+	uint8_t packet[PACKET_MTU];
+	struct media_packet_rtp *mp_rtp = (void *) packet;
+	const uint8_t *in = (const void *) pcm;
+	size_t len = frames * sizeof(*pcm);
+	size_t consumed = 0;
+	size_t total = 0;
+
+	memset(packet, 0, sizeof(packet));
+
+	while (consumed < len) {
+		size_t written = 0;
+		ssize_t ret;
+
+		ret = codec->encode_mediapacket(codec_data, in + consumed,
+					len - consumed, (void *) packet,
+					PAYLOAD_LEN, &written);
+		if (ret <= 0)
+			break;
+
+		/* Payload header and SBC frames, RTP header is not touched */
+		memcpy(out + total, mp_rtp->data, written);
+
+		consumed += ret;
+		total += written;
+	}
+
+	return total;
+}
+
+/*
+ * Encode downmixed fixture through SBC codec of the HAL, end to end check
+ * that vectorized downmix does not change a single encoded bit.
+ */
+static void test_sbc_encode(gconstpointer data)
+{
+	const struct test_data *test = data;
+	const struct audio_codec *codec = codec_sbc();
+	uint8_t preset_buf[sizeof(struct audio_preset) + sizeof(sbc_mono)];
+	struct audio_preset *preset = (void *) preset_buf;
+	int16_t *pcm = fixture_new(test);
+	int16_t *ref = g_new0(int16_t, FIXTURE_FRAMES);
+	int16_t *mono = g_new0(int16_t, FIXTURE_FRAMES);
+	uint8_t *ref_out = g_malloc0(FIXTURE_FRAMES * 2);
+	uint8_t *out = g_malloc0(FIXTURE_FRAMES * 2);
+	size_t ref_len, out_len;
+	void *codec_data;
+	int i;
+
+	preset->len = sizeof(sbc_mono);
+	memcpy(preset->data, &sbc_mono, sizeof(sbc_mono));
+
+	ref_downmix(ref, pcm + 1, FIXTURE_FRAMES);
+	pcm_downmix_s16le(mono, pcm + 1, FIXTURE_FRAMES);
+
+	g_assert(codec->init(preset, PAYLOAD_LEN, &codec_data));
+	ref_len = sbc_encode_all(codec, codec_data, ref, FIXTURE_FRAMES,
+								ref_out);
+	codec->cleanup(codec_data);
+
+	g_assert(codec->init(preset, PAYLOAD_LEN, &codec_data));
+	out_len = sbc_encode_all(codec, codec_data, mono, FIXTURE_FRAMES,
+									out);
+	codec->cleanup(codec_data);
+
+	g_assert(ref_len > 0);
+	g_assert(ref_len == out_len);
+	g_assert(!memcmp(ref_out, out, out_len));
+
+	if (g_test_perf()) {
+		g_assert(codec->init(preset, PAYLOAD_LEN, &codec_data));
+
+		g_test_timer_start();
+		for (i = 0; i < BENCH_ROUNDS; i++) {
+			pcm_downmix_s16le(mono, pcm + 1, FIXTURE_FRAMES);
+			sbc_encode_all(codec, codec_data, mono,
+							FIXTURE_FRAMES, out);
+		}
+		bench_report("sbc-mono", test, g_test_timer_elapsed());
+
+		codec->cleanup(codec_data);
+	}
+
+	g_free(out);
+	g_free(ref_out);
+	g_free(mono);
+	g_free(ref);
+	g_free(pcm);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/android_audio_pcm/downmix/silence",
+					&fixture_silence, test_downmix);
+	g_test_add_data_func("/android_audio_pcm/downmix/noise",
+					&fixture_noise, test_downmix);
+	g_test_add_data_func("/android_audio_pcm/downmix/triangle",
+					&fixture_triangle, test_downmix);
+	g_test_add_data_func("/android_audio_pcm/downmix/extremes",
+					&fixture_extremes, test_downmix);
+	g_test_add_data_func("/android_audio_pcm/deinterleave/noise",
+					&fixture_noise, test_deinterleave);
+	g_test_add_data_func("/android_audio_pcm/deinterleave/extremes",
+					&fixture_extremes, test_deinterleave);
+	g_test_add_data_func("/android_audio_pcm/sbc_encode/noise",
+					&fixture_noise, test_sbc_encode);
+	g_test_add_data_func("/android_audio_pcm/sbc_encode/triangle",
+					&fixture_triangle, test_sbc_encode);
+
+	return g_test_run();
+}
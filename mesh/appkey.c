@@ -65,6 +65,7 @@ static void finalize_key(void *a, void *b)
 
 	key->new_key_aid = APP_AID_INVALID;
 
+	mesh_crypto_forget_key(key->key);
 	memcpy(key->key, key->new_key, 16);
 }
 
@@ -113,6 +114,11 @@ void appkey_key_free(void *data)
 	if (!key)
 		return;
 
+	mesh_crypto_forget_key(key->key);
+
+	if (key->new_key_aid != APP_AID_INVALID)
+		mesh_crypto_forget_key(key->new_key);
+
 	l_free(key);
 }
 
@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <ell/ell.h>
+
+#include "mesh/crypto.h"
+#include "mesh/crypto-pool.h"
+
+/*
+ * Work queued to the pool runs on any of the worker threads, while the
+ * completions run on the main loop strictly in the order the work was
+ * queued.  The workers poke an eventfd watched by the main loop whenever
+ * a job finishes.
+ */
+
+/* Beyond this backlog the main loop waits for the oldest job */
+#define MAX_PENDING		256
+
+struct pool_job {
+	crypto_pool_work_func_t work;
+	crypto_pool_done_func_t done;
+	crypto_pool_destroy_func_t destroy;
+	void *user_data;
+	bool finished;
+};
+
+struct crypto_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	struct l_queue *todo;		/* Not taken by a worker yet */
+	struct l_queue *pending;	/* Not completed yet, main loop only */
+	struct l_io *io;
+	int fd;
+	pthread_t *threads;
+	unsigned int num_threads;
+	bool stopping;
+};
+
+static struct crypto_pool *pool;
+
+static void free_job(void *data)
+{
+	struct pool_job *job = data;
+
+	if (job->destroy)
+		job->destroy(job->user_data);
+
+	l_free(job);
+}
+
+static void *pool_worker(void *user_data)
+{
+	struct crypto_pool *p = user_data;
+	uint64_t val = 1;
+
+	pthread_mutex_lock(&p->lock);
+
+	while (true) {
+		struct pool_job *job;
+
+		while (!p->stopping && l_queue_isempty(p->todo))
+			pthread_cond_wait(&p->work_cond, &p->lock);
+
+		if (p->stopping)
+			break;
+
+		job = l_queue_pop_head(p->todo);
+		pthread_mutex_unlock(&p->lock);
+
+		job->work(job->user_data);
+
+		pthread_mutex_lock(&p->lock);
+		job->finished = true;
+		pthread_cond_signal(&p->done_cond);
+
+		if (write(p->fd, &val, sizeof(val)) < 0)
+			l_error("Failed to wake up main loop");
+	}
+
+	pthread_mutex_unlock(&p->lock);
+
+	/* Cipher handles set up by this thread */
+	mesh_crypto_cleanup();
+
+	return NULL;
+}
+
+static bool job_finished(struct pool_job *job)
+{
+	bool finished;
+
+	pthread_mutex_lock(&pool->lock);
+	finished = job->finished;
+	pthread_mutex_unlock(&pool->lock);
+
+	return finished;
+}
+
+static void complete_jobs(void)
+{
+	struct pool_job *job;
+
+	while (pool && (job = l_queue_peek_head(pool->pending))) {
+		if (!job_finished(job))
+			break;
+
+		l_queue_pop_head(pool->pending);
+		job->done(job->user_data);
+		free_job(job);
+	}
+}
+
+static bool pool_read(struct l_io *io, void *user_data)
+{
+	uint64_t val;
+
+	if (read(l_io_get_fd(io), &val, sizeof(val)) < 0)
+		return true;
+
+	complete_jobs();
+
+	return true;
+}
+
+static void wait_oldest(void)
+{
+	struct pool_job *job = l_queue_peek_head(pool->pending);
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (!job->finished)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+
+	pthread_mutex_unlock(&pool->lock);
+
+	complete_jobs();
+}
+
+bool crypto_pool_queue(crypto_pool_work_func_t work,
+				crypto_pool_done_func_t done, void *user_data,
+				crypto_pool_destroy_func_t destroy)
+{
+	struct pool_job *job;
+
+	if (!pool || !work || !done)
+		return false;
+
+	if (l_queue_length(pool->pending) >= MAX_PENDING)
+		wait_oldest();
+
+	job = l_new(struct pool_job, 1);
+	job->work = work;
+	job->done = done;
+	job->destroy = destroy;
+	job->user_data = user_data;
+
+	l_queue_push_tail(pool->pending, job);
+
+	pthread_mutex_lock(&pool->lock);
+	l_queue_push_tail(pool->todo, job);
+	pthread_cond_signal(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return true;
+}
+
+bool crypto_pool_active(void)
+{
+	return pool != NULL;
+}
+
+bool crypto_pool_init(unsigned int workers)
+{
+	unsigned int i;
+	int fd;
+
+	if (pool || !workers || workers > CRYPTO_POOL_MAX_WORKERS)
+		return false;
+
+	fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fd < 0)
+		return false;
+
+	pool = l_new(struct crypto_pool, 1);
+	pool->fd = fd;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	pool->todo = l_queue_new();
+	pool->pending = l_queue_new();
+
+	pool->io = l_io_new(fd);
+	l_io_set_close_on_destroy(pool->io, true);
+	l_io_set_read_handler(pool->io, pool_read, NULL, NULL);
+
+	pool->threads = l_new(pthread_t, workers);
+
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&pool->threads[i], NULL, pool_worker, pool))
+			break;
+
+		pool->num_threads++;
+	}
+
+	if (!pool->num_threads) {
+		crypto_pool_cleanup();
+		return false;
+	}
+
+	l_info("Crypto worker pool started with %u workers",
+							pool->num_threads);
+
+	return true;
+}
+
+void crypto_pool_cleanup(void)
+{
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	/* Jobs that haven't completed yet are dropped */
+	l_queue_destroy(pool->todo, NULL);
+	l_queue_destroy(pool->pending, free_job);
+	l_io_destroy(pool->io);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->lock);
+
+	l_free(pool->threads);
+	l_free(pool);
+	pool = NULL;
+}
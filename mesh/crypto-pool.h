@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#define CRYPTO_POOL_MAX_WORKERS	16
+
+/* Runs on a worker thread, must only touch the job's own data */
+typedef void (*crypto_pool_work_func_t)(void *user_data);
+
+/* Runs on the main loop, in the order the jobs were queued */
+typedef void (*crypto_pool_done_func_t)(void *user_data);
+
+typedef void (*crypto_pool_destroy_func_t)(void *user_data);
+
+bool crypto_pool_init(unsigned int workers);
+void crypto_pool_cleanup(void);
+bool crypto_pool_active(void);
+bool crypto_pool_queue(crypto_pool_work_func_t work,
+				crypto_pool_done_func_t done, void *user_data,
+				crypto_pool_destroy_func_t destroy);
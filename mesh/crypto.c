@@ -13,6 +13,7 @@
 #endif
 
 #define _GNU_SOURCE
+#include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <ell/ell.h>
@@ -24,20 +25,137 @@
 /* Multiply used Zero array */
 static const uint8_t zero[16] = { 0, };
 
-static bool aes_ecb_one(const uint8_t key[16], const uint8_t in[16],
-								uint8_t out[16])
+/*
+ * Every kernel cipher handle costs a handful of AF_ALG socket syscalls to
+ * set up, which used to be paid for each privacy and CCM operation of every
+ * relayed or received packet.  Only a few keys are in active use at any
+ * time, so keep the most recently used handles around.  Owners of a key
+ * drop its handles with mesh_crypto_forget_key() when the key goes away.
+ *
+ * Handles can't be shared between threads, so each thread that decodes
+ * packets has a cache of its own.  Forgetting a key bumps a generation
+ * count, and the other threads flush their whole cache when they see it.
+ */
+#define CIPHER_CACHE_SIZE	8
+
+struct cipher_entry {
+	uint8_t key[16];
+	uint8_t mic_size;	/* 0 for AES-ECB */
+	void *cipher;
+};
+
+struct cipher_lookup {
+	const uint8_t *key;
+	uint8_t mic_size;
+};
+
+static __thread struct l_queue *cipher_cache;
+static __thread unsigned int cipher_generation;
+static unsigned int forget_generation;
+
+static bool match_cipher(const void *a, const void *b)
+{
+	const struct cipher_entry *entry = a;
+	const struct cipher_lookup *lookup = b;
+
+	return entry->mic_size == lookup->mic_size &&
+				!memcmp(entry->key, lookup->key, 16);
+}
+
+static void free_cipher(void *data)
+{
+	struct cipher_entry *entry = data;
+
+	if (entry->mic_size)
+		l_aead_cipher_free(entry->cipher);
+	else
+		l_cipher_free(entry->cipher);
+
+	explicit_bzero(entry->key, sizeof(entry->key));
+	l_free(entry);
+}
+
+static void *get_cipher(const uint8_t key[16], uint8_t mic_size)
 {
+	struct cipher_lookup lookup = { .key = key, .mic_size = mic_size };
+	struct cipher_entry *entry;
 	void *cipher;
-	bool result = false;
+	unsigned int generation;
 
-	cipher = l_cipher_new(L_CIPHER_AES, key, 16);
+	if (!cipher_cache)
+		cipher_cache = l_queue_new();
 
-	if (cipher) {
-		result = l_cipher_encrypt(cipher, in, out, 16);
-		l_cipher_free(cipher);
+	generation = __atomic_load_n(&forget_generation, __ATOMIC_ACQUIRE);
+	if (cipher_generation != generation) {
+		l_queue_clear(cipher_cache, free_cipher);
+		cipher_generation = generation;
 	}
 
-	return result;
+	entry = l_queue_remove_if(cipher_cache, match_cipher, &lookup);
+	if (entry) {
+		l_queue_push_head(cipher_cache, entry);
+		return entry->cipher;
+	}
+
+	if (mic_size)
+		cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16,
+								mic_size);
+	else
+		cipher = l_cipher_new(L_CIPHER_AES, key, 16);
+
+	if (!cipher)
+		return NULL;
+
+	if (l_queue_length(cipher_cache) >= CIPHER_CACHE_SIZE) {
+		entry = l_queue_peek_tail(cipher_cache);
+		l_queue_remove(cipher_cache, entry);
+		free_cipher(entry);
+	}
+
+	entry = l_new(struct cipher_entry, 1);
+	memcpy(entry->key, key, 16);
+	entry->mic_size = mic_size;
+	entry->cipher = cipher;
+	l_queue_push_head(cipher_cache, entry);
+
+	return cipher;
+}
+
+static bool forget_cipher(void *a, void *b)
+{
+	struct cipher_entry *entry = a;
+
+	if (memcmp(entry->key, b, 16))
+		return false;
+
+	free_cipher(entry);
+	return true;
+}
+
+void mesh_crypto_forget_key(const uint8_t key[16])
+{
+	l_queue_foreach_remove(cipher_cache, forget_cipher, (void *) key);
+
+	cipher_generation = __atomic_add_fetch(&forget_generation, 1,
+							__ATOMIC_RELEASE);
+}
+
+void mesh_crypto_cleanup(void)
+{
+	l_queue_destroy(cipher_cache, free_cipher);
+	cipher_cache = NULL;
+}
+
+static bool aes_ecb_one(const uint8_t key[16], const uint8_t in[16],
+								uint8_t out[16])
+{
+	void *cipher;
+
+	cipher = get_cipher(key, 0);
+	if (!cipher)
+		return false;
+
+	return l_cipher_encrypt(cipher, in, out, 16);
 }
 
 static bool aes_cmac(void *checksum, const uint8_t *msg,
@@ -89,7 +207,9 @@ bool mesh_crypto_aes_ccm_encrypt(const uint8_t nonce[13], const uint8_t key[16],
 	void *cipher;
 	bool result;
 
-	cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16, mic_size);
+	cipher = get_cipher(key, mic_size);
+	if (!cipher)
+		return false;
 
 	result = l_aead_cipher_encrypt(cipher, msg, msg_len, aad, aad_len,
 					nonce, 13, out_msg, msg_len + mic_size);
@@ -101,8 +221,6 @@ bool mesh_crypto_aes_ccm_encrypt(const uint8_t nonce[13], const uint8_t key[16],
 			*(uint64_t *)out_mic = l_get_be64(out_msg + msg_len);
 	}
 
-	l_aead_cipher_free(cipher);
-
 	return result;
 }
 
@@ -116,7 +234,9 @@ bool mesh_crypto_aes_ccm_decrypt(const uint8_t nonce[13], const uint8_t key[16],
 	bool result;
 	size_t out_msg_len = enc_msg_len - mic_size;
 
-	cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16, mic_size);
+	cipher = get_cipher(key, mic_size);
+	if (!cipher)
+		return false;
 
 	result = l_aead_cipher_decrypt(cipher, enc_msg, enc_msg_len,
 							aad, aad_len, nonce, 13,
@@ -131,8 +251,6 @@ bool mesh_crypto_aes_ccm_decrypt(const uint8_t nonce[13], const uint8_t key[16],
 				l_get_be64(enc_msg + enc_msg_len - mic_size);
 	}
 
-	l_aead_cipher_free(cipher);
-
 	return result;
 }
 
@@ -228,6 +346,7 @@ bool mesh_crypto_identity(const uint8_t net_key[16], uint16_t addr,
 {
 	uint8_t id_key[16];
 	uint8_t tmp[16];
+	bool result;
 
 	if (!mesh_crypto_nkik(net_key, id_key))
 		return false;
@@ -239,7 +358,12 @@ bool mesh_crypto_identity(const uint8_t net_key[16], uint16_t addr,
 	memcpy(tmp + 6, id + 8, 8);
 	l_put_be16(addr, tmp + 14);
 
-	if (!aes_ecb_one(id_key, tmp, tmp))
+	result = aes_ecb_one(id_key, tmp, tmp);
+
+	/* Identity key is derived again for every beacon */
+	mesh_crypto_forget_key(id_key);
+
+	if (!result)
 		return false;
 
 	memcpy(id, tmp + 8, 8);
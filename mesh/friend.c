@@ -498,28 +498,28 @@ void friend_poll(struct mesh_net *net, uint16_t src, bool seq,
 	/* Reset Poll Timeout */
 	l_timeout_modify_ms(frnd->timeout, frnd->poll_timeout * 100);
 
-	if (!l_queue_length(frnd->pkt_cache))
+	if (!frnd->cache_len)
 		goto update;
 
 	if (frnd->u.active.seq != frnd->u.active.last &&
 						frnd->u.active.seq != seq) {
-		pkt = l_queue_peek_head(frnd->pkt_cache);
+		pkt = mesh_friend_cache_peek(frnd);
 		if (pkt->cnt_out < pkt->cnt_in) {
 			pkt->cnt_out++;
 		} else {
-			pkt = l_queue_pop_head(frnd->pkt_cache);
+			pkt = mesh_friend_cache_pop(frnd);
 			l_free(pkt);
 		}
 	}
 
-	pkt = l_queue_peek_head(frnd->pkt_cache);
+	pkt = mesh_friend_cache_peek(frnd);
 
 	if (!pkt)
 		goto update;
 
 	frnd->u.active.seq = seq;
 	frnd->u.active.last = !seq;
-	md = !!(l_queue_length(frnd->pkt_cache) > 1);
+	md = !!(frnd->cache_len > 1);
 
 	if (pkt->ctl) {
 		/* Make sure we don't change the bit-sense of MD,
@@ -25,6 +25,7 @@
 #include <ell/ell.h>
 
 #include "mesh/mesh-defs.h"
+#include "mesh/crypto.h"
 
 #include "mesh/dbus.h"
 #include "mesh/node.h"
@@ -343,6 +344,12 @@ bool keyring_del_remote_dev_key(struct mesh_node *node, uint16_t unicast,
 	node_path = node_get_storage_dir(node);
 
 	for (i = 0; i < count; i++) {
+		uint8_t dev_key[16];
+
+		/* Drop any cipher still set up for the removed node */
+		if (keyring_get_remote_dev_key(node, unicast + i, dev_key))
+			mesh_crypto_forget_key(dev_key);
+
 		snprintf(key_file, PATH_MAX, "%s%s/%4.4x", node_path,
 						dev_key_dir, unicast + i);
 		l_debug("RM Dev Key %s", key_file);
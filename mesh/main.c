@@ -64,9 +64,11 @@ static void usage(void)
 	       "\t--help            Show %s information\n", __func__);
 	fprintf(stderr,
 	       "io:\n"
-	       "\t([hci]<index> | generic[:[hci]<index>] | unit:<fd_path>)\n"
+	       "\t([hci]<index> | generic[:[hci]<index>] | ext[:[hci]<index>] |\n"
+	       "\t unit:<fd_path>)\n"
 	       "\t\tUse generic HCI io on interface hci<index>, or the first\n"
-	       "\t\tavailable one\n");
+	       "\t\tavailable one. The ext io uses LE extended advertising\n"
+	       "\t\tsets and extended scanning\n");
 }
 
 static void do_debug(const char *str, void *user_data)
@@ -135,32 +137,40 @@ static void signal_handler(uint32_t signo, void *user_data)
 	terminated = true;
 }
 
-static bool parse_io(const char *optarg, enum mesh_io_type *type, void **opts)
+static bool parse_index(const char *optarg, void **opts)
 {
-	if (strstr(optarg, "generic") == optarg) {
-		int *index = l_new(int, 1);
+	int *index = l_new(int, 1);
 
-		*type = MESH_IO_TYPE_GENERIC;
-		*opts = index;
+	*opts = index;
 
-		optarg += strlen("generic");
-		if (!*optarg) {
-			*index = MGMT_INDEX_NONE;
-			return true;
-		}
+	if (!*optarg) {
+		*index = MGMT_INDEX_NONE;
+		return true;
+	}
 
-		if (*optarg != ':')
-			return false;
+	if (*optarg != ':')
+		return false;
 
-		optarg++;
+	optarg++;
 
-		if (sscanf(optarg, "hci%d", index) == 1)
-			return true;
+	if (sscanf(optarg, "hci%d", index) == 1)
+		return true;
 
-		if (sscanf(optarg, "%d", index) == 1)
-			return true;
+	if (sscanf(optarg, "%d", index) == 1)
+		return true;
 
-		return false;
+	return false;
+}
+
+static bool parse_io(const char *optarg, enum mesh_io_type *type, void **opts)
+{
+	if (strstr(optarg, "generic") == optarg) {
+		*type = MESH_IO_TYPE_GENERIC;
+		return parse_index(optarg + strlen("generic"), opts);
+
+	} else if (strstr(optarg, "ext") == optarg) {
+		*type = MESH_IO_TYPE_EXT;
+		return parse_index(optarg + strlen("ext"), opts);
 
 	} else if (strstr(optarg, "unit") == optarg) {
 		char *test_path;
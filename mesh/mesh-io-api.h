@@ -10,6 +10,18 @@
 
 struct mesh_io_private;
 
+/* Transmit counters kept by the backends, logged when they are destroyed */
+struct mesh_io_tx_stats {
+	uint32_t queued;
+	uint32_t sent;
+	uint32_t retransmitted;
+	uint32_t dropped;
+	uint32_t max_depth;
+	uint64_t delay_total_ms;
+	uint32_t delay_max_ms;
+};
+
+
 typedef bool (*mesh_io_init_t)(struct mesh_io *io, void *opts,
 				mesh_io_ready_func_t cb, void *user_data);
 typedef bool (*mesh_io_destroy_t)(struct mesh_io *io);
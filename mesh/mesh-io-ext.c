@@ -0,0 +1,1018 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ell/ell.h>
+
+#include "monitor/bt.h"
+#include "src/shared/hci.h"
+#include "lib/bluetooth.h"
+#include "lib/mgmt.h"
+
+#include "mesh/mesh-defs.h"
+#include "mesh/mesh-mgmt.h"
+#include "mesh/mesh-io.h"
+#include "mesh/mesh-io-api.h"
+#include "mesh/mesh-io-ext.h"
+
+/*
+ * Number of advertising sets kept loaded with outgoing PDUs. PDUs with an
+ * unlimited transmit count stay queued until cancelled, so they never hold
+ * a set for longer than one advertising event. They take turns on the last
+ * set, which is reserved for them while any is queued, or share the only
+ * set the controller has with all other PDUs.
+ */
+#define MAX_ADV_SETS	4
+
+/* Upper bound on PDUs waiting for a free advertising set */
+#define MAX_TX_PKTS	64
+
+/* Slack added to each advertising event for the controller's advDelay */
+#define ADV_DELAY_MS	10
+
+#define ADV_PROP_LEGACY_NONCONN	0x0010
+
+struct mesh_io_private;
+
+struct tx_pkt {
+	struct mesh_io_send_info	info;
+	uint32_t			queued;
+	uint32_t			deadline;
+	bool				sent;
+	uint8_t				len;
+	uint8_t				pkt[30];
+};
+
+struct adv_set {
+	struct mesh_io_private		*pvt;
+	struct tx_pkt			*tx;
+	struct l_timeout		*timeout;
+	uint8_t				handle;
+};
+
+struct mesh_io_private {
+	struct bt_hci *hci;
+	void *user_data;
+	mesh_io_ready_func_t ready_callback;
+	struct l_timeout *tx_timeout;
+	struct l_queue *rx_regs;
+	struct l_queue *tx_pkts;
+	struct l_queue *unlimited;
+	struct adv_set sets[MAX_ADV_SETS];
+	struct mesh_io_tx_stats stats;
+	uint16_t index;
+	uint8_t num_sets;
+	bool active;
+};
+
+struct pvt_rx_reg {
+	mesh_io_recv_func_t cb;
+	void *user_data;
+	uint8_t len;
+	uint8_t filter[0];
+};
+
+struct process_data {
+	struct mesh_io_private		*pvt;
+	const uint8_t			*data;
+	uint8_t				len;
+	struct mesh_io_recv_info	info;
+};
+
+struct tx_pattern {
+	const uint8_t			*data;
+	uint8_t				len;
+};
+
+static mesh_io_ext_hci_func_t hci_new = bt_hci_new_user_channel;
+
+static void schedule_tx(struct mesh_io_private *pvt);
+
+static uint32_t get_instant(void)
+{
+	struct timeval tm;
+	uint32_t instant;
+
+	gettimeofday(&tm, NULL);
+	instant = tm.tv_sec * 1000;
+	instant += tm.tv_usec / 1000;
+
+	return instant;
+}
+
+static uint32_t get_random_delay(uint8_t min_delay, uint8_t max_delay)
+{
+	uint32_t delay;
+
+	if (min_delay >= max_delay)
+		return min_delay;
+
+	l_getrandom(&delay, sizeof(delay));
+	delay %= max_delay - min_delay;
+
+	return delay + min_delay;
+}
+
+static uint32_t get_tx_deadline(const struct mesh_io_send_info *info,
+							uint32_t instant)
+{
+	switch (info->type) {
+	case MESH_IO_TIMING_TYPE_GENERAL:
+		return instant + get_random_delay(info->u.gen.min_delay,
+							info->u.gen.max_delay);
+	case MESH_IO_TIMING_TYPE_POLL:
+		return instant + get_random_delay(info->u.poll.min_delay,
+							info->u.poll.max_delay);
+	case MESH_IO_TIMING_TYPE_POLL_RSP:
+		return info->u.poll_rsp.instant + info->u.poll_rsp.delay;
+	}
+
+	return instant;
+}
+
+static int compare_tx_deadline(const void *a, const void *b, void *user_data)
+{
+	const struct tx_pkt *tx_a = a;
+	const struct tx_pkt *tx_b = b;
+	int32_t diff = (int32_t) (tx_a->deadline - tx_b->deadline);
+
+	/* Equal deadlines keep FIFO order */
+	if (diff > 0)
+		return 1;
+
+	return diff < 0 ? -1 : 0;
+}
+
+static void process_rx_callbacks(void *v_reg, void *v_rx)
+{
+	struct pvt_rx_reg *rx_reg = v_reg;
+	struct process_data *rx = v_rx;
+
+	if (!memcmp(rx->data, rx_reg->filter, rx_reg->len))
+		rx_reg->cb(rx_reg->user_data, &rx->info, rx->data, rx->len);
+}
+
+static void process_rx(struct mesh_io_private *pvt, int8_t rssi,
+					uint32_t instant, const uint8_t *addr,
+					const uint8_t *data, uint8_t len)
+{
+	struct process_data rx = {
+		.pvt = pvt,
+		.data = data,
+		.len = len,
+		.info.instant = instant,
+		.info.addr = addr,
+		.info.chan = 7,
+		.info.rssi = rssi,
+	};
+
+	l_queue_foreach(pvt->rx_regs, process_rx_callbacks, &rx);
+}
+
+static void process_ext_report(struct mesh_io *io,
+				const struct bt_hci_le_ext_adv_report *report,
+				uint32_t instant)
+{
+	const uint8_t *adv = report->data;
+	uint8_t adv_len = report->data_len;
+	uint16_t len = 0;
+
+	/* Only complete, non-connectable and non-scannable PDUs carry Mesh */
+	if (L_LE16_TO_CPU(report->event_type) & 0x006f)
+		return;
+
+	while (len < adv_len - 1) {
+		uint8_t field_len = adv[0];
+
+		/* Check for the end of advertising data */
+		if (field_len == 0)
+			break;
+
+		len += field_len + 1;
+
+		/* Do not continue data parsing if got incorrect length */
+		if (len > adv_len)
+			break;
+
+		process_rx(io->pvt, report->rssi, instant, report->addr,
+							adv + 1, adv[0]);
+
+		adv += field_len + 1;
+	}
+}
+
+static void event_ext_adv_report(struct mesh_io *io, const void *buf,
+								uint8_t size)
+{
+	const struct bt_hci_evt_le_ext_adv_report *evt = buf;
+	const struct bt_hci_le_ext_adv_report *report;
+	uint32_t instant;
+	uint8_t i;
+
+	if (size < sizeof(*evt))
+		return;
+
+	instant = get_instant();
+	buf += sizeof(*evt);
+	size -= sizeof(*evt);
+
+	for (i = 0; i < evt->num_reports; i++) {
+		report = buf;
+
+		if (size < sizeof(*report) ||
+				size < sizeof(*report) + report->data_len)
+			return;
+
+		process_ext_report(io, report, instant);
+
+		buf += sizeof(*report) + report->data_len;
+		size -= sizeof(*report) + report->data_len;
+	}
+}
+
+static bool is_unlimited(const struct tx_pkt *tx)
+{
+	return tx->info.type == MESH_IO_TIMING_TYPE_GENERAL &&
+			tx->info.u.gen.cnt == MESH_IO_TX_COUNT_UNLIMITED;
+}
+
+static void set_done(struct adv_set *set)
+{
+	struct mesh_io_private *pvt = set->pvt;
+
+	l_timeout_remove(set->timeout);
+	set->timeout = NULL;
+
+	/* Next turn of an unlimited PDU is due one interval after this one */
+	if (is_unlimited(set->tx))
+		l_queue_insert(pvt->unlimited, set->tx, compare_tx_deadline,
+									NULL);
+	else
+		l_free(set->tx);
+
+	set->tx = NULL;
+
+	schedule_tx(pvt);
+}
+
+static void event_adv_set_term(struct mesh_io *io, const void *buf,
+								uint8_t size)
+{
+	const struct bt_hci_evt_le_adv_set_term *evt = buf;
+	struct mesh_io_private *pvt = io->pvt;
+
+	if (size < sizeof(*evt) || evt->handle >= pvt->num_sets)
+		return;
+
+	if (pvt->sets[evt->handle].tx)
+		set_done(&pvt->sets[evt->handle]);
+}
+
+static void event_callback(const void *buf, uint8_t size, void *user_data)
+{
+	uint8_t event = l_get_u8(buf);
+	struct mesh_io *io = user_data;
+
+	switch (event) {
+	case BT_HCI_EVT_LE_EXT_ADV_REPORT:
+		event_ext_adv_report(io, buf + 1, size - 1);
+		break;
+
+	case BT_HCI_EVT_LE_ADV_SET_TERM:
+		event_adv_set_term(io, buf + 1, size - 1);
+		break;
+
+	default:
+		l_debug("Other Meta Evt - %d", event);
+	}
+}
+
+static void hci_generic_callback(const void *data, uint8_t size,
+								void *user_data)
+{
+	uint8_t status = l_get_u8(data);
+
+	if (status)
+		l_error("Failed to initialize HCI");
+}
+
+static void num_adv_sets_callback(const void *data, uint8_t size,
+							void *user_data)
+{
+	const struct bt_hci_rsp_le_read_num_supported_adv_sets *rsp = data;
+	struct mesh_io *io = user_data;
+	struct mesh_io_private *pvt = io->pvt;
+	bool result = true;
+
+	if (rsp->status || !rsp->num_of_sets) {
+		l_error("Extended advertising not supported (hci %u)",
+								pvt->index);
+		result = false;
+	} else {
+		pvt->num_sets = rsp->num_of_sets;
+		if (pvt->num_sets > MAX_ADV_SETS)
+			pvt->num_sets = MAX_ADV_SETS;
+
+		l_debug("Using %u advertising sets", pvt->num_sets);
+	}
+
+	if (pvt->ready_callback)
+		pvt->ready_callback(pvt->user_data, result);
+}
+
+static void configure_hci(struct mesh_io *io)
+{
+	struct mesh_io_private *pvt = io->pvt;
+	struct bt_hci_cmd_set_event_mask cmd_sem;
+	struct bt_hci_cmd_le_set_event_mask cmd_slem;
+
+	/* Set event mask
+	 *
+	 * Mask: 0x2000800002008890
+	 *   Disconnection Complete
+	 *   Encryption Change
+	 *   Read Remote Version Information Complete
+	 *   Hardware Error
+	 *   Data Buffer Overflow
+	 *   Encryption Key Refresh Complete
+	 *   LE Meta
+	 */
+	cmd_sem.mask[0] = 0x90;
+	cmd_sem.mask[1] = 0x88;
+	cmd_sem.mask[2] = 0x00;
+	cmd_sem.mask[3] = 0x02;
+	cmd_sem.mask[4] = 0x00;
+	cmd_sem.mask[5] = 0x80;
+	cmd_sem.mask[6] = 0x00;
+	cmd_sem.mask[7] = 0x20;
+
+	/* Set LE event mask
+	 *
+	 * Mask: 0x000000000002187f
+	 *   LE Connection Complete
+	 *   LE Advertising Report
+	 *   LE Connection Update Complete
+	 *   LE Read Remote Used Features Complete
+	 *   LE Long Term Key Request
+	 *   LE Remote Connection Parameter Request
+	 *   LE Data Length Change
+	 *   LE PHY Update Complete
+	 *   LE Extended Advertising Report
+	 *   LE Advertising Set Terminated
+	 */
+	cmd_slem.mask[0] = 0x7f;
+	cmd_slem.mask[1] = 0x18;
+	cmd_slem.mask[2] = 0x02;
+	cmd_slem.mask[3] = 0x00;
+	cmd_slem.mask[4] = 0x00;
+	cmd_slem.mask[5] = 0x00;
+	cmd_slem.mask[6] = 0x00;
+	cmd_slem.mask[7] = 0x00;
+
+	/* Reset Command */
+	bt_hci_send(pvt->hci, BT_HCI_CMD_RESET, NULL, 0, hci_generic_callback,
+								NULL, NULL);
+
+	/* Set event mask */
+	bt_hci_send(pvt->hci, BT_HCI_CMD_SET_EVENT_MASK, &cmd_sem,
+			sizeof(cmd_sem), hci_generic_callback, NULL, NULL);
+
+	/* Set LE event mask */
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EVENT_MASK, &cmd_slem,
+			sizeof(cmd_slem), hci_generic_callback, NULL, NULL);
+
+	/* Read number of supported advertising sets */
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_READ_NUM_SUPPORTED_ADV_SETS,
+				NULL, 0, num_adv_sets_callback, io, NULL);
+}
+
+static void scan_enable_rsp(const void *buf, uint8_t size,
+							void *user_data)
+{
+	uint8_t status = *((uint8_t *) buf);
+
+	if (status)
+		l_error("LE Scan enable failed (0x%02x)", status);
+}
+
+static void set_recv_scan_enable(const void *buf, uint8_t size,
+							void *user_data)
+{
+	struct mesh_io_private *pvt = user_data;
+	struct bt_hci_cmd_le_set_ext_scan_enable cmd;
+
+	cmd.enable = 0x01;	/* Enable scanning */
+	cmd.filter_dup = 0x00;	/* Report duplicates */
+	cmd.duration = 0;	/* Scan continuously */
+	cmd.period = 0;
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_SCAN_ENABLE,
+			&cmd, sizeof(cmd), scan_enable_rsp, pvt, NULL);
+}
+
+static void scan_disable_rsp(const void *buf, uint8_t size,
+							void *user_data)
+{
+	struct mesh_io_private *pvt = user_data;
+	uint8_t status = *((uint8_t *) buf);
+	struct {
+		struct bt_hci_cmd_le_set_ext_scan_params params;
+		struct bt_hci_le_scan_phy phy;
+	} __attribute__ ((packed)) cmd;
+
+	if (status)
+		l_error("LE Scan disable failed (0x%02x)", status);
+
+	cmd.params.own_addr_type = 0x01;	/* ADDR_TYPE_RANDOM */
+	cmd.params.filter_policy = 0x00;	/* Accept all */
+	cmd.params.num_phys = 0x01;		/* LE 1M */
+	cmd.phy.type = pvt->active ? 0x01 : 0x00; /* Passive/Active */
+	cmd.phy.interval = L_CPU_TO_LE16(0x0010);	/* 10 ms */
+	cmd.phy.window = L_CPU_TO_LE16(0x0010);		/* 10 ms */
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_SCAN_PARAMS,
+			&cmd, sizeof(cmd),
+			set_recv_scan_enable, pvt, NULL);
+}
+
+static void scan_disable(struct mesh_io_private *pvt,
+					bt_hci_callback_func_t callback)
+{
+	struct bt_hci_cmd_le_set_ext_scan_enable cmd;
+
+	memset(&cmd, 0, sizeof(cmd));	/* Disable scanning */
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_SCAN_ENABLE,
+				&cmd, sizeof(cmd), callback, pvt, NULL);
+}
+
+static bool find_by_ad_type(const void *a, const void *b)
+{
+	const struct tx_pkt *tx = a;
+	uint8_t ad_type = L_PTR_TO_UINT(b);
+
+	return !ad_type || ad_type == tx->pkt[0];
+}
+
+static bool find_by_pattern(const void *a, const void *b)
+{
+	const struct tx_pkt *tx = a;
+	const struct tx_pattern *pattern = b;
+
+	if (tx->len < pattern->len)
+		return false;
+
+	return (!memcmp(tx->pkt, pattern->data, pattern->len));
+}
+
+static bool find_active(const void *a, const void *b)
+{
+	const struct pvt_rx_reg *rx_reg = a;
+
+	/* Mesh specific AD types do *not* require active scanning,
+	 * so do not turn on Active Scanning on their account.
+	 */
+	if (rx_reg->filter[0] < MESH_AD_TYPE_PROVISION ||
+			rx_reg->filter[0] > MESH_AD_TYPE_BEACON)
+		return true;
+
+	return false;
+}
+
+static void restart_scan(struct mesh_io_private *pvt)
+{
+	if (l_queue_isempty(pvt->rx_regs))
+		return;
+
+	pvt->active = l_queue_find(pvt->rx_regs, find_active, NULL);
+	scan_disable(pvt, scan_disable_rsp);
+}
+
+static void hci_init(void *user_data)
+{
+	struct mesh_io *io = user_data;
+	bool restarted = false;
+
+	if (io->pvt->hci) {
+		restarted = true;
+		bt_hci_unref(io->pvt->hci);
+	}
+
+	io->pvt->hci = hci_new(io->pvt->index);
+	if (!io->pvt->hci) {
+		l_error("Failed to start mesh io (hci %u): %s", io->pvt->index,
+							strerror(errno));
+		if (io->pvt->ready_callback)
+			io->pvt->ready_callback(io->pvt->user_data, false);
+
+		return;
+	}
+
+	configure_hci(io);
+
+	bt_hci_register(io->pvt->hci, BT_HCI_EVT_LE_META_EVENT,
+						event_callback, io, NULL);
+
+	l_debug("Started mesh on hci %u", io->pvt->index);
+
+	if (restarted)
+		restart_scan(io->pvt);
+}
+
+static void read_info(int index, void *user_data)
+{
+	struct mesh_io *io = user_data;
+
+	if (io->pvt->index != MGMT_INDEX_NONE &&
+					index != io->pvt->index) {
+		l_debug("Ignore index %d", index);
+		return;
+	}
+
+	io->pvt->index = index;
+	hci_init(io);
+}
+
+static bool dev_init(struct mesh_io *io, void *opts,
+				mesh_io_ready_func_t cb, void *user_data)
+{
+	uint8_t i;
+
+	if (!io || io->pvt)
+		return false;
+
+	io->pvt = l_new(struct mesh_io_private, 1);
+	io->pvt->index = *(int *)opts;
+
+	io->pvt->rx_regs = l_queue_new();
+	io->pvt->tx_pkts = l_queue_new();
+	io->pvt->unlimited = l_queue_new();
+
+	for (i = 0; i < MAX_ADV_SETS; i++) {
+		io->pvt->sets[i].pvt = io->pvt;
+		io->pvt->sets[i].handle = i;
+	}
+
+	io->pvt->ready_callback = cb;
+	io->pvt->user_data = user_data;
+
+	if (io->pvt->index == MGMT_INDEX_NONE)
+		return mesh_mgmt_list(read_info, io);
+
+	l_idle_oneshot(hci_init, io, NULL);
+
+	return true;
+}
+
+static bool dev_destroy(struct mesh_io *io)
+{
+	struct mesh_io_private *pvt = io->pvt;
+	uint8_t i;
+
+	if (!pvt)
+		return true;
+
+	l_debug("TX: queued %u sent %u retx %u dropped %u depth %u "
+			"delay avg %u max %u ms",
+			pvt->stats.queued, pvt->stats.sent,
+			pvt->stats.retransmitted, pvt->stats.dropped,
+			pvt->stats.max_depth,
+			pvt->stats.sent ? (unsigned int) (pvt->stats.delay_total_ms /
+							pvt->stats.sent) : 0,
+			pvt->stats.delay_max_ms);
+
+	for (i = 0; i < MAX_ADV_SETS; i++) {
+		l_timeout_remove(pvt->sets[i].timeout);
+		l_free(pvt->sets[i].tx);
+	}
+
+	bt_hci_unref(pvt->hci);
+	l_timeout_remove(pvt->tx_timeout);
+	l_queue_destroy(pvt->rx_regs, l_free);
+	l_queue_destroy(pvt->tx_pkts, l_free);
+	l_queue_destroy(pvt->unlimited, l_free);
+	l_free(pvt);
+	io->pvt = NULL;
+
+	return true;
+}
+
+static bool dev_caps(struct mesh_io *io, struct mesh_io_caps *caps)
+{
+	struct mesh_io_private *pvt = io->pvt;
+
+	if (!pvt || !caps)
+		return false;
+
+	caps->max_num_filters = 255;
+	caps->window_accuracy = 50;
+
+	return true;
+}
+
+static void set_disable(struct adv_set *set)
+{
+	struct {
+		struct bt_hci_cmd_le_set_ext_adv_enable enable;
+		struct bt_hci_cmd_ext_adv_set set;
+	} __attribute__ ((packed)) cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.enable.enable = 0x00;	/* Disable advertising */
+	cmd.enable.num_of_sets = 1;
+	cmd.set.handle = set->handle;
+
+	bt_hci_send(set->pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE,
+				&cmd, sizeof(cmd), NULL, NULL, NULL);
+}
+
+static void set_timeout(struct l_timeout *timeout, void *user_data)
+{
+	struct adv_set *set = user_data;
+
+	/* Controller did not report termination, stop the set ourselves */
+	set_disable(set);
+	set_done(set);
+}
+
+static void set_enable_rsp(const void *buf, uint8_t size, void *user_data)
+{
+	uint8_t status = l_get_u8(buf);
+
+	if (status)
+		l_error("LE Ext Adv enable failed (0x%02x)", status);
+}
+
+static void set_start(struct adv_set *set, struct tx_pkt *tx)
+{
+	struct mesh_io_private *pvt = set->pvt;
+	struct bt_hci_cmd_le_set_ext_adv_params params;
+	struct bt_hci_cmd_le_set_adv_set_rand_addr addr;
+	struct {
+		struct bt_hci_cmd_le_set_ext_adv_data hdr;
+		uint8_t data[31];
+	} __attribute__ ((packed)) data;
+	struct {
+		struct bt_hci_cmd_le_set_ext_adv_enable enable;
+		struct bt_hci_cmd_ext_adv_set set;
+	} __attribute__ ((packed)) enable;
+	uint32_t hci_interval;
+	uint32_t instant;
+	uint32_t delay;
+	uint16_t interval;
+	uint8_t count;
+
+	if (tx->info.type == MESH_IO_TIMING_TYPE_GENERAL) {
+		interval = tx->info.u.gen.interval;
+		count = tx->info.u.gen.cnt;
+	} else {
+		interval = 25;
+		count = 1;
+	}
+
+	/* Unlimited PDUs get a single advertising event per turn */
+	if (count == MESH_IO_TX_COUNT_UNLIMITED)
+		count = 1;
+
+	set->tx = tx;
+
+	instant = get_instant();
+	tx->deadline = instant + interval;
+
+	if (!tx->sent) {
+		tx->sent = true;
+
+		delay = instant - tx->queued;
+		pvt->stats.sent++;
+		pvt->stats.delay_total_ms += delay;
+		if (delay > pvt->stats.delay_max_ms)
+			pvt->stats.delay_max_ms = delay;
+	} else
+		pvt->stats.retransmitted++;
+
+	if (count > 1)
+		pvt->stats.retransmitted += count - 1;
+
+	memset(&params, 0, sizeof(params));
+	hci_interval = (interval * 16) / 10;
+	params.handle = set->handle;
+	params.evt_properties = L_CPU_TO_LE16(ADV_PROP_LEGACY_NONCONN);
+	params.min_interval[0] = hci_interval & 0xff;
+	params.min_interval[1] = (hci_interval >> 8) & 0xff;
+	params.min_interval[2] = (hci_interval >> 16) & 0xff;
+	memcpy(params.max_interval, params.min_interval, 3);
+	params.channel_map = 0x07;
+	params.own_addr_type = 0x01;	/* ADDR_TYPE_RANDOM */
+	params.filter_policy = 0x00;
+	params.tx_power = 0x7f;		/* No preference */
+	params.primary_phy = 0x01;	/* LE 1M */
+	params.secondary_phy = 0x01;	/* LE 1M */
+	params.sid = set->handle;
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_PARAMS,
+				&params, sizeof(params), NULL, NULL, NULL);
+
+	/* Each burst of ADVs goes out from a fresh random address */
+	addr.handle = set->handle;
+	l_getrandom(addr.bdaddr, 6);
+	addr.bdaddr[5] |= 0xc0;
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_ADV_SET_RAND_ADDR,
+				&addr, sizeof(addr), NULL, NULL, NULL);
+
+	memset(&data, 0, sizeof(data));
+	data.hdr.handle = set->handle;
+	data.hdr.operation = 0x03;		/* Complete data */
+	data.hdr.fragment_preference = 0x01;	/* No fragmentation */
+	data.hdr.data_len = tx->len + 1;
+	data.data[0] = tx->len;
+	memcpy(data.data + 1, tx->pkt, tx->len);
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_DATA,
+				&data, sizeof(data.hdr) + data.hdr.data_len,
+				NULL, NULL, NULL);
+
+	/* Controller performs the retransmissions on its own */
+	memset(&enable, 0, sizeof(enable));
+	enable.enable.enable = 0x01;
+	enable.enable.num_of_sets = 1;
+	enable.set.handle = set->handle;
+	enable.set.duration = 0;
+	enable.set.max_events = count;
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE,
+				&enable, sizeof(enable),
+				set_enable_rsp, NULL, NULL);
+
+	set->timeout = l_timeout_create_ms(count * (interval + ADV_DELAY_MS),
+						set_timeout, set, NULL);
+}
+
+/* Pick the queue whose head may be loaded into the given set */
+static struct l_queue *set_queue(struct mesh_io_private *pvt,
+							struct adv_set *set)
+{
+	struct tx_pkt *tx, *unlimited;
+
+	/* Reserved set is lent out while no unlimited PDU waits for it */
+	if (pvt->num_sets > 1) {
+		if (set->handle == pvt->num_sets - 1 &&
+					!l_queue_isempty(pvt->unlimited))
+			return pvt->unlimited;
+
+		return pvt->tx_pkts;
+	}
+
+	/* Single set rotates through both queues by deadline */
+	tx = l_queue_peek_head(pvt->tx_pkts);
+	unlimited = l_queue_peek_head(pvt->unlimited);
+
+	if (!tx || (unlimited &&
+			(int32_t) (unlimited->deadline - tx->deadline) < 0))
+		return pvt->unlimited;
+
+	return pvt->tx_pkts;
+}
+
+static void tx_to(struct l_timeout *timeout, void *user_data)
+{
+	struct mesh_io_private *pvt = user_data;
+
+	l_timeout_remove(pvt->tx_timeout);
+	pvt->tx_timeout = NULL;
+
+	schedule_tx(pvt);
+}
+
+static void schedule_tx(struct mesh_io_private *pvt)
+{
+	struct l_queue *queue;
+	struct tx_pkt *tx;
+	int32_t remaining, wait = 0;
+	uint8_t i;
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		if (pvt->sets[i].tx)
+			continue;
+
+		queue = set_queue(pvt, &pvt->sets[i]);
+
+		tx = l_queue_peek_head(queue);
+		if (!tx)
+			continue;
+
+		remaining = (int32_t) (tx->deadline - get_instant());
+		if (remaining > 0) {
+			if (!wait || remaining < wait)
+				wait = remaining;
+
+			continue;
+		}
+
+		l_queue_pop_head(queue);
+		set_start(&pvt->sets[i], tx);
+	}
+
+	if (!wait)
+		return;
+
+	if (pvt->tx_timeout)
+		l_timeout_modify_ms(pvt->tx_timeout, wait);
+	else
+		pvt->tx_timeout = l_timeout_create_ms(wait, tx_to, pvt, NULL);
+}
+
+static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
+					const uint8_t *data, uint16_t len)
+{
+	struct mesh_io_private *pvt = io->pvt;
+	struct tx_pkt *tx;
+	uint32_t instant;
+
+	if (!info || !data || !len || len > sizeof(tx->pkt))
+		return false;
+
+	if (l_queue_length(pvt->tx_pkts) +
+			l_queue_length(pvt->unlimited) >= MAX_TX_PKTS) {
+		pvt->stats.dropped++;
+		return false;
+	}
+
+	instant = get_instant();
+	tx = l_new(struct tx_pkt, 1);
+
+	memcpy(&tx->info, info, sizeof(tx->info));
+	memcpy(&tx->pkt, data, len);
+	tx->len = len;
+	tx->queued = instant;
+	tx->deadline = get_tx_deadline(info, instant);
+
+	l_queue_insert(is_unlimited(tx) ? pvt->unlimited : pvt->tx_pkts, tx,
+						compare_tx_deadline, NULL);
+	pvt->stats.queued++;
+
+	if (l_queue_length(pvt->tx_pkts) > pvt->stats.max_depth)
+		pvt->stats.max_depth = l_queue_length(pvt->tx_pkts);
+
+	schedule_tx(pvt);
+
+	return true;
+}
+
+static void cancel_queued(struct l_queue *queue, const uint8_t *data,
+					const struct tx_pattern *pattern)
+{
+	struct tx_pkt *tx;
+
+	do {
+		if (pattern->len == 1)
+			tx = l_queue_remove_if(queue, find_by_ad_type,
+							L_UINT_TO_PTR(data[0]));
+		else
+			tx = l_queue_remove_if(queue, find_by_pattern,
+								pattern);
+		l_free(tx);
+	} while (tx);
+}
+
+static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
+{
+	struct mesh_io_private *pvt = io->pvt;
+	struct tx_pattern pattern = {
+		.data = data,
+		.len = len
+	};
+	uint8_t i;
+
+	if (!data)
+		return false;
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		struct adv_set *set = &pvt->sets[i];
+
+		if (!set->tx)
+			continue;
+
+		if (len == 1 && !find_by_ad_type(set->tx,
+						L_UINT_TO_PTR(data[0])))
+			continue;
+
+		if (len != 1 && !find_by_pattern(set->tx, &pattern))
+			continue;
+
+		set_disable(set);
+		l_timeout_remove(set->timeout);
+		set->timeout = NULL;
+		l_free(set->tx);
+		set->tx = NULL;
+	}
+
+	cancel_queued(pvt->tx_pkts, data, &pattern);
+	cancel_queued(pvt->unlimited, data, &pattern);
+
+	if (l_queue_isempty(pvt->tx_pkts) && l_queue_isempty(pvt->unlimited)) {
+		l_timeout_remove(pvt->tx_timeout);
+		pvt->tx_timeout = NULL;
+	}
+
+	schedule_tx(pvt);
+
+	return true;
+}
+
+static bool find_by_filter(const void *a, const void *b)
+{
+	const struct pvt_rx_reg *rx_reg = a;
+	const uint8_t *filter = b;
+
+	return !memcmp(rx_reg->filter, filter, rx_reg->len);
+}
+
+static bool recv_register(struct mesh_io *io, const uint8_t *filter,
+			uint8_t len, mesh_io_recv_func_t cb, void *user_data)
+{
+	struct mesh_io_private *pvt = io->pvt;
+	struct pvt_rx_reg *rx_reg;
+	bool already_scanning;
+	bool active = false;
+
+	if (!cb || !filter || !len)
+		return false;
+
+	rx_reg = l_queue_remove_if(pvt->rx_regs, find_by_filter, filter);
+
+	l_free(rx_reg);
+	rx_reg = l_malloc(sizeof(*rx_reg) + len);
+
+	memcpy(rx_reg->filter, filter, len);
+	rx_reg->len = len;
+	rx_reg->cb = cb;
+	rx_reg->user_data = user_data;
+
+	already_scanning = !l_queue_isempty(pvt->rx_regs);
+
+	l_queue_push_head(pvt->rx_regs, rx_reg);
+
+	/* Look for any AD types requiring Active Scanning */
+	if (l_queue_find(pvt->rx_regs, find_active, NULL))
+		active = true;
+
+	if (!already_scanning || pvt->active != active) {
+		pvt->active = active;
+		scan_disable(pvt, scan_disable_rsp);
+	}
+
+	return true;
+}
+
+static bool recv_deregister(struct mesh_io *io, const uint8_t *filter,
+								uint8_t len)
+{
+	struct mesh_io_private *pvt = io->pvt;
+	struct pvt_rx_reg *rx_reg;
+	bool active = false;
+
+	rx_reg = l_queue_remove_if(pvt->rx_regs, find_by_filter, filter);
+
+	if (rx_reg)
+		l_free(rx_reg);
+
+	/* Look for any AD types requiring Active Scanning */
+	if (l_queue_find(pvt->rx_regs, find_active, NULL))
+		active = true;
+
+	if (l_queue_isempty(pvt->rx_regs)) {
+		scan_disable(pvt, NULL);
+	} else if (active != pvt->active) {
+		pvt->active = active;
+		scan_disable(pvt, scan_disable_rsp);
+	}
+
+	return true;
+}
+
+void mesh_io_ext_set_hci_func(mesh_io_ext_hci_func_t func)
+{
+	hci_new = func ? func : bt_hci_new_user_channel;
+}
+
+const struct mesh_io_api mesh_io_ext = {
+	.init = dev_init,
+	.destroy = dev_destroy,
+	.caps = dev_caps,
+	.send = send_tx,
+	.reg = recv_register,
+	.dereg = recv_deregister,
+	.cancel = tx_cancel,
+};
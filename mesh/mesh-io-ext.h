@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+struct bt_hci;
+
+typedef struct bt_hci *(*mesh_io_ext_hci_func_t)(uint16_t index);
+
+extern const struct mesh_io_api mesh_io_ext;
+
+/* Replaces the HCI user channel, e.g. with an emulated controller */
+void mesh_io_ext_set_hci_func(mesh_io_ext_hci_func_t func);
@@ -28,6 +28,29 @@
 #include "mesh/mesh-io-api.h"
 #include "mesh/mesh-io-generic.h"
 
+/* Upper bound on PDUs waiting for the advertiser */
+#define MAX_TX_PKTS	64
+
+/*
+ * Transmit priority classes. A lower class is scheduled ahead of a higher
+ * one by biasing its deadline, so beacons yield to relays and segment acks
+ * without being starved by them.
+ */
+enum tx_class {
+	TX_CLASS_FRIEND,
+	TX_CLASS_NETWORK,
+	TX_CLASS_PROV,
+	TX_CLASS_BEACON,
+	TX_CLASS_MAX
+};
+
+static const uint32_t class_bias_ms[TX_CLASS_MAX] = {
+	[TX_CLASS_FRIEND] = 0,
+	[TX_CLASS_NETWORK] = 0,
+	[TX_CLASS_PROV] = 20,
+	[TX_CLASS_BEACON] = 100,
+};
+
 struct mesh_io_private {
 	struct bt_hci *hci;
 	void *user_data;
@@ -36,6 +59,7 @@ struct mesh_io_private {
 	struct l_queue *rx_regs;
 	struct l_queue *tx_pkts;
 	struct tx_pkt *tx;
+	struct mesh_io_tx_stats stats;
 	uint16_t index;
 	uint16_t interval;
 	bool sending;
@@ -58,7 +82,11 @@ struct process_data {
 
 struct tx_pkt {
 	struct mesh_io_send_info	info;
+	uint32_t			queued;
+	uint32_t			deadline;
+	enum tx_class			class;
 	bool				delete;
+	bool				sent;
 	uint8_t				len;
 	uint8_t				pkt[30];
 };
@@ -86,6 +114,37 @@ static uint32_t instant_remaining_ms(uint32_t instant)
 	return instant;
 }
 
+static enum tx_class get_tx_class(const struct tx_pkt *tx)
+{
+	if (tx->info.type != MESH_IO_TIMING_TYPE_GENERAL)
+		return TX_CLASS_FRIEND;
+
+	switch (tx->pkt[0]) {
+	case MESH_AD_TYPE_NETWORK:
+		return TX_CLASS_NETWORK;
+	case MESH_AD_TYPE_PROVISION:
+		return TX_CLASS_PROV;
+	default:
+		return TX_CLASS_BEACON;
+	}
+}
+
+static int compare_tx_deadline(const void *a, const void *b, void *user_data)
+{
+	const struct tx_pkt *tx_a = a;
+	const struct tx_pkt *tx_b = b;
+	int32_t diff;
+
+	diff = (int32_t) ((tx_a->deadline + class_bias_ms[tx_a->class]) -
+				(tx_b->deadline + class_bias_ms[tx_b->class]));
+
+	/* Equal deadlines keep FIFO order */
+	if (diff > 0)
+		return 1;
+
+	return diff < 0 ? -1 : 0;
+}
+
 static void process_rx_callbacks(void *v_reg, void *v_rx)
 {
 	struct pvt_rx_reg *rx_reg = v_reg;
@@ -459,6 +518,15 @@ static bool dev_destroy(struct mesh_io *io)
 	if (!pvt)
 		return true;
 
+	l_debug("TX: queued %u sent %u retx %u dropped %u depth %u "
+			"delay avg %u max %u ms",
+			pvt->stats.queued, pvt->stats.sent,
+			pvt->stats.retransmitted, pvt->stats.dropped,
+			pvt->stats.max_depth,
+			pvt->stats.sent ? (unsigned int) (pvt->stats.delay_total_ms /
+							pvt->stats.sent) : 0,
+			pvt->stats.delay_max_ms);
+
 	bt_hci_unref(pvt->hci);
 	l_timeout_remove(pvt->tx_timeout);
 	l_queue_destroy(pvt->rx_regs, l_free);
@@ -647,6 +715,18 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 
 	tx->delete = !!(count == 1);
 
+	if (!tx->sent) {
+		uint32_t delay = get_instant() - tx->queued;
+
+		tx->sent = true;
+		pvt->stats.sent++;
+		pvt->stats.delay_total_ms += delay;
+
+		if (delay > pvt->stats.delay_max_ms)
+			pvt->stats.delay_max_ms = delay;
+	} else
+		pvt->stats.retransmitted++;
+
 	send_pkt(pvt, tx, ms);
 
 	if (count == 1) {
@@ -657,8 +737,11 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 			ms = instant_remaining_ms(tx->info.u.poll_rsp.instant +
 						tx->info.u.poll_rsp.delay);
 		}
-	} else
-		l_queue_push_tail(pvt->tx_pkts, tx);
+	} else {
+		/* Next repetition is due one interval from now */
+		tx->deadline = get_instant() + ms;
+		l_queue_insert(pvt->tx_pkts, tx, compare_tx_deadline, NULL);
+	}
 
 	if (timeout) {
 		pvt->tx_timeout = timeout;
@@ -720,21 +803,99 @@ static void tx_worker(void *user_data)
 		pvt->tx_timeout = l_timeout_create_ms(delay, tx_to, pvt, NULL);
 }
 
+static uint32_t get_tx_deadline(const struct mesh_io_send_info *info,
+							uint32_t instant)
+{
+	switch (info->type) {
+	case MESH_IO_TIMING_TYPE_GENERAL:
+		return instant + info->u.gen.max_delay;
+	case MESH_IO_TIMING_TYPE_POLL:
+		return instant + info->u.poll.max_delay;
+	case MESH_IO_TIMING_TYPE_POLL_RSP:
+		return info->u.poll_rsp.instant + info->u.poll_rsp.delay;
+	}
+
+	return instant;
+}
+
+static bool tx_less_urgent(const struct tx_pkt *a, const struct tx_pkt *b)
+{
+	if (a->class != b->class)
+		return a->class > b->class;
+
+	return compare_tx_deadline(a, b, NULL) > 0;
+}
+
+struct victim_data {
+	const struct tx_pkt *skip;
+	struct tx_pkt *victim;
+};
+
+static void find_victim(void *data, void *user_data)
+{
+	struct tx_pkt *tx = data;
+	struct victim_data *vd = user_data;
+
+	if (tx == vd->skip)
+		return;
+
+	if (!vd->victim || tx_less_urgent(tx, vd->victim))
+		vd->victim = tx;
+}
+
+static bool make_room(struct mesh_io_private *pvt, struct tx_pkt *tx)
+{
+	struct victim_data vd = { .skip = pvt->tx };
+
+	if (l_queue_length(pvt->tx_pkts) < MAX_TX_PKTS)
+		return true;
+
+	/*
+	 * Poll responses are pushed ahead of the deadline order, so the tail
+	 * is not necessarily the least urgent packet. Pick the victim from
+	 * the lowest class with the latest deadline, sparing the packet on
+	 * air, and drop the new packet instead if it ranks lower still.
+	 */
+	l_queue_foreach(pvt->tx_pkts, find_victim, &vd);
+
+	pvt->stats.dropped++;
+
+	if (!vd.victim || !tx_less_urgent(vd.victim, tx))
+		return false;
+
+	l_queue_remove(pvt->tx_pkts, vd.victim);
+	l_free(vd.victim);
+
+	return true;
+}
+
 static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 					const uint8_t *data, uint16_t len)
 {
 	struct mesh_io_private *pvt = io->pvt;
 	struct tx_pkt *tx;
+	uint32_t instant;
 	bool sending = false;
 
 	if (!info || !data || !len || len > sizeof(tx->pkt))
 		return false;
 
+	instant = get_instant();
 	tx = l_new(struct tx_pkt, 1);
 
 	memcpy(&tx->info, info, sizeof(tx->info));
 	memcpy(&tx->pkt, data, len);
 	tx->len = len;
+	tx->class = get_tx_class(tx);
+	tx->queued = instant;
+	tx->deadline = get_tx_deadline(info, instant);
+
+	if (!make_room(pvt, tx)) {
+		l_free(tx);
+		return false;
+	}
+
+	pvt->stats.queued++;
 
 	if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
 		l_queue_push_head(pvt->tx_pkts, tx);
@@ -744,7 +905,7 @@ static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 		else
 			sending = !l_queue_isempty(pvt->tx_pkts);
 
-		l_queue_push_tail(pvt->tx_pkts, tx);
+		l_queue_insert(pvt->tx_pkts, tx, compare_tx_deadline, NULL);
 
 		/*
 		 * If transmitter is idle, send packets at least twice to
@@ -755,6 +916,9 @@ static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 			tx->info.u.gen.cnt++;
 	}
 
+	if (l_queue_length(pvt->tx_pkts) > pvt->stats.max_depth)
+		pvt->stats.max_depth = l_queue_length(pvt->tx_pkts);
+
 	if (!sending) {
 		l_timeout_remove(pvt->tx_timeout);
 		pvt->tx_timeout = NULL;
@@ -22,11 +22,13 @@
 
 /* List of Mesh-IO Type headers */
 #include "mesh/mesh-io-generic.h"
+#include "mesh/mesh-io-ext.h"
 #include "mesh/mesh-io-unit.h"
 
 /* List of Supported Mesh-IO Types */
 static const struct mesh_io_table table[] = {
 	{MESH_IO_TYPE_GENERIC, &mesh_io_generic},
+	{MESH_IO_TYPE_EXT, &mesh_io_ext},
 	{MESH_IO_TYPE_UNIT_TEST, &mesh_io_unit},
 };
 
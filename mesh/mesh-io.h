@@ -15,7 +15,8 @@ struct mesh_io;
 enum mesh_io_type {
 	MESH_IO_TYPE_NONE = 0,
 	MESH_IO_TYPE_GENERIC,
-	MESH_IO_TYPE_UNIT_TEST
+	MESH_IO_TYPE_UNIT_TEST,
+	MESH_IO_TYPE_EXT
 };
 
 enum mesh_io_timing_type {
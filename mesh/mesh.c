@@ -19,6 +19,8 @@
 #include "mesh/node.h"
 #include "mesh/net.h"
 #include "mesh/net-keys.h"
+#include "mesh/crypto.h"
+#include "mesh/crypto-pool.h"
 #include "mesh/provision.h"
 #include "mesh/model.h"
 #include "mesh/dbus.h"
@@ -58,6 +60,7 @@ struct bt_mesh {
 	uint16_t req_index;
 	uint8_t friend_queue_sz;
 	uint8_t max_filters;
+	uint8_t crypto_workers;
 	bool initialized;
 };
 
@@ -245,6 +248,10 @@ static void parse_settings(const char *mesh_conf_fname)
 	if (l_settings_get_uint(settings, "General", "ProvTimeout", &value))
 		mesh.prov_timeout = value;
 
+	if (l_settings_get_uint(settings, "General", "CryptoWorkers", &value)
+					&& value <= CRYPTO_POOL_MAX_WORKERS)
+		mesh.crypto_workers = value;
+
 done:
 	l_settings_free(settings);
 }
@@ -275,6 +282,9 @@ bool mesh_init(const char *config_dir, const char *mesh_conf_fname,
 
 	parse_settings(mesh_conf_fname);
 
+	if (mesh.crypto_workers && !crypto_pool_init(mesh.crypto_workers))
+		l_warn("Failed to start crypto workers, decrypting inline");
+
 	if (!node_load_from_storage(storage_dir))
 		return false;
 
@@ -329,6 +339,7 @@ void mesh_cleanup(void)
 	struct l_dbus_message *reply;
 
 	mesh_io_destroy(mesh.io);
+	crypto_pool_cleanup();
 
 	if (join_pending) {
 
@@ -349,6 +360,7 @@ void mesh_cleanup(void)
 	mesh_model_cleanup();
 	mesh_net_cleanup();
 	net_key_cleanup();
+	mesh_crypto_cleanup();
 
 	l_dbus_object_remove_interface(dbus_get_bus(), BLUEZ_MESH_PATH,
 							MESH_NETWORK_INTERFACE);
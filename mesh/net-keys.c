@@ -17,6 +17,7 @@
 #include "mesh/mesh-defs.h"
 #include "mesh/util.h"
 #include "mesh/crypto.h"
+#include "mesh/crypto-pool.h"
 #include "mesh/mesh-io.h"
 #include "mesh/net.h"
 #include "mesh/net-keys.h"
@@ -169,6 +170,8 @@ void net_key_unref(uint32_t id)
 		if (--key->ref_cnt == 0) {
 			l_timeout_remove(key->snb.timeout);
 			l_queue_remove(keys, key);
+			mesh_crypto_forget_key(key->encrypt);
+			mesh_crypto_forget_key(key->privacy);
 			l_free(key);
 		}
 	}
@@ -246,6 +249,136 @@ done:
 	return cache_id;
 }
 
+/*
+ * Network PDUs can also be decrypted on the crypto worker pool. The job
+ * gets a copy of the keys that may fit, and its result is loaded into the
+ * decrypt cache right before its completion runs on the main loop, where
+ * net_key_decrypt() finds it. Anything else, such as a key that went away
+ * meanwhile, falls back to decrypting on the main loop.
+ */
+#define MAX_DECRYPT_KEYS	8
+
+struct decrypt_key {
+	uint32_t id;
+	uint8_t encrypt[16];
+	uint8_t privacy[16];
+};
+
+struct decrypt_job {
+	net_key_decrypt_func_t cb;
+	net_key_destroy_func_t destroy;
+	void *user_data;
+	uint32_t iv_index;
+	uint32_t id;
+	uint8_t pkt[29];
+	uint8_t plain[29];
+	size_t len;
+	size_t plain_len;
+	unsigned int num_keys;
+	struct decrypt_key keys[MAX_DECRYPT_KEYS];
+};
+
+static void copy_decrypt_key(void *a, void *b)
+{
+	const struct net_key *key = a;
+	struct decrypt_job *job = b;
+	struct decrypt_key *copy;
+
+	if (!key->ref_cnt || (job->pkt[0] & 0x7f) != key->nid ||
+					job->num_keys == MAX_DECRYPT_KEYS)
+		return;
+
+	copy = &job->keys[job->num_keys++];
+	copy->id = key->id;
+	memcpy(copy->encrypt, key->encrypt, sizeof(copy->encrypt));
+	memcpy(copy->privacy, key->privacy, sizeof(copy->privacy));
+}
+
+static void decrypt_job_work(void *user_data)
+{
+	struct decrypt_job *job = user_data;
+	unsigned int i;
+
+	for (i = 0; i < job->num_keys; i++) {
+		if (!mesh_crypto_packet_decode(job->pkt, job->len, false,
+						job->plain, job->iv_index,
+						job->keys[i].encrypt,
+						job->keys[i].privacy))
+			continue;
+
+		job->id = job->keys[i].id;
+		if (job->plain[1] & 0x80)
+			job->plain_len = job->len - 8;
+		else
+			job->plain_len = job->len - 4;
+		break;
+	}
+}
+
+static void decrypt_job_done(void *user_data)
+{
+	struct decrypt_job *job = user_data;
+
+	if (job->id && l_queue_find(keys, match_id, L_UINT_TO_PTR(job->id))) {
+		memcpy(cache_pkt, job->pkt, job->len);
+		memcpy(cache_plain, job->plain, job->len);
+		cache_len = job->len;
+		cache_plainlen = job->plain_len;
+		cache_iv_index = job->iv_index;
+		cache_id = job->id;
+	}
+
+	job->cb(job->user_data);
+}
+
+static void decrypt_job_free(void *user_data)
+{
+	struct decrypt_job *job = user_data;
+
+	if (job->destroy)
+		job->destroy(job->user_data);
+
+	explicit_bzero(job, sizeof(*job));
+	l_free(job);
+}
+
+/* Returns false if there is nothing to decrypt off the main loop */
+bool net_key_decrypt_queue(uint32_t iv_index, const uint8_t *pkt, size_t len,
+					net_key_decrypt_func_t cb,
+					void *user_data,
+					net_key_destroy_func_t destroy)
+{
+	struct decrypt_job *job;
+
+	if (!crypto_pool_active() || len > sizeof(job->pkt))
+		return false;
+
+	job = l_new(struct decrypt_job, 1);
+	memcpy(job->pkt, pkt, len);
+	job->len = len;
+	job->iv_index = iv_index;
+
+	l_queue_foreach(keys, copy_decrypt_key, job);
+
+	if (!job->num_keys)
+		goto fail;
+
+	if (!crypto_pool_queue(decrypt_job_work, decrypt_job_done, job,
+							decrypt_job_free))
+		goto fail;
+
+	job->cb = cb;
+	job->destroy = destroy;
+	job->user_data = user_data;
+
+	return true;
+
+fail:
+	explicit_bzero(job, sizeof(*job));
+	l_free(job);
+	return false;
+}
+
 bool net_key_encrypt(uint32_t id, uint32_t iv_index, uint8_t *pkt, size_t len)
 {
 	struct net_key *key = l_queue_find(keys, match_id, L_UINT_TO_PTR(id));
@@ -12,6 +12,9 @@
 #define KEY_REFRESH		0x01
 #define IV_INDEX_UPDATE		0x02
 
+typedef void (*net_key_decrypt_func_t)(void *user_data);
+typedef void (*net_key_destroy_func_t)(void *user_data);
+
 void net_key_cleanup(void);
 bool net_key_confirm(uint32_t id, const uint8_t flooding[16]);
 bool net_key_retrieve(uint32_t id, uint8_t *flooding);
@@ -21,6 +24,10 @@ uint32_t net_key_frnd_add(uint32_t flooding_id, uint16_t lpn, uint16_t frnd,
 void net_key_unref(uint32_t id);
 uint32_t net_key_decrypt(uint32_t iv_index, const uint8_t *pkt, size_t len,
 					uint8_t **plain, size_t *plain_len);
+bool net_key_decrypt_queue(uint32_t iv_index, const uint8_t *pkt, size_t len,
+					net_key_decrypt_func_t cb,
+					void *user_data,
+					net_key_destroy_func_t destroy);
 bool net_key_encrypt(uint32_t id, uint32_t iv_index, uint8_t *pkt, size_t len);
 uint32_t net_key_network_id(const uint8_t network[8]);
 bool net_key_snb_check(uint32_t id, uint32_t iv_index, bool kr, bool ivu,
@@ -21,6 +21,7 @@
 #include "mesh/mesh-defs.h"
 #include "mesh/util.h"
 #include "mesh/crypto.h"
+#include "mesh/crypto-pool.h"
 #include "mesh/net-keys.h"
 #include "mesh/node.h"
 #include "mesh/net.h"
@@ -54,6 +55,11 @@
 
 #define FAST_CACHE_SIZE 8
 
+/* Incoming reassembly limits: one context per peer, SAR_IN_MAX in total */
+#define SAR_IN_MAX	32
+#define SAR_POOL_SIZE	8
+#define SAR_BUF_SIZE	MAX_SEG_TO_LEN(SEG_MASK)
+
 enum _relay_advice {
 	RELAY_NONE,		/* Relay not enabled in node */
 	RELAY_ALLOWED,		/* Relay enabled, msg not to node's unicast */
@@ -133,13 +139,24 @@ struct mesh_net {
 	struct l_queue *subnets;
 	struct l_queue *msg_cache;
 	struct l_queue *replay_cache;
-	struct l_queue *sar_in;
+	struct l_hashmap *sar_in;
 	struct l_queue *sar_out;
 	struct l_queue *sar_queue;
 	struct l_queue *frnd_msgs;
 	struct l_queue *friends;
+	struct l_hashmap *frnd_addrs;	/* LPN element address -> friend */
 	struct l_queue *negotiations;
 	struct l_queue *destinations;
+
+	/* Incoming SAR statistics */
+	struct {
+		uint32_t started;
+		uint32_t completed;
+		uint32_t timeouts;
+		uint32_t naks;
+		uint32_t dropped;
+		uint32_t peak;
+	} sar_stats;
 };
 
 struct mesh_msg {
@@ -149,6 +166,7 @@ struct mesh_msg {
 };
 
 struct mesh_sar {
+	struct mesh_net *net;
 	unsigned int id;
 	struct l_timeout *seg_timeout;
 	struct l_timeout *msg_timeout;
@@ -166,6 +184,7 @@ struct mesh_sar {
 	bool segmented;
 	bool frnd;
 	bool frnd_cred;
+	bool pooled;
 	uint8_t ttl;
 	uint8_t last_seg;
 	uint8_t key_aid;
@@ -218,6 +237,7 @@ struct net_beacon_data {
 };
 
 static struct l_queue *fast_cache;
+static struct l_queue *sar_pool;
 static struct l_queue *nets;
 
 static void net_rx(void *net_ptr, void *user_data);
@@ -295,22 +315,143 @@ static void trigger_heartbeat(struct mesh_net *net, uint16_t feature,
 	l_idle_oneshot(send_hb_publication, net, NULL);
 }
 
-static bool match_by_friend(const void *a, const void *b)
+static struct mesh_friend *find_frnd_by_addr(struct mesh_net *net,
+								uint16_t addr)
 {
-	const struct mesh_friend *frnd = a;
-	uint16_t dst = L_PTR_TO_UINT(b);
+	if (!net->frnd_addrs || (addr & 0x8000))
+		return NULL;
+
+	return l_hashmap_lookup(net->frnd_addrs, L_UINT_TO_PTR(addr));
+}
+
+static struct mesh_friend *find_frnd_by_lpn(struct mesh_net *net,
+								uint16_t lpn)
+{
+	struct mesh_friend *frnd = find_frnd_by_addr(net, lpn);
+
+	if (frnd && frnd->lp_addr == lpn)
+		return frnd;
+
+	return NULL;
+}
+
+static void frnd_index_add(struct mesh_net *net, struct mesh_friend *frnd)
+{
+	uint16_t i;
+
+	if (!net->frnd_addrs)
+		return;
+
+	for (i = 0; i < frnd->ele_cnt; i++)
+		l_hashmap_replace(net->frnd_addrs,
+				L_UINT_TO_PTR(frnd->lp_addr + i), frnd, NULL);
+}
+
+static void frnd_index_del(struct mesh_net *net, struct mesh_friend *frnd)
+{
+	uint16_t i;
+
+	if (!net->frnd_addrs)
+		return;
+
+	for (i = 0; i < frnd->ele_cnt; i++) {
+		void *key = L_UINT_TO_PTR(frnd->lp_addr + i);
+
+		if (l_hashmap_lookup(net->frnd_addrs, key) == frnd)
+			l_hashmap_remove(net->frnd_addrs, key);
+	}
+}
+
+struct mesh_friend_msg *mesh_friend_cache_peek(struct mesh_friend *frnd)
+{
+	if (!frnd->cache_len)
+		return NULL;
+
+	return frnd->pkt_cache[frnd->cache_head];
+}
+
+struct mesh_friend_msg *mesh_friend_cache_pop(struct mesh_friend *frnd)
+{
+	struct mesh_friend_msg *pkt;
+
+	if (!frnd->cache_len)
+		return NULL;
+
+	pkt = frnd->pkt_cache[frnd->cache_head];
+	frnd->pkt_cache[frnd->cache_head] = NULL;
+	frnd->cache_head = (frnd->cache_head + 1) % FRND_CACHE_MAX;
+	frnd->cache_len--;
+
+	return pkt;
+}
+
+static void friend_cache_push(struct mesh_friend *frnd,
+						struct mesh_friend_msg *pkt)
+{
+	uint8_t tail;
+
+	if (frnd->cache_len == FRND_CACHE_MAX) {
+		/*
+		 * TODO: Guard against popping UPDATE packets
+		 * (disallowed per spec)
+		 */
+		l_free(mesh_friend_cache_pop(frnd));
+		frnd->u.active.last = frnd->u.active.seq;
+		frnd->cache_overflow++;
+	}
+
+	tail = (frnd->cache_head + frnd->cache_len) % FRND_CACHE_MAX;
+	frnd->pkt_cache[tail] = pkt;
+	frnd->cache_len++;
 
-	return frnd->lp_addr == dst;
+	if (frnd->cache_len > frnd->cache_peak)
+		frnd->cache_peak = frnd->cache_len;
+}
+
+/* Removes all cached packets matching, keeping the order of the others */
+static unsigned int friend_cache_remove_if(struct mesh_friend *frnd,
+					l_queue_match_func_t match,
+					const void *user_data)
+{
+	unsigned int removed = 0;
+	uint8_t i, len = frnd->cache_len;
+
+	for (i = 0; i < len; i++) {
+		uint8_t idx = (frnd->cache_head + i) % FRND_CACHE_MAX;
+		struct mesh_friend_msg *pkt = frnd->pkt_cache[idx];
+
+		frnd->pkt_cache[idx] = NULL;
+
+		if (match(pkt, user_data)) {
+			l_free(pkt);
+			removed++;
+			continue;
+		}
+
+		idx = (frnd->cache_head + i - removed) % FRND_CACHE_MAX;
+		frnd->pkt_cache[idx] = pkt;
+	}
+
+	frnd->cache_len -= removed;
+
+	return removed;
 }
 
 static void free_friend_internals(struct mesh_friend *frnd)
 {
-	if (frnd->pkt_cache)
-		l_queue_destroy(frnd->pkt_cache, l_free);
+	if (frnd->cache_peak)
+		l_debug("Friend cache %4.4x: peak %u overflow %u",
+				frnd->lp_addr, frnd->cache_peak,
+				frnd->cache_overflow);
+
+	while (frnd->cache_len)
+		l_free(mesh_friend_cache_pop(frnd));
 
 	l_free(frnd->u.active.grp_list);
 	frnd->u.active.grp_list = NULL;
-	frnd->pkt_cache = NULL;
+	frnd->cache_head = 0;
+	frnd->cache_peak = 0;
+	frnd->cache_overflow = 0;
 
 	net_key_unref(frnd->net_key_cur);
 	net_key_unref(frnd->net_key_upd);
@@ -361,11 +502,11 @@ struct mesh_friend *mesh_friend_new(struct mesh_net *net, uint16_t dst,
 					uint16_t fn_cnt, uint16_t lp_cnt)
 {
 	struct mesh_subnet *subnet;
-	struct mesh_friend *frnd = l_queue_find(net->friends,
-					match_by_friend, L_UINT_TO_PTR(dst));
+	struct mesh_friend *frnd = find_frnd_by_lpn(net, dst);
 
 	if (frnd) {
 		/* Kill all timers and empty cache for this friend */
+		frnd_index_del(net, frnd);
 		free_friend_internals(frnd);
 		l_timeout_remove(frnd->timeout);
 		frnd->timeout = NULL;
@@ -383,9 +524,10 @@ struct mesh_friend *mesh_friend_new(struct mesh_net *net, uint16_t dst,
 	frnd->lp_cnt = lp_cnt;
 	frnd->poll_timeout = fpt;
 	frnd->ele_cnt = ele_cnt;
-	frnd->pkt_cache = l_queue_new();
 	frnd->net_key_upd = 0;
 
+	frnd_index_add(net, frnd);
+
 	subnet = get_primary_subnet(net);
 	/* TODO: the primary key must be present, do we need to add check?. */
 
@@ -415,6 +557,9 @@ bool mesh_friend_clear(struct mesh_net *net, struct mesh_friend *frnd)
 {
 	bool removed = l_queue_remove(net->friends, frnd);
 
+	if (removed)
+		frnd_index_del(net, frnd);
+
 	free_friend_internals(frnd);
 
 	return removed;
@@ -425,9 +570,8 @@ void mesh_friend_sub_add(struct mesh_net *net, uint16_t lpn, uint8_t ele_cnt,
 {
 	uint16_t *new_list;
 	uint16_t *grp_list;
-	struct mesh_friend *frnd = l_queue_find(net->friends,
-							match_by_friend,
-							L_UINT_TO_PTR(lpn));
+	struct mesh_friend *frnd = find_frnd_by_lpn(net, lpn);
+
 	if (!frnd)
 		return;
 
@@ -442,7 +586,9 @@ void mesh_friend_sub_add(struct mesh_net *net, uint16_t lpn, uint8_t ele_cnt,
 	memcpy(&new_list[frnd->u.active.grp_cnt], list,
 						grp_cnt * sizeof(uint16_t));
 	l_free(grp_list);
+	frnd_index_del(net, frnd);
 	frnd->ele_cnt = ele_cnt;
+	frnd_index_add(net, frnd);
 	frnd->u.active.grp_list = new_list;
 	frnd->u.active.grp_cnt += grp_cnt;
 }
@@ -453,8 +599,7 @@ void mesh_friend_sub_del(struct mesh_net *net, uint16_t lpn, uint8_t cnt,
 	uint16_t *grp_list;
 	int16_t i, grp_cnt;
 	size_t cnt16 = cnt * sizeof(uint16_t);
-	struct mesh_friend *frnd = l_queue_find(net->friends, match_by_friend,
-							L_UINT_TO_PTR(lpn));
+	struct mesh_friend *frnd = find_frnd_by_lpn(net, lpn);
 	if (!frnd)
 		return;
 
@@ -509,6 +654,21 @@ static struct mesh_sar *mesh_sar_new(size_t len)
 	return sar;
 }
 
+static struct mesh_sar *mesh_sar_in_new(struct mesh_net *net)
+{
+	struct mesh_sar *sar = l_queue_pop_head(sar_pool);
+
+	if (sar)
+		memset(sar, 0, sizeof(*sar) + SAR_BUF_SIZE);
+	else
+		sar = mesh_sar_new(SAR_BUF_SIZE);
+
+	sar->net = net;
+	sar->pooled = true;
+
+	return sar;
+}
+
 static void mesh_sar_free(void *data)
 {
 	struct mesh_sar *sar = data;
@@ -518,6 +678,11 @@ static void mesh_sar_free(void *data)
 
 	l_timeout_remove(sar->seg_timeout);
 	l_timeout_remove(sar->msg_timeout);
+
+	if (sar->pooled && l_queue_length(sar_pool) < SAR_POOL_SIZE &&
+					l_queue_push_head(sar_pool, sar))
+		return;
+
 	l_free(sar);
 }
 
@@ -618,7 +783,7 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 
 	net->subnets = l_queue_new();
 	net->msg_cache = l_queue_new();
-	net->sar_in = l_queue_new();
+	net->sar_in = l_hashmap_new();
 	net->sar_out = l_queue_new();
 	net->sar_queue = l_queue_new();
 	net->frnd_msgs = l_queue_new();
@@ -632,6 +797,9 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 	if (!fast_cache)
 		fast_cache = l_queue_new();
 
+	if (!sar_pool)
+		sar_pool = l_queue_new();
+
 	return net;
 }
 
@@ -645,11 +813,18 @@ void mesh_net_free(void *user_data)
 	l_queue_destroy(net->subnets, subnet_free);
 	l_queue_destroy(net->msg_cache, l_free);
 	l_queue_destroy(net->replay_cache, l_free);
-	l_queue_destroy(net->sar_in, mesh_sar_free);
+	l_debug("SAR in: started %u completed %u timeouts %u naks %u "
+			"dropped %u peak %u", net->sar_stats.started,
+			net->sar_stats.completed, net->sar_stats.timeouts,
+			net->sar_stats.naks, net->sar_stats.dropped,
+			net->sar_stats.peak);
+
+	l_hashmap_destroy(net->sar_in, mesh_sar_free);
 	l_queue_destroy(net->sar_out, mesh_sar_free);
 	l_queue_destroy(net->sar_queue, mesh_sar_free);
 	l_queue_destroy(net->frnd_msgs, l_free);
 	l_queue_destroy(net->friends, mesh_friend_free);
+	l_hashmap_destroy(net->frnd_addrs, NULL);
 	l_queue_destroy(net->negotiations, mesh_friend_free);
 	l_queue_destroy(net->destinations, l_free);
 	l_queue_destroy(net->app_keys, appkey_key_free);
@@ -663,6 +838,8 @@ void mesh_net_cleanup(void)
 	fast_cache = NULL;
 	l_queue_destroy(nets, mesh_net_free);
 	nets = NULL;
+	l_queue_destroy(sar_pool, l_free);
+	sar_pool = NULL;
 }
 
 bool mesh_net_set_seq_num(struct mesh_net *net, uint32_t seq)
@@ -757,8 +934,11 @@ bool mesh_net_set_friend_mode(struct mesh_net *net, bool enable)
 
 	if (enable) {
 		net->friends = l_queue_new();
+		net->frnd_addrs = l_hashmap_new();
 		net->negotiations = l_queue_new();
 	} else {
+		l_hashmap_destroy(net->frnd_addrs, NULL);
+		net->frnd_addrs = NULL;
 		l_queue_destroy(net->friends, mesh_friend_free);
 		l_queue_destroy(net->negotiations, mesh_friend_free);
 		net->friends = net->negotiations = NULL;
@@ -1084,6 +1264,54 @@ static bool match_seg_timeout(const void *a, const void *b)
 	return sar->seg_timeout == seg_timeout;
 }
 
+static bool sar_in_complete(const struct mesh_sar *sar)
+{
+	return sar->flags == 0xffffffff >> (31 - SEG_MAX(true, sar->len));
+}
+
+static bool remove_sar_complete(const void *key, void *value, void *user_data)
+{
+	struct mesh_sar *sar = value;
+	struct mesh_sar **found = user_data;
+
+	if (*found || !sar_in_complete(sar))
+		return false;
+
+	*found = sar;
+	return true;
+}
+
+static struct mesh_sar *sar_in_add(struct mesh_net *net, uint16_t remote)
+{
+	unsigned int size = l_hashmap_size(net->sar_in);
+	struct mesh_sar *sar = NULL;
+
+	if (size >= SAR_IN_MAX) {
+		/*
+		 * Recycle a finished reassembly that is only lingering to
+		 * re-ACK late segments, otherwise refuse the new one.
+		 */
+		l_hashmap_foreach_remove(net->sar_in, remove_sar_complete, &sar);
+		if (!sar) {
+			net->sar_stats.dropped++;
+			return NULL;
+		}
+
+		mesh_sar_free(sar);
+		size--;
+	}
+
+	sar = mesh_sar_in_new(net);
+	sar->remote = remote;
+	l_hashmap_insert(net->sar_in, L_UINT_TO_PTR(remote), sar);
+
+	net->sar_stats.started++;
+	if (size + 1 > net->sar_stats.peak)
+		net->sar_stats.peak = size + 1;
+
+	return sar;
+}
+
 static bool match_dest_dst(const void *a, const void *b)
 {
 	const struct mesh_destination *dest = a;
@@ -1117,13 +1345,18 @@ static bool match_frnd_dst(const void *a, const void *b)
 	return false;
 }
 
-static bool is_lpn_friend(struct mesh_net *net, uint16_t addr)
+static struct mesh_friend *find_frnd_dst(struct mesh_net *net, uint16_t dst)
 {
-	void *tst;
+	/* Unicast destinations resolve through the address index */
+	if (!(dst & 0x8000))
+		return find_frnd_by_addr(net, dst);
 
-	tst = l_queue_find(net->friends, match_frnd_dst, L_UINT_TO_PTR(addr));
+	return l_queue_find(net->friends, match_frnd_dst, L_UINT_TO_PTR(dst));
+}
 
-	return tst != NULL;
+static bool is_lpn_friend(struct mesh_net *net, uint16_t addr)
+{
+	return find_frnd_dst(net, addr) != NULL;
 }
 
 static bool is_us(struct mesh_net *net, uint16_t addr, bool src)
@@ -1149,8 +1382,7 @@ static bool is_us(struct mesh_net *net, uint16_t addr, bool src)
 							L_UINT_TO_PTR(addr));
 
 	if (tst == NULL && !src)
-		tst = l_queue_find(net->friends, match_frnd_dst,
-							L_UINT_TO_PTR(addr));
+		tst = find_frnd_dst(net, addr);
 
 	return tst != NULL;
 }
@@ -1227,25 +1459,16 @@ enqueue:
 	/* Special handling for Seg Ack -- Only one per message queue */
 	if (((rx->u.one[0].hdr >> OPCODE_HDR_SHIFT) & OPCODE_MASK) ==
 						NET_OP_SEG_ACKNOWLEDGE) {
-		void *old_head = l_queue_peek_head(frnd->pkt_cache);
-		/* Suppress duplicate ACKs */
-		do {
-			void *old = l_queue_remove_if(frnd->pkt_cache,
-							match_ack, rx);
-
-			if (!old)
-				break;
-
-			if (old_head == old)
-				/*
-				 * If we are discarding head for any
-				 * reason, reset FRND SEQ
-				 */
-				frnd->u.active.last = frnd->u.active.seq;
+		struct mesh_friend_msg *old_head = mesh_friend_cache_peek(frnd);
 
-			l_free(old);
-
-		} while (true);
+		/* Suppress duplicate ACKs */
+		if (friend_cache_remove_if(frnd, match_ack, rx) &&
+				old_head != mesh_friend_cache_peek(frnd))
+			/*
+			 * If we are discarding head for any
+			 * reason, reset FRND SEQ
+			 */
+			frnd->u.active.last = frnd->u.active.seq;
 	}
 
 	l_debug("%s for %4.4x from %4.4x ttl: %2.2x (seq: %6.6x) (ctl: %d)",
@@ -1262,17 +1485,23 @@ enqueue:
 	pkt = l_malloc(size);
 	memcpy(pkt, rx, size);
 
-	l_queue_push_tail(frnd->pkt_cache, pkt);
+	friend_cache_push(frnd, pkt);
+}
 
-	if (l_queue_length(frnd->pkt_cache) > FRND_CACHE_MAX) {
-		/*
-		 * TODO: Guard against popping UPDATE packets
-		 * (disallowed per spec)
-		 */
-		pkt = l_queue_pop_head(frnd->pkt_cache);
-		l_free(pkt);
-		frnd->u.active.last = frnd->u.active.seq;
+static void enqueue_friends(struct mesh_net *net, struct mesh_friend_msg *rx)
+{
+	struct mesh_friend *frnd;
+
+	/* Unicast traffic belongs to at most one LPN */
+	if (!(rx->dst & 0x8000)) {
+		frnd = find_frnd_by_addr(net, rx->dst);
+		if (frnd)
+			enqueue_friend_pkt(frnd, rx);
+
+		return;
 	}
+
+	l_queue_foreach(net->friends, enqueue_friend_pkt, rx);
 }
 
 static void enqueue_update(void *a, void *b)
@@ -1359,7 +1588,7 @@ static bool friend_packet_queue(struct mesh_net *net,
 	frnd_msg->ttl = ttl;
 
 	/* Re-Package into Friend Delivery payload */
-	l_queue_foreach(net->friends, enqueue_friend_pkt, frnd_msg);
+	enqueue_friends(net, frnd_msg);
 	ret = frnd_msg->done;
 
 	/* TODO Optimization(?): Unicast messages keep this buffer */
@@ -1390,7 +1619,7 @@ static void friend_ack_rxed(struct mesh_net *net, uint32_t iv_index,
 	hdr |= NET_OP_SEG_ACKNOWLEDGE << OPCODE_HDR_SHIFT;
 	frnd_ack.u.one[0].hdr = hdr;
 	l_put_be32(flags, frnd_ack.u.one[0].data);
-	l_queue_foreach(net->friends, enqueue_friend_pkt, &frnd_ack);
+	enqueue_friends(net, &frnd_ack);
 }
 
 static bool send_seg(struct mesh_net *net, uint8_t cnt, uint16_t interval,
@@ -1475,32 +1704,29 @@ static void send_net_ack(struct mesh_net *net, struct mesh_sar *sar,
 
 static void inseg_to(struct l_timeout *seg_timeout, void *user_data)
 {
-	struct mesh_net *net = user_data;
-	struct mesh_sar *sar = l_queue_find(net->sar_in,
-					match_seg_timeout, seg_timeout);
+	struct mesh_sar *sar = user_data;
+	struct mesh_net *net = sar->net;
 
 	l_timeout_remove(seg_timeout);
-	if (!sar)
-		return;
 
 	/* Send NAK */
 	l_debug("Timeout %p %3.3x", sar, sar->app_idx);
 	send_net_ack(net, sar, sar->flags);
+	net->sar_stats.naks++;
 
-	sar->seg_timeout = l_timeout_create(SEG_TO, inseg_to, net, NULL);
+	sar->seg_timeout = l_timeout_create(SEG_TO, inseg_to, sar, NULL);
 }
 
 static void inmsg_to(struct l_timeout *msg_timeout, void *user_data)
 {
-	struct mesh_net *net = user_data;
-	struct mesh_sar *sar = l_queue_remove_if(net->sar_in,
-			match_msg_timeout, msg_timeout);
+	struct mesh_sar *sar = user_data;
+	struct mesh_net *net = sar->net;
 
-	l_timeout_remove(msg_timeout);
-	if (!sar)
-		return;
+	l_hashmap_remove(net->sar_in, L_UINT_TO_PTR(sar->remote));
+
+	if (!sar_in_complete(sar))
+		net->sar_stats.timeouts++;
 
-	sar->msg_timeout = NULL;
 	mesh_sar_free(sar);
 }
 
@@ -1816,8 +2042,7 @@ static void friend_seg_rxed(struct mesh_net *net,
 	uint32_t largest = (0xffffffff << segO) & expected;
 	uint32_t hdr_key =  hdr & HDR_KEY_MASK;
 
-	frnd = l_queue_find(net->friends, match_frnd_dst,
-			L_UINT_TO_PTR(dst));
+	frnd = find_frnd_dst(net, dst);
 	if (!frnd)
 		return;
 
@@ -1877,8 +2102,7 @@ static void friend_seg_rxed(struct mesh_net *net,
 		if (frnd_msg->ttl > 1) {
 			frnd_msg->ttl--;
 			/* Add to friends cache  */
-			l_queue_foreach(net->friends,
-					enqueue_friend_pkt, frnd_msg);
+			enqueue_friends(net, frnd_msg);
 		}
 
 		/* Remove from "in progress" queue */
@@ -1916,8 +2140,7 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 	 * DST could receive additional Segments after
 	 * completing due to a lost ACK, so re-ACK and discard
 	 */
-	sar_in = l_queue_find(net->sar_in, match_sar_remote,
-						L_UINT_TO_PTR(src));
+	sar_in = l_hashmap_lookup(net->sar_in, L_UINT_TO_PTR(src));
 
 	/* Discard *old* incoming-SAR-in-progress if this segment newer */
 	seqAuth = seq_auth(seq, seqZero);
@@ -1934,7 +2157,7 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 
 		if (newer) {
 			/* Cancel Old, start New */
-			l_queue_remove(net->sar_in, sar_in);
+			l_hashmap_remove(net->sar_in, L_UINT_TO_PTR(src));
 			mesh_sar_free(sar_in);
 			sar_in = NULL;
 		} else
@@ -1962,22 +2185,24 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 
 		l_debug("RXed (new: %04x %06x size: %d len: %d) %d of %d",
 				seqZero, seq, size, len, segO, segN);
-		l_debug("Queue Size: %d", l_queue_length(net->sar_in));
-		sar_in = mesh_sar_new(len);
+		l_debug("Queue Size: %d", l_hashmap_size(net->sar_in));
+
+		sar_in = sar_in_add(net, src);
+		if (!sar_in)
+			return false;
+
 		sar_in->seqAuth = seqAuth;
 		sar_in->iv_index = iv_index;
 		sar_in->src = dst;
-		sar_in->remote = src;
 		sar_in->seqZero = seqZero;
 		sar_in->key_aid = key_aid;
 		sar_in->len = len;
 		sar_in->last_seg = 0xff;
 		sar_in->net_idx = net_idx;
 		sar_in->msg_timeout = l_timeout_create(MSG_TO,
-					inmsg_to, net, NULL);
+					inmsg_to, sar_in, NULL);
 
 		l_debug("First Seg %4.4x", sar_in->flags);
-		l_queue_push_head(net->sar_in, sar_in);
 	}
 
 	seg_off = segO * MAX_SEG_LEN;
@@ -1998,6 +2223,7 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 	if (sar_in->flags == expected) {
 		/* Got it all */
 		send_net_ack(net, sar_in, expected);
+		net->sar_stats.completed++;
 
 		msg_rxed(net, frnd, iv_index, ttl, seq, net_idx,
 				sar_in->remote, dst, key_aid, true, szmic,
@@ -2015,11 +2241,13 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 
 		/* if this is the largest outstanding segment, send NAK now */
 		largest = (0xffffffff << segO) & expected;
-		if ((largest & sar_in->flags) == largest)
+		if ((largest & sar_in->flags) == largest) {
 			send_net_ack(net, sar_in, sar_in->flags);
+			net->sar_stats.naks++;
+		}
 
 		sar_in->seg_timeout = l_timeout_create(SEG_TO,
-				inseg_to, net, NULL);
+				inseg_to, sar_in, NULL);
 	} else
 		largest = 0;
 
@@ -2063,8 +2291,7 @@ static bool ctl_received(struct mesh_net *net, uint16_t net_key_id,
 			return false;
 
 		print_packet("Rx-NET_OP_FRND_POLL", pkt, len);
-		friend_poll(net, src, !!(pkt[0]), l_queue_find(net->friends,
-					match_by_friend, L_UINT_TO_PTR(src)));
+		friend_poll(net, src, !!(pkt[0]), find_frnd_by_lpn(net, src));
 		break;
 
 	case NET_OP_FRND_REQUEST:
@@ -2100,8 +2327,7 @@ static bool ctl_received(struct mesh_net *net, uint16_t net_key_id,
 
 		print_packet("Rx-NET_OP_FRND_CLEAR", pkt, len);
 		friend_clear(net, src, l_get_be16(pkt), l_get_be16(pkt + 2),
-				l_queue_find(net->friends, match_by_friend,
-					L_UINT_TO_PTR(l_get_be16(pkt))));
+				find_frnd_by_lpn(net, l_get_be16(pkt)));
 		l_debug("Remaining Friends: %d", l_queue_length(net->friends));
 		break;
 
@@ -2110,8 +2336,7 @@ static bool ctl_received(struct mesh_net *net, uint16_t net_key_id,
 			return false;
 
 		print_packet("Rx-NET_OP_PROXY_SUB_ADD", pkt, len);
-		friend_sub_add(net, l_queue_find(net->friends,
-					match_by_friend, L_UINT_TO_PTR(src)),
+		friend_sub_add(net, find_frnd_by_lpn(net, src),
 				pkt, len);
 		break;
 
@@ -2120,8 +2345,7 @@ static bool ctl_received(struct mesh_net *net, uint16_t net_key_id,
 			return false;
 
 		print_packet("Rx-NET_OP_PROXY_SUB_REMOVE", pkt, len);
-		friend_sub_del(net, l_queue_find(net->friends, match_by_friend,
-						L_UINT_TO_PTR(src)), pkt, len);
+		friend_sub_del(net, find_frnd_by_lpn(net, src), pkt, len);
 		break;
 
 	case NET_OP_PROXY_SUB_CONFIRM:
@@ -2450,11 +2674,9 @@ static void net_rx(void *net_ptr, void *user_data)
 	}
 }
 
-static void net_msg_recv(void *user_data, struct mesh_io_recv_info *info,
+static void net_msg_process(struct mesh_io_recv_info *info,
 					const uint8_t *data, uint16_t len)
 {
-	uint64_t hash;
-	bool isNew;
 	struct net_queue_data net_data = {
 		.info = info,
 		.data = data + 1,
@@ -2463,16 +2685,6 @@ static void net_msg_recv(void *user_data, struct mesh_io_recv_info *info,
 		.seen = false,
 	};
 
-	if (len < 9)
-		return;
-
-	hash = l_get_le64(data + 1);
-
-	/* Only process packet once per reception */
-	isNew = check_fast_cache(hash);
-	if (!isNew)
-		return;
-
 	l_queue_foreach(nets, net_rx, &net_data);
 
 	if (net_data.relay_advice == RELAY_ALWAYS ||
@@ -2487,6 +2699,85 @@ static void net_msg_recv(void *user_data, struct mesh_io_recv_info *info,
 	}
 }
 
+/* Received network PDU waiting for its decryption on the crypto pool */
+struct net_msg {
+	struct mesh_io_recv_info info;
+	struct mesh_io_recv_info *info_ptr;
+	uint8_t addr[6];
+	uint16_t len;
+	uint8_t data[];
+};
+
+static void net_msg_decrypted(void *user_data)
+{
+	struct net_msg *msg = user_data;
+
+	net_msg_process(msg->info_ptr, msg->data, msg->len);
+}
+
+static bool net_msg_queue(struct mesh_io_recv_info *info,
+					const uint8_t *data, uint16_t len)
+{
+	struct mesh_net *net = l_queue_peek_head(nets);
+	struct net_msg *msg;
+	bool ivi_net, ivi_pkt;
+	uint32_t iv_index;
+
+	if (!net || !crypto_pool_active())
+		return false;
+
+	/* The decrypt cache is only hit with the IV Index of the first net */
+	ivi_net = !!(net->iv_index & 1);
+	ivi_pkt = !!(data[1] & 0x80);
+	iv_index = net->iv_index - (ivi_pkt ^ ivi_net);
+
+	msg = l_malloc(sizeof(*msg) + len);
+	msg->len = len;
+	memcpy(msg->data, data, len);
+	msg->info_ptr = NULL;
+
+	if (info) {
+		msg->info = *info;
+		msg->info_ptr = &msg->info;
+
+		if (info->addr) {
+			memcpy(msg->addr, info->addr, sizeof(msg->addr));
+			msg->info.addr = msg->addr;
+		}
+	}
+
+	if (!net_key_decrypt_queue(iv_index, msg->data + 1, len - 1,
+					net_msg_decrypted, msg, l_free)) {
+		l_free(msg);
+		return false;
+	}
+
+	return true;
+}
+
+static void net_msg_recv(void *user_data, struct mesh_io_recv_info *info,
+					const uint8_t *data, uint16_t len)
+{
+	uint64_t hash;
+	bool isNew;
+
+	if (len < 9)
+		return;
+
+	hash = l_get_le64(data + 1);
+
+	/* Only process packet once per reception */
+	isNew = check_fast_cache(hash);
+	if (!isNew)
+		return;
+
+	/* With worker threads, decryption happens off the main loop */
+	if (net_msg_queue(info, data, len))
+		return;
+
+	net_msg_process(info, data, len);
+}
+
 static void iv_upd_to(struct l_timeout *upd_timeout, void *user_data)
 {
 	struct mesh_net *net = user_data;
@@ -3426,8 +3717,7 @@ uint16_t mesh_net_get_primary_idx(struct mesh_net *net)
 
 uint32_t mesh_net_friend_timeout(struct mesh_net *net, uint16_t addr)
 {
-	struct mesh_friend *frnd = l_queue_find(net->friends, match_by_friend,
-							L_UINT_TO_PTR(addr));
+	struct mesh_friend *frnd = find_frnd_by_lpn(net, addr);
 
 	if (!frnd)
 		return 0;
@@ -166,8 +166,9 @@ struct friend_act {
 struct mesh_friend {
 	struct mesh_net *net;
 	struct l_timeout *timeout;
-	struct l_queue *pkt_cache;
+	struct mesh_friend_msg *pkt_cache[FRND_CACHE_MAX]; /* Ring buffer */
 	void *pkt;
+	uint32_t cache_overflow;
 	uint32_t poll_timeout;
 	uint32_t net_key_cur;
 	uint32_t net_key_upd;
@@ -180,6 +181,9 @@ struct mesh_friend {
 	uint8_t ele_cnt;
 	uint8_t frd;
 	uint8_t frw;
+	uint8_t cache_head;
+	uint8_t cache_len;
+	uint8_t cache_peak;
 	union {
 		struct friend_neg negotiate;
 		struct friend_act active;
@@ -283,6 +287,8 @@ struct mesh_friend *mesh_friend_new(struct mesh_net *net, uint16_t dst,
 					uint16_t fn_cnt, uint16_t lp_cnt);
 void mesh_friend_free(void *frnd);
 bool mesh_friend_clear(struct mesh_net *net, struct mesh_friend *frnd);
+struct mesh_friend_msg *mesh_friend_cache_peek(struct mesh_friend *frnd);
+struct mesh_friend_msg *mesh_friend_cache_pop(struct mesh_friend *frnd);
 void mesh_friend_sub_add(struct mesh_net *net, uint16_t lpn, uint8_t ele_cnt,
 							uint8_t grp_cnt,
 							const uint8_t *list);
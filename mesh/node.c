@@ -24,6 +24,7 @@
 #include "mesh/mesh.h"
 #include "mesh/net.h"
 #include "mesh/net-keys.h"
+#include "mesh/crypto.h"
 #include "mesh/appkey.h"
 #include "mesh/mesh-config.h"
 #include "mesh/provision.h"
@@ -295,6 +296,7 @@ static void free_node_resources(void *data)
 	mesh_agent_remove(node->agent);
 	mesh_config_release(node->cfg);
 	mesh_net_free(node->net);
+	mesh_crypto_forget_key(node->dev_key);
 	l_free(node->storage_dir);
 	l_free(node);
 }
@@ -96,6 +96,8 @@ static void acceptor_free(void)
 
 	pb_adv_unreg(prov);
 
+	mesh_crypto_forget_key(prov->s_key);
+
 	l_free(prov);
 	prov = NULL;
 }
@@ -104,8 +104,10 @@ static struct mesh_prov_initiator *prov = NULL;
 
 static void initiator_free(void)
 {
-	if (prov)
+	if (prov) {
 		l_timeout_remove(prov->timeout);
+		mesh_crypto_forget_key(prov->s_key);
+	}
 
 	mesh_send_cancel(&pkt_filter, sizeof(pkt_filter));
 
@@ -909,3 +909,239 @@ bool a2dp_codec_cfg(uint8_t codec, uint8_t losc, struct l2cap_frame *frame)
 		return true;
 	}
 }
+
+/* Packets arriving after such a pause start a new measurement interval */
+#define STREAM_RESYNC_USEC	1000000
+
+/* Sequence number window for reordered and lost packets, RFC 3550 A.1 */
+#define STREAM_MAX_DROPOUT	3000
+#define STREAM_MAX_MISORDER	100
+
+static uint32_t sbc_rate(uint8_t cfg)
+{
+	switch (cfg & 0xf0) {
+	case 0x80:
+		return 16000;
+	case 0x40:
+		return 32000;
+	case 0x20:
+		return 44100;
+	case 0x10:
+		return 48000;
+	}
+
+	return 0;
+}
+
+static uint32_t aac_rate(uint16_t freq)
+{
+	static const uint32_t rates[] = {
+		96000, 88200, 64000, 48000, 44100, 32000,
+		24000, 22050, 16000, 12000, 11025, 8000,
+	};
+	unsigned int i;
+
+	/* Bit 4 is 96000, bit 15 is 8000 */
+	for (i = 0; i < 12; i++) {
+		if (freq & (0x0010 << i))
+			return rates[i];
+	}
+
+	return 0;
+}
+
+static uint32_t ldac_rate(uint8_t cfg)
+{
+	switch (cfg & 0x3f) {
+	case 0x20:
+		return 44100;
+	case 0x10:
+		return 48000;
+	case 0x08:
+		return 88200;
+	case 0x04:
+		return 96000;
+	case 0x02:
+		return 176400;
+	case 0x01:
+		return 192000;
+	}
+
+	return 0;
+}
+
+static void stream_init_vendor(struct a2dp_stream *stream,
+					const uint8_t *cfg, uint8_t len)
+{
+	uint32_t vendor_id;
+	uint16_t codec_id;
+
+	if (len < 7)
+		return;
+
+	vendor_id = get_le32(cfg);
+	codec_id = get_le16(cfg + 4);
+
+	if (vendor_id == APTX_VENDOR_ID && codec_id == APTX_CODEC_ID) {
+		/* aptX and FastStream carry raw codec data without RTP */
+		stream->rtp = false;
+		stream->rate = sbc_rate(cfg[6]);
+	} else if (vendor_id == FASTSTREAM_VENDOR_ID &&
+					codec_id == FASTSTREAM_CODEC_ID) {
+		stream->rtp = false;
+	} else if (vendor_id == APTX_LL_VENDOR_ID &&
+					codec_id == APTX_LL_CODEC_ID) {
+		stream->rtp = false;
+		stream->rate = sbc_rate(cfg[6]);
+	} else if (vendor_id == APTX_HD_VENDOR_ID &&
+					codec_id == APTX_HD_CODEC_ID) {
+		stream->rate = sbc_rate(cfg[6]);
+	} else if (vendor_id == LDAC_VENDOR_ID &&
+					codec_id == LDAC_CODEC_ID) {
+		stream->rate = ldac_rate(cfg[6]);
+		stream->frame_count = true;
+	}
+}
+
+void a2dp_stream_init(struct a2dp_stream *stream, uint8_t codec,
+					const uint8_t *cfg, uint8_t len)
+{
+	memset(stream, 0, sizeof(*stream));
+
+	stream->codec = codec;
+	stream->rtp = true;
+
+	if (!cfg)
+		return;
+
+	switch (codec) {
+	case A2DP_CODEC_SBC:
+		if (len < 1)
+			break;
+		stream->rate = sbc_rate(cfg[0]);
+		stream->frame_count = true;
+		break;
+	case A2DP_CODEC_MPEG24:
+		if (len < 3)
+			break;
+		stream->rate = aac_rate(cfg[1] << 8 | (cfg[2] & 0xf0));
+		break;
+	case A2DP_CODEC_VENDOR:
+		stream_init_vendor(stream, cfg, len);
+		break;
+	}
+}
+
+static uint64_t stream_tv_diff(const struct timeval *a,
+						const struct timeval *b)
+{
+	struct timeval res;
+
+	if (timercmp(a, b, <))
+		return 0;
+
+	timersub(a, b, &res);
+
+	return (uint64_t) res.tv_sec * 1000000 + res.tv_usec;
+}
+
+bool a2dp_stream_packet(struct a2dp_stream *stream, const struct timeval *tv,
+				const void *data, uint16_t size,
+				struct a2dp_rtp *rtp)
+{
+	const uint8_t *hdr = data;
+	uint16_t len = 12;
+	uint16_t delta;
+
+	memset(rtp, 0, sizeof(*rtp));
+
+	if (!stream->rtp || size < len || (hdr[0] >> 6) != 2)
+		return false;
+
+	/* Skip CSRC list and header extension */
+	len += (hdr[0] & 0x0f) * 4;
+	if (hdr[0] & 0x10) {
+		if (size < len + 4)
+			return false;
+		len += 4 + get_be16(hdr + len + 2) * 4;
+	}
+
+	if (size < len)
+		return false;
+
+	rtp->marker = hdr[1] & 0x80;
+	rtp->pt = hdr[1] & 0x7f;
+	rtp->seq = get_be16(hdr + 2);
+	rtp->ts = get_be32(hdr + 4);
+	rtp->ssrc = get_be32(hdr + 8);
+
+	/* Fragments other than the first one carry no new frames */
+	if (stream->frame_count && size > len &&
+				(!(hdr[len] & 0x80) || (hdr[len] & 0x40)))
+		rtp->frames = hdr[len] & 0x0f;
+
+	stream->frames += rtp->frames;
+
+	if (!stream->packets++ || rtp->ssrc != stream->ssrc) {
+		rtp->resync = true;
+		goto done;
+	}
+
+	delta = rtp->seq - stream->seq;
+
+	/* Duplicated or reordered, only the latter was counted as lost */
+	if (!delta || delta > 0xffff - STREAM_MAX_MISORDER) {
+		rtp->late = true;
+		stream->late++;
+		if (delta && stream->lost)
+			stream->lost--;
+		return true;
+	}
+
+	/* Large jump, restart from it once the next packet follows it as
+	 * the sender may have restarted its sequence, RFC 3550 A.1
+	 */
+	if (delta >= STREAM_MAX_DROPOUT) {
+		rtp->resync = true;
+		if (stream->probation && rtp->seq == stream->probation_seq) {
+			stream->probation = false;
+			goto done;
+		}
+
+		stream->probation = true;
+		stream->probation_seq = rtp->seq + 1;
+		return true;
+	}
+
+	stream->probation = false;
+
+	rtp->lost = delta - 1;
+	stream->lost += rtp->lost;
+
+	rtp->interval = stream_tv_diff(tv, &stream->last);
+	if (rtp->interval >= STREAM_RESYNC_USEC) {
+		rtp->resync = true;
+		goto done;
+	}
+
+	if (stream->rate) {
+		uint32_t samples = rtp->ts - stream->ts;
+		int64_t d;
+
+		/* Difference of relative transit times, RFC 3550 A.8 */
+		rtp->transit = (int64_t) rtp->interval -
+				(int64_t) samples * 1000000 / stream->rate;
+		d = rtp->transit < 0 ? -rtp->transit : rtp->transit;
+
+		stream->jitter += d - ((stream->jitter + 8) >> 4);
+		stream->drift += rtp->transit;
+	}
+
+done:
+	stream->ssrc = rtp->ssrc;
+	stream->seq = rtp->seq;
+	stream->ts = rtp->ts;
+	stream->last = *tv;
+
+	return true;
+}
@@ -11,3 +11,49 @@
 bool a2dp_codec_cap(uint8_t codec, uint8_t losc, struct l2cap_frame *frame);
 
 bool a2dp_codec_cfg(uint8_t codec, uint8_t losc, struct l2cap_frame *frame);
+
+/* RTP media stream tracking, used by live decoding and by --analyze */
+struct a2dp_stream {
+	uint8_t codec;
+	bool rtp;
+	bool frame_count;
+	uint32_t rate;
+	uint32_t ssrc;
+	uint16_t seq;
+	uint16_t probation_seq;
+	bool probation;
+	uint32_t ts;
+	struct timeval last;
+	int64_t drift;
+	int64_t jitter;
+	unsigned long packets;
+	unsigned long lost;
+	unsigned long late;
+	unsigned long frames;
+};
+
+struct a2dp_rtp {
+	uint8_t pt;
+	bool marker;
+	uint16_t seq;
+	uint32_t ts;
+	uint32_t ssrc;
+	uint8_t frames;
+	uint16_t lost;
+	bool late;
+	bool resync;
+	uint64_t interval;
+	int64_t transit;
+};
+
+void a2dp_stream_init(struct a2dp_stream *stream, uint8_t codec,
+					const uint8_t *cfg, uint8_t len);
+bool a2dp_stream_packet(struct a2dp_stream *stream, const struct timeval *tv,
+				const void *data, uint16_t size,
+				struct a2dp_rtp *rtp);
+
+/* Interarrival jitter estimate in usec as defined by RFC 3550 */
+static inline uint64_t a2dp_stream_jitter(const struct a2dp_stream *stream)
+{
+	return stream->jitter >> 4;
+}
@@ -15,7 +15,9 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <sys/time.h>
 
 #include "lib/bluetooth.h"
@@ -23,11 +25,56 @@
 #include "src/shared/util.h"
 #include "src/shared/queue.h"
 #include "src/shared/btsnoop.h"
+#include "src/shared/att-types.h"
 #include "monitor/bt.h"
 #include "monitor/display.h"
 #include "monitor/packet.h"
+#include "monitor/l2cap.h"
+#include "monitor/a2dp.h"
 #include "monitor/analyze.h"
 
+/* Throughput is sampled over fixed windows of one second */
+#define THROUGHPUT_WINDOW	1000000
+
+/* Commands that never complete, e.g. when the trace misses the event,
+ * are dropped oldest first once this many are outstanding.
+ */
+#define CMD_PENDING_MAX		16
+
+#define AVDTP_PSM			0x0019
+#define AVDTP_SET_CONFIGURATION		0x03
+#define AVDTP_GET_CONFIGURATION		0x04
+#define AVDTP_RECONFIGURE		0x05
+#define AVDTP_MEDIA_CODEC		0x07
+
+/* Samples are kept in usec for latencies and in bit/s for throughput */
+struct stats {
+	uint64_t *val;
+	size_t num;
+	size_t alloc;
+	uint64_t sum;
+	bool sorted;
+};
+
+struct throughput {
+	struct timeval first;
+	struct timeval last;
+	struct timeval start;
+	uint64_t bytes;
+	uint64_t total;
+	struct stats windows;
+};
+
+struct hci_cmd {
+	uint16_t opcode;
+	struct timeval tv;
+};
+
+struct cmd_stats {
+	uint16_t opcode;
+	struct stats latency;
+};
+
 struct hci_dev {
 	uint16_t index;
 	uint8_t type;
@@ -47,6 +94,8 @@ struct hci_dev {
 	unsigned long unknown;
 	uint16_t manufacturer;
 	struct queue *conn_list;
+	struct queue *cmd_pending;
+	struct queue *cmd_list;
 };
 
 #define CONN_BR_ACL	0x01
@@ -56,6 +105,7 @@ struct hci_dev {
 #define CONN_LE_ISO	0x05
 
 struct hci_conn {
+	uint16_t index;
 	uint16_t handle;
 	uint8_t type;
 	uint8_t bdaddr[6];
@@ -64,35 +114,334 @@ struct hci_conn {
 	unsigned long rx_num;
 	unsigned long tx_num;
 	unsigned long tx_num_comp;
+	unsigned int tx_inflight_max;
 	size_t tx_bytes;
+	size_t rx_bytes;
 	struct queue *tx_queue;
-	struct timeval tx_lat_min;
-	struct timeval tx_lat_max;
-	struct timeval tx_lat_med;
+	struct stats tx_latency;
 	uint16_t tx_pkt_min;
 	uint16_t tx_pkt_max;
 	uint16_t tx_pkt_med;
+	struct throughput tx_rate;
+	struct throughput rx_rate;
+	struct timeval att_req[2];
+	struct stats att_rtt[2];
+	struct l2cap_chan *last_chan[2];
 	struct queue *chan_list;
+	uint8_t a2dp_codec;
+	uint8_t a2dp_cfg_len;
+	uint8_t a2dp_cfg[UINT8_MAX];
+	bool a2dp_cfg_valid;
+};
+
+struct a2dp_media {
+	struct a2dp_stream stream;
+	struct stats interval;
+	struct stats jitter;
+	struct throughput rate;
+	unsigned long packets;
+	uint8_t frames_min;
+	uint8_t frames_max;
 };
 
 struct l2cap_chan {
 	uint16_t cid;
 	uint16_t psm;
+	uint8_t seq_num;
 	bool out;
+	bool closed;
 	unsigned long num;
+	size_t bytes;
+	struct a2dp_media *media;
 };
 
 static struct queue *dev_list;
+static FILE *csv_file;
 
-static void chan_destroy(void *data)
+static uint64_t tv_diff(const struct timeval *a, const struct timeval *b)
+{
+	struct timeval res;
+
+	if (timercmp(a, b, <))
+		return 0;
+
+	timersub(a, b, &res);
+
+	return (uint64_t) res.tv_sec * 1000000 + res.tv_usec;
+}
+
+static void stats_add(struct stats *stats, uint64_t val)
+{
+	if (stats->num == stats->alloc) {
+		size_t alloc = stats->alloc ? stats->alloc * 2 : 64;
+		uint64_t *tmp;
+
+		tmp = realloc(stats->val, alloc * sizeof(*tmp));
+		if (!tmp)
+			return;
+
+		stats->val = tmp;
+		stats->alloc = alloc;
+	}
+
+	stats->val[stats->num++] = val;
+	stats->sum += val;
+	stats->sorted = false;
+}
+
+static int stats_compare(const void *a, const void *b)
+{
+	uint64_t val1 = *(const uint64_t *) a;
+	uint64_t val2 = *(const uint64_t *) b;
+
+	return val1 < val2 ? -1 : val1 > val2;
+}
+
+static void stats_sort(struct stats *stats)
+{
+	if (stats->sorted || !stats->num)
+		return;
+
+	qsort(stats->val, stats->num, sizeof(*stats->val), stats_compare);
+	stats->sorted = true;
+}
+
+/* Nearest-rank percentile, the samples need to be sorted */
+static uint64_t stats_percentile(const struct stats *stats,
+						unsigned int percent)
+{
+	size_t rank = (stats->num * percent + 99) / 100;
+
+	return stats->val[rank ? rank - 1 : 0];
+}
+
+static void stats_free(struct stats *stats)
+{
+	free(stats->val);
+}
+
+#define VAL_FMT "%" PRIu64 ".%03" PRIu64
+#define VAL_ARGS(val) (val) / 1000, (val) % 1000
+
+/* Prints latencies in msec or throughput in kbit/s */
+static void stats_print(const char *label, const char *unit,
+							struct stats *stats)
+{
+	if (!stats->num)
+		return;
+
+	stats_sort(stats);
+
+	print_field("%s: %zu samples", label, stats->num);
+	print_field("  min " VAL_FMT " avg " VAL_FMT " max " VAL_FMT " %s",
+					VAL_ARGS(stats->val[0]),
+					VAL_ARGS(stats->sum / stats->num),
+					VAL_ARGS(stats->val[stats->num - 1]),
+					unit);
+	print_field("  50th " VAL_FMT " 90th " VAL_FMT " 99th " VAL_FMT " %s",
+					VAL_ARGS(stats_percentile(stats, 50)),
+					VAL_ARGS(stats_percentile(stats, 90)),
+					VAL_ARGS(stats_percentile(stats, 99)),
+					unit);
+}
+
+static void stats_histogram(const char *label, const struct stats *stats)
+{
+	unsigned long bucket[12] = {};
+	size_t i;
+	int n;
+
+	if (!stats->num)
+		return;
+
+	/* Power of two buckets in msec, the last one is open ended */
+	for (i = 0; i < stats->num; i++) {
+		uint64_t msec = stats->val[i] / 1000;
+
+		for (n = 0; msec && n < 11; n++)
+			msec >>= 1;
+
+		bucket[n]++;
+	}
+
+	print_field("%s:", label);
+
+	for (n = 0; n < 12; n++) {
+		if (!bucket[n])
+			continue;
+
+		if (n == 0)
+			print_field("  0-1 msec: %lu", bucket[n]);
+		else if (n == 11)
+			print_field("  %u+ msec: %lu", 1u << (n - 1),
+							bucket[n]);
+		else
+			print_field("  %u-%u msec: %lu", 1u << (n - 1),
+							1u << n, bucket[n]);
+	}
+}
+
+/* Samples are sorted by stats_print() before they get exported */
+static void stats_csv(uint16_t index, int handle, const char *metric,
+				const char *key, const struct stats *stats)
+{
+	if (!csv_file || !stats->num)
+		return;
+
+	fprintf(csv_file, "%u,", index);
+
+	if (handle >= 0)
+		fprintf(csv_file, "%d", handle);
+
+	fprintf(csv_file, ",%s,%s,%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64
+				",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+				metric, key ? key : "", stats->num,
+				stats->val[0], stats->sum / stats->num,
+				stats_percentile(stats, 50),
+				stats_percentile(stats, 90),
+				stats_percentile(stats, 99),
+				stats->val[stats->num - 1]);
+}
+
+static void throughput_add(struct throughput *rate, const struct timeval *tv,
+								uint16_t size)
+{
+	uint64_t elapsed;
+
+	if (!timerisset(&rate->first)) {
+		rate->first = *tv;
+		rate->start = *tv;
+	}
+
+	elapsed = tv_diff(tv, &rate->start);
+	if (elapsed >= THROUGHPUT_WINDOW) {
+		struct timeval res;
+
+		/* Windows without any traffic are not sampled */
+		if (rate->bytes)
+			stats_add(&rate->windows, rate->bytes * 8 *
+					1000000 / THROUGHPUT_WINDOW);
+
+		elapsed -= elapsed % THROUGHPUT_WINDOW;
+		res.tv_sec = elapsed / 1000000;
+		res.tv_usec = elapsed % 1000000;
+		timeradd(&rate->start, &res, &rate->start);
+		rate->bytes = 0;
+	}
+
+	rate->bytes += size;
+	rate->total += size;
+	rate->last = *tv;
+}
+
+static void throughput_flush(struct throughput *rate)
+{
+	/* The last window is cut short by the end of the trace. It is sampled
+	 * like a full window, since scaling a tail of a few packets up to a
+	 * whole window would inflate the peak rates.
+	 */
+	if (rate->bytes)
+		stats_add(&rate->windows, rate->bytes * 8 *
+					1000000 / THROUGHPUT_WINDOW);
+
+	rate->bytes = 0;
+}
+
+static void throughput_print(const char *label, struct throughput *rate)
+{
+	uint64_t elapsed = tv_diff(&rate->last, &rate->first);
+
+	throughput_flush(rate);
+
+	if (!rate->total)
+		return;
+
+	if (elapsed)
+		print_field("%s throughput: " VAL_FMT " kbit/s over "
+				VAL_FMT " msec", label,
+				VAL_ARGS(rate->total * 8 * 1000000 / elapsed),
+				VAL_ARGS(elapsed));
+}
+
+static void media_print(struct hci_conn *conn, struct l2cap_chan *chan)
+{
+	struct a2dp_media *media = chan->media;
+	struct a2dp_stream *stream = &media->stream;
+	uint64_t jitter = a2dp_stream_jitter(stream);
+	char key[8];
+
+	printf("      A2DP media stream");
+	if (stream->rate)
+		printf(" at %u Hz", stream->rate);
+	printf("\n");
+
+	if (!stream->packets) {
+		printf("      %lu packets without RTP header\n",
+							media->packets);
+		throughput_print("Media", &media->rate);
+		return;
+	}
+
+	printf("      %lu RTP packets\n", stream->packets);
+	printf("      %lu lost packets\n", stream->lost);
+	printf("      %lu late packets\n", stream->late);
+
+	if (stream->frames)
+		printf("      %lu frames (%u-%u per packet)\n",
+					stream->frames, media->frames_min,
+					media->frames_max);
+
+	if (stream->rate) {
+		printf("      " VAL_FMT " msec jitter\n", VAL_ARGS(jitter));
+		printf("      %" PRId64 " usec clock drift\n", stream->drift);
+	}
+
+	throughput_print("Media", &media->rate);
+	stats_print("Media bitrate per second", "kbit/s",
+						&media->rate.windows);
+	stats_print("Packet interval", "msec", &media->interval);
+	stats_histogram("Packet interval histogram", &media->interval);
+	stats_print("Jitter", "msec", &media->jitter);
+
+	snprintf(key, sizeof(key), "%u", chan->cid);
+
+	stats_csv(conn->index, conn->handle, "a2dp_interval_us", key,
+							&media->interval);
+	stats_csv(conn->index, conn->handle, "a2dp_jitter_us", key,
+							&media->jitter);
+	stats_csv(conn->index, conn->handle, "a2dp_bitrate_bps", key,
+						&media->rate.windows);
+}
+
+static void chan_print(void *data, void *user_data)
 {
 	struct l2cap_chan *chan = data;
+	struct hci_conn *conn = user_data;
+	size_t total = chan->out ? conn->tx_bytes : conn->rx_bytes;
 
 	printf("    Found %s L2CAP channel with CID %u\n",
 					chan->out ? "TX" : "RX", chan->cid);
 	if (chan->psm)
 		printf("      PSM %u\n", chan->psm);
 	printf("      %lu packets\n", chan->num);
+	printf("      %zu octets (%zu%% of %s)\n", chan->bytes,
+					total ? chan->bytes * 100 / total : 0,
+					chan->out ? "TX" : "RX");
+
+	if (chan->media)
+		media_print(conn, chan);
+}
+
+static void chan_destroy(void *data)
+{
+	struct l2cap_chan *chan = data;
+
+	if (chan->media) {
+		stats_free(&chan->media->interval);
+		stats_free(&chan->media->jitter);
+		stats_free(&chan->media->rate.windows);
+		free(chan->media);
+	}
 
 	free(chan);
 }
@@ -164,6 +513,8 @@ static void conn_destroy(void *data)
 	if (conn->tx_num > 0)
 		conn->tx_pkt_med = conn->tx_bytes / conn->tx_num;
 
+	stats_sort(&conn->tx_latency);
+
 	printf("  Found %s connection with handle %u\n", str, conn->handle);
 	/* TODO: Store address type */
 	packet_print_addr("Address", conn->bdaddr, 0x00);
@@ -172,20 +523,46 @@ static void conn_destroy(void *data)
 	print_field("%lu RX packets", conn->rx_num);
 	print_field("%lu TX packets", conn->tx_num);
 	print_field("%lu TX completed packets", conn->tx_num_comp);
-	print_field("%ld msec min latency",
-			conn->tx_lat_min.tv_sec * 1000 +
-			conn->tx_lat_min.tv_usec / 1000);
-	print_field("%ld msec max latency",
-			conn->tx_lat_max.tv_sec * 1000 +
-			conn->tx_lat_max.tv_usec / 1000);
-	print_field("%ld msec median latency",
-			conn->tx_lat_med.tv_sec * 1000 +
-			conn->tx_lat_med.tv_usec / 1000);
+	print_field("%u TX packets max in flight", conn->tx_inflight_max);
+	print_field("%" PRIu64 " msec min latency", conn->tx_latency.num ?
+					conn->tx_latency.val[0] / 1000 : 0);
+	print_field("%" PRIu64 " msec max latency", conn->tx_latency.num ?
+		conn->tx_latency.val[conn->tx_latency.num - 1] / 1000 : 0);
+	print_field("%" PRIu64 " msec median latency", conn->tx_latency.num ?
+		stats_percentile(&conn->tx_latency, 50) / 1000 : 0);
 	print_field("%u octets TX min packet size", conn->tx_pkt_min);
 	print_field("%u octets TX max packet size", conn->tx_pkt_max);
 	print_field("%u octets TX median packet size", conn->tx_pkt_med);
+	stats_print("TX latency", "msec", &conn->tx_latency);
+	stats_histogram("TX latency histogram", &conn->tx_latency);
+	throughput_print("TX", &conn->tx_rate);
+	stats_print("TX throughput per second", "kbit/s",
+						&conn->tx_rate.windows);
+	throughput_print("RX", &conn->rx_rate);
+	stats_print("RX throughput per second", "kbit/s",
+						&conn->rx_rate.windows);
+	stats_print("ATT request round trip", "msec", &conn->att_rtt[1]);
+	stats_print("ATT response time", "msec", &conn->att_rtt[0]);
+
+	stats_csv(conn->index, conn->handle, "tx_latency_us", NULL,
+							&conn->tx_latency);
+	stats_csv(conn->index, conn->handle, "tx_throughput_bps", NULL,
+						&conn->tx_rate.windows);
+	stats_csv(conn->index, conn->handle, "rx_throughput_bps", NULL,
+						&conn->rx_rate.windows);
+	stats_csv(conn->index, conn->handle, "att_rtt_us", "tx",
+							&conn->att_rtt[1]);
+	stats_csv(conn->index, conn->handle, "att_rtt_us", "rx",
+							&conn->att_rtt[0]);
+
+	queue_foreach(conn->chan_list, chan_print, conn);
 	queue_destroy(conn->chan_list, chan_destroy);
 
+	stats_free(&conn->tx_latency);
+	stats_free(&conn->tx_rate.windows);
+	stats_free(&conn->rx_rate.windows);
+	stats_free(&conn->att_rtt[0]);
+	stats_free(&conn->att_rtt[1]);
 	queue_destroy(conn->tx_queue, free);
 	free(conn);
 }
@@ -197,6 +574,7 @@ static struct hci_conn *conn_alloc(struct hci_dev *dev, uint16_t handle,
 
 	conn = new0(struct hci_conn, 1);
 
+	conn->index = dev->index;
 	conn->handle = handle;
 	conn->type = type;
 	conn->tx_queue = queue_new();
@@ -235,6 +613,68 @@ static struct hci_conn *conn_lookup_type(struct hci_dev *dev, uint16_t handle,
 	return conn;
 }
 
+static void cmd_print(void *data, void *user_data)
+{
+	struct cmd_stats *cmd = data;
+	struct hci_dev *dev = user_data;
+	const char *str = packet_opcode_str(cmd->opcode);
+	char key[7];
+
+	printf("  Command %s (0x%2.2x|0x%4.4x)\n", str ? str : "Unknown",
+				cmd->opcode >> 10, cmd->opcode & 0x03ff);
+	stats_print("Latency", "msec", &cmd->latency);
+
+	snprintf(key, sizeof(key), "0x%4.4x", cmd->opcode);
+	stats_csv(dev->index, -1, "cmd_latency_us", key, &cmd->latency);
+}
+
+static void cmd_destroy(void *data)
+{
+	struct cmd_stats *cmd = data;
+
+	stats_free(&cmd->latency);
+	free(cmd);
+}
+
+static bool cmd_match_opcode(const void *a, const void *b)
+{
+	const struct cmd_stats *cmd = a;
+	uint16_t opcode = PTR_TO_UINT(b);
+
+	return cmd->opcode == opcode;
+}
+
+static bool pending_match_opcode(const void *a, const void *b)
+{
+	const struct hci_cmd *cmd = a;
+	uint16_t opcode = PTR_TO_UINT(b);
+
+	return cmd->opcode == opcode;
+}
+
+static void cmd_done(struct hci_dev *dev, struct timeval *tv,
+							uint16_t opcode)
+{
+	struct hci_cmd *pending;
+	struct cmd_stats *cmd;
+
+	pending = queue_remove_if(dev->cmd_pending, pending_match_opcode,
+							UINT_TO_PTR(opcode));
+	if (!pending)
+		return;
+
+	cmd = queue_find(dev->cmd_list, cmd_match_opcode,
+							UINT_TO_PTR(opcode));
+	if (!cmd) {
+		cmd = new0(struct cmd_stats, 1);
+		cmd->opcode = opcode;
+		queue_push_tail(dev->cmd_list, cmd);
+	}
+
+	stats_add(&cmd->latency, tv_diff(tv, &pending->tv));
+	free(pending);
+}
+
 static void dev_destroy(void *data)
 {
 	struct hci_dev *dev = data;
@@ -271,6 +711,9 @@ static void dev_destroy(void *data)
 	printf("  %lu user logs\n", dev->user_log);
 	printf("  %lu control messages \n", dev->ctrl_msg);
 	printf("  %lu unknown opcodes\n", dev->unknown);
+	queue_foreach(dev->cmd_list, cmd_print, dev);
+	queue_destroy(dev->cmd_list, cmd_destroy);
+	queue_destroy(dev->cmd_pending, free);
 	queue_destroy(dev->conn_list, conn_destroy);
 	printf("\n");
 
@@ -287,6 +730,8 @@ static struct hci_dev *dev_alloc(uint16_t index)
 	dev->manufacturer = 0xffff;
 
 	dev->conn_list = queue_new();
+	dev->cmd_pending = queue_new();
+	dev->cmd_list = queue_new();
 
 	return dev;
 }
@@ -312,31 +757,213 @@ static struct hci_dev *dev_lookup(uint16_t index)
 	return dev;
 }
 
+struct seq_num_data {
+	struct l2cap_chan *chan;
+	uint8_t seq_num;
+};
+
+static void chan_count_psm(void *data, void *user_data)
+{
+	struct l2cap_chan *chan = data;
+	struct seq_num_data *seq = user_data;
+
+	if (chan != seq->chan && !chan->closed && chan->out == seq->chan->out &&
+					chan->psm == seq->chan->psm)
+		seq->seq_num++;
+}
+
+/*
+ * Channels are tracked in the direction their data flows in, so the CID a
+ * side allocated for itself receives data sent by the remote side.
+ */
 static void l2cap_sig(struct hci_conn *conn, bool out,
 					const void *data, uint16_t size)
 {
 	const struct bt_l2cap_hdr_sig *hdr = data;
 	struct l2cap_chan *chan;
+	struct seq_num_data seq;
 	uint16_t psm, scid, dcid;
 
 	switch (hdr->code) {
 	case BT_L2CAP_PDU_CONN_REQ:
 		psm = get_le16(data + 4);
 		scid = get_le16(data + 6);
-		chan = chan_lookup(conn, scid, out);
-		if (chan)
+		chan = chan_lookup(conn, scid, !out);
+		if (chan) {
 			chan->psm = psm;
+			chan->closed = false;
+
+			/* Same numbering as used by the packet decoder */
+			seq.chan = chan;
+			seq.seq_num = 1;
+			queue_foreach(conn->chan_list, chan_count_psm, &seq);
+			chan->seq_num = seq.seq_num;
+		}
 		break;
 	case BT_L2CAP_PDU_CONN_RSP:
 		dcid = get_le16(data + 4);
 		scid = get_le16(data + 6);
-		chan = chan_lookup(conn, scid, !out);
-		if (chan) {
+		chan = chan_lookup(conn, scid, out);
+		if (chan && dcid) {
 			psm = chan->psm;
-			chan = chan_lookup(conn, dcid, out);
-			if (chan)
+			seq.seq_num = chan->seq_num;
+			chan = chan_lookup(conn, dcid, !out);
+			if (chan) {
 				chan->psm = psm;
+				chan->seq_num = seq.seq_num;
+				chan->closed = false;
+			}
+		}
+		break;
+	case BT_L2CAP_PDU_DISCONN_RSP:
+		dcid = get_le16(data + 4);
+		scid = get_le16(data + 6);
+		chan = chan_lookup(conn, dcid, !out);
+		if (chan)
+			chan->closed = true;
+		chan = chan_lookup(conn, scid, out);
+		if (chan)
+			chan->closed = true;
+		break;
+	}
+}
+
+/* Remembers the codec configuration for the next media channel */
+static void avdtp_sig(struct hci_conn *conn, const uint8_t *data,
+								uint16_t size)
+{
+	uint8_t cat, losc;
+
+	/* Fragmented signaling messages are not tracked */
+	if (size < 2 || data[0] & 0x0c)
+		return;
+
+	switch (data[1] & 0x3f) {
+	case AVDTP_SET_CONFIGURATION:
+		if ((data[0] & 0x03) || size < 4)
+			return;
+		data += 4;
+		size -= 4;
+		break;
+	case AVDTP_RECONFIGURE:
+		if ((data[0] & 0x03) || size < 3)
+			return;
+		data += 3;
+		size -= 3;
+		break;
+	case AVDTP_GET_CONFIGURATION:
+		/* Response accept */
+		if ((data[0] & 0x03) != 0x02)
+			return;
+		data += 2;
+		size -= 2;
+		break;
+	default:
+		return;
+	}
+
+	while (size >= 2) {
+		cat = data[0];
+		losc = data[1];
+
+		if (size < 2 + losc)
+			return;
+
+		if (cat == AVDTP_MEDIA_CODEC && losc >= 2) {
+			conn->a2dp_codec = data[3];
+			conn->a2dp_cfg_len = losc - 2;
+			memcpy(conn->a2dp_cfg, data + 4, losc - 2);
+			conn->a2dp_cfg_valid = true;
 		}
+
+		data += 2 + losc;
+		size -= 2 + losc;
+	}
+}
+
+static void a2dp_media_pkt(struct hci_conn *conn, struct l2cap_chan *chan,
+				struct timeval *tv, const void *data,
+				uint16_t size)
+{
+	struct a2dp_media *media = chan->media;
+	struct a2dp_rtp rtp;
+
+	if (!media) {
+		media = new0(struct a2dp_media, 1);
+
+		if (conn->a2dp_cfg_valid)
+			a2dp_stream_init(&media->stream, conn->a2dp_codec,
+						conn->a2dp_cfg,
+						conn->a2dp_cfg_len);
+		else
+			a2dp_stream_init(&media->stream, 0xff, NULL, 0);
+
+		chan->media = media;
+	}
+
+	media->packets++;
+
+	if (!a2dp_stream_packet(&media->stream, tv, data, size, &rtp))
+		return;
+
+	if (rtp.frames) {
+		if (!media->frames_min || rtp.frames < media->frames_min)
+			media->frames_min = rtp.frames;
+		if (rtp.frames > media->frames_max)
+			media->frames_max = rtp.frames;
+	}
+
+	if (rtp.late || rtp.resync)
+		return;
+
+	stats_add(&media->interval, rtp.interval);
+
+	if (media->stream.rate)
+		stats_add(&media->jitter, a2dp_stream_jitter(&media->stream));
+}
+
+static void att_pdu(struct hci_conn *conn, struct timeval *tv, bool out,
+					const uint8_t *data, uint16_t size)
+{
+	struct timeval *req;
+
+	switch (data[0]) {
+	case BT_ATT_OP_MTU_REQ:
+	case BT_ATT_OP_FIND_INFO_REQ:
+	case BT_ATT_OP_FIND_BY_TYPE_REQ:
+	case BT_ATT_OP_READ_BY_TYPE_REQ:
+	case BT_ATT_OP_READ_REQ:
+	case BT_ATT_OP_READ_BLOB_REQ:
+	case BT_ATT_OP_READ_MULT_REQ:
+	case BT_ATT_OP_READ_BY_GRP_TYPE_REQ:
+	case BT_ATT_OP_WRITE_REQ:
+	case BT_ATT_OP_PREP_WRITE_REQ:
+	case BT_ATT_OP_EXEC_WRITE_REQ:
+	case BT_ATT_OP_READ_MULT_VL_REQ:
+	case BT_ATT_OP_HANDLE_IND:
+		/* Only one request per direction can be outstanding */
+		conn->att_req[out] = *tv;
+		break;
+	case BT_ATT_OP_ERROR_RSP:
+	case BT_ATT_OP_MTU_RSP:
+	case BT_ATT_OP_FIND_INFO_RSP:
+	case BT_ATT_OP_FIND_BY_TYPE_RSP:
+	case BT_ATT_OP_READ_BY_TYPE_RSP:
+	case BT_ATT_OP_READ_RSP:
+	case BT_ATT_OP_READ_BLOB_RSP:
+	case BT_ATT_OP_READ_MULT_RSP:
+	case BT_ATT_OP_READ_BY_GRP_TYPE_RSP:
+	case BT_ATT_OP_WRITE_RSP:
+	case BT_ATT_OP_PREP_WRITE_RSP:
+	case BT_ATT_OP_EXEC_WRITE_RSP:
+	case BT_ATT_OP_READ_MULT_VL_RSP:
+	case BT_ATT_OP_HANDLE_CONF:
+		req = &conn->att_req[!out];
+		if (!timerisset(req))
+			break;
+
+		stats_add(&conn->att_rtt[!out], tv_diff(tv, req));
+		timerclear(req);
 		break;
 	}
 }
@@ -374,6 +1001,7 @@ static void command_pkt(struct timeval *tv, uint16_t index,
 {
 	const struct bt_hci_cmd_hdr *hdr = data;
 	struct hci_dev *dev;
+	struct hci_cmd *pending;
 
 	data += sizeof(*hdr);
 	size -= sizeof(*hdr);
@@ -384,6 +1012,14 @@ static void command_pkt(struct timeval *tv, uint16_t index,
 
 	dev->num_hci++;
 	dev->num_cmd++;
+
+	if (queue_length(dev->cmd_pending) >= CMD_PENDING_MAX)
+		free(queue_pop_head(dev->cmd_pending));
+
+	pending = new0(struct hci_cmd, 1);
+	pending->opcode = le16_to_cpu(hdr->opcode);
+	pending->tv = *tv;
+	queue_push_tail(dev->cmd_pending, pending);
 }
 
 static void evt_conn_complete(struct hci_dev *dev, struct timeval *tv,
@@ -447,6 +1083,8 @@ static void evt_cmd_complete(struct hci_dev *dev, struct timeval *tv,
 
 	opcode = le16_to_cpu(evt->opcode);
 
+	cmd_done(dev, tv, opcode);
+
 	switch (opcode) {
 	case BT_HCI_CMD_READ_BD_ADDR:
 		rsp_read_bd_addr(dev, tv, data, size);
@@ -454,6 +1092,14 @@ static void evt_cmd_complete(struct hci_dev *dev, struct timeval *tv,
 	}
 }
 
+static void evt_cmd_status(struct hci_dev *dev, struct timeval *tv,
+					const void *data, uint16_t size)
+{
+	const struct bt_hci_evt_cmd_status *evt = data;
+
+	cmd_done(dev, tv, le16_to_cpu(evt->opcode));
+}
+
 static void evt_num_completed_packets(struct hci_dev *dev, struct timeval *tv,
 					const void *data, uint16_t size)
 {
@@ -467,7 +1113,6 @@ static void evt_num_completed_packets(struct hci_dev *dev, struct timeval *tv,
 		uint16_t handle = get_le16(data);
 		uint16_t count = get_le16(data + 2);
 		struct hci_conn *conn;
-		struct timeval res;
 		struct timeval *last_tx;
 
 		data += 4;
@@ -479,41 +1124,51 @@ static void evt_num_completed_packets(struct hci_dev *dev, struct timeval *tv,
 
 		conn->tx_num_comp += count;
 
-		last_tx = queue_pop_head(conn->tx_queue);
-		if (last_tx) {
-			timersub(tv, last_tx, &res);
+		/* Each completed packet releases the oldest one in flight */
+		while (count--) {
+			last_tx = queue_pop_head(conn->tx_queue);
+			if (!last_tx)
+				break;
+
+			stats_add(&conn->tx_latency, tv_diff(tv, last_tx));
+			free(last_tx);
+		}
+	}
+}
+
+static void le_conn_setup(struct hci_dev *dev, uint8_t status,
+				uint16_t handle, const uint8_t *peer_addr)
+{
+	struct hci_conn *conn;
 
-			if ((!timerisset(&conn->tx_lat_min) ||
-					timercmp(&res, &conn->tx_lat_min, <)) &&
-					res.tv_sec >= 0 && res.tv_usec >= 0)
-				conn->tx_lat_min = res;
+	if (status)
+		return;
 
-			if (!timerisset(&conn->tx_lat_max) ||
-					timercmp(&res, &conn->tx_lat_max, >))
-				conn->tx_lat_max = res;
+	conn = conn_lookup_type(dev, handle, CONN_LE_ACL);
+	if (!conn)
+		return;
 
-			if (timerisset(&conn->tx_lat_med)) {
-				struct timeval tmp;
+	memcpy(conn->bdaddr, peer_addr, 6);
+	conn->setup_seen = true;
+}
 
-				timeradd(&conn->tx_lat_med, &res, &tmp);
+static void evt_le_conn_complete(struct hci_dev *dev, struct timeval *tv,
+					const void *data, uint16_t size)
+{
+	const struct bt_hci_evt_le_conn_complete *evt = data;
 
-				tmp.tv_sec /= 2;
-				tmp.tv_usec /= 2;
-				if (tmp.tv_sec % 2) {
-					tmp.tv_usec += 500000;
-					if (tmp.tv_usec >= 1000000) {
-						tmp.tv_sec++;
-						tmp.tv_usec -= 1000000;
-					}
-				}
+	le_conn_setup(dev, evt->status, le16_to_cpu(evt->handle),
+							evt->peer_addr);
+}
 
-				conn->tx_lat_med = tmp;
-			} else
-				conn->tx_lat_med = res;
+static void evt_le_enhanced_conn_complete(struct hci_dev *dev,
+					struct timeval *tv,
+					const void *data, uint16_t size)
+{
+	const struct bt_hci_evt_le_enhanced_conn_complete *evt = data;
 
-			free(last_tx);
-		}
-	}
+	le_conn_setup(dev, evt->status, le16_to_cpu(evt->handle),
+							evt->peer_addr);
 }
 
 static void evt_le_meta_event(struct hci_dev *dev, struct timeval *tv,
@@ -525,6 +1180,12 @@ static void evt_le_meta_event(struct hci_dev *dev, struct timeval *tv,
 	size -= sizeof(subtype);
 
 	switch (subtype) {
+	case BT_HCI_EVT_LE_CONN_COMPLETE:
+		evt_le_conn_complete(dev, tv, data, size);
+		break;
+	case BT_HCI_EVT_LE_ENHANCED_CONN_COMPLETE:
+		evt_le_enhanced_conn_complete(dev, tv, data, size);
+		break;
 	}
 }
 
@@ -554,6 +1215,9 @@ static void event_pkt(struct timeval *tv, uint16_t index,
 	case BT_HCI_EVT_CMD_COMPLETE:
 		evt_cmd_complete(dev, tv, data, size);
 		break;
+	case BT_HCI_EVT_CMD_STATUS:
+		evt_cmd_status(dev, tv, data, size);
+		break;
 	case BT_HCI_EVT_NUM_COMPLETED_PACKETS:
 		evt_num_completed_packets(dev, tv, data, size);
 		break;
@@ -582,7 +1246,9 @@ static void acl_pkt(struct timeval *tv, uint16_t index, bool out,
 	dev->num_hci++;
 	dev->num_acl++;
 
-	conn = conn_lookup_type(dev, le16_to_cpu(hdr->handle) & 0x0fff,
+	conn = conn_lookup(dev, le16_to_cpu(hdr->handle) & 0x0fff);
+	if (!conn)
+		conn = conn_lookup_type(dev, le16_to_cpu(hdr->handle) & 0x0fff,
 								CONN_BR_ACL);
 	if (!conn)
 		return;
@@ -592,13 +1258,36 @@ static void acl_pkt(struct timeval *tv, uint16_t index, bool out,
 	case 0x02:
 		cid = get_le16(data + 2);
 		chan = chan_lookup(conn, cid, out);
+		conn->last_chan[out] = chan;
 		if (chan)
 			chan->num++;
 		if (cid == 1)
 			l2cap_sig(conn, out, data + 4, size - 4);
+		else if (cid == 4 && size > 4)
+			att_pdu(conn, tv, out, data + 4, size - 4);
+		else if (chan && chan->psm == AVDTP_PSM && size > 4) {
+			if (chan->seq_num == 1)
+				avdtp_sig(conn, data + 4, size - 4);
+			else if (chan->seq_num > 1)
+				a2dp_media_pkt(conn, chan, tv, data + 4,
+								size - 4);
+		}
+		break;
+	case 0x01:
+		/* Continuation fragments belong to the last started PDU */
+		chan = conn->last_chan[out];
+		break;
+	default:
+		chan = NULL;
 		break;
 	}
 
+	if (chan)
+		chan->bytes += size;
+
+	if (chan && chan->media)
+		throughput_add(&chan->media->rate, tv, size);
+
 	if (out) {
 		struct timeval *last_tx;
 
@@ -607,6 +1296,10 @@ static void acl_pkt(struct timeval *tv, uint16_t index, bool out,
 		memcpy(last_tx, tv, sizeof(*tv));
 		queue_push_tail(conn->tx_queue, last_tx);
 		conn->tx_bytes += size;
+		throughput_add(&conn->tx_rate, tv, size);
+
+		if (queue_length(conn->tx_queue) > conn->tx_inflight_max)
+			conn->tx_inflight_max = queue_length(conn->tx_queue);
 
 		if (!conn->tx_pkt_min || size < conn->tx_pkt_min)
 			conn->tx_pkt_min = size;
@@ -614,6 +1307,8 @@ static void acl_pkt(struct timeval *tv, uint16_t index, bool out,
 			conn->tx_pkt_max = size;
 	} else {
 		conn->rx_num++;
+		conn->rx_bytes += size;
+		throughput_add(&conn->rx_rate, tv, size);
 	}
 }
 
@@ -727,7 +1422,7 @@ static void unknown_opcode(struct timeval *tv, uint16_t index,
 	dev->unknown++;
 }
 
-void analyze_trace(const char *path)
+void analyze_trace(const char *path, const char *csv_path)
 {
 	struct btsnoop *btsnoop_file;
 	unsigned long num_packets = 0;
@@ -749,6 +1444,17 @@ void analyze_trace(const char *path)
 		goto done;
 	}
 
+	if (csv_path) {
+		csv_file = fopen(csv_path, "w");
+		if (!csv_file) {
+			perror("Failed to open CSV file");
+			goto done;
+		}
+
+		fprintf(csv_file, "index,handle,metric,key,count,"
+					"min,avg,p50,p90,p99,max\n");
+	}
+
 	dev_list = queue_new();
 
 	while (1) {
@@ -820,6 +1526,11 @@ void analyze_trace(const char *path)
 
 	queue_destroy(dev_list, dev_destroy);
 
+	if (csv_file) {
+		fclose(csv_file);
+		csv_file = NULL;
+	}
+
 done:
 	btsnoop_unref(btsnoop_file);
 }
@@ -9,4 +9,4 @@
  *
  */
 
-void analyze_trace(const char *path);
+void analyze_trace(const char *path, const char *csv_path);
@@ -625,6 +625,20 @@ static const char *status2str(uint8_t status)
 	}
 }
 
+static const char *systemstatus2str(uint8_t status)
+{
+	switch (status) {
+	case 0x00:
+		return "POWER_ON";
+	case 0x01:
+		return "POWER_OFF";
+	case 0x02:
+		return "UNPLUGGED";
+	default:
+		return "UNKNOWN";
+	}
+}
+
 static const char *scope2str(uint8_t scope)
 {
 	switch (scope) {
@@ -773,6 +787,37 @@ static const char *elementtype2str(uint8_t type)
 	return "Reserved";
 }
 
+static bool print_string(struct l2cap_frame *frame, uint8_t indent,
+					const char *label, uint16_t len)
+{
+	char *str;
+	uint16_t i;
+	bool ret = true;
+
+	str = malloc(len + 1);
+	if (!str)
+		return false;
+
+	for (i = 0; i < len; i++) {
+		uint8_t c;
+
+		if (!l2cap_frame_get_u8(frame, &c)) {
+			ret = false;
+			break;
+		}
+
+		str[i] = isprint(c) ? c : '.';
+	}
+
+	str[i] = '\0';
+
+	print_field("%*c%s: %s", indent, ' ', label, str);
+
+	free(str);
+
+	return ret;
+}
+
 static bool avrcp_passthrough_packet(struct avctp_frame *avctp_frame,
 								uint8_t indent)
 {
@@ -1048,16 +1093,8 @@ response:
 
 		print_field("%*cStringLength: 0x%02x", (indent - 8), ' ', len);
 
-		printf("String: ");
-		for (; len > 0; len--) {
-			uint8_t c;
-
-			if (!l2cap_frame_get_u8(frame, &c))
-				return false;
-
-			printf("%1c", isprint(c) ? c : '.');
-		}
-		printf("\n");
+		if (!print_string(frame, indent - 8, "String", len))
+			return false;
 	}
 
 	return true;
@@ -1124,16 +1161,8 @@ response:
 
 		print_field("%*cStringLength: 0x%02x", (indent - 8), ' ', len);
 
-		printf("String: ");
-		for (; len > 0; len--) {
-			uint8_t c;
-
-			if (!l2cap_frame_get_u8(frame, &c))
-				return false;
-
-			printf("%1c", isprint(c) ? c : '.');
-		}
-		printf("\n");
+		if (!print_string(frame, indent - 8, "String", len))
+			return false;
 	}
 
 	return true;
@@ -1400,22 +1429,8 @@ response:
 		if (!l2cap_frame_get_u8(frame, &status))
 			return false;
 
-		print_field("%*cSystemStatus: 0x%02x ", (indent - 8),
-								' ', status);
-		switch (status) {
-		case 0x00:
-			printf("(POWER_ON)\n");
-			break;
-		case 0x01:
-			printf("(POWER_OFF)\n");
-			break;
-		case 0x02:
-			printf("(UNPLUGGED)\n");
-			break;
-		default:
-			printf("(UNKNOWN)\n");
-			break;
-		}
+		print_field("%*cSystemStatus: 0x%02x (%s)", (indent - 8),
+					' ', status, systemstatus2str(status));
 		break;
 	case AVRCP_EVENT_PLAYER_APPLICATION_SETTING_CHANGED:
 		if (!l2cap_frame_get_u8(frame, &status))
@@ -1848,6 +1863,7 @@ static bool avrcp_media_player_item(struct avctp_frame *avctp_frame,
 	uint8_t type, status, i;
 	uint32_t subtype;
 	uint8_t features[16];
+	char str[33];
 
 	if (!l2cap_frame_get_be16(frame, &id))
 		return false;
@@ -1872,16 +1888,14 @@ static bool avrcp_media_player_item(struct avctp_frame *avctp_frame,
 	print_field("%*cPlayStatus: 0x%02x (%s)", indent, ' ',
 						status, playstatus2str(status));
 
-	printf("%*cFeatures: 0x", indent+8, ' ');
-
 	for (i = 0; i < 16; i++) {
 		if (!l2cap_frame_get_u8(frame, &features[i]))
 			return false;
 
-		printf("%02x", features[i]);
+		sprintf(str + i * 2, "%02x", features[i]);
 	}
 
-	printf("\n");
+	print_field("%*cFeatures: 0x%s", indent, ' ', str);
 
 	print_features(features, indent + 2);
 
@@ -1897,15 +1911,8 @@ static bool avrcp_media_player_item(struct avctp_frame *avctp_frame,
 	print_field("%*cNameLength: 0x%04x (%u)", indent, ' ',
 						namelen, namelen);
 
-	printf("%*cName: ", indent+8, ' ');
-	for (; namelen > 0; namelen--) {
-		uint8_t c;
-
-		if (!l2cap_frame_get_u8(frame, &c))
-			return false;
-		printf("%1c", isprint(c) ? c : '.');
-	}
-	printf("\n");
+	if (!print_string(frame, indent, "Name", namelen))
+		return false;
 
 	return true;
 }
@@ -1919,7 +1926,7 @@ static bool avrcp_folder_item(struct avctp_frame *avctp_frame,
 	uint64_t uid;
 
 	if (frame->size < 14) {
-		printf("PDU Malformed\n");
+		print_field("%*cPDU Malformed", indent, ' ');
 		return false;
 	}
 
@@ -1953,15 +1960,8 @@ static bool avrcp_folder_item(struct avctp_frame *avctp_frame,
 	print_field("%*cNameLength: 0x%04x (%u)", indent, ' ',
 					namelen, namelen);
 
-	printf("%*cName: ", indent+8, ' ');
-	for (; namelen > 0; namelen--) {
-		uint8_t c;
-		if (!l2cap_frame_get_u8(frame, &c))
-			return false;
-
-		printf("%1c", isprint(c) ? c : '.');
-	}
-	printf("\n");
+	if (!print_string(frame, indent, "Name", namelen))
+		return false;
 
 	return true;
 }
@@ -1993,16 +1993,8 @@ static bool avrcp_attribute_entry_list(struct avctp_frame *avctp_frame,
 		print_field("%*cAttributeLength: 0x%04x (%u)", indent, ' ',
 						len, len);
 
-		printf("%*cAttributeValue: ", indent+8, ' ');
-		for (; len > 0; len--) {
-			uint8_t c;
-
-			if (!l2cap_frame_get_u8(frame, &c))
-				return false;
-
-			printf("%1c", isprint(c) ? c : '.');
-		}
-		printf("\n");
+		if (!print_string(frame, indent, "AttributeValue", len))
+			return false;
 	}
 
 	return true;
@@ -2040,15 +2032,8 @@ static bool avrcp_media_element_item(struct avctp_frame *avctp_frame,
 	print_field("%*cNameLength: 0x%04x (%u)", indent, ' ',
 					namelen, namelen);
 
-	printf("%*cName: ", indent+8, ' ');
-	for (; namelen > 0; namelen--) {
-		uint8_t c;
-		if (!l2cap_frame_get_u8(frame, &c))
-			return false;
-
-		printf("%1c", isprint(c) ? c : '.');
-	}
-	printf("\n");
+	if (!print_string(frame, indent, "Name", namelen))
+		return false;
 
 	if (!l2cap_frame_get_u8(frame, &count))
 		return false;
@@ -2096,7 +2081,7 @@ static bool avrcp_get_total_number_of_items(struct avctp_frame *avctp_frame)
 		goto response;
 
 	if (frame->size < 4) {
-		printf("PDU Malformed\n");
+		print_field("%*cPDU Malformed", indent, ' ');
 		packet_hexdump(frame->data, frame->size);
 		return false;
 	}
@@ -2145,7 +2130,7 @@ static bool avrcp_search_item(struct avctp_frame *avctp_frame)
 		goto response;
 
 	if (frame->size < 4) {
-		printf("PDU Malformed\n");
+		print_field("%*cPDU Malformed", indent, ' ');
 		packet_hexdump(frame->data, frame->size);
 		return false;
 	}
@@ -2161,17 +2146,8 @@ static bool avrcp_search_item(struct avctp_frame *avctp_frame)
 
 	print_field("%*cLength: 0x%04x (%u)", indent, ' ', namelen, namelen);
 
-	printf("%*cString: ", indent+8, ' ');
-	for (; namelen > 0; namelen--) {
-		uint8_t c;
-
-		if (!l2cap_frame_get_u8(frame, &c))
-			return false;
-
-		printf("%1c", isprint(c) ? c : '.');
-	}
-
-	printf("\n");
+	if (!print_string(frame, indent, "String", namelen))
+		return false;
 
 	return true;
 
@@ -2425,16 +2401,8 @@ response:
 			continue;
 		}
 
-		printf("%*cFolder: ", indent+8, ' ');
-		for (; len > 0; len--) {
-			uint8_t c;
-
-			if (!l2cap_frame_get_u8(frame, &c))
-				return false;
-
-			printf("%1c", isprint(c) ? c : '.');
-		}
-		printf("\n");
+		if (!print_string(frame, indent, "Folder", len))
+			return false;
 	}
 
 	return true;
@@ -16,10 +16,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "lib/bluetooth.h"
 
 #include "src/shared/util.h"
+#include "src/shared/queue.h"
 #include "bt.h"
 #include "packet.h"
 #include "display.h"
@@ -64,6 +66,26 @@ struct avdtp_frame {
 	struct l2cap_frame l2cap_frame;
 };
 
+/* Last media codec configuration seen on an ACL link */
+struct avdtp_config {
+	uint16_t index;
+	uint16_t handle;
+	uint8_t codec;
+	uint8_t len;
+	uint8_t data[UINT8_MAX];
+};
+
+struct avdtp_media {
+	uint16_t index;
+	uint16_t handle;
+	uint16_t cid;
+	bool in;
+	struct a2dp_stream stream;
+};
+
+static struct queue *config_list;
+static struct queue *media_list;
+
 static inline bool is_configuration_sig_id(uint8_t sig_id)
 {
 	return (sig_id == AVDTP_SET_CONFIGURATION) ||
@@ -269,6 +291,61 @@ static bool service_content_protection(struct avdtp_frame *avdtp_frame,
 	return true;
 }
 
+static bool config_match(const void *data, const void *match_data)
+{
+	const struct avdtp_config *config = data;
+	const struct l2cap_frame *frame = match_data;
+
+	return config->index == frame->index &&
+					config->handle == frame->handle;
+}
+
+static bool media_match_handle(const void *data, const void *match_data)
+{
+	const struct avdtp_media *media = data;
+	const struct l2cap_frame *frame = match_data;
+
+	return media->index == frame->index &&
+					media->handle == frame->handle;
+}
+
+static bool media_match(const void *data, const void *match_data)
+{
+	const struct avdtp_media *media = data;
+	const struct l2cap_frame *frame = match_data;
+
+	return media_match_handle(data, match_data) &&
+			media->cid == frame->cid && media->in == frame->in;
+}
+
+static void config_update(const struct l2cap_frame *frame, uint8_t codec,
+								uint8_t len)
+{
+	struct avdtp_config *config;
+
+	/* Truncated configuration, the codec decoder reports it */
+	if (frame->size < len)
+		return;
+
+	if (!config_list)
+		config_list = queue_new();
+
+	config = queue_find(config_list, config_match, frame);
+	if (!config) {
+		config = new0(struct avdtp_config, 1);
+		config->index = frame->index;
+		config->handle = frame->handle;
+		queue_push_tail(config_list, config);
+	}
+
+	config->codec = codec;
+	config->len = len;
+	memcpy(config->data, frame->data, len);
+
+	/* Streams get configured before their transport channel is used */
+	queue_remove_all(media_list, media_match_handle, (void *) frame, free);
+}
+
 static bool service_media_codec(struct avdtp_frame *avdtp_frame, uint8_t losc)
 {
 	struct l2cap_frame *frame = &avdtp_frame->l2cap_frame;
@@ -289,10 +366,12 @@ static bool service_media_codec(struct avdtp_frame *avdtp_frame, uint8_t losc)
 	print_field("%*cMedia Codec: %s (0x%02x)", 2, ' ',
 					mediacodec2str(codec), codec);
 
-	if (is_configuration_sig_id(avdtp_frame->sig_id))
+	if (is_configuration_sig_id(avdtp_frame->sig_id)) {
+		config_update(frame, codec, losc);
 		return a2dp_codec_cfg(codec, losc, frame);
-	else
+	} else {
 		return a2dp_codec_cap(codec, losc, frame);
+	}
 }
 
 static bool decode_capabilities(struct avdtp_frame *avdtp_frame)
@@ -748,6 +827,84 @@ static bool avdtp_signalling_packet(struct avdtp_frame *avdtp_frame)
 	return true;
 }
 
+static struct avdtp_media *media_lookup(const struct l2cap_frame *frame)
+{
+	struct avdtp_media *media;
+	struct avdtp_config *config;
+
+	if (!media_list)
+		media_list = queue_new();
+
+	media = queue_find(media_list, media_match, frame);
+	if (media)
+		return media;
+
+	media = new0(struct avdtp_media, 1);
+	media->index = frame->index;
+	media->handle = frame->handle;
+	media->cid = frame->cid;
+	media->in = frame->in;
+
+	config = queue_find(config_list, config_match, frame);
+	if (config)
+		a2dp_stream_init(&media->stream, config->codec, config->data,
+								config->len);
+	else
+		a2dp_stream_init(&media->stream, 0xff, NULL, 0);
+
+	queue_push_tail(media_list, media);
+
+	return media;
+}
+
+static void avdtp_media_packet(const struct l2cap_frame *frame)
+{
+	const struct timeval *tv = packet_get_time();
+	struct avdtp_media *media;
+	struct a2dp_stream *stream;
+	struct a2dp_rtp rtp;
+	uint64_t jitter;
+
+	if (!tv)
+		return;
+
+	media = media_lookup(frame);
+	stream = &media->stream;
+
+	if (!a2dp_stream_packet(stream, tv, frame->data, frame->size, &rtp))
+		return;
+
+	print_field("RTP: seq %u timestamp %u SSRC 0x%8.8x PT %u%s",
+					rtp.seq, rtp.ts, rtp.ssrc, rtp.pt,
+					rtp.marker ? " marker" : "");
+
+	if (rtp.frames)
+		print_field("Frames: %u", rtp.frames);
+
+	if (rtp.late) {
+		print_text(COLOR_WARN, "Late packet (%lu total)",
+							stream->late);
+		return;
+	}
+
+	if (rtp.lost)
+		print_text(COLOR_ERROR, "Lost %u packets (%lu total)",
+						rtp.lost, stream->lost);
+
+	if (rtp.resync)
+		return;
+
+	jitter = a2dp_stream_jitter(stream);
+
+	print_field("Interval: %" PRIu64 ".%03" PRIu64 " msec",
+				rtp.interval / 1000, rtp.interval % 1000);
+
+	if (stream->rate)
+		print_field("Jitter: %" PRIu64 ".%03" PRIu64 " msec "
+				"Drift: %" PRId64 " usec", jitter / 1000,
+				jitter % 1000, stream->drift);
+}
+
 void avdtp_packet(const struct l2cap_frame *frame)
 {
 	struct avdtp_frame avdtp_frame;
@@ -760,8 +917,10 @@ void avdtp_packet(const struct l2cap_frame *frame)
 		ret = avdtp_signalling_packet(&avdtp_frame);
 		break;
 	default:
-		if (packet_has_filter(PACKET_FILTER_SHOW_A2DP_STREAM))
+		if (packet_has_filter(PACKET_FILTER_SHOW_A2DP_STREAM)) {
+			avdtp_media_packet(frame);
 			packet_hexdump(frame->data, frame->size);
+		}
 		return;
 	}
 
@@ -21,14 +21,17 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <linux/filter.h>
+#include <linux/sock_diag.h>
 
 #include "lib/bluetooth.h"
 #include "lib/hci.h"
@@ -38,7 +41,9 @@
 #include "src/shared/btsnoop.h"
 #include "src/shared/mainloop.h"
 
+#include "bt.h"
 #include "display.h"
+#include "filter.h"
 #include "packet.h"
 #include "hcidump.h"
 #include "ellisys.h"
@@ -46,16 +51,48 @@
 #include "control.h"
 #include "jlink.h"
 
+/* Maximum time a buffered record may wait before reaching the file */
+#define WRITER_FLUSH_INTERVAL	1000
+
 static struct btsnoop *btsnoop_file = NULL;
+static int writer_flush_id = -1;
 static bool hcidump_fallback = false;
 static bool decode_control = true;
 static uint16_t filter_index = HCI_DEV_NONE;
+static int queue_size = 0;
+static unsigned long reader_first = 0;
+static unsigned long reader_last = ULONG_MAX;
+static struct timeval reader_offset;
+static bool reader_offset_set = false;
+static unsigned int reader_jobs = 1;
+
+/*
+ * Controllers tracked when looking for places to split a trace. Traces
+ * with a higher controller index are decoded sequentially.
+ */
+#define READER_MAX_INDEX	16
+
+/*
+ * Number of packets fetched from a channel socket per recvmmsg() call.
+ * This only saves syscall overhead per packet, decoding still dominates.
+ */
+#define RECV_BATCH	32
+
+struct recv_slot {
+	struct mgmt_hdr hdr;
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned char control[64];
+	struct iovec iov[2];
+};
 
 struct control_data {
 	uint16_t channel;
 	int fd;
 	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
 	uint16_t offset;
+	struct recv_slot *slots;
+	struct mmsghdr *msgs;
+	uint32_t drops;
 };
 
 static void free_data(void *user_data)
@@ -64,6 +101,8 @@ static void free_data(void *user_data)
 
 	close(data->fd);
 
+	free(data->slots);
+	free(data->msgs);
 	free(data);
 }
 
@@ -900,81 +939,140 @@ void control_message(uint16_t opcode, const void *data, uint16_t size)
 	}
 }
 
+static void update_drops(struct control_data *data)
+{
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len = sizeof(meminfo);
+
+	/* Packets the kernel could not queue because the socket was full */
+	if (getsockopt(data->fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) < 0)
+		return;
+
+	if (len <= SK_MEMINFO_DROPS * sizeof(uint32_t))
+		return;
+
+	if (meminfo[SK_MEMINFO_DROPS] == data->drops)
+		return;
+
+	if (use_json())
+		printf("{\"type\":\"drops\",\"drops\":%u}\n",
+				meminfo[SK_MEMINFO_DROPS] - data->drops);
+	else
+		printf("* Drops: %u packets\n",
+				meminfo[SK_MEMINFO_DROPS] - data->drops);
+
+	data->drops = meminfo[SK_MEMINFO_DROPS];
+}
+
+static void process_packet(struct control_data *data, struct recv_slot *slot,
+					struct msghdr *msg, unsigned int len)
+{
+	struct cmsghdr *cmsg;
+	struct timeval *tv = NULL;
+	struct timeval ctv;
+	struct ucred *cred = NULL;
+	struct ucred ccred;
+	uint16_t opcode, index, pktlen;
+
+	if (len < MGMT_HDR_SIZE)
+		return;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+				cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
+
+		if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+			memcpy(&ctv, CMSG_DATA(cmsg), sizeof(ctv));
+			tv = &ctv;
+		}
+
+		if (cmsg->cmsg_type == SCM_CREDENTIALS) {
+			memcpy(&ccred, CMSG_DATA(cmsg), sizeof(ccred));
+			cred = &ccred;
+		}
+	}
+
+	opcode = le16_to_cpu(slot->hdr.opcode);
+	index  = le16_to_cpu(slot->hdr.index);
+	pktlen = le16_to_cpu(slot->hdr.len);
+
+	switch (data->channel) {
+	case HCI_CHANNEL_CONTROL:
+		packet_control(tv, cred, index, opcode, slot->buf, pktlen);
+		break;
+	case HCI_CHANNEL_MONITOR:
+		if (!filter_packet(index, opcode, slot->buf, pktlen))
+			break;
+
+		btsnoop_write_hci(btsnoop_file, tv, index, opcode, data->drops,
+							slot->buf, pktlen);
+		ellisys_inject_hci(tv, index, opcode, slot->buf, pktlen);
+		packet_monitor(tv, cred, index, opcode, slot->buf, pktlen);
+		break;
+	}
+}
+
 static void data_callback(int fd, uint32_t events, void *user_data)
 {
 	struct control_data *data = user_data;
-	unsigned char control[64];
-	struct mgmt_hdr hdr;
-	struct msghdr msg;
-	struct iovec iov[2];
 
 	if (events & (EPOLLERR | EPOLLHUP)) {
 		mainloop_remove_fd(data->fd);
 		return;
 	}
 
-	iov[0].iov_base = &hdr;
-	iov[0].iov_len = MGMT_HDR_SIZE;
-	iov[1].iov_base = data->buf;
-	iov[1].iov_len = sizeof(data->buf);
-
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 2;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
-
 	while (1) {
-		struct cmsghdr *cmsg;
-		struct timeval *tv = NULL;
-		struct timeval ctv;
-		struct ucred *cred = NULL;
-		struct ucred ccred;
-		uint16_t opcode, index, pktlen;
-		ssize_t len;
+		int i, count;
+
+		/* The kernel overwrites the control length of each message */
+		for (i = 0; i < RECV_BATCH; i++)
+			data->msgs[i].msg_hdr.msg_controllen =
+					sizeof(data->slots[i].control);
 
-		len = recvmsg(data->fd, &msg, MSG_DONTWAIT);
-		if (len < 0)
+		count = recvmmsg(data->fd, data->msgs, RECV_BATCH,
+							MSG_DONTWAIT, NULL);
+		if (count <= 0)
 			break;
 
-		if (len < MGMT_HDR_SIZE)
+		update_drops(data);
+
+		for (i = 0; i < count; i++)
+			process_packet(data, &data->slots[i],
+						&data->msgs[i].msg_hdr,
+						data->msgs[i].msg_len);
+
+		/* Socket has been drained */
+		if (count < RECV_BATCH)
 			break;
+	}
+}
 
-		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
-					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-			if (cmsg->cmsg_level != SOL_SOCKET)
-				continue;
+static bool alloc_slots(struct control_data *data)
+{
+	int i;
 
-			if (cmsg->cmsg_type == SCM_TIMESTAMP) {
-				memcpy(&ctv, CMSG_DATA(cmsg), sizeof(ctv));
-				tv = &ctv;
-			}
+	data->slots = calloc(RECV_BATCH, sizeof(*data->slots));
+	data->msgs = calloc(RECV_BATCH, sizeof(*data->msgs));
+	if (!data->slots || !data->msgs)
+		return false;
 
-			if (cmsg->cmsg_type == SCM_CREDENTIALS) {
-				memcpy(&ccred, CMSG_DATA(cmsg), sizeof(ccred));
-				cred = &ccred;
-			}
-		}
+	for (i = 0; i < RECV_BATCH; i++) {
+		struct recv_slot *slot = &data->slots[i];
+		struct msghdr *msg = &data->msgs[i].msg_hdr;
 
-		opcode = le16_to_cpu(hdr.opcode);
-		index  = le16_to_cpu(hdr.index);
-		pktlen = le16_to_cpu(hdr.len);
+		slot->iov[0].iov_base = &slot->hdr;
+		slot->iov[0].iov_len = MGMT_HDR_SIZE;
+		slot->iov[1].iov_base = slot->buf;
+		slot->iov[1].iov_len = sizeof(slot->buf);
 
-		switch (data->channel) {
-		case HCI_CHANNEL_CONTROL:
-			packet_control(tv, cred, index, opcode,
-							data->buf, pktlen);
-			break;
-		case HCI_CHANNEL_MONITOR:
-			btsnoop_write_hci(btsnoop_file, tv, index, opcode, 0,
-							data->buf, pktlen);
-			ellisys_inject_hci(tv, index, opcode,
-							data->buf, pktlen);
-			packet_monitor(tv, cred, index, opcode,
-							data->buf, pktlen);
-			break;
-		}
+		msg->msg_iov = slot->iov;
+		msg->msg_iovlen = 2;
+		msg->msg_control = slot->control;
+		msg->msg_controllen = sizeof(slot->control);
 	}
+
+	return true;
 }
 
 static int open_socket(uint16_t channel)
@@ -1017,6 +1115,13 @@ static int open_socket(uint16_t channel)
 		return -1;
 	}
 
+	/* The forced variant allows exceeding rmem_max when privileged */
+	if (queue_size && setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE,
+				&queue_size, sizeof(queue_size)) < 0 &&
+			setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+				&queue_size, sizeof(queue_size)) < 0)
+		perror("Failed to set receive queue size");
+
 	return fd;
 }
 
@@ -1062,8 +1167,17 @@ static int open_channel(uint16_t channel)
 	memset(data, 0, sizeof(*data));
 	data->channel = channel;
 
+	if (!alloc_slots(data)) {
+		free(data->slots);
+		free(data->msgs);
+		free(data);
+		return -1;
+	}
+
 	data->fd = open_socket(channel);
 	if (data->fd < 0) {
+		free(data->slots);
+		free(data->msgs);
 		free(data);
 		return -1;
 	}
@@ -1074,6 +1188,8 @@ static int open_channel(uint16_t channel)
 	if (mainloop_add_fd(data->fd, EPOLLIN, data_callback,
 						data, free_data) < 0) {
 		close(data->fd);
+		free(data->slots);
+		free(data->msgs);
 		free(data);
 		return -1;
 	};
@@ -1109,7 +1225,9 @@ static void client_callback(int fd, uint32_t events, void *user_data)
 		opcode = le16_to_cpu(hdr->opcode);
 		index = le16_to_cpu(hdr->index);
 
-		packet_monitor(NULL, NULL, index, opcode,
+		if (filter_packet(index, opcode, data->buf + MGMT_HDR_SIZE,
+								pktlen))
+			packet_monitor(NULL, NULL, index, opcode,
 					data->buf + MGMT_HDR_SIZE, pktlen);
 
 		data->offset -= pktlen + MGMT_HDR_SIZE;
@@ -1141,7 +1259,8 @@ static void server_accept_callback(int fd, uint32_t events, void *user_data)
 		return;
 	}
 
-	printf("--- New monitor connection ---\n");
+	if (!use_json())
+		printf("--- New monitor connection ---\n");
 
 	data = malloc(sizeof(*data));
 	if (!data) {
@@ -1287,9 +1406,16 @@ static bool tty_parse_header(uint8_t *hdr, uint8_t len, struct timeval **tv,
 
 	if (total) {
 		*drops += total;
-		printf("* Drops: cmd %u evt %u acl_tx %u acl_rx %u sco_tx %u "
-			"sco_rx %u other %u\n", cmd, evt, acl_tx, acl_rx,
-			sco_tx, sco_rx, other);
+		if (use_json())
+			printf("{\"type\":\"drops\",\"drops\":%u,"
+				"\"cmd\":%u,\"evt\":%u,"
+				"\"acl_tx\":%u,\"acl_rx\":%u,\"sco_tx\":%u,"
+				"\"sco_rx\":%u,\"other\":%u}\n", total, cmd,
+				evt, acl_tx, acl_rx, sco_tx, sco_rx, other);
+		else
+			printf("* Drops: cmd %u evt %u acl_tx %u acl_rx %u "
+				"sco_tx %u sco_rx %u other %u\n", cmd, evt,
+				acl_tx, acl_rx, sco_tx, sco_rx, other);
 	}
 
 	return true;
@@ -1323,12 +1449,15 @@ static void process_data(struct control_data *data)
 		opcode = le16_to_cpu(hdr->opcode);
 		pktlen = data_len - 4 - hdr->hdr_len;
 
-		btsnoop_write_hci(btsnoop_file, tv, 0, opcode, drops,
+		if (filter_packet(0, opcode, hdr->ext_hdr + hdr->hdr_len,
+								pktlen)) {
+			btsnoop_write_hci(btsnoop_file, tv, 0, opcode, drops,
 					hdr->ext_hdr + hdr->hdr_len, pktlen);
-		ellisys_inject_hci(tv, 0, opcode, hdr->ext_hdr + hdr->hdr_len,
-					pktlen);
-		packet_monitor(tv, NULL, 0, opcode,
+			ellisys_inject_hci(tv, 0, opcode,
 					hdr->ext_hdr + hdr->hdr_len, pktlen);
+			packet_monitor(tv, NULL, 0, opcode,
+					hdr->ext_hdr + hdr->hdr_len, pktlen);
+		}
 
 		data->offset -= 2 + data_len;
 
@@ -1394,7 +1523,8 @@ int control_tty(const char *path, unsigned int speed)
 		return err;
 	}
 
-	printf("--- %s opened ---\n", path);
+	if (!use_json())
+		printf("--- %s opened ---\n", path);
 
 	data = malloc(sizeof(*data));
 	if (!data) {
@@ -1451,7 +1581,8 @@ int control_rtt(char *jlink, char *rtt)
 		return -ENODEV;
 	}
 
-	printf("--- RTT opened ---\n");
+	if (!use_json())
+		printf("--- RTT opened ---\n");
 
 	data = new0(struct control_data, 1);
 	data->channel = HCI_CHANNEL_MONITOR;
@@ -1465,16 +1596,433 @@ int control_rtt(char *jlink, char *rtt)
 	return 0;
 }
 
-bool control_writer(const char *path)
+static void writer_flush(int id, void *user_data)
+{
+	btsnoop_flush(btsnoop_file);
+
+	mainloop_modify_timeout(id, WRITER_FLUSH_INTERVAL);
+}
+
+bool control_writer(const char *path, size_t buffer_size)
 {
 	btsnoop_file = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_MONITOR);
+	if (!btsnoop_file)
+		return false;
+
+	if (!buffer_size)
+		return true;
+
+	if (!btsnoop_set_buffer_size(btsnoop_file, buffer_size)) {
+		btsnoop_unref(btsnoop_file);
+		btsnoop_file = NULL;
+		return false;
+	}
+
+	writer_flush_id = mainloop_add_timeout(WRITER_FLUSH_INTERVAL,
+						writer_flush, NULL, NULL);
+
+	return true;
+}
+
+void control_cleanup(void)
+{
+	if (writer_flush_id >= 0) {
+		mainloop_remove_timeout(writer_flush_id);
+		writer_flush_id = -1;
+	}
+
+	/* Writes out any buffered records */
+	btsnoop_unref(btsnoop_file);
+	btsnoop_file = NULL;
+}
+
+static bool is_index_opcode(uint16_t opcode)
+{
+	switch (opcode) {
+	case BTSNOOP_OPCODE_NEW_INDEX:
+	case BTSNOOP_OPCODE_DEL_INDEX:
+	case BTSNOOP_OPCODE_OPEN_INDEX:
+	case BTSNOOP_OPCODE_CLOSE_INDEX:
+	case BTSNOOP_OPCODE_INDEX_INFO:
+		return true;
+	}
+
+	return false;
+}
+
+static bool is_frame_opcode(uint16_t opcode)
+{
+	switch (opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+	case BTSNOOP_OPCODE_EVENT_PKT:
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		return true;
+	}
+
+	return false;
+}
+
+static unsigned long reader_start(void)
+{
+	struct timeval tv;
+	unsigned long first = reader_first;
+	unsigned long i;
+
+	if (reader_offset_set) {
+		btsnoop_get_record(btsnoop_file, 0, &tv, NULL, NULL);
+		timeradd(&tv, &reader_offset, &tv);
+
+		i = btsnoop_find_record(btsnoop_file, &tv);
+		if (i > first)
+			first = i;
+	}
+
+	return first;
+}
+
+static void reader_decode(unsigned long record)
+{
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	uint16_t index, opcode, pktlen;
+
+	if (!btsnoop_seek(btsnoop_file, record) ||
+			!btsnoop_read_hci(btsnoop_file, &tv, &index,
+						&opcode, buf, &pktlen))
+		return;
+
+	if (filter_packet(index, opcode, buf, pktlen))
+		packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
+}
+
+/* Feed a skipped record to the filter so it knows the connections */
+static void reader_track(unsigned long record)
+{
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	uint16_t index, opcode, pktlen;
+
+	if (!btsnoop_seek(btsnoop_file, record) ||
+			!btsnoop_read_hci(btsnoop_file, &tv, &index,
+						&opcode, buf, &pktlen))
+		return;
+
+	filter_packet(index, opcode, buf, pktlen);
+}
+
+/* Replay controller lifetime records so skipped indexes are known */
+static void reader_replay(unsigned long end)
+{
+	unsigned long i;
+	uint16_t opcode;
+
+	for (i = 0; i < end; i++) {
+		if (!btsnoop_get_record(btsnoop_file, i, NULL, NULL, &opcode))
+			break;
+
+		if (is_index_opcode(opcode))
+			reader_decode(i);
+		else if (filter_active())
+			reader_track(i);
+	}
+}
+
+static bool reader_seek(unsigned long *first)
+{
+	if (!btsnoop_get_record_count(btsnoop_file)) {
+		fprintf(stderr, "Seeking not supported for this file\n");
+		return false;
+	}
+
+	*first = reader_start();
+
+	reader_replay(*first);
+
+	return btsnoop_seek(btsnoop_file, *first);
+}
+
+static void reader_track_conn(unsigned int *conns, const uint8_t *data,
+								uint16_t size)
+{
+	if (size < 3)
+		return;
+
+	switch (data[0]) {
+	case BT_HCI_EVT_CONN_COMPLETE:
+	case BT_HCI_EVT_SYNC_CONN_COMPLETE:
+		if (!data[2])
+			(*conns)++;
+		break;
+	case BT_HCI_EVT_DISCONNECT_COMPLETE:
+		if (!data[2] && *conns)
+			(*conns)--;
+		break;
+	case BT_HCI_EVT_LE_META_EVENT:
+		if (size < 4)
+			return;
+
+		switch (data[2]) {
+		case BT_HCI_EVT_LE_CONN_COMPLETE:
+		case BT_HCI_EVT_LE_ENHANCED_CONN_COMPLETE:
+		case BT_HCI_EVT_LE_CIS_ESTABLISHED:
+			if (!data[3])
+				(*conns)++;
+			break;
+		}
+		break;
+	}
+}
+
+/*
+ * Split the records between first and last into chunks of about the same
+ * size. L2CAP reassembly and ATT state only live as long as a connection,
+ * so chunks only start at records where no connection is up.
+ */
+static unsigned int reader_split(unsigned long first, unsigned long last,
+						unsigned long *bounds)
+{
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned int conns[READER_MAX_INDEX];
+	bool untracked[READER_MAX_INDEX];
+	unsigned int chunks = 1;
+	unsigned long i;
+
+	memset(conns, 0, sizeof(conns));
+	memset(untracked, 0, sizeof(untracked));
+
+	for (i = 0; i < last && chunks < reader_jobs; i++) {
+		struct timeval tv;
+		uint16_t index, opcode, pktlen;
+		unsigned int j, open = 0;
+
+		for (j = 0; j < READER_MAX_INDEX; j++)
+			open += conns[j] + untracked[j];
+
+		if (!open && i > bounds[chunks - 1] && i >= first +
+				(last - first) * chunks / reader_jobs)
+			bounds[chunks++] = i;
+
+		if (!btsnoop_get_record(btsnoop_file, i, NULL, &index,
+								&opcode))
+			break;
+
+		if (index == HCI_DEV_NONE)
+			continue;
+
+		/* Connections on other controllers can't be tracked */
+		if (index >= READER_MAX_INDEX)
+			return 1;
+
+		switch (opcode) {
+		case BTSNOOP_OPCODE_DEL_INDEX:
+			conns[index] = 0;
+			untracked[index] = false;
+			continue;
+		case BTSNOOP_OPCODE_ACL_TX_PKT:
+		case BTSNOOP_OPCODE_ACL_RX_PKT:
+		case BTSNOOP_OPCODE_SCO_TX_PKT:
+		case BTSNOOP_OPCODE_SCO_RX_PKT:
+		case BTSNOOP_OPCODE_ISO_TX_PKT:
+		case BTSNOOP_OPCODE_ISO_RX_PKT:
+			/* Data without a known connection means the trace
+			 * started with connections already up, so their end
+			 * can't be told until the controller goes away.
+			 */
+			if (!conns[index])
+				untracked[index] = true;
+			continue;
+		case BTSNOOP_OPCODE_EVENT_PKT:
+			break;
+		default:
+			continue;
+		}
+
+		if (!btsnoop_seek(btsnoop_file, i) ||
+				!btsnoop_read_hci(btsnoop_file, &tv, &index,
+							&opcode, buf, &pktlen))
+			break;
+
+		reader_track_conn(&conns[index], buf, pktlen);
+	}
+
+	bounds[chunks] = last;
+
+	return chunks;
+}
+
+static void reader_worker(unsigned long first, unsigned long start,
+					unsigned long end, int fd)
+{
+	unsigned long frames[READER_MAX_INDEX];
+	unsigned long i;
+	struct timeval tv;
+	uint16_t index, opcode;
+	int null_fd;
+
+	/*
+	 * Later chunks silently rebuild the state the sequential decoder
+	 * would have at their start: the time offset base, known
+	 * controllers and the per controller frame numbers.
+	 */
+	if (start > first) {
+		null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		if (null_fd >= 0) {
+			dup2(null_fd, STDOUT_FILENO);
+			close(null_fd);
+		}
+
+		/* Time offsets are relative to the first record shown */
+		for (i = 0; i < first; i++) {
+			if (btsnoop_get_record(btsnoop_file, i, NULL, NULL,
+							&opcode) &&
+						is_index_opcode(opcode))
+				break;
+		}
+
+		if (btsnoop_get_record(btsnoop_file, i, &tv, NULL, NULL))
+			packet_set_time_offset(tv.tv_sec);
+
+		reader_replay(start);
+
+		memset(frames, 0, sizeof(frames));
+
+		for (i = first; i < start; i++) {
+			if (!btsnoop_get_record(btsnoop_file, i, NULL, &index,
+								&opcode))
+				break;
+
+			if (index < READER_MAX_INDEX && is_frame_opcode(opcode))
+				frames[index]++;
+		}
+
+		for (i = 0; i < READER_MAX_INDEX; i++)
+			packet_set_frame(i, frames[i]);
+
+		fflush(stdout);
+		dup2(fd, STDOUT_FILENO);
+	} else {
+		dup2(fd, STDOUT_FILENO);
+		reader_replay(start);
+	}
+
+	for (i = start; i < end; i++) {
+		if (btsnoop_get_record(btsnoop_file, i, NULL, NULL, &opcode) &&
+							opcode != 0xffff)
+			reader_decode(i);
+	}
 
-	return !!btsnoop_file;
+	fflush(stdout);
+}
+
+static bool reader_parallel(void)
+{
+	unsigned long count, first, last;
+	unsigned long *bounds;
+	unsigned int chunks, i;
+	FILE **files;
+	pid_t *pids;
+
+	/* Frame numbers only count packets passing the filter */
+	if (filter_active())
+		return false;
+
+	count = btsnoop_get_record_count(btsnoop_file);
+	if (!count)
+		return false;
+
+	first = reader_start();
+	last = reader_last < count ? reader_last + 1 : count;
+	if (first >= last)
+		return false;
+
+	bounds = calloc(reader_jobs + 1, sizeof(*bounds));
+	files = calloc(reader_jobs, sizeof(*files));
+	pids = calloc(reader_jobs, sizeof(*pids));
+	if (!bounds || !files || !pids)
+		goto failed;
+
+	bounds[0] = first;
+
+	chunks = reader_split(first, last, bounds);
+	if (chunks < 2)
+		goto failed;
+
+	/* Workers inherit the decisions made for the real output */
+	use_color();
+	num_columns();
+	fflush(stdout);
+
+	for (i = 0; i < chunks; i++) {
+		files[i] = tmpfile();
+		if (!files[i])
+			break;
+
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			fclose(files[i]);
+			files[i] = NULL;
+			break;
+		}
+
+		if (pids[i] == 0) {
+			reader_worker(first, bounds[i], bounds[i + 1],
+							fileno(files[i]));
+			_exit(EXIT_SUCCESS);
+		}
+	}
+
+	/* Chunks that could not be started are reported when merging */
+	for (; i < chunks; i++) {
+		files[i] = NULL;
+		pids[i] = 0;
+	}
+
+	for (i = 0; i < chunks; i++) {
+		char buf[8192];
+		size_t len;
+
+		if (!files[i]) {
+			fprintf(stderr, "Failed to start decoder for records "
+					"%lu-%lu\n", bounds[i] + 1, bounds[i + 1]);
+			continue;
+		}
+
+		waitpid(pids[i], NULL, 0);
+
+		rewind(files[i]);
+
+		while ((len = fread(buf, 1, sizeof(buf), files[i])) > 0)
+			fwrite(buf, 1, len, stdout);
+
+		fclose(files[i]);
+	}
+
+	free(bounds);
+	free(files);
+	free(pids);
+
+	return true;
+
+failed:
+	free(bounds);
+	free(files);
+	free(pids);
+
+	/* Splitting reads ahead, so rewind for the sequential decoder */
+	btsnoop_seek(btsnoop_file, 0);
+
+	return false;
 }
 
 void control_reader(const char *path, bool pager)
 {
 	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned long record = reader_first;
 	uint16_t pktlen;
 	uint32_t format;
 	struct timeval tv;
@@ -1504,7 +2052,14 @@ void control_reader(const char *path, bool pager)
 	case BTSNOOP_FORMAT_HCI:
 	case BTSNOOP_FORMAT_UART:
 	case BTSNOOP_FORMAT_MONITOR:
-		while (1) {
+		if (reader_jobs > 1 && reader_parallel())
+			break;
+
+		if ((reader_first || reader_offset_set) &&
+						!reader_seek(&record))
+			break;
+
+		while (record++ <= reader_last) {
 			uint16_t index, opcode;
 
 			if (!btsnoop_read_hci(btsnoop_file, &tv, &index,
@@ -1514,6 +2069,9 @@ void control_reader(const char *path, bool pager)
 			if (opcode == 0xffff)
 				continue;
 
+			if (!filter_packet(index, opcode, buf, pktlen))
+				continue;
+
 			packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
 			ellisys_inject_hci(&tv, index, opcode, buf, pktlen);
 		}
@@ -1532,6 +2090,8 @@ void control_reader(const char *path, bool pager)
 		break;
 	}
 
+	json_flush();
+
 	if (pager)
 		close_pager();
 
@@ -1568,3 +2128,25 @@ void control_filter_index(uint16_t index)
 {
 	filter_index = index;
 }
+
+void control_set_queue_size(int size)
+{
+	queue_size = size;
+}
+
+void control_set_records(unsigned long first, unsigned long last)
+{
+	reader_first = first;
+	reader_last = last;
+}
+
+void control_set_time_offset(const struct timeval *offset)
+{
+	reader_offset = *offset;
+	reader_offset_set = true;
+}
+
+void control_set_jobs(unsigned int jobs)
+{
+	reader_jobs = jobs;
+}
@@ -10,8 +10,10 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
 
-bool control_writer(const char *path);
+bool control_writer(const char *path, size_t buffer_size);
 void control_reader(const char *path, bool pager);
 void control_server(const char *path);
 int control_tty(const char *path, unsigned int speed);
@@ -19,5 +21,10 @@ int control_rtt(char *jlink, char *rtt);
 int control_tracing(void);
 void control_disable_decoding(void);
 void control_filter_index(uint16_t index);
+void control_set_queue_size(int size);
+void control_set_records(unsigned long first, unsigned long last);
+void control_set_time_offset(const struct timeval *offset);
+void control_set_jobs(unsigned int jobs);
+void control_cleanup(void);
 
 void control_message(uint16_t opcode, const void *data, uint16_t size);
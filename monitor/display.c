@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/prctl.h>
@@ -50,6 +51,325 @@ bool use_color(void)
 	return cached_use_color;
 }
 
+enum json_type {
+	JSON_NONE,
+	JSON_UINT,
+	JSON_INT,
+	JSON_STR,
+};
+
+static bool json_output;
+static bool json_open;
+static unsigned int json_fields;
+
+/*
+ * A record is built up in memory and written out with a single call when
+ * it is closed, instead of going through stdio for every piece of it.
+ */
+static char *json_buf;
+static size_t json_len;
+static size_t json_size;
+
+/* Typed value given by the decoder for the next decode line */
+static struct {
+	enum json_type type;
+	const char *name;
+	uint64_t u;
+	int64_t i;
+	const char *str;
+} json_value;
+
+void set_json_output(bool enable)
+{
+	json_output = enable;
+}
+
+bool use_json(void)
+{
+	return json_output;
+}
+
+static char *json_reserve(size_t len)
+{
+	if (json_len + len > json_size) {
+		size_t size = json_size ? json_size : 4096;
+		char *buf;
+
+		while (size < json_len + len)
+			size *= 2;
+
+		buf = realloc(json_buf, size);
+		if (!buf)
+			return NULL;
+
+		json_buf = buf;
+		json_size = size;
+	}
+
+	return json_buf + json_len;
+}
+
+static void json_put(const char *str, size_t len)
+{
+	char *buf = json_reserve(len);
+
+	if (!buf)
+		return;
+
+	memcpy(buf, str, len);
+	json_len += len;
+}
+
+#define json_put_str(str) json_put(str, sizeof(str) - 1)
+
+static void json_put_uint(uint64_t val)
+{
+	char str[20];
+	size_t len = sizeof(str);
+
+	do {
+		str[--len] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	json_put(str + len, sizeof(str) - len);
+}
+
+static void json_put_int(int64_t val)
+{
+	if (val < 0) {
+		json_put_str("-");
+		json_put_uint(-(uint64_t) val);
+	} else
+		json_put_uint(val);
+}
+
+static void json_put_string(const char *str, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *buf, *out;
+	size_t i;
+
+	buf = json_reserve(len * 6 + 2);
+	if (!buf)
+		return;
+
+	out = buf;
+	*out++ = '"';
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = str[i];
+
+		switch (c) {
+		case '"':
+		case '\\':
+			*out++ = '\\';
+			*out++ = c;
+			break;
+		case '\n':
+			*out++ = '\\';
+			*out++ = 'n';
+			break;
+		case '\t':
+			*out++ = '\\';
+			*out++ = 't';
+			break;
+		default:
+			if (c < 0x20 || c == 0x7f) {
+				memcpy(out, "\\u00", 4);
+				out[4] = hex[c >> 4];
+				out[5] = hex[c & 0x0f];
+				out += 6;
+			} else
+				*out++ = c;
+			break;
+		}
+	}
+
+	*out++ = '"';
+	json_len += out - buf;
+}
+
+static void json_put_name(const char *name)
+{
+	json_put_str(",\"");
+	json_put(name, strlen(name));
+	json_put_str("\":");
+}
+
+static void json_begin(void)
+{
+	json_flush();
+
+	json_put_str("{");
+	json_open = true;
+	json_fields = 0;
+	json_value.type = JSON_NONE;
+}
+
+void json_print_packet(const struct timeval *tv, uint16_t index)
+{
+	char usec[7];
+
+	json_begin();
+	json_put_str("\"ts\":");
+
+	if (tv) {
+		snprintf(usec, sizeof(usec), "%06ld", (long) tv->tv_usec);
+		json_put_uint(tv->tv_sec);
+		json_put_str(".");
+		json_put(usec, 6);
+	} else
+		json_put_str("null");
+
+	if (index != 0xffff) {
+		json_put_name("index");
+		json_put_uint(index);
+	}
+}
+
+/* Packet members are only accepted until the first decode line */
+void json_print_str(const char *name, const char *str)
+{
+	if (!json_open || json_fields)
+		return;
+
+	json_put_name(name);
+	json_put_string(str, strlen(str));
+}
+
+void json_print_uint(const char *name, uint64_t val)
+{
+	if (!json_open || json_fields)
+		return;
+
+	json_put_name(name);
+	json_put_uint(val);
+}
+
+/*
+ * Decoders give the raw value of a line just before printing it. The name
+ * and a string value have to stay valid until that line is printed.
+ */
+void json_field_uint(const char *name, uint64_t val)
+{
+	if (!json_output)
+		return;
+
+	json_value.type = JSON_UINT;
+	json_value.name = name;
+	json_value.u = val;
+}
+
+void json_field_int(const char *name, int64_t val)
+{
+	if (!json_output)
+		return;
+
+	json_value.type = JSON_INT;
+	json_value.name = name;
+	json_value.i = val;
+}
+
+void json_field_str(const char *name, const char *str)
+{
+	if (!json_output)
+		return;
+
+	json_value.type = JSON_STR;
+	json_value.name = name;
+	json_value.str = str;
+}
+
+static void json_print_value(void)
+{
+	const char *name = json_value.name;
+
+	while (*name == ' ')
+		name++;
+
+	json_put_str(",\"field\":");
+	json_put_string(name, strlen(name));
+	json_put_str(",\"value\":");
+
+	switch (json_value.type) {
+	case JSON_UINT:
+		json_put_uint(json_value.u);
+		break;
+	case JSON_INT:
+		json_put_int(json_value.i);
+		break;
+	case JSON_STR:
+		json_put_string(json_value.str, strlen(json_value.str));
+		break;
+	case JSON_NONE:
+		break;
+	}
+
+	json_value.type = JSON_NONE;
+}
+
+void json_print_field(int indent, const char *prefix, const char *title,
+					const char *format, ...)
+{
+	char line[1024];
+	const char *str;
+	va_list ap;
+	int len = 0;
+
+	if (*prefix || *title) {
+		len = snprintf(line, sizeof(line), "%s%s", prefix, title);
+		if (len < 0)
+			return;
+	}
+
+	if ((size_t) len < sizeof(line)) {
+		va_start(ap, format);
+		vsnprintf(line + len, sizeof(line) - len, format, ap);
+		va_end(ap);
+	}
+
+	/* Lines printed outside of a packet get a record of their own */
+	if (!json_open) {
+		json_begin();
+		json_put_str("\"type\":\"text\"");
+	}
+
+	if (json_fields++)
+		json_put_str(",");
+	else
+		json_put_str(",\"decode\":[");
+
+	for (str = line; *str == ' '; str++)
+		indent++;
+
+	json_put_str("{\"indent\":");
+	json_put_uint(indent);
+	json_put_str(",\"text\":");
+	json_put_string(str, strlen(str));
+
+	if (json_value.type != JSON_NONE)
+		json_print_value();
+
+	json_put_str("}");
+}
+
+void json_flush(void)
+{
+	if (!json_open)
+		return;
+
+	if (json_fields)
+		json_put_str("]}\n");
+	else
+		json_put_str("}\n");
+
+	fwrite(json_buf, 1, json_len, stdout);
+	json_len = 0;
+	json_open = false;
+	json_value.type = JSON_NONE;
+}
+
 void set_default_pager_num_columns(int num_columns)
 {
 	default_pager_num_columns = num_columns;
@@ -11,9 +11,23 @@
 
 #include <stdbool.h>
 #include <inttypes.h>
+#include <sys/time.h>
 
 bool use_color(void);
 
+void set_json_output(bool enable);
+bool use_json(void);
+void json_print_packet(const struct timeval *tv, uint16_t index);
+void json_print_str(const char *name, const char *str);
+void json_print_uint(const char *name, uint64_t val);
+void json_field_uint(const char *name, uint64_t val);
+void json_field_int(const char *name, int64_t val);
+void json_field_str(const char *name, const char *str);
+void json_print_field(int indent, const char *prefix, const char *title,
+					const char *format, ...)
+					__attribute__((format(printf, 4, 5)));
+void json_flush(void);
+
 enum monitor_color { COLOR_AUTO, COLOR_ALWAYS, COLOR_NEVER };
 void set_monitor_color(enum monitor_color);
 
@@ -43,6 +57,10 @@ void set_monitor_color(enum monitor_color);
 
 #define print_indent(indent, color1, prefix, title, color2, fmt, args...) \
 do { \
+	if (use_json()) { \
+		json_print_field((indent), prefix, title, fmt, ## args); \
+		break; \
+	} \
 	printf("%*c%s%s%s%s" fmt "%s\n", (indent), ' ', \
 		use_color() ? (color1) : "", prefix, title, \
 		use_color() ? (color2) : "", ## args, \
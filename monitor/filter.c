@@ -0,0 +1,784 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/bluetooth.h"
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/btsnoop.h"
+#include "src/shared/att-types.h"
+#include "bt.h"
+#include "filter.h"
+
+#define MAX_INSNS	64
+
+enum {
+	OP_INDEX,
+	OP_TYPE,
+	OP_DIR,
+	OP_OPCODE,
+	OP_EVENT,
+	OP_HANDLE,
+	OP_ADDR,
+	OP_CID,
+	OP_PSM,
+	OP_ATT,
+	OP_NOT,
+	OP_AND,
+	OP_OR,
+};
+
+#define TYPE_CMD	0x01
+#define TYPE_EVT	0x02
+#define TYPE_ACL	0x03
+#define TYPE_SCO	0x04
+#define TYPE_ISO	0x05
+#define TYPE_OTHER	0x06
+
+struct insn {
+	uint8_t op;
+	uint16_t val;
+	uint8_t addr[6];
+};
+
+static const struct {
+	const char *str;
+	uint8_t op;
+	uint16_t val;
+	bool arg;
+	uint16_t max;
+} keyword_table[] = {
+	{ "cmd",    OP_TYPE,   TYPE_CMD },
+	{ "evt",    OP_TYPE,   TYPE_EVT },
+	{ "acl",    OP_TYPE,   TYPE_ACL },
+	{ "sco",    OP_TYPE,   TYPE_SCO },
+	{ "iso",    OP_TYPE,   TYPE_ISO },
+	{ "tx",     OP_DIR,    true     },
+	{ "rx",     OP_DIR,    false    },
+	{ "index",  OP_INDEX,  0, true, 0xfffe },
+	{ "opcode", OP_OPCODE, 0, true, 0xffff },
+	{ "event",  OP_EVENT,  0, true, 0x00ff },
+	{ "handle", OP_HANDLE, 0, true, 0x0fff },
+	{ "addr",   OP_ADDR,   0, true, 0x0000 },
+	{ "cid",    OP_CID,    0, true, 0xffff },
+	{ "psm",    OP_PSM,    0, true, 0xffff },
+	{ "att",    OP_ATT,    0, true, 0xffff },
+	{ }
+};
+
+struct filter_chan {
+	uint8_t ident;
+	uint16_t psm;
+	uint16_t cid;
+};
+
+struct filter_conn {
+	uint16_t index;
+	uint16_t handle;
+	bool has_addr;
+	uint8_t bdaddr[6];
+	bool frag_match[2];
+	struct queue *chan_list;
+	struct queue *req_list;
+};
+
+/* Fields not present in a packet are set to -1 */
+struct packet {
+	uint16_t index;
+	uint8_t type;
+	bool out;
+	int opcode;
+	int event;
+	int handle;
+	int cid;
+	int att;
+	const uint8_t *bdaddr;
+	struct filter_conn *conn;
+	bool disconnected;
+};
+
+static struct insn program[MAX_INSNS];
+static unsigned int program_len;
+static struct queue *conn_list;
+
+static const char *parse_pos;
+static char token[32];
+
+static bool next_token(void)
+{
+	size_t len = 0;
+
+	while (*parse_pos == ' ' || *parse_pos == '\t')
+		parse_pos++;
+
+	if (!*parse_pos) {
+		token[0] = '\0';
+		return false;
+	}
+
+	if (strchr("()!", *parse_pos)) {
+		token[len++] = *parse_pos++;
+	} else if (!strncmp(parse_pos, "&&", 2) ||
+					!strncmp(parse_pos, "||", 2)) {
+		token[len++] = *parse_pos++;
+		token[len++] = *parse_pos++;
+	} else {
+		while (*parse_pos && !strchr(" \t()!&|", *parse_pos)) {
+			if (len == sizeof(token) - 1)
+				return false;
+
+			token[len++] = *parse_pos++;
+		}
+	}
+
+	token[len] = '\0';
+
+	return true;
+}
+
+static bool emit(uint8_t op, uint16_t val, const uint8_t *addr)
+{
+	struct insn *insn;
+
+	if (program_len == MAX_INSNS) {
+		fprintf(stderr, "Filter expression too long\n");
+		return false;
+	}
+
+	insn = &program[program_len++];
+	insn->op = op;
+	insn->val = val;
+
+	if (addr)
+		memcpy(insn->addr, addr, 6);
+
+	return true;
+}
+
+static bool parse_arg(unsigned int i)
+{
+	const char *str = token;
+	unsigned long val;
+	bdaddr_t bdaddr;
+	char *endptr;
+
+	if (!next_token()) {
+		fprintf(stderr, "Missing value for filter '%s'\n",
+							keyword_table[i].str);
+		return false;
+	}
+
+	if (keyword_table[i].op == OP_ADDR) {
+		if (bachk(token) < 0 || str2ba(token, &bdaddr) < 0) {
+			fprintf(stderr, "Invalid address '%s'\n", token);
+			return false;
+		}
+
+		return emit(OP_ADDR, 0, bdaddr.b);
+	}
+
+	if (keyword_table[i].op == OP_INDEX && !strncmp(str, "hci", 3))
+		str += 3;
+
+	val = strtoul(str, &endptr, 0);
+	if (!*str || *endptr || val > keyword_table[i].max) {
+		fprintf(stderr, "Invalid value '%s' for filter '%s'\n",
+						token, keyword_table[i].str);
+		return false;
+	}
+
+	return emit(keyword_table[i].op, val, NULL);
+}
+
+static bool parse_expr(void);
+
+static bool parse_factor(void)
+{
+	unsigned int i;
+
+	if (!strcmp(token, "not") || !strcmp(token, "!")) {
+		next_token();
+
+		if (!parse_factor())
+			return false;
+
+		return emit(OP_NOT, 0, NULL);
+	}
+
+	if (!strcmp(token, "(")) {
+		next_token();
+
+		if (!parse_expr())
+			return false;
+
+		if (strcmp(token, ")")) {
+			fprintf(stderr, "Missing ')' in filter expression\n");
+			return false;
+		}
+
+		next_token();
+		return true;
+	}
+
+	for (i = 0; keyword_table[i].str; i++) {
+		if (strcmp(token, keyword_table[i].str))
+			continue;
+
+		if (keyword_table[i].arg) {
+			if (!parse_arg(i))
+				return false;
+		} else if (!emit(keyword_table[i].op, keyword_table[i].val,
+									NULL))
+			return false;
+
+		next_token();
+		return true;
+	}
+
+	if (token[0])
+		fprintf(stderr, "Unexpected '%s' in filter expression\n",
+									token);
+	else
+		fprintf(stderr, "Incomplete filter expression\n");
+
+	return false;
+}
+
+static bool parse_term(void)
+{
+	if (!parse_factor())
+		return false;
+
+	while (!strcmp(token, "and") || !strcmp(token, "&&")) {
+		next_token();
+
+		if (!parse_factor() || !emit(OP_AND, 0, NULL))
+			return false;
+	}
+
+	return true;
+}
+
+static bool parse_expr(void)
+{
+	if (!parse_term())
+		return false;
+
+	while (!strcmp(token, "or") || !strcmp(token, "||")) {
+		next_token();
+
+		if (!parse_term() || !emit(OP_OR, 0, NULL))
+			return false;
+	}
+
+	return true;
+}
+
+bool filter_compile(const char *expr)
+{
+	program_len = 0;
+	parse_pos = expr;
+
+	next_token();
+
+	if (!parse_expr())
+		goto failed;
+
+	if (token[0]) {
+		fprintf(stderr, "Unexpected '%s' in filter expression\n",
+									token);
+		goto failed;
+	}
+
+	if (!conn_list)
+		conn_list = queue_new();
+
+	return true;
+
+failed:
+	program_len = 0;
+	return false;
+}
+
+static void conn_destroy(void *data)
+{
+	struct filter_conn *conn = data;
+
+	queue_destroy(conn->chan_list, free);
+	queue_destroy(conn->req_list, free);
+	free(conn);
+}
+
+void filter_cleanup(void)
+{
+	queue_destroy(conn_list, conn_destroy);
+	conn_list = NULL;
+	program_len = 0;
+}
+
+bool filter_active(void)
+{
+	return program_len > 0;
+}
+
+static bool conn_match(const void *a, const void *b)
+{
+	const struct filter_conn *conn = a;
+	const struct packet *pkt = b;
+
+	return conn->index == pkt->index && conn->handle == pkt->handle;
+}
+
+static struct filter_conn *conn_lookup(struct packet *pkt, bool create)
+{
+	struct filter_conn *conn;
+
+	conn = queue_find(conn_list, conn_match, pkt);
+	if (conn || !create)
+		return conn;
+
+	conn = new0(struct filter_conn, 1);
+	conn->index = pkt->index;
+	conn->handle = pkt->handle;
+	conn->chan_list = queue_new();
+	conn->req_list = queue_new();
+
+	queue_push_tail(conn_list, conn);
+
+	return conn;
+}
+
+static void conn_setup(struct packet *pkt, const uint8_t *bdaddr)
+{
+	struct filter_conn *conn;
+
+	/* Handles can be reused, so start over with a clean state */
+	conn = queue_remove_if(conn_list, conn_match, pkt);
+	if (conn)
+		conn_destroy(conn);
+
+	conn = conn_lookup(pkt, true);
+	conn->has_addr = true;
+	memcpy(conn->bdaddr, bdaddr, 6);
+}
+
+static bool chan_match_ident(const void *a, const void *b)
+{
+	const struct filter_chan *chan = a;
+
+	return chan->ident == PTR_TO_UINT(b);
+}
+
+static bool chan_match_cid(const void *a, const void *b)
+{
+	const struct filter_chan *chan = a;
+
+	return chan->cid == PTR_TO_UINT(b);
+}
+
+static void chan_add(struct filter_conn *conn, uint16_t cid, uint16_t psm)
+{
+	struct filter_chan *chan;
+
+	chan = queue_find(conn->chan_list, chan_match_cid, UINT_TO_PTR(cid));
+	if (!chan) {
+		chan = new0(struct filter_chan, 1);
+		chan->cid = cid;
+		queue_push_tail(conn->chan_list, chan);
+	}
+
+	chan->psm = psm;
+}
+
+static void chan_response(struct filter_conn *conn, uint8_t ident,
+					uint16_t dcid, uint16_t result)
+{
+	struct filter_chan *req;
+
+	req = queue_remove_if(conn->req_list, chan_match_ident,
+							UINT_TO_PTR(ident));
+	if (!req)
+		return;
+
+	if (!result) {
+		chan_add(conn, req->cid, req->psm);
+		chan_add(conn, dcid, req->psm);
+	}
+
+	free(req);
+}
+
+/* Learn the PSM of dynamic channels from the signaling channel */
+static void track_sig(struct filter_conn *conn, const uint8_t *data,
+								uint16_t size)
+{
+	struct filter_chan *req;
+
+	if (size < 8)
+		return;
+
+	switch (data[0]) {
+	case BT_L2CAP_PDU_CONN_REQ:
+	case BT_L2CAP_PDU_LE_CONN_REQ:
+		req = new0(struct filter_chan, 1);
+		req->ident = data[1];
+		req->psm = get_le16(data + 4);
+		req->cid = get_le16(data + 6);
+		queue_push_tail(conn->req_list, req);
+		break;
+	case BT_L2CAP_PDU_CONN_RSP:
+		/* Pending responses are followed by the final one */
+		if (size < 12 || get_le16(data + 8) == 0x0001)
+			return;
+
+		chan_response(conn, data[1], get_le16(data + 4),
+							get_le16(data + 8));
+		break;
+	case BT_L2CAP_PDU_LE_CONN_RSP:
+		if (size < 14)
+			return;
+
+		chan_response(conn, data[1], get_le16(data + 4),
+							get_le16(data + 12));
+		break;
+	}
+}
+
+static uint16_t chan_psm(struct filter_conn *conn, uint16_t cid)
+{
+	struct filter_chan *chan;
+
+	chan = queue_find(conn->chan_list, chan_match_cid, UINT_TO_PTR(cid));
+
+	return chan ? chan->psm : 0;
+}
+
+static void parse_cmd(struct packet *pkt, const uint8_t *data, uint16_t size)
+{
+	const uint8_t *param = data + 3;
+
+	if (size < 3)
+		return;
+
+	pkt->opcode = get_le16(data);
+	size -= 3;
+
+	switch (pkt->opcode) {
+	case BT_HCI_CMD_DISCONNECT:
+	case BT_HCI_CMD_AUTH_REQUESTED:
+	case BT_HCI_CMD_SET_CONN_ENCRYPT:
+	case BT_HCI_CMD_READ_REMOTE_FEATURES:
+	case BT_HCI_CMD_READ_REMOTE_VERSION:
+	case BT_HCI_CMD_LE_CONN_UPDATE:
+	case BT_HCI_CMD_LE_READ_REMOTE_FEATURES:
+	case BT_HCI_CMD_LE_START_ENCRYPT:
+	case BT_HCI_CMD_LE_SET_DATA_LENGTH:
+	case BT_HCI_CMD_LE_SET_PHY:
+		if (size >= 2)
+			pkt->handle = get_le16(param) & 0x0fff;
+		break;
+	case BT_HCI_CMD_CREATE_CONN:
+		if (size >= 6)
+			pkt->bdaddr = param;
+		break;
+	case BT_HCI_CMD_LE_CREATE_CONN:
+		if (size >= 12)
+			pkt->bdaddr = param + 6;
+		break;
+	case BT_HCI_CMD_LE_EXT_CREATE_CONN:
+		if (size >= 9)
+			pkt->bdaddr = param + 3;
+		break;
+	}
+}
+
+static void parse_le_meta(struct packet *pkt, const uint8_t *param,
+								uint8_t size)
+{
+	if (size < 4)
+		return;
+
+	switch (param[0]) {
+	case BT_HCI_EVT_LE_CONN_COMPLETE:
+	case BT_HCI_EVT_LE_ENHANCED_CONN_COMPLETE:
+		pkt->handle = get_le16(param + 2) & 0x0fff;
+
+		if (size >= 12 && !param[1]) {
+			pkt->bdaddr = param + 6;
+			conn_setup(pkt, pkt->bdaddr);
+		}
+		break;
+	case BT_HCI_EVT_LE_CONN_UPDATE_COMPLETE:
+	case BT_HCI_EVT_LE_REMOTE_FEATURES_COMPLETE:
+	case BT_HCI_EVT_LE_PHY_UPDATE_COMPLETE:
+		pkt->handle = get_le16(param + 2) & 0x0fff;
+		break;
+	}
+}
+
+static void parse_evt(struct packet *pkt, const uint8_t *data, uint16_t size)
+{
+	const uint8_t *param = data + 2;
+
+	if (size < 2 || size - 2 < data[1])
+		return;
+
+	pkt->event = data[0];
+	size = data[1];
+
+	switch (pkt->event) {
+	case BT_HCI_EVT_CMD_COMPLETE:
+		if (size >= 3)
+			pkt->opcode = get_le16(param + 1);
+		break;
+	case BT_HCI_EVT_CMD_STATUS:
+		if (size >= 4)
+			pkt->opcode = get_le16(param + 2);
+		break;
+	case BT_HCI_EVT_CONN_REQUEST:
+		if (size >= 6)
+			pkt->bdaddr = param;
+		break;
+	case BT_HCI_EVT_CONN_COMPLETE:
+	case BT_HCI_EVT_SYNC_CONN_COMPLETE:
+		if (size < 9)
+			return;
+
+		pkt->handle = get_le16(param + 1) & 0x0fff;
+		pkt->bdaddr = param + 3;
+
+		if (!param[0])
+			conn_setup(pkt, pkt->bdaddr);
+		break;
+	case BT_HCI_EVT_DISCONNECT_COMPLETE:
+		if (size < 3)
+			return;
+
+		pkt->handle = get_le16(param + 1) & 0x0fff;
+		pkt->disconnected = !param[0];
+		break;
+	case BT_HCI_EVT_AUTH_COMPLETE:
+	case BT_HCI_EVT_ENCRYPT_CHANGE:
+	case BT_HCI_EVT_REMOTE_FEATURES_COMPLETE:
+	case BT_HCI_EVT_REMOTE_VERSION_COMPLETE:
+	case BT_HCI_EVT_ENCRYPT_KEY_REFRESH_COMPLETE:
+		if (size >= 3)
+			pkt->handle = get_le16(param + 1) & 0x0fff;
+		break;
+	case BT_HCI_EVT_NUM_COMPLETED_PACKETS:
+		if (size >= 3 && param[0])
+			pkt->handle = get_le16(param + 1) & 0x0fff;
+		break;
+	case BT_HCI_EVT_LE_META_EVENT:
+		parse_le_meta(pkt, param, size);
+		break;
+	}
+}
+
+static bool acl_continuation(const uint8_t *data)
+{
+	/* Packet boundary flag 0b01, all other values start a PDU */
+	return ((get_le16(data) >> 12) & 0x03) == 0x01;
+}
+
+static void parse_acl(struct packet *pkt, const uint8_t *data, uint16_t size)
+{
+	uint16_t cid;
+
+	if (size < 4)
+		return;
+
+	pkt->handle = get_le16(data) & 0x0fff;
+	pkt->conn = conn_lookup(pkt, true);
+
+	/* Continuation fragments carry no L2CAP header */
+	if (acl_continuation(data) || size < 8)
+		return;
+
+	cid = get_le16(data + 6);
+	pkt->cid = cid;
+
+	switch (cid) {
+	case 0x0001:
+	case 0x0005:
+		track_sig(pkt->conn, data + 8, size - 8);
+		break;
+	case 0x0004:
+		if (size < 11)
+			break;
+
+		switch (data[8]) {
+		case BT_ATT_OP_READ_REQ:
+		case BT_ATT_OP_READ_BLOB_REQ:
+		case BT_ATT_OP_WRITE_REQ:
+		case BT_ATT_OP_WRITE_CMD:
+		case BT_ATT_OP_SIGNED_WRITE_CMD:
+		case BT_ATT_OP_PREP_WRITE_REQ:
+		case BT_ATT_OP_PREP_WRITE_RSP:
+		case BT_ATT_OP_HANDLE_NFY:
+		case BT_ATT_OP_HANDLE_IND:
+			pkt->att = get_le16(data + 9);
+			break;
+		}
+		break;
+	}
+}
+
+static bool match_insn(const struct insn *insn, const struct packet *pkt)
+{
+	switch (insn->op) {
+	case OP_INDEX:
+		return pkt->index == insn->val;
+	case OP_TYPE:
+		return pkt->type == insn->val;
+	case OP_DIR:
+		return pkt->type != TYPE_OTHER && pkt->out == insn->val;
+	case OP_OPCODE:
+		return pkt->opcode == insn->val;
+	case OP_EVENT:
+		return pkt->event == insn->val;
+	case OP_HANDLE:
+		return pkt->handle == insn->val;
+	case OP_ADDR:
+		if (pkt->bdaddr && !memcmp(pkt->bdaddr, insn->addr, 6))
+			return true;
+
+		return pkt->conn && pkt->conn->has_addr &&
+				!memcmp(pkt->conn->bdaddr, insn->addr, 6);
+	case OP_CID:
+		return pkt->cid == insn->val;
+	case OP_PSM:
+		return pkt->conn && pkt->cid >= 0 &&
+				chan_psm(pkt->conn, pkt->cid) == insn->val;
+	case OP_ATT:
+		return pkt->att == insn->val;
+	}
+
+	return false;
+}
+
+static bool run_program(const struct packet *pkt)
+{
+	bool stack[MAX_INSNS];
+	unsigned int i, sp = 0;
+
+	for (i = 0; i < program_len; i++) {
+		const struct insn *insn = &program[i];
+
+		switch (insn->op) {
+		case OP_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		case OP_AND:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] && stack[sp];
+			break;
+		case OP_OR:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] || stack[sp];
+			break;
+		default:
+			stack[sp++] = match_insn(insn, pkt);
+			break;
+		}
+	}
+
+	return stack[0];
+}
+
+bool filter_packet(uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size)
+{
+	struct packet pkt;
+	struct filter_conn *conn;
+	bool match;
+
+	if (!program_len)
+		return true;
+
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.index = index;
+	pkt.opcode = -1;
+	pkt.event = -1;
+	pkt.handle = -1;
+	pkt.cid = -1;
+	pkt.att = -1;
+
+	switch (opcode) {
+	case BTSNOOP_OPCODE_NEW_INDEX:
+	case BTSNOOP_OPCODE_DEL_INDEX:
+	case BTSNOOP_OPCODE_OPEN_INDEX:
+	case BTSNOOP_OPCODE_CLOSE_INDEX:
+	case BTSNOOP_OPCODE_INDEX_INFO:
+		/* Controller lifetime is needed to decode anything else */
+		return true;
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+		pkt.type = TYPE_CMD;
+		pkt.out = true;
+		parse_cmd(&pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		pkt.type = TYPE_EVT;
+		parse_evt(&pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+		pkt.type = TYPE_ACL;
+		pkt.out = opcode == BTSNOOP_OPCODE_ACL_TX_PKT;
+		parse_acl(&pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+		pkt.type = TYPE_SCO;
+		pkt.out = opcode == BTSNOOP_OPCODE_SCO_TX_PKT;
+		if (size >= 3)
+			pkt.handle = get_le16(data) & 0x0fff;
+		break;
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		pkt.type = TYPE_ISO;
+		pkt.out = opcode == BTSNOOP_OPCODE_ISO_TX_PKT;
+		if (size >= 4)
+			pkt.handle = get_le16(data) & 0x0fff;
+		break;
+	default:
+		pkt.type = TYPE_OTHER;
+		break;
+	}
+
+	if (pkt.handle >= 0 && !pkt.conn)
+		pkt.conn = conn_lookup(&pkt, false);
+
+	/* Continuation fragments follow the verdict of their start */
+	if (pkt.type == TYPE_ACL && pkt.conn && pkt.cid < 0 && size >= 4 &&
+						acl_continuation(data))
+		return pkt.conn->frag_match[pkt.out];
+
+	match = run_program(&pkt);
+
+	if (pkt.type == TYPE_ACL && pkt.conn)
+		pkt.conn->frag_match[pkt.out] = match;
+
+	if (pkt.disconnected && pkt.conn) {
+		conn = pkt.conn;
+		queue_remove(conn_list, conn);
+		conn_destroy(conn);
+	}
+
+	return match;
+}
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool filter_compile(const char *expr);
+void filter_cleanup(void);
+
+bool filter_active(void);
+bool filter_packet(uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size);
@@ -417,73 +417,88 @@ static char *mode2str(uint8_t mode)
 
 static void l2cap_ctrl_ext_parse(struct l2cap_frame *frame, uint32_t ctrl)
 {
-	printf("      %s:",
+	char str[96];
+	int n;
+
+	n = sprintf(str, "%s:",
 		ctrl & L2CAP_EXT_CTRL_FRAME_TYPE ? "S-frame" : "I-frame");
 
 	if (ctrl & L2CAP_EXT_CTRL_FRAME_TYPE) {
-		printf(" %s",
+		n += sprintf(str + n, " %s",
 		supervisory2str((ctrl & L2CAP_EXT_CTRL_SUPERVISE_MASK) >>
 						L2CAP_EXT_CTRL_SUPER_SHIFT));
 
 		if (ctrl & L2CAP_EXT_CTRL_POLL)
-			printf(" P-bit");
+			n += sprintf(str + n, " P-bit");
 	} else {
 		uint8_t sar = (ctrl & L2CAP_EXT_CTRL_SAR_MASK) >>
 						L2CAP_EXT_CTRL_SAR_SHIFT;
-		printf(" %s", sar2str(sar));
+		n += sprintf(str + n, " %s", sar2str(sar));
 		if (sar == L2CAP_SAR_START) {
 			uint16_t len;
 
 			if (!l2cap_frame_get_le16(frame, &len))
-				return;
+				goto done;
 
-			printf(" (len %d)", len);
+			n += sprintf(str + n, " (len %d)", len);
 		}
-		printf(" TxSeq %d", (ctrl & L2CAP_EXT_CTRL_TXSEQ_MASK) >>
-						L2CAP_EXT_CTRL_TXSEQ_SHIFT);
+		n += sprintf(str + n, " TxSeq %d",
+					(ctrl & L2CAP_EXT_CTRL_TXSEQ_MASK) >>
+					L2CAP_EXT_CTRL_TXSEQ_SHIFT);
 	}
 
-	printf(" ReqSeq %d", (ctrl & L2CAP_EXT_CTRL_REQSEQ_MASK) >>
-						L2CAP_EXT_CTRL_REQSEQ_SHIFT);
+	n += sprintf(str + n, " ReqSeq %d",
+					(ctrl & L2CAP_EXT_CTRL_REQSEQ_MASK) >>
+					L2CAP_EXT_CTRL_REQSEQ_SHIFT);
 
 	if (ctrl & L2CAP_EXT_CTRL_FINAL)
-		printf(" F-bit");
+		sprintf(str + n, " F-bit");
+
+done:
+	print_indent(6, COLOR_OFF, "", "", COLOR_OFF, "%s", str);
 }
 
 static void l2cap_ctrl_parse(struct l2cap_frame *frame, uint32_t ctrl)
 {
-	printf("      %s:",
+	char str[96];
+	int n;
+
+	n = sprintf(str, "%s:",
 			ctrl & L2CAP_CTRL_FRAME_TYPE ? "S-frame" : "I-frame");
 
 	if (ctrl & 0x01) {
-		printf(" %s",
+		n += sprintf(str + n, " %s",
 			supervisory2str((ctrl & L2CAP_CTRL_SUPERVISE_MASK) >>
 						L2CAP_CTRL_SUPER_SHIFT));
 
 		if (ctrl & L2CAP_CTRL_POLL)
-			printf(" P-bit");
+			n += sprintf(str + n, " P-bit");
 	} else {
 		uint8_t sar;
 
 		sar = (ctrl & L2CAP_CTRL_SAR_MASK) >> L2CAP_CTRL_SAR_SHIFT;
-		printf(" %s", sar2str(sar));
+		n += sprintf(str + n, " %s", sar2str(sar));
 		if (sar == L2CAP_SAR_START) {
 			uint16_t len;
 
 			if (!l2cap_frame_get_le16(frame, &len))
-				return;
+				goto done;
 
-			printf(" (len %d)", len);
+			n += sprintf(str + n, " (len %d)", len);
 		}
-		printf(" TxSeq %d", (ctrl & L2CAP_CTRL_TXSEQ_MASK) >>
-						L2CAP_CTRL_TXSEQ_SHIFT);
+		n += sprintf(str + n, " TxSeq %d",
+					(ctrl & L2CAP_CTRL_TXSEQ_MASK) >>
+					L2CAP_CTRL_TXSEQ_SHIFT);
 	}
 
-	printf(" ReqSeq %d", (ctrl & L2CAP_CTRL_REQSEQ_MASK) >>
+	n += sprintf(str + n, " ReqSeq %d", (ctrl & L2CAP_CTRL_REQSEQ_MASK) >>
 						L2CAP_CTRL_REQSEQ_SHIFT);
 
 	if (ctrl & L2CAP_CTRL_FINAL)
-		printf(" F-bit");
+		sprintf(str + n, " F-bit");
+
+done:
+	print_indent(6, COLOR_OFF, "", "", COLOR_OFF, "%s", str);
 }
 
 #define MAX_INDEX 16
@@ -507,12 +522,17 @@ static void clear_fragment_buffer(uint16_t index, bool in)
 
 static void print_psm(uint16_t psm)
 {
+	json_field_uint("PSM", le16_to_cpu(psm));
 	print_field("PSM: %d (0x%4.4x)", le16_to_cpu(psm), le16_to_cpu(psm));
 }
 
 static void print_cid(const char *type, uint16_t cid)
 {
-	print_field("%s CID: %d", type, le16_to_cpu(cid));
+	char label[24];
+
+	snprintf(label, sizeof(label), "%s CID", type);
+	json_field_uint(label, le16_to_cpu(cid));
+	print_field("%s: %d", label, le16_to_cpu(cid));
 }
 
 static void print_reject_reason(uint16_t reason)
@@ -534,6 +554,7 @@ static void print_reject_reason(uint16_t reason)
 		break;
 	}
 
+	json_field_uint("Reason", le16_to_cpu(reason));
 	print_field("Reason: %s (0x%4.4x)", str, le16_to_cpu(reason));
 }
 
@@ -568,6 +589,7 @@ static void print_conn_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -611,6 +633,7 @@ static void print_le_conn_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -648,6 +671,7 @@ static void print_create_chan_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -670,6 +694,7 @@ static void print_conn_status(uint16_t status)
 		break;
 	}
 
+	json_field_uint("Status", le16_to_cpu(status));
 	print_field("Status: %s (0x%4.4x)", str, le16_to_cpu(status));
 }
 
@@ -682,6 +707,7 @@ static void print_config_flags(uint16_t flags)
 	else
 		str = "";
 
+	json_field_uint("Flags", le16_to_cpu(flags));
 	print_field("Flags: 0x%4.4x%s", le16_to_cpu(flags), str);
 }
 
@@ -713,6 +739,7 @@ static void print_config_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -902,6 +929,7 @@ static void print_info_type(uint16_t type)
 		break;
 	}
 
+	json_field_uint("Type", le16_to_cpu(type));
 	print_field("Type: %s (0x%4.4x)", str, le16_to_cpu(type));
 }
 
@@ -921,6 +949,7 @@ static void print_info_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -1005,6 +1034,7 @@ static void print_move_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -1024,6 +1054,7 @@ static void print_move_cfm_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -1043,6 +1074,7 @@ static void print_conn_param_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -1072,6 +1104,7 @@ static void sig_cmd_reject(const struct l2cap_frame *frame)
 			packet_hexdump(data, size);
 			break;
 		}
+		json_field_uint("MTU", get_le16(data));
 		print_field("MTU: %d", get_le16(data));
 		break;
 	case 0x0002:
@@ -1195,6 +1228,7 @@ static void sig_info_rsp(const struct l2cap_frame *frame)
 			packet_hexdump(data, size);
 			break;
 		}
+		json_field_uint("MTU", get_le16(data));
 		print_field("MTU: %d", get_le16(data));
 		break;
 	case 0x0002:
@@ -1225,6 +1259,7 @@ static void sig_create_chan_req(const struct l2cap_frame *frame)
 
 	print_psm(pdu->psm);
 	print_cid("Source", pdu->scid);
+	json_field_uint("Controller ID", pdu->ctrlid);
 	print_field("Controller ID: %d", pdu->ctrlid);
 
 	assign_scid(frame, le16_to_cpu(pdu->scid), le16_to_cpu(pdu->psm),
@@ -1248,6 +1283,7 @@ static void sig_move_chan_req(const struct l2cap_frame *frame)
 	const struct bt_l2cap_pdu_move_chan_req *pdu = frame->data;
 
 	print_cid("Initiator", pdu->icid);
+	json_field_uint("Controller ID", pdu->ctrlid);
 	print_field("Controller ID: %d", pdu->ctrlid);
 }
 
@@ -1278,9 +1314,13 @@ static void sig_conn_param_req(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_pdu_conn_param_req *pdu = frame->data;
 
+	json_field_uint("Min interval", le16_to_cpu(pdu->min_interval));
 	print_field("Min interval: %d", le16_to_cpu(pdu->min_interval));
+	json_field_uint("Max interval", le16_to_cpu(pdu->max_interval));
 	print_field("Max interval: %d", le16_to_cpu(pdu->max_interval));
+	json_field_uint("Peripheral latency", le16_to_cpu(pdu->latency));
 	print_field("Peripheral latency: %d", le16_to_cpu(pdu->latency));
+	json_field_uint("Timeout multiplier", le16_to_cpu(pdu->timeout));
 	print_field("Timeout multiplier: %d", le16_to_cpu(pdu->timeout));
 }
 
@@ -1297,8 +1337,11 @@ static void sig_le_conn_req(const struct l2cap_frame *frame)
 
 	print_psm(pdu->psm);
 	print_cid("Source", pdu->scid);
+	json_field_uint("MTU", le16_to_cpu(pdu->mtu));
 	print_field("MTU: %u", le16_to_cpu(pdu->mtu));
+	json_field_uint("MPS", le16_to_cpu(pdu->mps));
 	print_field("MPS: %u", le16_to_cpu(pdu->mps));
+	json_field_uint("Credits", le16_to_cpu(pdu->credits));
 	print_field("Credits: %u", le16_to_cpu(pdu->credits));
 
 	assign_scid(frame, le16_to_cpu(pdu->scid), le16_to_cpu(pdu->psm),
@@ -1310,8 +1353,11 @@ static void sig_le_conn_rsp(const struct l2cap_frame *frame)
 	const struct bt_l2cap_pdu_le_conn_rsp *pdu = frame->data;
 
 	print_cid("Destination", pdu->dcid);
+	json_field_uint("MTU", le16_to_cpu(pdu->mtu));
 	print_field("MTU: %u", le16_to_cpu(pdu->mtu));
+	json_field_uint("MPS", le16_to_cpu(pdu->mps));
 	print_field("MPS: %u", le16_to_cpu(pdu->mps));
+	json_field_uint("Credits", le16_to_cpu(pdu->credits));
 	print_field("Credits: %u", le16_to_cpu(pdu->credits));
 	print_le_conn_result(pdu->result);
 
@@ -1323,6 +1369,7 @@ static void sig_le_flowctl_creds(const struct l2cap_frame *frame)
 	const struct bt_l2cap_pdu_le_flowctl_creds *pdu = frame->data;
 
 	print_cid("Source", pdu->cid);
+	json_field_uint("Credits", le16_to_cpu(pdu->credits));
 	print_field("Credits: %u", le16_to_cpu(pdu->credits));
 }
 
@@ -1334,8 +1381,11 @@ static void sig_ecred_conn_req(const struct l2cap_frame *frame)
 	l2cap_frame_pull((void *)frame, frame, sizeof(pdu));
 
 	print_psm(pdu->psm);
+	json_field_uint("MTU", le16_to_cpu(pdu->mtu));
 	print_field("MTU: %u", le16_to_cpu(pdu->mtu));
+	json_field_uint("MPS", le16_to_cpu(pdu->mps));
 	print_field("MPS: %u", le16_to_cpu(pdu->mps));
+	json_field_uint("Credits", le16_to_cpu(pdu->credits));
 	print_field("Credits: %u", le16_to_cpu(pdu->credits));
 
 	while (l2cap_frame_get_le16((void *)frame, &scid)) {
@@ -1387,6 +1437,7 @@ static void print_ecred_conn_result(uint16_t result)
 		break;
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -1397,8 +1448,11 @@ static void sig_ecred_conn_rsp(const struct l2cap_frame *frame)
 
 	l2cap_frame_pull((void *)frame, frame, sizeof(*pdu));
 
+	json_field_uint("MTU", le16_to_cpu(pdu->mtu));
 	print_field("MTU: %u", le16_to_cpu(pdu->mtu));
+	json_field_uint("MPS", le16_to_cpu(pdu->mps));
 	print_field("MPS: %u", le16_to_cpu(pdu->mps));
+	json_field_uint("Credits", le16_to_cpu(pdu->credits));
 	print_field("Credits: %u", le16_to_cpu(pdu->credits));
 	print_ecred_conn_result(pdu->result);
 
@@ -1415,7 +1469,9 @@ static void sig_ecred_reconf_req(const struct l2cap_frame *frame)
 
 	l2cap_frame_pull((void *)frame, frame, sizeof(*pdu));
 
+	json_field_uint("MTU", le16_to_cpu(pdu->mtu));
 	print_field("MTU: %u", le16_to_cpu(pdu->mtu));
+	json_field_uint("MPS", le16_to_cpu(pdu->mps));
 	print_field("MPS: %u", le16_to_cpu(pdu->mps));
 
 	while (l2cap_frame_get_le16((void *)frame, &scid))
@@ -1442,6 +1498,7 @@ static void print_ecred_reconf_result(uint16_t result)
 		str = "Reserved";
 	}
 
+	json_field_uint("Result", le16_to_cpu(result));
 	print_field("Result: %s (0x%4.4x)", str, le16_to_cpu(result));
 }
 
@@ -1538,6 +1595,48 @@ static const struct sig_opcode_data le_sig_opcode_table[] = {
 	{ },
 };
 
+/*
+ * Direct indexes by opcode into the signaling and ATT tables. They are
+ * built by l2cap_setup() before decoding starts.
+ */
+struct l2cap_index {
+	const struct sig_opcode_data *bredr_sig[256];
+	const struct sig_opcode_data *le_sig[256];
+	const struct att_opcode_data *att[256];
+};
+
+static struct l2cap_index *l2cap_index;
+
+static const struct sig_opcode_data *sig_opcode_scan(
+				const struct sig_opcode_data *table,
+				uint8_t opcode)
+{
+	int i;
+
+	for (i = 0; table[i].str; i++) {
+		if (table[i].opcode == opcode)
+			return &table[i];
+	}
+
+	return NULL;
+}
+
+static const struct sig_opcode_data *bredr_sig_opcode_lookup(uint8_t opcode)
+{
+	if (l2cap_index)
+		return l2cap_index->bredr_sig[opcode];
+
+	return sig_opcode_scan(bredr_sig_opcode_table, opcode);
+}
+
+static const struct sig_opcode_data *le_sig_opcode_lookup(uint8_t opcode)
+{
+	if (l2cap_index)
+		return l2cap_index->le_sig[opcode];
+
+	return sig_opcode_scan(le_sig_opcode_table, opcode);
+}
+
 static void l2cap_frame_init(struct l2cap_frame *frame, uint16_t index, bool in,
 				uint16_t handle, uint8_t ident,
 				uint16_t cid, uint16_t psm,
@@ -1566,7 +1665,6 @@ static void bredr_sig_packet(uint16_t index, bool in, uint16_t handle,
 		const struct sig_opcode_data *opcode_data = NULL;
 		const char *opcode_color, *opcode_str;
 		uint16_t len;
-		int i;
 
 		if (size < 4) {
 			print_text(COLOR_ERROR, "malformed signal packet");
@@ -1585,12 +1683,7 @@ static void bredr_sig_packet(uint16_t index, bool in, uint16_t handle,
 			return;
 		}
 
-		for (i = 0; bredr_sig_opcode_table[i].str; i++) {
-			if (bredr_sig_opcode_table[i].opcode == hdr->code) {
-				opcode_data = &bredr_sig_opcode_table[i];
-				break;
-			}
-		}
+		opcode_data = bredr_sig_opcode_lookup(hdr->code);
 
 		if (opcode_data) {
 			if (opcode_data->func) {
@@ -1606,6 +1699,7 @@ static void bredr_sig_packet(uint16_t index, bool in, uint16_t handle,
 			opcode_str = "Unknown";
 		}
 
+		json_field_uint("L2CAP", hdr->code);
 		print_indent(6, opcode_color, "L2CAP: ", opcode_str,
 					COLOR_OFF,
 					" (0x%2.2x) ident %d len %d",
@@ -1655,7 +1749,6 @@ static void le_sig_packet(uint16_t index, bool in, uint16_t handle,
 	const struct sig_opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	uint16_t len;
-	int i;
 
 	if (size < 4) {
 		print_text(COLOR_ERROR, "malformed signal packet");
@@ -1674,12 +1767,7 @@ static void le_sig_packet(uint16_t index, bool in, uint16_t handle,
 		return;
 	}
 
-	for (i = 0; le_sig_opcode_table[i].str; i++) {
-		if (le_sig_opcode_table[i].opcode == hdr->code) {
-			opcode_data = &le_sig_opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = le_sig_opcode_lookup(hdr->code);
 
 	if (opcode_data) {
 		if (opcode_data->func) {
@@ -1695,6 +1783,7 @@ static void le_sig_packet(uint16_t index, bool in, uint16_t handle,
 		opcode_str = "Unknown";
 	}
 
+	json_field_uint("LE L2CAP", hdr->code);
 	print_indent(6, opcode_color, "LE L2CAP: ", opcode_str, COLOR_OFF,
 					" (0x%2.2x) ident %d len %d",
 					hdr->code, hdr->ident, len);
@@ -2134,6 +2223,7 @@ static void print_hex_field(const char *label, const uint8_t *data,
 	for (i = 0; i < len; i++)
 		sprintf(str + (i * 2), "%2.2x", data[i]);
 
+	json_field_str(label, str);
 	print_field("%s: %s", label, str);
 }
 
@@ -2145,10 +2235,12 @@ static void print_uuid(const char *label, const void *data, uint16_t size)
 	switch (size) {
 	case 2:
 		str = bt_uuid16_to_str(get_le16(data));
+		json_field_uint(label, get_le16(data));
 		print_field("%s: %s (0x%4.4x)", label, str, get_le16(data));
 		break;
 	case 4:
 		str = bt_uuid32_to_str(get_le32(data));
+		json_field_uint(label, get_le32(data));
 		print_field("%s: %s (0x%8.8x)", label, str, get_le32(data));
 		break;
 	case 16:
@@ -2157,6 +2249,7 @@ static void print_uuid(const char *label, const void *data, uint16_t size)
 				get_le16(data + 8), get_le16(data + 6),
 				get_le32(data + 2), get_le16(data + 0));
 		str = bt_uuidstr_to_str(uuidstr);
+		json_field_str(label, uuidstr);
 		print_field("%s: %s (%s)", label, str, uuidstr);
 		break;
 	default:
@@ -2184,6 +2277,7 @@ static void print_data_list(const char *label, uint8_t length,
 	print_field("%s: %u entr%s", label, count, count == 1 ? "y" : "ies");
 
 	while (size >= length) {
+		json_field_uint("Handle", get_le16(data));
 		print_field("Handle: 0x%4.4x", get_le16(data));
 		print_hex_field("Value", data + 2, length - 2);
 
@@ -2218,7 +2312,9 @@ static void print_attribute_info(uint16_t type, const void *data, uint16_t len)
 			print_hex_field("  Value", data, len);
 			break;
 		}
+		json_field_uint("  Properties", *((uint8_t *) data));
 		print_field("  Properties: 0x%2.2x", *((uint8_t *) data));
+		json_field_uint("  Handle", get_le16(data + 1));
 		print_field("  Handle: 0x%2.2x", get_le16(data + 1));
 		print_uuid("  UUID", data + 3, len - 3);
 		break;
@@ -2309,7 +2405,9 @@ static void att_error_response(const struct l2cap_frame *frame)
 
 	print_field("%s (0x%2.2x)", att_opcode_to_str(pdu->request),
 							pdu->request);
+	json_field_uint("Handle", le16_to_cpu(pdu->handle));
 	print_field("Handle: 0x%4.4x", le16_to_cpu(pdu->handle));
+	json_field_uint("Error", pdu->error);
 	print_field("Error: %s (0x%2.2x)", str, pdu->error);
 }
 
@@ -2317,6 +2415,7 @@ static void att_exchange_mtu_req(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_att_exchange_mtu_req *pdu = frame->data;
 
+	json_field_uint("Client RX MTU", le16_to_cpu(pdu->mtu));
 	print_field("Client RX MTU: %d", le16_to_cpu(pdu->mtu));
 }
 
@@ -2324,6 +2423,7 @@ static void att_exchange_mtu_rsp(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_att_exchange_mtu_rsp *pdu = frame->data;
 
+	json_field_uint("Server RX MTU", le16_to_cpu(pdu->mtu));
 	print_field("Server RX MTU: %d", le16_to_cpu(pdu->mtu));
 }
 
@@ -2347,6 +2447,7 @@ static const char *att_format_str(uint8_t format)
 static uint16_t print_info_data_16(const void *data, uint16_t len)
 {
 	while (len >= 4) {
+		json_field_uint("Handle", get_le16(data));
 		print_field("Handle: 0x%4.4x", get_le16(data));
 		print_uuid("UUID", data + 2, 2);
 		data += 4;
@@ -2359,6 +2460,7 @@ static uint16_t print_info_data_16(const void *data, uint16_t len)
 static uint16_t print_info_data_128(const void *data, uint16_t len)
 {
 	while (len >= 18) {
+		json_field_uint("Handle", get_le16(data));
 		print_field("Handle: 0x%4.4x", get_le16(data));
 		print_uuid("UUID", data + 2, 16);
 		data += 18;
@@ -2419,6 +2521,7 @@ static void att_read_type_rsp(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_att_read_group_type_rsp *pdu = frame->data;
 
+	json_field_uint("Attribute data length", pdu->length);
 	print_field("Attribute data length: %d", pdu->length);
 	print_data_list("Attribute data list", pdu->length,
 					frame->data + 1, frame->size - 1);
@@ -2428,6 +2531,7 @@ static void att_read_req(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_att_read_req *pdu = frame->data;
 
+	json_field_uint("Handle", le16_to_cpu(pdu->handle));
 	print_field("Handle: 0x%4.4x", le16_to_cpu(pdu->handle));
 }
 
@@ -2438,7 +2542,9 @@ static void att_read_rsp(const struct l2cap_frame *frame)
 
 static void att_read_blob_req(const struct l2cap_frame *frame)
 {
+	json_field_uint("Handle", get_le16(frame->data));
 	print_field("Handle: 0x%4.4x", get_le16(frame->data));
+	json_field_uint("Offset", get_le16(frame->data + 2));
 	print_field("Offset: 0x%4.4x", get_le16(frame->data + 2));
 }
 
@@ -2453,9 +2559,11 @@ static void att_read_multiple_req(const struct l2cap_frame *frame)
 
 	count = frame->size / 2;
 
-	for (i = 0; i < count; i++)
+	for (i = 0; i < count; i++) {
+		json_field_uint("Handle", get_le16(frame->data + (i * 2)));
 		print_field("Handle: 0x%4.4x",
 					get_le16(frame->data + (i * 2)));
+	}
 }
 
 static void att_read_group_type_req(const struct l2cap_frame *frame)
@@ -2491,6 +2599,7 @@ static void att_read_group_type_rsp(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_att_read_group_type_rsp *pdu = frame->data;
 
+	json_field_uint("Attribute data length", pdu->length);
 	print_field("Attribute data length: %d", pdu->length);
 	print_group_list("Attribute group list", pdu->length,
 					frame->data + 1, frame->size - 1);
@@ -2498,6 +2607,7 @@ static void att_read_group_type_rsp(const struct l2cap_frame *frame)
 
 static void att_write_req(const struct l2cap_frame *frame)
 {
+	json_field_uint("Handle", get_le16(frame->data));
 	print_field("Handle: 0x%4.4x", get_le16(frame->data));
 	print_hex_field("  Data", frame->data + 2, frame->size - 2);
 }
@@ -2508,14 +2618,18 @@ static void att_write_rsp(const struct l2cap_frame *frame)
 
 static void att_prepare_write_req(const struct l2cap_frame *frame)
 {
+	json_field_uint("Handle", get_le16(frame->data));
 	print_field("Handle: 0x%4.4x", get_le16(frame->data));
+	json_field_uint("Offset", get_le16(frame->data + 2));
 	print_field("Offset: 0x%4.4x", get_le16(frame->data + 2));
 	print_hex_field("  Data", frame->data + 4, frame->size - 4);
 }
 
 static void att_prepare_write_rsp(const struct l2cap_frame *frame)
 {
+	json_field_uint("Handle", get_le16(frame->data));
 	print_field("Handle: 0x%4.4x", get_le16(frame->data));
+	json_field_uint("Offset", get_le16(frame->data + 2));
 	print_field("Offset: 0x%4.4x", get_le16(frame->data + 2));
 	print_hex_field("  Data", frame->data + 4, frame->size - 4);
 }
@@ -2537,6 +2651,7 @@ static void att_execute_write_req(const struct l2cap_frame *frame)
 		break;
 	}
 
+	json_field_uint("Flags", flags);
 	print_field("Flags: %s (0x%02x)", flags_str, flags);
 }
 
@@ -2544,6 +2659,7 @@ static void att_handle_value_notify(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_att_handle_value_notify *pdu = frame->data;
 
+	json_field_uint("Handle", le16_to_cpu(pdu->handle));
 	print_field("Handle: 0x%4.4x", le16_to_cpu(pdu->handle));
 	print_hex_field("  Data", frame->data + 2, frame->size - 2);
 }
@@ -2552,6 +2668,7 @@ static void att_handle_value_ind(const struct l2cap_frame *frame)
 {
 	const struct bt_l2cap_att_handle_value_ind *pdu = frame->data;
 
+	json_field_uint("Handle", le16_to_cpu(pdu->handle));
 	print_field("Handle: 0x%4.4x", le16_to_cpu(pdu->handle));
 	print_hex_field("  Data", frame->data + 2, frame->size - 2);
 }
@@ -2571,11 +2688,13 @@ static void att_multiple_vl_rsp(const struct l2cap_frame *frame)
 		if (!l2cap_frame_get_le16(f, &handle))
 			return;
 
+		json_field_uint("Handle", handle);
 		print_field("Handle: 0x%4.4x", handle);
 
 		if (!l2cap_frame_get_le16(f, &len))
 			return;
 
+		json_field_uint("Length", len);
 		print_field("Length: 0x%4.4x", len);
 
 		print_hex_field("  Data", f->data,
@@ -2592,12 +2711,14 @@ static void att_multiple_vl_rsp(const struct l2cap_frame *frame)
 
 static void att_write_command(const struct l2cap_frame *frame)
 {
+	json_field_uint("Handle", get_le16(frame->data));
 	print_field("Handle: 0x%4.4x", get_le16(frame->data));
 	print_hex_field("  Data", frame->data + 2, frame->size - 2);
 }
 
 static void att_signed_write_command(const struct l2cap_frame *frame)
 {
+	json_field_uint("Handle", get_le16(frame->data));
 	print_field("Handle: 0x%4.4x", get_le16(frame->data));
 	print_hex_field("  Data", frame->data + 2, frame->size - 2 - 12);
 	print_hex_field("  Signature", frame->data + frame->size - 12, 12);
@@ -2674,16 +2795,68 @@ static const struct att_opcode_data att_opcode_table[] = {
 	{ }
 };
 
-static const char *att_opcode_to_str(uint8_t opcode)
+static const struct att_opcode_data *att_opcode_lookup(uint8_t opcode)
 {
 	int i;
 
+	if (l2cap_index)
+		return l2cap_index->att[opcode];
+
 	for (i = 0; att_opcode_table[i].str; i++) {
 		if (att_opcode_table[i].opcode == opcode)
-			return att_opcode_table[i].str;
+			return &att_opcode_table[i];
+	}
+
+	return NULL;
+}
+
+static void sig_opcode_index(const struct sig_opcode_data *table,
+				const struct sig_opcode_data **index)
+{
+	int i;
+
+	/* First entry wins for duplicate codes, like the table scans */
+	for (i = 0; table[i].str; i++) {
+		if (!index[table[i].opcode])
+			index[table[i].opcode] = &table[i];
+	}
+}
+
+void l2cap_setup(void)
+{
+	int i;
+
+	if (l2cap_index)
+		return;
+
+	l2cap_index = new0(struct l2cap_index, 1);
+
+	sig_opcode_index(bredr_sig_opcode_table, l2cap_index->bredr_sig);
+	sig_opcode_index(le_sig_opcode_table, l2cap_index->le_sig);
+
+	for (i = 0; att_opcode_table[i].str; i++) {
+		uint8_t code = att_opcode_table[i].opcode;
+
+		if (!l2cap_index->att[code])
+			l2cap_index->att[code] = &att_opcode_table[i];
 	}
+}
+
+void l2cap_cleanup(void)
+{
+	free(l2cap_index);
+	l2cap_index = NULL;
+}
+
+static const char *att_opcode_to_str(uint8_t opcode)
+{
+	const struct att_opcode_data *opcode_data;
+
+	opcode_data = att_opcode_lookup(opcode);
+	if (!opcode_data)
+		return "Unknown";
 
-	return "Unknown";
+	return opcode_data->str;
 }
 
 static void att_packet(uint16_t index, bool in, uint16_t handle,
@@ -2693,7 +2866,6 @@ static void att_packet(uint16_t index, bool in, uint16_t handle,
 	uint8_t opcode = *((const uint8_t *) data);
 	const struct att_opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
-	int i;
 
 	if (size < 1) {
 		print_text(COLOR_ERROR, "malformed attribute packet");
@@ -2701,12 +2873,7 @@ static void att_packet(uint16_t index, bool in, uint16_t handle,
 		return;
 	}
 
-	for (i = 0; att_opcode_table[i].str; i++) {
-		if (att_opcode_table[i].opcode == opcode) {
-			opcode_data = &att_opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = att_opcode_lookup(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->func) {
@@ -2722,6 +2889,7 @@ static void att_packet(uint16_t index, bool in, uint16_t handle,
 		opcode_str = "Unknown";
 	}
 
+	json_field_uint("ATT", opcode);
 	print_indent(6, opcode_color, "ATT: ", opcode_str, COLOR_OFF,
 				" (0x%2.2x) len %d", opcode, size - 1);
 
@@ -3192,6 +3360,7 @@ void l2cap_frame(uint16_t index, bool in, uint16_t handle, uint16_t cid,
 				if (!l2cap_frame_get_le16(&frame, &chan->sdu))
 					return;
 			}
+			json_field_uint("Channel", cid);
 			print_indent(6, COLOR_CYAN, "Channel:", "",
 					COLOR_OFF, " %d len %d sdu %d"
 					" [PSM %d mode %s (0x%02x)] {chan %d}",
@@ -3201,6 +3370,7 @@ void l2cap_frame(uint16_t index, bool in, uint16_t handle, uint16_t cid,
 			chan->sdu -= frame.size;
 			break;
 		case L2CAP_MODE_BASIC:
+			json_field_uint("Channel", cid);
 			print_indent(6, COLOR_CYAN, "Channel:", "", COLOR_OFF,
 					" %d len %d [PSM %d mode %s (0x%02x)] "
 					"{chan %d}", cid, size, frame.psm,
@@ -3214,6 +3384,7 @@ void l2cap_frame(uint16_t index, bool in, uint16_t handle, uint16_t cid,
 				if (!l2cap_frame_get_le32(&frame, &ctrl32))
 					return;
 
+				json_field_uint("Channel", cid);
 				print_indent(6, COLOR_CYAN, "Channel:", "",
 						COLOR_OFF, " %d len %d"
 						" ext_ctrl 0x%8.8x"
@@ -3227,6 +3398,7 @@ void l2cap_frame(uint16_t index, bool in, uint16_t handle, uint16_t cid,
 				if (!l2cap_frame_get_le16(&frame, &ctrl16))
 					return;
 
+				json_field_uint("Channel", cid);
 				print_indent(6, COLOR_CYAN, "Channel:", "",
 						COLOR_OFF, " %d len %d"
 						" ctrl 0x%4.4x"
@@ -3237,8 +3409,6 @@ void l2cap_frame(uint16_t index, bool in, uint16_t handle, uint16_t cid,
 
 				l2cap_ctrl_parse(&frame, ctrl16);
 			}
-
-			printf("\n");
 			break;
 		}
 
@@ -157,6 +157,9 @@ static inline bool l2cap_frame_get_be128(struct l2cap_frame *frame,
 	return true;
 }
 
+void l2cap_setup(void);
+void l2cap_cleanup(void);
+
 void l2cap_frame(uint16_t index, bool in, uint16_t handle, uint16_t cid,
 		uint16_t psm, const void *data, uint16_t size);
 
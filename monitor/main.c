@@ -18,16 +18,20 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <getopt.h>
 #include <sys/un.h>
 
+#include "src/shared/util.h"
 #include "src/shared/mainloop.h"
 #include "src/shared/tty.h"
 
 #include "packet.h"
+#include "l2cap.h"
 #include "lmp.h"
 #include "keys.h"
 #include "analyze.h"
+#include "filter.h"
 #include "ellisys.h"
 #include "control.h"
 #include "display.h"
@@ -49,11 +53,19 @@ static void usage(void)
 	printf("\tbtmon [options]\n");
 	printf("options:\n"
 		"\t-r, --read <file>      Read traces in btsnoop format\n"
+		"\t-o, --offset <secs>    Start reading at time offset\n"
+		"\t-n, --records <first>[-<last>]\n"
+		"\t                       Read only specified records\n"
+		"\t-j, --jobs <num>       Decode traces with multiple processes\n"
 		"\t-w, --write <file>     Save traces in btsnoop format\n"
+		"\t-b, --buffer <size>    Buffer traces written to file\n"
 		"\t-a, --analyze <file>   Analyze traces in btsnoop format\n"
+		"\t-X, --csv <file>       Export analyze statistics as CSV\n"
 		"\t-s, --server <socket>  Start monitor server socket\n"
 		"\t-p, --priority <level> Show only priority or lower\n"
 		"\t-i, --index <num>      Show only specified controller\n"
+		"\t-f, --filter <expr>    Show and save only matching packets\n"
+		"\t-Q, --queue <size>     Set monitor socket receive queue size\n"
 		"\t-d, --tty <tty>        Read data from TTY\n"
 		"\t-B, --tty-speed <rate> Set TTY speed (default 115200)\n"
 		"\t-V, --vendor <compid>  Set default company identifier\n"
@@ -70,16 +82,24 @@ static void usage(void)
 		"\t                       RTT control block parameters\n"
 		"\t-C, --columns [width]  Output width if not a terminal\n"
 		"\t-c, --color [mode]     Output color: auto/always/never\n"
+		"\t-F, --format [format]  Output format: text/json\n"
 		"\t-h, --help             Show help options\n");
 }
 
 static const struct option main_options[] = {
 	{ "read",      required_argument, NULL, 'r' },
+	{ "offset",    required_argument, NULL, 'o' },
+	{ "records",   required_argument, NULL, 'n' },
+	{ "jobs",      required_argument, NULL, 'j' },
 	{ "write",     required_argument, NULL, 'w' },
+	{ "buffer",    required_argument, NULL, 'b' },
 	{ "analyze",   required_argument, NULL, 'a' },
+	{ "csv",       required_argument, NULL, 'X' },
 	{ "server",    required_argument, NULL, 's' },
 	{ "priority",  required_argument, NULL, 'p' },
 	{ "index",     required_argument, NULL, 'i' },
+	{ "filter",    required_argument, NULL, 'f' },
+	{ "queue",     required_argument, NULL, 'Q' },
 	{ "tty",       required_argument, NULL, 'd' },
 	{ "tty-speed", required_argument, NULL, 'B' },
 	{ "vendor",    required_argument, NULL, 'V' },
@@ -95,6 +115,7 @@ static const struct option main_options[] = {
 	{ "rtt",       required_argument, NULL, 'R' },
 	{ "columns",   required_argument, NULL, 'C' },
 	{ "color",     required_argument, NULL, 'c' },
+	{ "format",    required_argument, NULL, 'F' },
 	{ "todo",      no_argument,       NULL, '#' },
 	{ "version",   no_argument,       NULL, 'v' },
 	{ "help",      no_argument,       NULL, 'h' },
@@ -107,12 +128,20 @@ int main(int argc, char *argv[])
 	bool use_pager = true;
 	const char *reader_path = NULL;
 	const char *writer_path = NULL;
+	size_t writer_buffer = 0;
+	unsigned long queue_size;
+	unsigned long first, last;
+	unsigned long jobs = 1;
+	struct timeval offset;
+	double secs;
 	const char *analyze_path = NULL;
+	const char *csv_path = NULL;
 	const char *ellisys_server = NULL;
 	const char *tty = NULL;
 	unsigned int tty_speed = B115200;
 	unsigned short ellisys_port = 0;
 	const char *str;
+	char *endptr;
 	char *jlink = NULL;
 	char *rtt = NULL;
 	int exit_status;
@@ -126,7 +155,7 @@ int main(int argc, char *argv[])
 		struct sockaddr_un addr;
 
 		opt = getopt_long(argc, argv,
-					"r:w:a:s:p:i:d:B:V:MNtTSAE:PJ:R:C:c:vh",
+					"r:o:n:j:w:b:a:X:s:p:i:f:Q:d:B:V:MNtTSAE:PJ:R:C:c:F:vh",
 					main_options, NULL);
 		if (opt < 0)
 			break;
@@ -135,12 +164,59 @@ int main(int argc, char *argv[])
 		case 'r':
 			reader_path = optarg;
 			break;
+		case 'o':
+			secs = strtod(optarg, &endptr);
+			if (*endptr != '\0' || secs < 0) {
+				fprintf(stderr, "Invalid time offset\n");
+				return EXIT_FAILURE;
+			}
+
+			offset.tv_sec = secs;
+			offset.tv_usec = (secs - offset.tv_sec) * 1000000;
+			control_set_time_offset(&offset);
+			break;
+		case 'n':
+			first = strtoul(optarg, &endptr, 10);
+			last = ULONG_MAX;
+
+			if (*endptr == '-')
+				last = strtoul(endptr + 1, &endptr, 10);
+
+			if (*endptr != '\0' || !first || last < first) {
+				fprintf(stderr, "Invalid record range\n");
+				return EXIT_FAILURE;
+			}
+
+			/* Records are numbered from 1 on the command line */
+			control_set_records(first - 1, last - 1);
+			break;
+		case 'j':
+			jobs = strtoul(optarg, &endptr, 10);
+			if (*endptr != '\0' || !jobs || jobs > 256) {
+				fprintf(stderr, "Invalid number of jobs\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'w':
 			writer_path = optarg;
 			break;
+		case 'b':
+			writer_buffer = strtoul(optarg, &endptr, 10);
+			if (*endptr == 'K' || *endptr == 'k')
+				writer_buffer *= 1024;
+			else if (*endptr == 'M' || *endptr == 'm')
+				writer_buffer *= 1024 * 1024;
+			else if (*endptr != '\0') {
+				fprintf(stderr, "Invalid buffer size\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'a':
 			analyze_path = optarg;
 			break;
+		case 'X':
+			csv_path = optarg;
+			break;
 		case 's':
 			if (strlen(optarg) > sizeof(addr.sun_path) - 1) {
 				fprintf(stderr, "Socket name too long\n");
@@ -162,6 +238,28 @@ int main(int argc, char *argv[])
 			}
 			packet_select_index(atoi(str));
 			break;
+		case 'f':
+			if (!filter_compile(optarg))
+				return EXIT_FAILURE;
+			break;
+		case 'Q':
+			queue_size = strtoul(optarg, &endptr, 10);
+			if (*endptr == 'K' || *endptr == 'k')
+				queue_size *= 1024;
+			else if (*endptr == 'M' || *endptr == 'm')
+				queue_size *= 1024 * 1024;
+			else if (*endptr != '\0') {
+				fprintf(stderr, "Invalid queue size\n");
+				return EXIT_FAILURE;
+			}
+
+			if (queue_size > INT_MAX) {
+				fprintf(stderr, "Queue size too large\n");
+				return EXIT_FAILURE;
+			}
+
+			control_set_queue_size(queue_size);
+			break;
 		case 'd':
 			tty = optarg;
 			break;
@@ -226,6 +324,17 @@ int main(int argc, char *argv[])
 				return EXIT_FAILURE;
 			}
 			break;
+		case 'F':
+			if (strcmp("json", optarg) == 0)
+				set_json_output(true);
+			else if (strcmp("text", optarg) == 0)
+				set_json_output(false);
+			else {
+				fprintf(stderr, "Format option must be one of "
+						"text/json\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		case '#':
 			packet_todo();
 			lmp_todo();
@@ -251,45 +360,75 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	printf("Bluetooth monitor ver %s\n", VERSION);
+	if (csv_path && !analyze_path) {
+		fprintf(stderr, "CSV export requires analyze\n");
+		return EXIT_FAILURE;
+	}
+
+	if (use_json()) {
+		if (analyze_path ||
+				(filter_mask & PACKET_FILTER_SHOW_MGMT_SOCKET)) {
+			fprintf(stderr, "JSON output can't be combined with "
+						"analyze or mgmt channel\n");
+			return EXIT_FAILURE;
+		}
+
+		set_monitor_color(COLOR_NEVER);
+	} else
+		printf("Bluetooth monitor ver %s\n", VERSION);
 
 	keys_setup();
+	packet_setup();
+	l2cap_setup();
 
 	packet_set_filter(filter_mask);
 
 	if (analyze_path) {
-		analyze_trace(analyze_path);
-		return EXIT_SUCCESS;
+		analyze_trace(analyze_path, csv_path);
+		exit_status = EXIT_SUCCESS;
+		goto done;
 	}
 
 	if (reader_path) {
 		if (ellisys_server)
 			ellisys_enable(ellisys_server, ellisys_port);
+		else
+			control_set_jobs(jobs);
 
 		control_reader(reader_path, use_pager);
-		return EXIT_SUCCESS;
+		exit_status = EXIT_SUCCESS;
+		goto done;
 	}
 
-	if (writer_path && !control_writer(writer_path)) {
+	if (writer_path && !control_writer(writer_path, writer_buffer)) {
 		printf("Failed to open '%s'\n", writer_path);
-		return EXIT_FAILURE;
+		exit_status = EXIT_FAILURE;
+		goto done;
 	}
 
 	if (ellisys_server)
 		ellisys_enable(ellisys_server, ellisys_port);
 
+	exit_status = EXIT_FAILURE;
+
 	if (!tty && !jlink && control_tracing() < 0)
-		return EXIT_FAILURE;
+		goto done;
 
 	if (tty && control_tty(tty, tty_speed) < 0)
-		return EXIT_FAILURE;
+		goto done;
 
 	if (jlink && control_rtt(jlink, rtt) < 0)
-		return EXIT_FAILURE;
+		goto done;
 
 	exit_status = mainloop_run_with_signal(signal_callback, NULL);
 
+	control_cleanup();
+
+done:
+	l2cap_cleanup();
+	packet_cleanup();
 	keys_cleanup();
+	filter_cleanup();
 
 	return exit_status;
 }
@@ -96,6 +96,7 @@
 #define UNKNOWN_MANUFACTURER 0xffff
 
 static time_t time_offset = ((time_t) -1);
+static const struct timeval *current_tv;
 static int priority_level = BTSNOOP_PRIORITY_INFO;
 static unsigned long filter_mask = 0;
 static bool index_filter = false;
@@ -273,6 +274,23 @@ struct index_data {
 
 static struct index_data index_list[MAX_INDEX];
 
+/* Timestamp of the ACL packet currently being decoded, if known */
+const struct timeval *packet_get_time(void)
+{
+	return current_tv;
+}
+
+void packet_set_time_offset(time_t offset)
+{
+	time_offset = offset;
+}
+
+void packet_set_frame(uint16_t index, size_t frame)
+{
+	if (index < MAX_INDEX)
+		index_list[index].frame = frame;
+}
+
 void packet_set_fallback_manufacturer(uint16_t manufacturer)
 {
 	int i;
@@ -299,6 +317,17 @@ static void print_packet(struct timeval *tv, struct ucred *cred, char ident,
 	int n, ts_len = 0, ts_pos = 0, len = 0, pos = 0;
 	static size_t last_frame;
 
+	if (use_json()) {
+		json_print_packet(tv, index);
+
+		if (!strcmp(color, COLOR_ERROR)) {
+			json_print_str("type", "error");
+			json_print_str("message", label);
+		}
+
+		return;
+	}
+
 	if (channel) {
 		if (use_color()) {
 			n = sprintf(ts_str + ts_pos, "%s", COLOR_CHANNEL_LABEL);
@@ -445,6 +474,25 @@ static void print_packet(struct timeval *tv, struct ucred *cred, char ident,
 		printf("%s\n", line);
 }
 
+static void json_print_data(const char *type, uint16_t index, bool in,
+				uint16_t handle, uint8_t flags, uint16_t dlen)
+{
+	json_print_str("type", type);
+	json_print_uint("frame", index_list[index].frame);
+	json_print_str("dir", in ? "rx" : "tx");
+	json_print_uint("handle", handle);
+	json_print_uint("flags", flags);
+	json_print_uint("dlen", dlen);
+}
+
+static void json_print_ctrl(const char *type, uint32_t cookie,
+							uint16_t format)
+{
+	json_print_str("type", type);
+	json_print_uint("cookie", cookie);
+	json_print_uint("format", format);
+}
+
 static const struct {
 	uint8_t error;
 	const char *str;
@@ -553,6 +601,7 @@ static void print_error(const char *label, uint8_t error)
 		color_off = "";
 	}
 
+	json_field_uint(label, error);
 	print_field("%s: %s%s%s (0x%2.2x)", label,
 				color_on, str, color_off, error);
 }
@@ -588,6 +637,7 @@ static void print_enable(const char *label, uint8_t enable)
 		break;
 	}
 
+	json_field_uint(label, enable);
 	print_field("%s: %s (0x%2.2x)", label, str, enable);
 }
 
@@ -607,6 +657,7 @@ static void print_addr_type(const char *label, uint8_t addr_type)
 		break;
 	}
 
+	json_field_uint(label, addr_type);
 	print_field("%s: %s (0x%2.2x)", label, str, addr_type);
 }
 
@@ -628,6 +679,7 @@ static void print_own_addr_type(uint8_t addr_type)
 		break;
 	}
 
+	json_field_uint("Own address type", addr_type);
 	print_field("Own address type: %s (0x%2.2x)", str, addr_type);
 }
 
@@ -653,6 +705,7 @@ static void print_peer_addr_type(const char *label, uint8_t addr_type)
 		break;
 	}
 
+	json_field_uint(label, addr_type);
 	print_field("%s: %s (0x%2.2x)", label, str, addr_type);
 }
 
@@ -661,6 +714,14 @@ static void print_addr_resolve(const char *label, const uint8_t *addr,
 {
 	const char *str;
 	char *company;
+	char addr_str[18];
+
+	if (use_json()) {
+		sprintf(addr_str, "%2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X",
+					addr[5], addr[4], addr[3],
+					addr[2], addr[1], addr[0]);
+		json_field_str(label, addr_str);
+	}
 
 	switch (addr_type) {
 	case 0x00:
@@ -734,11 +795,13 @@ static void print_bdaddr(const uint8_t *bdaddr)
 
 static void print_lt_addr(uint8_t lt_addr)
 {
+	json_field_uint("LT address", lt_addr);
 	print_field("LT address: %d", lt_addr);
 }
 
 static void print_handle_native(uint16_t handle)
 {
+	json_field_uint("Handle", handle);
 	print_field("Handle: %d", handle);
 }
 
@@ -749,6 +812,7 @@ static void print_handle(uint16_t handle)
 
 static void print_phy_handle(uint8_t phy_handle)
 {
+	json_field_uint("Physical handle", phy_handle);
 	print_field("Physical handle: %d", phy_handle);
 }
 
@@ -2198,12 +2262,14 @@ static void print_rssi(int8_t rssi)
 
 static void print_slot_625(const char *label, uint16_t value)
 {
-	 print_field("%s: %.3f msec (0x%4.4x)", label,
+	json_field_uint(label, le16_to_cpu(value));
+	print_field("%s: %.3f msec (0x%4.4x)", label,
 				le16_to_cpu(value) * 0.625, le16_to_cpu(value));
 }
 
 static void print_slot_125(const char *label, uint16_t value)
 {
+	json_field_uint(label, le16_to_cpu(value));
 	print_field("%s: %.2f msec (0x%4.4x)", label,
 				le16_to_cpu(value) * 1.25, le16_to_cpu(value));
 }
@@ -2225,6 +2291,7 @@ static void print_window(uint16_t window)
 
 static void print_conn_latency(const char *label, uint16_t value)
 {
+	json_field_uint(label, le16_to_cpu(value));
 	print_field("%s: %u (0x%4.4x)", label, le16_to_cpu(value),
 							le16_to_cpu(value));
 }
@@ -2245,6 +2312,7 @@ static void print_role(uint8_t role)
 		break;
 	}
 
+	json_field_uint("Role", role);
 	print_field("Role: %s (0x%2.2x)", str, role);
 }
 
@@ -3801,6 +3869,8 @@ void packet_print_handle(uint16_t handle)
 
 void packet_print_rssi(const char *label, int8_t rssi)
 {
+	json_field_int(label, rssi);
+
 	if ((uint8_t) rssi == 0x99 || rssi == 127)
 		print_field("%s: invalid (0x%2.2x)", label, (uint8_t) rssi);
 	else
@@ -4073,9 +4143,13 @@ void packet_monitor(struct timeval *tv, struct ucred *cred,
 		sprintf(extra_str, "(code %d len %d)", opcode, size);
 		print_packet(tv, cred, '*', index, NULL, COLOR_ERROR,
 					"Unknown packet", NULL, extra_str);
+		json_print_uint("opcode", opcode);
+		json_print_uint("len", size);
 		packet_hexdump(data, size);
 		break;
 	}
+
+	json_flush();
 }
 
 void packet_simulator(struct timeval *tv, uint16_t frequency,
@@ -4090,6 +4164,8 @@ void packet_simulator(struct timeval *tv, uint16_t frequency,
 
 	print_packet(tv, NULL, '*', 0, NULL, COLOR_PHY_PACKET,
 					"Physical packet:", NULL, str);
+	json_print_str("type", "phy");
+	json_print_uint("frequency", frequency);
 
 	ll_packet(frequency, data, size, false);
 }
@@ -9325,6 +9401,66 @@ static const struct opcode_data opcode_table[] = {
 	{ }
 };
 
+/*
+ * Indexes into the opcode, event and LE meta event tables. They are built
+ * by packet_setup() before decoding starts, so lookups never modify shared
+ * state. The opcode index is open addressed and stores the table position
+ * plus one so that zero marks an empty slot.
+ */
+#define OPCODE_INDEX_SIZE 1024
+
+struct packet_index {
+	uint16_t opcode[OPCODE_INDEX_SIZE];
+	const struct event_data *event[256];
+	const struct subevent_data *le_meta_event[256];
+};
+
+static struct packet_index *packet_index;
+
+static unsigned int opcode_slot(uint16_t opcode)
+{
+	unsigned int slot;
+
+	slot = cmd_opcode_ocf(opcode) ^ (cmd_opcode_ogf(opcode) << 7);
+	slot &= OPCODE_INDEX_SIZE - 1;
+
+	/* Linear probing until the opcode or an empty slot is found */
+	while (packet_index->opcode[slot] &&
+			opcode_table[packet_index->opcode[slot] - 1].opcode !=
+								opcode)
+		slot = (slot + 1) & (OPCODE_INDEX_SIZE - 1);
+
+	return slot;
+}
+
+static const struct opcode_data *opcode_lookup(uint16_t opcode)
+{
+	unsigned int slot;
+	int i;
+
+	if (!packet_index) {
+		for (i = 0; opcode_table[i].str; i++) {
+			if (opcode_table[i].opcode == opcode)
+				return &opcode_table[i];
+		}
+
+		return NULL;
+	}
+
+	slot = opcode_slot(opcode);
+	if (!packet_index->opcode[slot])
+		return NULL;
+
+	return &opcode_table[packet_index->opcode[slot] - 1];
+}
+
+const char *packet_opcode_str(uint16_t opcode)
+{
+	const struct opcode_data *opcode_data = opcode_lookup(opcode);
+
+	return opcode_data ? opcode_data->str : NULL;
+}
+
 static const char *get_supported_command(int bit)
 {
 	int i;
@@ -9572,14 +9708,8 @@ static void cmd_complete_evt(const void *data, uint8_t size)
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char vendor_str[150];
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->rsp_func)
@@ -9621,6 +9751,7 @@ static void cmd_complete_evt(const void *data, uint8_t size)
 		}
 	}
 
+	json_field_uint("Command", opcode);
 	print_indent(6, opcode_color, "", opcode_str, COLOR_OFF,
 			" (0x%2.2x|0x%4.4x) ncmd %d", ogf, ocf, evt->ncmd);
 
@@ -9667,14 +9798,8 @@ static void cmd_status_evt(const void *data, uint8_t size)
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char vendor_str[150];
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		opcode_color = COLOR_HCI_COMMAND;
@@ -9704,6 +9829,7 @@ static void cmd_status_evt(const void *data, uint8_t size)
 		}
 	}
 
+	json_field_uint("Command", opcode);
 	print_indent(6, opcode_color, "", opcode_str, COLOR_OFF,
 			" (0x%2.2x|0x%4.4x) ncmd %d", ogf, ocf, evt->ncmd);
 
@@ -10904,6 +11030,7 @@ static void print_subevent(const struct subevent_data *subevent_data,
 	else
 		subevent_color = COLOR_HCI_EVENT_UNKNOWN;
 
+	json_field_uint("Subevent", subevent_data->subevent);
 	print_indent(6, subevent_color, "", subevent_data->str, COLOR_OFF,
 					" (0x%2.2x)", subevent_data->subevent);
 
@@ -11007,12 +11134,26 @@ static const struct subevent_data le_meta_event_table[] = {
 	{ }
 };
 
+static const struct subevent_data *le_meta_event_lookup(uint8_t subevent)
+{
+	int i;
+
+	if (packet_index)
+		return packet_index->le_meta_event[subevent];
+
+	for (i = 0; le_meta_event_table[i].str; i++) {
+		if (le_meta_event_table[i].subevent == subevent)
+			return &le_meta_event_table[i];
+	}
+
+	return NULL;
+}
+
 static void le_meta_event_evt(const void *data, uint8_t size)
 {
 	uint8_t subevent = *((const uint8_t *) data);
 	struct subevent_data unknown;
-	const struct subevent_data *subevent_data = &unknown;
-	int i;
+	const struct subevent_data *subevent_data;
 
 	unknown.subevent = subevent;
 	unknown.str = "Unknown";
@@ -11020,12 +11161,9 @@ static void le_meta_event_evt(const void *data, uint8_t size)
 	unknown.size = 0;
 	unknown.fixed = true;
 
-	for (i = 0; le_meta_event_table[i].str; i++) {
-		if (le_meta_event_table[i].subevent == subevent) {
-			subevent_data = &le_meta_event_table[i];
-			break;
-		}
-	}
+	subevent_data = le_meta_event_lookup(subevent);
+	if (!subevent_data)
+		subevent_data = &unknown;
 
 	print_subevent(subevent_data, data + 1, size - 1);
 }
@@ -11229,6 +11367,61 @@ static const struct event_data event_table[] = {
 	{ }
 };
 
+static const struct event_data *event_lookup(uint8_t event)
+{
+	int i;
+
+	if (packet_index)
+		return packet_index->event[event];
+
+	for (i = 0; event_table[i].str; i++) {
+		if (event_table[i].event == event)
+			return &event_table[i];
+	}
+
+	return NULL;
+}
+
+void packet_setup(void)
+{
+	unsigned int slot;
+	int i;
+
+	if (packet_index)
+		return;
+
+	packet_index = new0(struct packet_index, 1);
+
+	/* First entry wins for duplicate codes, like the table scans */
+	for (i = 0; opcode_table[i].str; i++) {
+		slot = opcode_slot(opcode_table[i].opcode);
+
+		if (!packet_index->opcode[slot])
+			packet_index->opcode[slot] = i + 1;
+	}
+
+	for (i = 0; event_table[i].str; i++) {
+		uint8_t code = event_table[i].event;
+
+		if (!packet_index->event[code])
+			packet_index->event[code] = &event_table[i];
+	}
+
+	for (i = 0; le_meta_event_table[i].str; i++) {
+		uint8_t code = le_meta_event_table[i].subevent;
+
+		if (!packet_index->le_meta_event[code])
+			packet_index->le_meta_event[code] =
+						&le_meta_event_table[i];
+	}
+}
+
+void packet_cleanup(void)
+{
+	free(packet_index);
+	packet_index = NULL;
+}
+
 void packet_new_index(struct timeval *tv, uint16_t index, const char *label,
 				uint8_t type, uint8_t bus, const char *name)
 {
@@ -11239,24 +11432,35 @@ void packet_new_index(struct timeval *tv, uint16_t index, const char *label,
 
 	print_packet(tv, NULL, '=', index, NULL, COLOR_NEW_INDEX,
 					"New Index", label, details);
+	json_print_str("type", "new_index");
+	json_print_str("addr", label);
+	json_print_str("hci_type", hci_typetostr(type));
+	json_print_str("bus", hci_bustostr(bus));
+	json_print_str("name", name);
 }
 
 void packet_del_index(struct timeval *tv, uint16_t index, const char *label)
 {
 	print_packet(tv, NULL, '=', index, NULL, COLOR_DEL_INDEX,
 					"Delete Index", label, NULL);
+	json_print_str("type", "del_index");
+	json_print_str("addr", label);
 }
 
 void packet_open_index(struct timeval *tv, uint16_t index, const char *label)
 {
 	print_packet(tv, NULL, '=', index, NULL, COLOR_OPEN_INDEX,
 					"Open Index", label, NULL);
+	json_print_str("type", "open_index");
+	json_print_str("addr", label);
 }
 
 void packet_close_index(struct timeval *tv, uint16_t index, const char *label)
 {
 	print_packet(tv, NULL, '=', index, NULL, COLOR_CLOSE_INDEX,
 					"Close Index", label, NULL);
+	json_print_str("type", "close_index");
+	json_print_str("addr", label);
 }
 
 void packet_index_info(struct timeval *tv, uint16_t index, const char *label,
@@ -11268,6 +11472,9 @@ void packet_index_info(struct timeval *tv, uint16_t index, const char *label,
 
 	print_packet(tv, NULL, '=', index, NULL, COLOR_INDEX_INFO,
 					"Index Info", label, details);
+	json_print_str("type", "index_info");
+	json_print_str("addr", label);
+	json_print_uint("manufacturer", manufacturer);
 }
 
 void packet_vendor_diag(struct timeval *tv, uint16_t index,
@@ -11280,6 +11487,9 @@ void packet_vendor_diag(struct timeval *tv, uint16_t index,
 
 	print_packet(tv, NULL, '=', index, NULL, COLOR_VENDOR_DIAG,
 					"Vendor Diagnostic", NULL, extra_str);
+	json_print_str("type", "vendor_diag");
+	json_print_uint("manufacturer", manufacturer);
+	json_print_uint("len", size);
 
 	switch (manufacturer) {
 	case 15:
@@ -11296,6 +11506,8 @@ void packet_system_note(struct timeval *tv, struct ucred *cred,
 {
 	print_packet(tv, cred, '=', index, NULL, COLOR_SYSTEM_NOTE,
 					"Note", message, NULL);
+	json_print_str("type", "note");
+	json_print_str("message", message);
 }
 
 struct monitor_l2cap_hdr {
@@ -11318,6 +11530,11 @@ static void packet_decode(struct timeval *tv, struct ucred *cred, char dir,
 	print_packet(tv, cred, dir, index, NULL, COLOR_HCI_ACLDATA, label,
 				dir == '>' ? "User Data RX" : "User Data TX",
 				NULL);
+	json_print_str("type", "user_data");
+	json_print_str("dir", dir == '>' ? "rx" : "tx");
+	json_print_str("source", label);
+	json_print_uint("cid", hdr->cid);
+	json_print_uint("psm", hdr->psm);
 
 	/* Discard last byte since it just a filler */
 	l2cap_frame(index, dir == '>', 0, hdr->cid, hdr->psm,
@@ -11390,6 +11607,10 @@ void packet_user_logging(struct timeval *tv, struct ucred *cred,
 	}
 
 	print_packet(tv, cred, '=', index, NULL, color, label, data, NULL);
+	json_print_str("type", "log");
+	json_print_str("source", label);
+	json_print_uint("priority", priority);
+	json_print_str("message", data);
 }
 
 void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
@@ -11403,7 +11624,6 @@ void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char extra_str[25], vendor_str[150];
-	int i;
 
 	if (index >= MAX_INDEX) {
 		print_field("Invalid index (%d).", index);
@@ -11422,12 +11642,7 @@ void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += HCI_COMMAND_HDR_SIZE;
 	size -= HCI_COMMAND_HDR_SIZE;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->cmd_func)
@@ -11473,6 +11688,13 @@ void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 	print_packet(tv, cred, '<', index, NULL, opcode_color, "HCI Command",
 							opcode_str, extra_str);
+	json_print_str("type", "command");
+	json_print_uint("frame", index_list[index].frame);
+	json_print_uint("opcode", opcode);
+	json_print_uint("ogf", ogf);
+	json_print_uint("ocf", ocf);
+	json_print_str("name", opcode_str);
+	json_print_uint("plen", hdr->plen);
 
 	if (!opcode_data || !opcode_data->cmd_func) {
 		packet_hexdump(data, size);
@@ -11510,7 +11732,6 @@ void packet_hci_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct event_data *event_data = NULL;
 	const char *event_color, *event_str;
 	char extra_str[25];
-	int i;
 
 	if (index >= MAX_INDEX) {
 		print_field("Invalid index (%d).", index);
@@ -11531,12 +11752,7 @@ void packet_hci_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += HCI_EVENT_HDR_SIZE;
 	size -= HCI_EVENT_HDR_SIZE;
 
-	for (i = 0; event_table[i].str; i++) {
-		if (event_table[i].event == hdr->evt) {
-			event_data = &event_table[i];
-			break;
-		}
-	}
+	event_data = event_lookup(hdr->evt);
 
 	if (event_data) {
 		if (event_data->func)
@@ -11553,6 +11769,11 @@ void packet_hci_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 	print_packet(tv, cred, '>', index, NULL, event_color, "HCI Event",
 						event_str, extra_str);
+	json_print_str("type", "event");
+	json_print_uint("frame", index_list[index].frame);
+	json_print_uint("event", hdr->evt);
+	json_print_str("name", event_str);
+	json_print_uint("plen", hdr->plen);
 
 	if (!event_data || !event_data->func) {
 		packet_hexdump(data, size);
@@ -11619,6 +11840,7 @@ void packet_hci_acldata(struct timeval *tv, struct ucred *cred, uint16_t index,
 	print_packet(tv, cred, in ? '>' : '<', index, NULL, COLOR_HCI_ACLDATA,
 				in ? "ACL Data RX" : "ACL Data TX",
 						handle_str, extra_str);
+	json_print_data("acl", index, in, acl_handle(handle), flags, dlen);
 
 	if (size != dlen) {
 		print_text(COLOR_ERROR, "invalid packet size (%d != %d)",
@@ -11630,7 +11852,9 @@ void packet_hci_acldata(struct timeval *tv, struct ucred *cred, uint16_t index,
 	if (filter_mask & PACKET_FILTER_SHOW_ACL_DATA)
 		packet_hexdump(data, size);
 
+	current_tv = tv;
 	l2cap_packet(index, in, acl_handle(handle), flags, data, size);
+	current_tv = NULL;
 }
 
 void packet_hci_scodata(struct timeval *tv, struct ucred *cred, uint16_t index,
@@ -11668,6 +11892,8 @@ void packet_hci_scodata(struct timeval *tv, struct ucred *cred, uint16_t index,
 	print_packet(tv, cred, in ? '>' : '<', index, NULL, COLOR_HCI_SCODATA,
 				in ? "SCO Data RX" : "SCO Data TX",
 						handle_str, extra_str);
+	json_print_data("sco", index, in, acl_handle(handle), flags,
+								hdr->dlen);
 
 	if (size != hdr->dlen) {
 		print_text(COLOR_ERROR, "invalid packet size (%d != %d)",
@@ -11715,6 +11941,8 @@ void packet_hci_isodata(struct timeval *tv, struct ucred *cred, uint16_t index,
 	print_packet(tv, cred, in ? '>' : '<', index, NULL, COLOR_HCI_SCODATA,
 				in ? "ISO Data RX" : "ISO Data TX",
 						handle_str, extra_str);
+	json_print_data("iso", index, in, acl_handle(handle), flags,
+								hdr->dlen);
 
 	if (size != hdr->dlen) {
 		print_text(COLOR_ERROR, "invalid packet size (%d != %d)",
@@ -11801,6 +12029,11 @@ void packet_ctrl_open(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 		print_packet(tv, cred, '@', index, channel, COLOR_CTRL_OPEN,
 						title, comm, details);
+		json_print_ctrl("ctrl_open", cookie, format);
+		json_print_str("comm", comm);
+		json_print_uint("version", version);
+		json_print_uint("revision", revision);
+		json_print_uint("flags", flags);
 	} else {
 		char label[7];
 
@@ -11810,6 +12043,7 @@ void packet_ctrl_open(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 		print_packet(tv, cred, '@', index, channel, COLOR_CTRL_OPEN,
 						"Control Open", label, NULL);
+		json_print_ctrl("ctrl_open", cookie, format);
 	}
 
 	packet_hexdump(data, size);
@@ -11857,6 +12091,10 @@ void packet_ctrl_close(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 	print_packet(tv, cred, '@', index, channel, COLOR_CTRL_CLOSE,
 							title, label, NULL);
+	json_print_ctrl("ctrl_close", cookie, format);
+
+	if (format == CTRL_RAW || format == CTRL_USER || format == CTRL_MGMT)
+		json_print_str("comm", label);
 
 	packet_hexdump(data, size);
 }
@@ -14494,6 +14732,7 @@ void packet_ctrl_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 		print_packet(tv, cred, '@', index, channel, COLOR_CTRL_CLOSE,
 						"Control Command", label, NULL);
+		json_print_ctrl("ctrl_command", cookie, format);
 		packet_hexdump(data, size);
 		return;
 	}
@@ -14532,6 +14771,10 @@ void packet_ctrl_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 	print_packet(tv, cred, '@', index, channel, mgmt_color,
 					"MGMT Command", mgmt_str, extra_str);
+	json_print_ctrl("mgmt_command", cookie, format);
+	json_print_uint("opcode", opcode);
+	json_print_str("name", mgmt_str);
+	json_print_uint("plen", size);
 
 	if (!mgmt_data || !mgmt_data->func) {
 		packet_hexdump(data, size);
@@ -14588,6 +14831,7 @@ void packet_ctrl_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 		print_packet(tv, cred, '@', index, channel, COLOR_CTRL_CLOSE,
 						"Control Event", label, NULL);
+		json_print_ctrl("ctrl_event", cookie, format);
 		packet_hexdump(data, size);
 		return;
 	}
@@ -14626,6 +14870,10 @@ void packet_ctrl_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 
 	print_packet(tv, cred, '@', index, channel, mgmt_color,
 					"MGMT Event", mgmt_str, extra_str);
+	json_print_ctrl("mgmt_event", cookie, format);
+	json_print_uint("event", opcode);
+	json_print_str("name", mgmt_str);
+	json_print_uint("plen", size);
 
 	if (!mgmt_data || !mgmt_data->func) {
 		packet_hexdump(data, size);
@@ -23,6 +23,9 @@
 #define PACKET_FILTER_SHOW_A2DP_STREAM	(1 << 6)
 #define PACKET_FILTER_SHOW_MGMT_SOCKET	(1 << 7)
 
+void packet_setup(void);
+void packet_cleanup(void);
+
 bool packet_has_filter(unsigned long filter);
 void packet_set_filter(unsigned long filter);
 void packet_add_filter(unsigned long filter);
@@ -30,9 +33,14 @@ void packet_del_filter(unsigned long filter);
 
 void packet_set_priority(const char *priority);
 void packet_select_index(uint16_t index);
+void packet_set_frame(uint16_t index, size_t frame);
+void packet_set_time_offset(time_t offset);
+const struct timeval *packet_get_time(void);
 void packet_set_fallback_manufacturer(uint16_t manufacturer);
 void packet_set_msft_evt_prefix(const uint8_t *prefix, uint8_t len);
 
+const char *packet_opcode_str(uint16_t opcode);
+
 void packet_hexdump(const unsigned char *buf, uint16_t len);
 void packet_print_error(const char *label, uint8_t error);
 void packet_print_version(const char *label, uint8_t version,
@@ -137,17 +137,28 @@ static void print_rfcomm_hdr(struct rfcomm_frame *rfcomm_frame, uint8_t indent)
 static inline bool mcc_test(struct rfcomm_frame *rfcomm_frame, uint8_t indent)
 {
 	struct l2cap_frame *frame = &rfcomm_frame->l2cap_frame;
+	char *str;
+	size_t n = 0;
 	uint8_t data;
 
-	printf("%*cTest Data: 0x ", indent, ' ');
+	str = malloc(frame->size * 3 + 1);
+	if (!str)
+		return false;
+
+	str[0] = '\0';
 
 	while (frame->size > 1) {
-		if (!l2cap_frame_get_u8(frame, &data))
+		if (!l2cap_frame_get_u8(frame, &data)) {
+			free(str);
 			return false;
-		printf("%2.2x ", data);
+		}
+		n += sprintf(str + n, "%2.2x ", data);
 	}
 
-	printf("\n");
+	print_indent(indent, COLOR_OFF, "", "", COLOR_OFF, "Test Data: 0x %s",
+									str);
+
+	free(str);
 	return true;
 }
 
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 
 #include <dbus/dbus.h>
 #include <glib.h>
@@ -104,6 +105,8 @@ struct a2dp_setup {
 	GSList *caps;
 	gboolean reconfigure;
 	gboolean start;
+	gboolean cached;
+	struct timespec started;
 	GSList *cb;
 	GIOChannel *io;
 	guint id;
@@ -146,6 +149,7 @@ struct a2dp_channel {
 	struct avdtp *session;
 	struct queue *seps;
 	struct a2dp_last_used *last_used;
+	bool discovered;
 };
 
 static GSList *servers = NULL;
@@ -315,6 +319,16 @@ static int error_to_errno(struct avdtp_error *err)
 	}
 }
 
+static long setup_elapsed_ms(struct a2dp_setup *s)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - s->started.tv_sec) * 1000L +
+			(now.tv_nsec - s->started.tv_nsec) / 1000000L;
+}
+
 static gboolean finalize_config(gpointer data)
 {
 	struct a2dp_setup *s = data;
@@ -892,6 +906,9 @@ static void invalidate_remote_cache(struct a2dp_setup *setup,
 	}
 }
 
+static int setup_fallback(struct a2dp_setup *setup);
+static void channel_validate(struct a2dp_channel *chan);
+
 static void setconf_cfm(struct avdtp *session, struct avdtp_local_sep *sep,
 				struct avdtp_stream *stream,
 				struct avdtp_error *err, void *user_data)
@@ -910,6 +927,13 @@ static void setconf_cfm(struct avdtp *session, struct avdtp_local_sep *sep,
 	setup = find_setup_by_session(session);
 
 	if (err) {
+		/* Endpoints may have changed since they were cached */
+		if (setup && setup->cached) {
+			warn("Cached endpoint rejected: %s", avdtp_strerror(err));
+			if (setup_fallback(setup) == 0)
+				return;
+		}
+
 		if (setup) {
 			setup_ref(setup);
 			setup->err = err;
@@ -1120,9 +1144,21 @@ static void open_cfm(struct avdtp *session, struct avdtp_local_sep *sep,
 		setup->err = err;
 		if (setup->start)
 			finalize_resume(setup);
-	} else if (setup->chan)
+	} else if (setup->chan) {
 		update_last_used(setup->chan, a2dp_sep, stream);
 
+		if (setup->started.tv_sec)
+			DBG("Stream setup completed in %ld ms%s",
+					setup_elapsed_ms(setup),
+					setup->cached ? " using cache" : "");
+
+		if (!setup->chan->discovered)
+			channel_validate(setup->chan);
+	}
+
+	setup->cached = FALSE;
+	memset(&setup->started, 0, sizeof(setup->started));
+
 	finalize_config(setup);
 
 	return;
@@ -2061,8 +2097,15 @@ static const GDBusPropertyTable sep_properties[] = {
 static void remote_sep_destroy(void *user_data)
 {
 	struct a2dp_remote_sep *sep = user_data;
+	struct a2dp_channel *chan = sep->chan;
+
+	/* Don't leave LastUsed pointing to an endpoint that is gone */
+	if (chan->last_used && chan->last_used->rsep == sep) {
+		free(chan->last_used);
+		chan->last_used = NULL;
+	}
 
-	if (queue_remove(sep->chan->seps, sep))
+	if (queue_remove(chan->seps, sep))
 		remove_remote_sep(sep);
 }
 
@@ -2369,6 +2412,23 @@ found:
 	return avdtp_ref(chan->session);
 }
 
+/* Return the existing session with the device without connecting */
+struct avdtp *a2dp_avdtp_find(struct btd_device *device)
+{
+	struct a2dp_server *server;
+	struct a2dp_channel *chan;
+
+	server = find_server(servers, device_get_adapter(device));
+	if (server == NULL)
+		return NULL;
+
+	chan = queue_find(server->channels, match_by_device, device);
+	if (!chan)
+		return NULL;
+
+	return chan->session;
+}
+
 static void connect_cb(GIOChannel *io, GError *err, gpointer user_data)
 {
 	struct a2dp_channel *chan = user_data;
@@ -2851,6 +2911,20 @@ static void foreach_register_remote_sep(void *data, void *user_data)
 	register_remote_sep(data, user_data);
 }
 
+static void channel_discovered(struct a2dp_channel *chan, GSList *seps)
+{
+	g_slist_foreach(seps, foreach_register_remote_sep, chan);
+
+	chan->discovered = true;
+
+	/* Only store version has been initialized as features like
+	 * Delay Reporting may not be queried if the version in
+	 * unknown.
+	 */
+	if (avdtp_get_version(chan->session))
+		store_remote_seps(chan);
+}
+
 static void discover_cb(struct avdtp *session, GSList *seps,
 				struct avdtp_error *err, void *user_data)
 {
@@ -2863,20 +2937,110 @@ static void discover_cb(struct avdtp *session, GSList *seps,
 	if (err)
 		setup->err = err;
 
-	if (!err) {
-		g_slist_foreach(seps, foreach_register_remote_sep, setup->chan);
+	if (!err && !setup->cached)
+		channel_discovered(setup->chan, seps);
 
-		/* Only store version has been initialized as features like
-		 * Delay Reporting may not be queried if the version in
-		 * unknown.
-		 */
-		if (version)
-			store_remote_seps(setup->chan);
-	}
+	if (setup->started.tv_sec)
+		DBG("Discovery completed in %ld ms%s", setup_elapsed_ms(setup),
+					setup->cached ? " using cache" : "");
 
 	finalize_discover(setup);
 }
 
+static void validate_cb(struct avdtp *session, GSList *seps,
+				struct avdtp_error *err, void *user_data)
+{
+	struct a2dp_channel *chan = find_channel(session);
+
+	DBG("err %p", err);
+
+	if (!err && chan)
+		channel_discovered(chan, seps);
+}
+
+/* Confirms the cached endpoints once the stream has been set up, so that
+ * SEPs which have been added or removed are picked up by the cache.
+ */
+static void channel_validate(struct a2dp_channel *chan)
+{
+	int err;
+
+	err = avdtp_discover(chan->session, validate_cb, NULL);
+	if (err < 0)
+		DBG("Unable to validate cached endpoints: %s (%d)",
+							strerror(-err), -err);
+}
+
+static void fallback_cb(struct avdtp *session, GSList *seps,
+				struct avdtp_error *err, void *user_data)
+{
+	struct a2dp_setup *setup = user_data;
+	int posix_err = -EIO;
+	GSList *l;
+
+	DBG("err %p", err);
+
+	if (err)
+		goto failed;
+
+	channel_discovered(setup->chan, seps);
+
+	/* Delay Reporting is appended again if the SEP found supports it */
+	for (l = setup->caps; l; ) {
+		struct avdtp_service_capability *cap = l->data;
+
+		l = l->next;
+
+		if (cap->category != AVDTP_DELAY_REPORTING)
+			continue;
+
+		setup->caps = g_slist_remove(setup->caps, cap);
+		g_free(cap);
+	}
+
+	/* Retry the configuration selected before with the SEP found */
+	setup->rsep = find_remote_sep(setup->chan, setup->sep);
+	if (!setup->rsep) {
+		error("No matching ACP and INT SEPs found");
+		goto failed;
+	}
+
+	posix_err = avdtp_set_configuration(session, setup->rsep->sep,
+						setup->sep->lsep, setup->caps,
+						&setup->stream);
+	if (posix_err == 0)
+		goto done;
+
+	error("avdtp_set_configuration: %s", strerror(-posix_err));
+
+failed:
+	setup->stream = NULL;
+	finalize_setup_errno(setup, posix_err, finalize_config, NULL);
+done:
+	setup_unref(setup);
+}
+
+static int setup_fallback(struct a2dp_setup *setup)
+{
+	int err;
+
+	setup->cached = FALSE;
+	setup->stream = NULL;
+
+	err = avdtp_discover(setup->session, fallback_cb, setup_ref(setup));
+	if (err < 0)
+		setup_unref(setup);
+
+	return err;
+}
+
+static bool channel_use_cache(struct a2dp_channel *chan)
+{
+	/* Only skip discovery when the endpoint used last time is known */
+	return chan && !chan->discovered && chan->last_used &&
+					chan->last_used->rsep->from_cache;
+}
+
 unsigned int a2dp_discover(struct avdtp *session, a2dp_discover_cb_t cb,
 							void *user_data)
 {
@@ -2894,6 +3058,23 @@ unsigned int a2dp_discover(struct avdtp *session, a2dp_discover_cb_t cb,
 	cb_data->discover_cb = cb;
 	cb_data->user_data = user_data;
 
+	clock_gettime(CLOCK_MONOTONIC, &setup->started);
+
+	/* Configure the last used endpoint straight away, it is validated
+	 * once the stream is open or discovered again if it gets rejected.
+	 */
+	if (channel_use_cache(setup->chan)) {
+		setup->cached = TRUE;
+
+		if (avdtp_discover_cached(session, discover_cb, setup) == 0) {
+			DBG("Using cached endpoints");
+			setup->cb = g_slist_append(setup->cb, cb_data);
+			return cb_data->id;
+		}
+
+		setup->cached = FALSE;
+	}
+
 	if (avdtp_discover(session, discover_cb, setup) == 0) {
 		setup->cb = g_slist_append(setup->cb, cb_data);
 		return cb_data->id;
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <assert.h>
+#include <time.h>
 
 #include <glib.h>
 
@@ -293,6 +294,7 @@ struct in_buf {
 };
 
 struct pending_req {
+	struct avdtp *session;
 	uint8_t transaction;
 	uint8_t signal_id;
 	void *data;
@@ -300,6 +302,7 @@ struct pending_req {
 	struct avdtp_stream *stream; /* Set if the request targeted a stream */
 	unsigned int timeout;
 	gboolean collided;
+	struct timespec sent;
 };
 
 struct avdtp_remote_sep {
@@ -344,6 +347,7 @@ struct discover_callback {
 	unsigned int id;
 	avdtp_discover_cb_t cb;
 	void *user_data;
+	bool cached;
 };
 
 struct avdtp_stream {
@@ -403,6 +407,10 @@ struct avdtp {
 
 	struct discover_callback *discover;
 	struct pending_req *req;
+	GSList *pipeline; /* Requests sent while req is still pending */
+	uint8_t transaction; /* Next transaction label to try */
+
+	struct avdtp_latency latency[AVDTP_DELAY_REPORT + 1];
 
 	unsigned int dc_timer;
 	int dc_timeout;
@@ -449,6 +457,97 @@ static const char *avdtp_statestr(avdtp_state_t state)
 	}
 }
 
+static const char *avdtp_sigstr(uint8_t signal_id)
+{
+	switch (signal_id) {
+	case AVDTP_DISCOVER:
+		return "Discover";
+	case AVDTP_GET_CAPABILITIES:
+		return "GetCapabilities";
+	case AVDTP_SET_CONFIGURATION:
+		return "SetConfiguration";
+	case AVDTP_GET_CONFIGURATION:
+		return "GetConfiguration";
+	case AVDTP_RECONFIGURE:
+		return "Reconfigure";
+	case AVDTP_OPEN:
+		return "Open";
+	case AVDTP_START:
+		return "Start";
+	case AVDTP_CLOSE:
+		return "Close";
+	case AVDTP_SUSPEND:
+		return "Suspend";
+	case AVDTP_ABORT:
+		return "Abort";
+	case AVDTP_SECURITY_CONTROL:
+		return "SecurityControl";
+	case AVDTP_GET_ALL_CAPABILITIES:
+		return "GetAllCapabilities";
+	case AVDTP_DELAY_REPORT:
+		return "DelayReport";
+	default:
+		return "<unknown signal>";
+	}
+}
+
+static long req_elapsed_ms(struct pending_req *req)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - req->sent.tv_sec) * 1000L +
+			(now.tv_nsec - req->sent.tv_nsec) / 1000000L;
+}
+
+static const unsigned int latency_limits[AVDTP_LATENCY_BUCKETS - 1] = {
+	5, 10, 20, 50, 100, 200, 500, 1000
+};
+
+static const uint8_t latency_signals[] = {
+	AVDTP_DISCOVER,
+	AVDTP_GET_CAPABILITIES,
+	AVDTP_SET_CONFIGURATION,
+	AVDTP_OPEN,
+	AVDTP_START,
+	AVDTP_SUSPEND,
+};
+
+static void latency_record(struct avdtp *session, uint8_t signal_id, long ms)
+{
+	struct avdtp_latency *latency;
+	unsigned int i;
+
+	/* Account both capability queries together */
+	if (signal_id == AVDTP_GET_ALL_CAPABILITIES)
+		signal_id = AVDTP_GET_CAPABILITIES;
+
+	if (signal_id >= ARRAY_SIZE(session->latency))
+		return;
+
+	if (ms < 0)
+		ms = 0;
+
+	latency = &session->latency[signal_id];
+
+	if (!latency->count || ms < latency->min)
+		latency->min = ms;
+
+	if (ms > latency->max)
+		latency->max = ms;
+
+	latency->count++;
+	latency->total += ms;
+
+	for (i = 0; i < ARRAY_SIZE(latency_limits); i++) {
+		if (ms < latency_limits[i])
+			break;
+	}
+
+	latency->histogram[i]++;
+}
+
 static gboolean try_send(int sk, void *data, size_t len)
 {
 	int err;
@@ -1082,7 +1181,8 @@ static void finalize_discovery(struct avdtp *session, int err)
 	if (discover->id > 0)
 		g_source_remove(discover->id);
 
-	if (!err)
+	/* SEPs loaded from cache have not been confirmed by the remote */
+	if (!err && !discover->cached)
 		g_slist_foreach(session->seps, remove_disappeared, session);
 
 	if (discover->cb)
@@ -1138,6 +1238,7 @@ static void avdtp_free(void *data)
 	if (session->req)
 		pending_req_free(session->req);
 
+	g_slist_free_full(session->pipeline, pending_req_free);
 	g_slist_free_full(session->req_queue, pending_req_free);
 	g_slist_free_full(session->prio_queue, pending_req_free);
 	g_slist_free_full(session->seps, sep_free);
@@ -1160,6 +1261,10 @@ static void connection_lost(struct avdtp *session, int err)
 	g_slist_foreach(session->streams, (GFunc) release_stream, session);
 	session->streams = NULL;
 
+	/* Responses to pipelined requests can no longer arrive */
+	g_slist_free_full(session->pipeline, pending_req_free);
+	session->pipeline = NULL;
+
 	finalize_discovery(session, err);
 
 	avdtp_set_state(session, AVDTP_SESSION_STATE_DISCONNECTED);
@@ -2207,12 +2312,45 @@ static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
 	return PARSE_SUCCESS;
 }
 
+static int pending_req_transaction_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct pending_req *req = a;
+	uint8_t transaction = GPOINTER_TO_UINT(b);
+
+	if (req->transaction == transaction)
+		return 0;
+
+	return -1;
+}
+
+/* Make the pipelined request matching the transaction label the current one,
+ * the previous current request goes back to the front of the pipeline.
+ */
+static bool pipeline_select(struct avdtp *session, uint8_t transaction)
+{
+	GSList *l;
+
+	l = g_slist_find_custom(session->pipeline,
+					GUINT_TO_POINTER(transaction),
+					pending_req_transaction_cmp);
+	if (!l)
+		return false;
+
+	session->pipeline = g_slist_remove_link(session->pipeline, l);
+	session->pipeline = g_slist_prepend(session->pipeline, session->req);
+	session->req = l->data;
+	g_slist_free_1(l);
+
+	return true;
+}
+
 static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 				gpointer data)
 {
 	struct avdtp *session = data;
 	struct avdtp_common_header *header;
 	ssize_t size;
+	long elapsed;
 	int fd;
 
 	DBG("");
@@ -2268,7 +2406,8 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 		return TRUE;
 	}
 
-	if (header->transaction != session->req->transaction) {
+	if (header->transaction != session->req->transaction &&
+			!pipeline_select(session, header->transaction)) {
 		error("Transaction label doesn't match");
 		return TRUE;
 	}
@@ -2281,6 +2420,14 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 	timeout_remove(session->req->timeout);
 	session->req->timeout = 0;
 
+	elapsed = req_elapsed_ms(session->req);
+
+	DBG("%s %s after %ld ms", avdtp_sigstr(session->req->signal_id),
+			header->message_type == AVDTP_MSG_TYPE_ACCEPT ?
+			"accepted" : "rejected", elapsed);
+
+	latency_record(session, session->req->signal_id, elapsed);
+
 	switch (header->message_type) {
 	case AVDTP_MSG_TYPE_ACCEPT:
 		if (!avdtp_parse_resp(session, session->req->stream,
@@ -2520,17 +2667,41 @@ static uint8_t req_get_seid(struct pending_req *req)
 	return ((struct seid_req *) (req->data))->acp_seid;
 }
 
-static int cancel_request(struct avdtp *session, int err)
+static bool req_is_getcap(struct pending_req *req)
+{
+	return req->signal_id == AVDTP_GET_CAPABILITIES ||
+			req->signal_id == AVDTP_GET_ALL_CAPABILITIES;
+}
+
+/* Find the in flight request, current or pipelined, with the given label */
+static struct pending_req *find_inflight_req(struct avdtp *session,
+							uint8_t transaction)
+{
+	GSList *l;
+
+	if (session->req && session->req->transaction == transaction)
+		return session->req;
+
+	l = g_slist_find_custom(session->pipeline,
+					GUINT_TO_POINTER(transaction),
+					pending_req_transaction_cmp);
+
+	return l ? l->data : NULL;
+}
+
+static int cancel_request(struct avdtp *session, struct pending_req *req,
+								int err)
 {
-	struct pending_req *req;
 	struct seid_req sreq;
 	struct avdtp_local_sep *lsep;
 	struct avdtp_stream *stream;
 	uint8_t seid;
 	struct avdtp_error averr;
 
-	req = session->req;
-	session->req = NULL;
+	if (session->req == req)
+		session->req = NULL;
+	else
+		session->pipeline = g_slist_remove(session->pipeline, req);
 
 	avdtp_error_init(&averr, AVDTP_ERRNO, err);
 
@@ -2625,18 +2796,63 @@ done:
 
 static bool request_timeout(gpointer user_data)
 {
-	struct avdtp *session = user_data;
+	struct pending_req *req = user_data;
+	struct avdtp *session = req->session;
+
+	/* The timer is destroyed once this returns */
+	req->timeout = 0;
 
-	cancel_request(session, ETIMEDOUT);
+	cancel_request(session, req, ETIMEDOUT);
 
 	return FALSE;
 }
 
+static int transmit_req(struct avdtp *session, struct pending_req *req)
+{
+	int timeout;
+	int i;
+
+	/* Skip labels of requests still waiting for their response */
+	for (i = 0; i < 16; i++) {
+		req->transaction = session->transaction++;
+		session->transaction %= 16;
+
+		if (!find_inflight_req(session, req->transaction))
+			break;
+	}
+
+	if (i == 16)
+		return -EBUSY;
+
+	/* FIXME: Should we retry to send if the buffer
+	was not totally sent or in case of EINTR? */
+	if (!avdtp_send(session, req->transaction, AVDTP_MSG_TYPE_COMMAND,
+				req->signal_id, req->data, req->data_size))
+		return -EIO;
+
+	clock_gettime(CLOCK_MONOTONIC, &req->sent);
+
+	switch (req->signal_id) {
+	case AVDTP_ABORT:
+		timeout = ABORT_TIMEOUT;
+		break;
+	case AVDTP_SUSPEND:
+		timeout = SUSPEND_TIMEOUT;
+		break;
+	default:
+		timeout = REQ_TIMEOUT;
+	}
+
+	req->session = session;
+	req->timeout = timeout_add_seconds(timeout, request_timeout,
+						req, NULL);
+	return 0;
+}
+
 static int send_req(struct avdtp *session, gboolean priority,
 			struct pending_req *req)
 {
-	static int transaction = 0;
-	int err, timeout;
+	int err;
 
 	if (session->state == AVDTP_SESSION_STATE_DISCONNECTED) {
 		BtIOMode mode = btd_opts.avdtp.session_mode;
@@ -2660,32 +2876,12 @@ static int send_req(struct avdtp *session, gboolean priority,
 		return 0;
 	}
 
-	req->transaction = transaction++;
-	transaction %= 16;
-
-	/* FIXME: Should we retry to send if the buffer
-	was not totally sent or in case of EINTR? */
-	if (!avdtp_send(session, req->transaction, AVDTP_MSG_TYPE_COMMAND,
-				req->signal_id, req->data, req->data_size)) {
-		err = -EIO;
+	err = transmit_req(session, req);
+	if (err < 0)
 		goto failed;
-	}
 
 	session->req = req;
 
-	switch (req->signal_id) {
-	case AVDTP_ABORT:
-		timeout = ABORT_TIMEOUT;
-		break;
-	case AVDTP_SUSPEND:
-		timeout = SUSPEND_TIMEOUT;
-		break;
-	default:
-		timeout = REQ_TIMEOUT;
-	}
-
-	req->timeout = timeout_add_seconds(timeout, request_timeout,
-						session, NULL);
 	return 0;
 
 failed:
@@ -2953,8 +3149,7 @@ static gboolean avdtp_parse_resp(struct avdtp *session,
 		DBG("GET_%sCAPABILITIES request succeeded", get_all);
 		if (!avdtp_get_capabilities_resp(session, buf, size))
 			return FALSE;
-		if (!(next && (next->signal_id == AVDTP_GET_CAPABILITIES ||
-				next->signal_id == AVDTP_GET_ALL_CAPABILITIES)))
+		if (!session->pipeline && !(next && req_is_getcap(next)))
 			finalize_discovery(session, 0);
 		return TRUE;
 	}
@@ -3269,19 +3464,69 @@ gboolean avdtp_stream_get_transport(struct avdtp_stream *stream, int *sock,
 	return TRUE;
 }
 
+static GSList **next_queue(struct avdtp *session)
+{
+	if (session->prio_queue)
+		return &session->prio_queue;
+
+	return &session->req_queue;
+}
+
+/* Capability queries only read the state of the remote SEPs so, if enabled,
+ * send the ones queued behind the current one without waiting for its
+ * response. The transaction label is used to match the responses.
+ */
+static void pipeline_fill(struct avdtp *session)
+{
+	GSList **queue;
+	struct pending_req *req;
+
+	if (!session->req || !req_is_getcap(session->req))
+		return;
+
+	while (g_slist_length(session->pipeline) + 1 <
+						btd_opts.avdtp.pipeline) {
+		queue = next_queue(session);
+		if (!*queue)
+			return;
+
+		req = (*queue)->data;
+		if (!req_is_getcap(req))
+			return;
+
+		*queue = g_slist_remove(*queue, req);
+
+		if (transmit_req(session, req) < 0) {
+			pending_req_free(req);
+			return;
+		}
+
+		DBG("%s seid %u pipelined", avdtp_sigstr(req->signal_id),
+							req_get_seid(req));
+
+		session->pipeline = g_slist_append(session->pipeline, req);
+	}
+}
+
 static int process_queue(struct avdtp *session)
 {
 	GSList **queue, *l;
 	struct pending_req *req;
+	int err;
 
 	if (session->req)
 		return 0;
 
-	if (session->prio_queue)
-		queue = &session->prio_queue;
-	else
-		queue = &session->req_queue;
+	/* Requests already in flight take precedence */
+	if (session->pipeline) {
+		session->req = session->pipeline->data;
+		session->pipeline = g_slist_remove(session->pipeline,
+							session->req);
+		pipeline_fill(session);
+		return 0;
+	}
 
+	queue = next_queue(session);
 	if (!*queue)
 		return 0;
 
@@ -3290,7 +3535,11 @@ static int process_queue(struct avdtp *session)
 
 	*queue = g_slist_remove(*queue, req);
 
-	return send_req(session, FALSE, req);
+	err = send_req(session, FALSE, req);
+	if (!err)
+		pipeline_fill(session);
+
+	return err;
 }
 
 uint8_t avdtp_get_seid(struct avdtp_remote_sep *sep)
@@ -3434,6 +3683,27 @@ int avdtp_discover(struct avdtp *session, avdtp_discover_cb_t cb,
 	return err;
 }
 
+/* Completes discovery with the remote SEPs currently known, including the
+ * ones loaded from cache, without sending any request.
+ */
+int avdtp_discover_cached(struct avdtp *session, avdtp_discover_cb_t cb,
+							void *user_data)
+{
+	if (session->discover)
+		return -EBUSY;
+
+	if (!session->seps)
+		return -ENOENT;
+
+	session->discover = g_new0(struct discover_callback, 1);
+	session->discover->cb = cb;
+	session->discover->user_data = user_data;
+	session->discover->cached = true;
+	session->discover->id = g_idle_add(process_discover, session);
+
+	return 0;
+}
+
 gboolean avdtp_stream_remove_cb(struct avdtp *session,
 				struct avdtp_stream *stream,
 				unsigned int id)
@@ -3730,7 +4000,7 @@ int avdtp_abort(struct avdtp *session, struct avdtp_stream *stream)
 	avdtp_sep_set_state(session, stream->lsep, AVDTP_STATE_ABORTING);
 
 	if (session->req && stream == session->req->stream)
-		return cancel_request(session, ECANCELED);
+		return cancel_request(session, session->req, ECANCELED);
 
 	memset(&req, 0, sizeof(req));
 	req.acp_seid = stream->rseid;
@@ -3902,6 +4172,22 @@ struct btd_device *avdtp_get_device(struct avdtp *session)
 	return session->device;
 }
 
+void avdtp_foreach_latency(struct avdtp *session, avdtp_latency_func_t func,
+							void *user_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(latency_signals); i++) {
+		uint8_t signal_id = latency_signals[i];
+
+		if (!session->latency[signal_id].count)
+			continue;
+
+		func(avdtp_sigstr(signal_id), &session->latency[signal_id],
+								user_data);
+	}
+}
+
 gboolean avdtp_has_stream(struct avdtp *session, struct avdtp_stream *stream)
 {
 	return g_slist_find(session->streams, stream) ? TRUE : FALSE;
@@ -76,6 +76,19 @@ typedef enum {
 	AVDTP_STATE_ABORTING,
 } avdtp_state_t;
 
+#define AVDTP_LATENCY_BUCKETS			9
+
+/* Signaling round trip times in milliseconds, the histogram buckets are
+ * split at 5, 10, 20, 50, 100, 200, 500 and 1000 ms.
+ */
+struct avdtp_latency {
+	unsigned int count;
+	unsigned int min;
+	unsigned int max;
+	unsigned long total;
+	unsigned int histogram[AVDTP_LATENCY_BUCKETS];
+};
+
 struct avdtp_service_capability {
 	uint8_t category;
 	uint8_t length;
@@ -233,6 +246,15 @@ bool avdtp_get_delay_reporting(struct avdtp_remote_sep *sep);
 
 int avdtp_discover(struct avdtp *session, avdtp_discover_cb_t cb,
 			void *user_data);
+int avdtp_discover_cached(struct avdtp *session, avdtp_discover_cb_t cb,
+							void *user_data);
+
+typedef void (*avdtp_latency_func_t) (const char *signal,
+					const struct avdtp_latency *latency,
+					void *user_data);
+
+void avdtp_foreach_latency(struct avdtp *session, avdtp_latency_func_t func,
+							void *user_data);
 
 gboolean avdtp_has_stream(struct avdtp *session, struct avdtp_stream *stream);
 
@@ -2536,6 +2536,15 @@ static const char *subtype_to_string(uint32_t subtype)
 	return "None";
 }
 
+static void ct_set_uid_counter(struct avrcp_player *player,
+							uint16_t uid_counter)
+{
+	player->uid_counter = uid_counter;
+
+	/* Let the player drop listings cached with a stale counter */
+	media_player_set_uid_counter(player->user_data, uid_counter);
+}
+
 static struct media_item *parse_media_element(struct avrcp *session,
 					uint8_t *operands, uint16_t len)
 {
@@ -2635,6 +2644,8 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 		goto done;
 	}
 
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
+
 	count = get_be16(&operands[6]);
 	if (count == 0)
 		goto done;
@@ -2778,7 +2789,7 @@ static gboolean avrcp_set_browsed_player_rsp(struct avctp *conn,
 							operand_count < 13)
 		return FALSE;
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 	player->browsed = true;
 
 	items = get_be32(&pdu->params[3]);
@@ -3233,7 +3244,7 @@ static gboolean avrcp_search_rsp(struct avctp *conn, uint8_t *operands,
 		goto done;
 	}
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 	ret = get_be32(&pdu->params[3]);
 
 done:
@@ -3427,7 +3438,7 @@ static gboolean avrcp_get_total_numberofitems_rsp(struct avctp *conn,
 	if (pdu->params[0] == AVRCP_STATUS_OUT_OF_BOUNDS)
 		goto done;
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 	num_of_items = get_be32(&pdu->params[3]);
 
 	if (!num_of_items)
@@ -3825,7 +3836,7 @@ static void avrcp_addressed_player_changed(struct avrcp *session,
 	}
 
 	player->addressed = true;
-	player->uid_counter = get_be16(&pdu->params[3]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[3]));
 	set_ct_player(session, player);
 
 	if (player->features != NULL)
@@ -3838,7 +3849,7 @@ static void avrcp_uids_changed(struct avrcp *session, struct avrcp_header *pdu)
 {
 	struct avrcp_player *player = session->controller->player;
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 }
 
 static gboolean avrcp_handle_event(struct avctp *conn, uint8_t code,
@@ -37,6 +37,9 @@
 #define MEDIA_FOLDER_INTERFACE "org.bluez.MediaFolder1"
 #define MEDIA_ITEM_INTERFACE "org.bluez.MediaItem1"
 
+/* Upper bound of items fetched ahead of the range listed by a client */
+#define PREFETCH_ITEMS_MAX 64
+
 struct player_callback {
 	const struct media_player_callback *cbs;
 	void *user_data;
@@ -55,6 +58,7 @@ struct media_item {
 	player_item_type_t	type;		/* Item type */
 	player_folder_type_t	folder_type;	/* Folder type */
 	bool			playable;	/* Item playable flag */
+	bool			registered;	/* Item D-Bus object exists */
 	uint64_t		uid;		/* Item uid */
 	GHashTable		*metadata;	/* Item metadata */
 };
@@ -65,6 +69,9 @@ struct media_folder {
 	uint32_t		number_of_items;/* Number of items */
 	GSList			*subfolders;
 	GSList			*items;
+	GHashTable		*uids;		/* Items by uid */
+	GHashTable		*cache;		/* Listed items by index */
+	uint16_t		uid_counter;	/* UID counter of cache */
 	DBusMessage		*msg;
 };
 
@@ -88,8 +95,20 @@ struct media_player {
 	struct player_callback	*cb;
 	GSList			*pending;
 	GSList			*folders;
+	uint16_t		uid_counter;	/* Media database UID counter */
+	struct media_folder	*listing;	/* Folder being listed */
+	uint32_t		list_start;	/* First index being listed */
+	bool			prefetch;	/* Listing is a prefetch */
+	uint32_t		page_start;	/* Range last listed by client */
+	uint32_t		page_end;
+	bool			prefetch_next;	/* Pages still to prefetch */
+	bool			prefetch_prev;
+	DBusMessage		*deferred;	/* Call held while prefetching */
+	GDBusMethodFunction	deferred_func;
 };
 
+static bool media_item_register(struct media_item *item);
+
 static void append_track(void *key, void *value, void *user_data)
 {
 	DBusMessageIter *dict = user_data;
@@ -623,6 +642,10 @@ static void parse_folder_list(gpointer data, gpointer user_data)
 	DBusMessageIter *array = user_data;
 	DBusMessageIter entry;
 
+	/* Objects are only created once an item is listed to a client */
+	if (!media_item_register(item))
+		return;
+
 	dbus_message_iter_open_container(array, DBUS_TYPE_DICT_ENTRY, NULL,
 								&entry);
 
@@ -635,22 +658,12 @@ static void parse_folder_list(gpointer data, gpointer user_data)
 	dbus_message_iter_close_container(array, &entry);
 }
 
-void media_player_list_complete(struct media_player *mp, GSList *items,
-								int err)
+static DBusMessage *media_player_list_reply(DBusMessage *msg, GSList *items)
 {
-	struct media_folder *folder = mp->scope;
 	DBusMessage *reply;
 	DBusMessageIter iter, array;
 
-	if (folder == NULL || folder->msg == NULL)
-		return;
-
-	if (err < 0) {
-		reply = btd_error_failed(folder->msg, strerror(-err));
-		goto done;
-	}
-
-	reply = dbus_message_new_method_return(folder->msg);
+	reply = dbus_message_new_method_return(msg);
 
 	dbus_message_iter_init_append(reply, &iter);
 
@@ -668,10 +681,224 @@ void media_player_list_complete(struct media_player *mp, GSList *items,
 	g_slist_foreach(items, parse_folder_list, &array);
 	dbus_message_iter_close_container(&iter, &array);
 
+	return reply;
+}
+
+static void media_folder_clear_cache(struct media_folder *folder)
+{
+	if (folder->cache != NULL)
+		g_hash_table_remove_all(folder->cache);
+}
+
+static void media_folder_cache_items(struct media_player *mp,
+						struct media_folder *folder,
+						uint32_t start, GSList *items)
+{
+	GSList *l;
+
+	if (folder->cache == NULL)
+		folder->cache = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+
+	/* Items listed with a different UID counter are no longer valid */
+	if (folder->uid_counter != mp->uid_counter) {
+		g_hash_table_remove_all(folder->cache);
+		folder->uid_counter = mp->uid_counter;
+	}
+
+	for (l = items; l; l = l->next, start++)
+		g_hash_table_insert(folder->cache, GUINT_TO_POINTER(start),
+								l->data);
+}
+
+static bool media_folder_cached(struct media_player *mp,
+					struct media_folder *folder,
+					uint32_t start, uint32_t end)
+{
+	uint32_t i;
+
+	if (folder->cache == NULL || folder->number_of_items == 0)
+		return false;
+
+	if (folder->uid_counter != mp->uid_counter) {
+		media_folder_clear_cache(folder);
+		return false;
+	}
+
+	end = MIN(end, folder->number_of_items - 1);
+	if (start > end)
+		return false;
+
+	for (i = start; i <= end; i++) {
+		if (!g_hash_table_contains(folder->cache, GUINT_TO_POINTER(i)))
+			return false;
+	}
+
+	return true;
+}
+
+static DBusMessage *media_folder_list_cached(struct media_folder *folder,
+						DBusMessage *msg,
+						uint32_t start, uint32_t end)
+{
+	DBusMessage *reply;
+	GSList *items = NULL;
+	uint32_t i;
+
+	end = MIN(end, folder->number_of_items - 1);
+
+	DBG("start %u end %u", start, end);
+
+	for (i = end; ; i--) {
+		items = g_slist_prepend(items,
+				g_hash_table_lookup(folder->cache,
+						GUINT_TO_POINTER(i)));
+		if (i == start)
+			break;
+	}
+
+	reply = media_player_list_reply(msg, items);
+
+	g_slist_free(items);
+
+	return reply;
+}
+
+static int media_player_list(struct media_player *mp,
+						struct media_folder *folder,
+						uint32_t start, uint32_t end,
+						bool prefetch)
+{
+	struct player_callback *cb = mp->cb;
+	int err;
+
+	err = cb->cbs->list_items(mp, folder->item->name, start, end,
+							cb->user_data);
+	if (err < 0)
+		return err;
+
+	mp->listing = folder;
+	mp->list_start = start;
+	mp->prefetch = prefetch;
+
+	return 0;
+}
+
+/*
+ * Fetch the pages next to the range last listed by the client so that
+ * scrolling in either direction can be answered from the cache.
+ */
+static void media_player_prefetch(struct media_player *mp)
+{
+	struct media_folder *folder = mp->scope;
+	uint32_t size, last, start, end;
+
+	if (folder == NULL || folder->msg != NULL || mp->listing != NULL ||
+					folder->number_of_items == 0)
+		return;
+
+	last = MIN(mp->page_end, folder->number_of_items - 1);
+	if (mp->page_start > last)
+		return;
+
+	size = MIN(last - mp->page_start + 1, PREFETCH_ITEMS_MAX);
+
+	if (mp->prefetch_next) {
+		mp->prefetch_next = false;
+
+		start = last + 1;
+		end = MIN(last + size, folder->number_of_items - 1);
+
+		if (start <= end && !media_folder_cached(mp, folder, start, end)
+				&& !media_player_list(mp, folder, start, end,
+									true))
+			return;
+	}
+
+	if (mp->prefetch_prev) {
+		mp->prefetch_prev = false;
+
+		if (mp->page_start == 0)
+			return;
+
+		end = mp->page_start - 1;
+		start = end >= size ? end - size + 1 : 0;
+
+		if (!media_folder_cached(mp, folder, start, end))
+			media_player_list(mp, folder, start, end, true);
+	}
+}
+
+/* Calls which cannot proceed while a prefetch is in flight are held */
+static DBusMessage *media_player_defer(struct media_player *mp,
+						DBusMessage *msg,
+						GDBusMethodFunction func)
+{
+	if (mp->deferred != NULL)
+		return btd_error_failed(msg, strerror(EBUSY));
+
+	mp->deferred = dbus_message_ref(msg);
+	mp->deferred_func = func;
+
+	return NULL;
+}
+
+static void media_player_resume(struct media_player *mp)
+{
+	DBusMessage *msg = mp->deferred;
+	DBusMessage *reply;
+
+	if (msg == NULL) {
+		media_player_prefetch(mp);
+		return;
+	}
+
+	mp->deferred = NULL;
+
+	reply = mp->deferred_func(btd_get_dbus_connection(), msg, mp);
+	if (reply != NULL)
+		g_dbus_send_message(btd_get_dbus_connection(), reply);
+
+	dbus_message_unref(msg);
+}
+
+void media_player_list_complete(struct media_player *mp, GSList *items,
+								int err)
+{
+	struct media_folder *folder = mp->listing;
+	bool prefetch = mp->prefetch;
+	DBusMessage *reply;
+
+	mp->listing = NULL;
+	mp->prefetch = false;
+
+	/* Items are always created in the current scope */
+	if (err == 0 && folder != NULL && folder == mp->scope)
+		media_folder_cache_items(mp, folder, mp->list_start, items);
+
+	if (prefetch) {
+		media_player_resume(mp);
+		return;
+	}
+
+	folder = mp->scope;
+
+	if (folder == NULL || folder->msg == NULL)
+		return;
+
+	if (err < 0) {
+		reply = btd_error_failed(folder->msg, strerror(-err));
+		goto done;
+	}
+
+	reply = media_player_list_reply(folder->msg, items);
+
 done:
 	g_dbus_send_message(btd_get_dbus_connection(), reply);
 	dbus_message_unref(folder->msg);
 	folder->msg = NULL;
+
+	media_player_prefetch(mp);
 }
 
 static struct media_item *
@@ -714,6 +941,8 @@ void media_player_search_complete(struct media_player *mp, int ret)
 		mp->folders = g_slist_prepend(mp->folders, search);
 	}
 
+	/* Results of a previous search are not valid anymore */
+	media_folder_clear_cache(search);
 	search->number_of_items = ret;
 
 	reply = g_dbus_create_reply(folder->msg,
@@ -736,6 +965,7 @@ void media_player_total_items_complete(struct media_player *mp,
 
 	if (folder->number_of_items != num_of_items) {
 		folder->number_of_items = num_of_items;
+		media_folder_clear_cache(folder);
 
 		g_dbus_emit_property_changed(btd_get_dbus_connection(),
 				mp->path, MEDIA_FOLDER_INTERFACE,
@@ -804,6 +1034,9 @@ static DBusMessage *media_folder_search(DBusConnection *conn, DBusMessage *msg,
 	if (folder->msg != NULL)
 		return btd_error_failed(msg, strerror(EINVAL));
 
+	if (mp->listing != NULL)
+		return media_player_defer(mp, msg, media_folder_search);
+
 	err = cb->cbs->search(mp, string, cb->user_data);
 	if (err < 0)
 		return btd_error_failed(msg, strerror(-err));
@@ -888,8 +1121,24 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 	if (folder->msg != NULL)
 		return btd_error_failed(msg, strerror(EBUSY));
 
-	err = cb->cbs->list_items(mp, folder->item->name, start, end,
-							cb->user_data);
+	mp->page_start = start;
+	mp->page_end = end;
+	mp->prefetch_next = true;
+	mp->prefetch_prev = true;
+
+	if (media_folder_cached(mp, folder, start, end)) {
+		DBusMessage *reply;
+
+		reply = media_folder_list_cached(folder, msg, start, end);
+		media_player_prefetch(mp);
+
+		return reply;
+	}
+
+	if (mp->listing != NULL)
+		return media_player_defer(mp, msg, media_folder_list_items);
+
+	err = media_player_list(mp, folder, start, end, false);
 	if (err < 0)
 		return btd_error_failed(msg, strerror(-err));
 
@@ -914,18 +1163,37 @@ static void media_item_destroy(void *data)
 
 	DBG("%s", item->path);
 
-	g_dbus_unregister_interface(btd_get_dbus_connection(), item->path,
+	if (item->registered)
+		g_dbus_unregister_interface(btd_get_dbus_connection(),
+						item->path,
 						MEDIA_ITEM_INTERFACE);
 
 	media_item_free(item);
 }
 
+static void media_folder_clear_items(struct media_folder *folder)
+{
+	media_folder_clear_cache(folder);
+
+	if (folder->uids != NULL)
+		g_hash_table_remove_all(folder->uids);
+
+	g_slist_free_full(folder->items, media_item_destroy);
+	folder->items = NULL;
+}
+
 static void media_folder_destroy(void *data)
 {
 	struct media_folder *folder = data;
 
 	g_slist_free_full(folder->subfolders, media_folder_destroy);
-	g_slist_free_full(folder->items, media_item_destroy);
+	media_folder_clear_items(folder);
+
+	if (folder->uids != NULL)
+		g_hash_table_unref(folder->uids);
+
+	if (folder->cache != NULL)
+		g_hash_table_unref(folder->cache);
 
 	if (folder->msg != NULL)
 		dbus_message_unref(folder->msg);
@@ -956,8 +1224,7 @@ static void media_player_change_scope(struct media_player *mp,
 		goto done;
 
 cleanup:
-	g_slist_free_full(mp->scope->items, media_item_destroy);
-	mp->scope->items = NULL;
+	media_folder_clear_items(mp->scope);
 
 	/* Destroy search folder if it exists and is not being set as scope */
 	if (mp->search != NULL && folder != mp->search) {
@@ -1028,6 +1295,9 @@ static DBusMessage *media_folder_change_folder(DBusConnection *conn,
 	if (folder->msg != NULL)
 		return btd_error_failed(msg, strerror(EBUSY));
 
+	if (mp->listing != NULL)
+		return media_player_defer(mp, msg, media_folder_change_folder);
+
 	folder = media_player_find_folder(mp, path);
 	if (folder == NULL)
 		return btd_error_invalid_args(msg);
@@ -1189,7 +1459,10 @@ static void media_player_set_folder_by_uid(struct media_player *mp,
 		return;
 	}
 
-	folder->number_of_items = number_of_items;
+	if (folder->number_of_items != number_of_items) {
+		folder->number_of_items = number_of_items;
+		media_folder_clear_cache(folder);
+	}
 
 	media_player_set_scope(mp, folder);
 }
@@ -1237,6 +1510,9 @@ void media_player_destroy(struct media_player *mp)
 						mp->path,
 						MEDIA_FOLDER_INTERFACE);
 
+	if (mp->deferred)
+		dbus_message_unref(mp->deferred);
+
 	g_slist_free_full(mp->pending, g_free);
 	g_slist_free_full(mp->folders, media_folder_destroy);
 
@@ -1537,7 +1813,10 @@ void media_player_set_folder(struct media_player *mp, const char *name,
 		return;
 	}
 
-	folder->number_of_items = number_of_items;
+	if (folder->number_of_items != number_of_items) {
+		folder->number_of_items = number_of_items;
+		media_folder_clear_cache(folder);
+	}
 
 	media_player_set_scope(mp, folder);
 }
@@ -1563,19 +1842,10 @@ void media_player_set_playlist(struct media_player *mp, const char *name)
 static struct media_item *media_folder_find_item(struct media_folder *folder,
 								uint64_t uid)
 {
-	GSList *l;
-
-	if (uid == 0)
+	if (uid == 0 || folder->uids == NULL)
 		return NULL;
 
-	for (l = folder->items; l; l = l->next) {
-		struct media_item *item = l->data;
-
-		if (item->uid == uid)
-			return item;
-	}
-
-	return NULL;
+	return g_hash_table_lookup(folder->uids, &uid);
 }
 
 static DBusMessage *media_item_play(DBusConnection *conn, DBusMessage *msg,
@@ -1807,6 +2077,26 @@ static const GDBusPropertyTable media_item_properties[] = {
 	{ }
 };
 
+static bool media_item_register(struct media_item *item)
+{
+	if (item->registered)
+		return true;
+
+	if (!g_dbus_register_interface(btd_get_dbus_connection(),
+					item->path, MEDIA_ITEM_INTERFACE,
+					media_item_methods,
+					NULL,
+					media_item_properties, item, NULL)) {
+		error("D-Bus failed to register %s on %s path",
+					MEDIA_ITEM_INTERFACE, item->path);
+		return false;
+	}
+
+	item->registered = true;
+
+	return true;
+}
+
 void media_player_play_item_complete(struct media_player *mp, int err)
 {
 	struct media_folder *folder = mp->scope;
@@ -1835,6 +2125,9 @@ void media_item_set_playable(struct media_item *item, bool value)
 
 	item->playable = value;
 
+	if (!item->registered)
+		return;
+
 	g_dbus_emit_property_changed(btd_get_dbus_connection(), item->path,
 					MEDIA_ITEM_INTERFACE, "Playable");
 }
@@ -1872,13 +2165,13 @@ static struct media_item *media_folder_create_item(struct media_player *mp,
 	item->type = type;
 	item->folder_type = PLAYER_FOLDER_TYPE_INVALID;
 
-	if (!g_dbus_register_interface(btd_get_dbus_connection(),
-					item->path, MEDIA_ITEM_INTERFACE,
-					media_item_methods,
-					NULL,
-					media_item_properties, item, NULL)) {
-		error("D-Bus failed to register %s on %s path",
-					MEDIA_ITEM_INTERFACE, item->path);
+	/*
+	 * Only the top level folders are exported right away, other items
+	 * get their object once they are listed or become the current track
+	 * since a folder may hold far more items than a client ever shows.
+	 */
+	if (type == PLAYER_ITEM_TYPE_FOLDER && !uid &&
+					!media_item_register(item)) {
 		media_item_free(item);
 		return NULL;
 	}
@@ -1887,6 +2180,14 @@ static struct media_item *media_folder_create_item(struct media_player *mp,
 		folder->items = g_slist_prepend(folder->items, item);
 		item->metadata = g_hash_table_new_full(g_str_hash, g_str_equal,
 							g_free, g_free);
+
+		if (uid) {
+			if (folder->uids == NULL)
+				folder->uids = g_hash_table_new(g_int64_hash,
+								g_int64_equal);
+
+			g_hash_table_insert(folder->uids, &item->uid, item);
+		}
 	}
 
 	DBG("%s", item->path);
@@ -1949,6 +2250,18 @@ done:
 	return item;
 }
 
+void media_player_set_uid_counter(struct media_player *mp,
+							uint16_t uid_counter)
+{
+	if (!mp || mp->uid_counter == uid_counter)
+		return;
+
+	DBG("%u", uid_counter);
+
+	/* Cached listings are checked against it before being used */
+	mp->uid_counter = uid_counter;
+}
+
 void media_player_set_callbacks(struct media_player *mp,
 				const struct media_player_callback *cbs,
 				void *user_data)
@@ -1979,7 +2292,7 @@ struct media_item *media_player_set_playlist_item(struct media_player *mp,
 
 	item = media_folder_create_item(mp, folder, NULL,
 						PLAYER_ITEM_TYPE_AUDIO, uid);
-	if (item == NULL)
+	if (item == NULL || !media_item_register(item))
 		return NULL;
 
 	media_item_set_playable(item, true);
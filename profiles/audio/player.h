@@ -107,6 +107,9 @@ void media_player_search_complete(struct media_player *mp, int ret);
 void media_player_total_items_complete(struct media_player *mp,
 						uint32_t num_of_items);
 
+void media_player_set_uid_counter(struct media_player *mp,
+							uint16_t uid_counter);
+
 void media_player_set_callbacks(struct media_player *mp,
 				const struct media_player_callback *cbs,
 				void *user_data);
@@ -15,6 +15,8 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
 
 #include <glib.h>
 
@@ -33,6 +35,7 @@
 #include "src/shared/queue.h"
 
 #include "avdtp.h"
+#include "a2dp-codecs.h"
 #include "media.h"
 #include "transport.h"
 #include "a2dp.h"
@@ -42,6 +45,9 @@
 
 #define MEDIA_TRANSPORT_INTERFACE "org.bluez.MediaTransport1"
 
+#define TRANSPORT_DELAY_HISTORY		16
+#define TRANSPORT_SAMPLE_INTERVAL	250	/* ms */
+
 typedef enum {
 	TRANSPORT_STATE_IDLE,		/* Not acquired and suspended */
 	TRANSPORT_STATE_PENDING,	/* Playing but not acquired */
@@ -73,9 +79,27 @@ struct media_owner {
 struct a2dp_transport {
 	struct avdtp		*session;
 	uint16_t		delay;
+	uint16_t		delays[TRANSPORT_DELAY_HISTORY];
+	unsigned int		delay_reports;
 	int8_t			volume;
 };
 
+/*
+ * Outgoing queue of the transport socket, sampled periodically while the
+ * transport is active. The queue going from having room for another packet
+ * of omtu size to not having it is counted as a congestion event, it does
+ * not necessarily mean any data was dropped.
+ */
+struct transport_stats {
+	guint			timer;
+	int			sndbuf;
+	unsigned int		samples;
+	unsigned int		outq_max;
+	uint64_t		outq_total;
+	unsigned int		congestions;
+	bool			congested;
+};
+
 struct media_transport {
 	char			*path;		/* Transport object path */
 	struct btd_device	*device;	/* Transport device */
@@ -87,6 +111,7 @@ struct media_transport {
 	int			fd;		/* Transport file descriptor */
 	uint16_t		imtu;		/* Transport input mtu */
 	uint16_t		omtu;		/* Transport output mtu */
+	struct transport_stats	stats;		/* Transport socket stats */
 	transport_state_t	state;
 	guint			hs_watch;
 	guint			source_watch;
@@ -134,6 +159,73 @@ static gboolean state_in_use(transport_state_t state)
 	return FALSE;
 }
 
+static int transport_get_outq(struct media_transport *transport)
+{
+	int outq;
+
+	if (transport->fd < 0 || ioctl(transport->fd, TIOCOUTQ, &outq) < 0)
+		return -1;
+
+	return outq;
+}
+
+static gboolean transport_sample(gpointer user_data)
+{
+	struct media_transport *transport = user_data;
+	struct transport_stats *stats = &transport->stats;
+	bool congested;
+	int outq;
+
+	outq = transport_get_outq(transport);
+	if (outq < 0)
+		return TRUE;
+
+	stats->samples++;
+	stats->outq_total += outq;
+	stats->outq_max = MAX(stats->outq_max, (unsigned int) outq);
+
+	if (stats->sndbuf <= 0)
+		return TRUE;
+
+	congested = outq + transport->omtu > stats->sndbuf;
+	if (congested == stats->congested)
+		return TRUE;
+
+	stats->congested = congested;
+	if (!congested)
+		return TRUE;
+
+	stats->congestions++;
+
+	/* Only signal the start of congestion, not every sample of it */
+	g_dbus_emit_property_changed(btd_get_dbus_connection(),
+					transport->path,
+					MEDIA_TRANSPORT_INTERFACE,
+					"Statistics");
+
+	return TRUE;
+}
+
+static void transport_update_sampling(struct media_transport *transport)
+{
+	struct transport_stats *stats = &transport->stats;
+
+	if (transport->state == TRANSPORT_STATE_ACTIVE) {
+		if (!stats->timer)
+			stats->timer = g_timeout_add(TRANSPORT_SAMPLE_INTERVAL,
+							transport_sample,
+							transport);
+		return;
+	}
+
+	if (stats->timer) {
+		g_source_remove(stats->timer);
+		stats->timer = 0;
+	}
+
+	stats->congested = false;
+}
+
 static void transport_set_state(struct media_transport *transport,
 							transport_state_t state)
 {
@@ -148,6 +240,8 @@ static void transport_set_state(struct media_transport *transport,
 	DBG("State changed %s: %s -> %s", transport->path, str_state[old_state],
 							str_state[state]);
 
+	transport_update_sampling(transport);
+
 	str = state2str(state);
 
 	if (g_strcmp0(str, state2str(old_state)) != 0)
@@ -260,6 +354,8 @@ static void media_transport_remove_owner(struct media_transport *transport)
 static gboolean media_transport_set_fd(struct media_transport *transport,
 					int fd, uint16_t imtu, uint16_t omtu)
 {
+	socklen_t len;
+
 	if (transport->fd == fd)
 		return TRUE;
 
@@ -267,6 +363,19 @@ static gboolean media_transport_set_fd(struct media_transport *transport,
 	transport->imtu = imtu;
 	transport->omtu = omtu;
 
+	/* Statistics are kept per stream socket */
+	if (transport->stats.timer)
+		g_source_remove(transport->stats.timer);
+
+	memset(&transport->stats, 0, sizeof(transport->stats));
+
+	len = sizeof(transport->stats.sndbuf);
+	if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &transport->stats.sndbuf,
+								&len) < 0)
+		transport->stats.sndbuf = 0;
+
+	transport_update_sampling(transport);
+
 	info("%s: fd(%d) ready", transport->path, fd);
 
 	return TRUE;
@@ -676,6 +785,86 @@ error:
 					"Invalid arguments in method call");
 }
 
+static struct avdtp *transport_get_session(struct media_transport *transport)
+{
+	struct a2dp_transport *a2dp = transport->data;
+
+	if (a2dp->session)
+		return a2dp->session;
+
+	return a2dp_avdtp_find(transport->device);
+}
+
+static gboolean latency_exists(const GDBusPropertyTable *property,
+								void *data)
+{
+	struct media_transport *transport = data;
+
+	return transport_get_session(transport) != NULL;
+}
+
+static void append_latency(const char *signal,
+				const struct avdtp_latency *latency,
+				void *user_data)
+{
+	DBusMessageIter *dict = user_data;
+	DBusMessageIter entry, value;
+	const unsigned int *histogram = latency->histogram;
+	dbus_uint32_t count = latency->count;
+	dbus_uint32_t min = latency->min;
+	dbus_uint32_t max = latency->max;
+	dbus_uint32_t average = latency->total / latency->count;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+								&entry);
+
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &signal);
+
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&value);
+
+	dict_append_entry(&value, "Count", DBUS_TYPE_UINT32, &count);
+	dict_append_entry(&value, "Min", DBUS_TYPE_UINT32, &min);
+	dict_append_entry(&value, "Max", DBUS_TYPE_UINT32, &max);
+	dict_append_entry(&value, "Average", DBUS_TYPE_UINT32, &average);
+	dict_append_array(&value, "Histogram", DBUS_TYPE_UINT32, &histogram,
+						AVDTP_LATENCY_BUCKETS);
+
+	dbus_message_iter_close_container(&entry, &value);
+
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static gboolean get_latency(const GDBusPropertyTable *property,
+					DBusMessageIter *iter, void *data)
+{
+	struct media_transport *transport = data;
+	struct avdtp *session = transport_get_session(transport);
+	DBusMessageIter dict;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	if (session)
+		avdtp_foreach_latency(session, append_latency, &dict);
+
+	dbus_message_iter_close_container(iter, &dict);
+
+	return TRUE;
+}
+
 static gboolean endpoint_exists(const GDBusPropertyTable *property, void *data)
 {
 	struct media_transport *transport = data;
@@ -694,6 +883,161 @@ static gboolean get_endpoint(const GDBusPropertyTable *property,
 	return TRUE;
 }
 
+static uint32_t sbc_get_bitrate(const a2dp_sbc_t *sbc)
+{
+	unsigned int freq, subbands, blocks, channels, len;
+
+	switch (sbc->frequency) {
+	case SBC_SAMPLING_FREQ_16000:
+		freq = 16000;
+		break;
+	case SBC_SAMPLING_FREQ_32000:
+		freq = 32000;
+		break;
+	case SBC_SAMPLING_FREQ_44100:
+		freq = 44100;
+		break;
+	case SBC_SAMPLING_FREQ_48000:
+		freq = 48000;
+		break;
+	default:
+		return 0;
+	}
+
+	switch (sbc->block_length) {
+	case SBC_BLOCK_LENGTH_4:
+		blocks = 4;
+		break;
+	case SBC_BLOCK_LENGTH_8:
+		blocks = 8;
+		break;
+	case SBC_BLOCK_LENGTH_12:
+		blocks = 12;
+		break;
+	case SBC_BLOCK_LENGTH_16:
+		blocks = 16;
+		break;
+	default:
+		return 0;
+	}
+
+	subbands = sbc->subbands == SBC_SUBBANDS_4 ? 4 : 8;
+	channels = sbc->channel_mode == SBC_CHANNEL_MODE_MONO ? 1 : 2;
+
+	/* Frame length as of A2DP spec 12.9, encoding at max_bitpool */
+	len = 4 + (4 * subbands * channels) / 8;
+
+	switch (sbc->channel_mode) {
+	case SBC_CHANNEL_MODE_MONO:
+	case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+		len += (blocks * channels * sbc->max_bitpool + 7) / 8;
+		break;
+	case SBC_CHANNEL_MODE_STEREO:
+		len += (blocks * sbc->max_bitpool + 7) / 8;
+		break;
+	case SBC_CHANNEL_MODE_JOINT_STEREO:
+		len += (subbands + blocks * sbc->max_bitpool + 7) / 8;
+		break;
+	default:
+		return 0;
+	}
+
+	return 8 * len * freq / (subbands * blocks);
+}
+
+static uint32_t transport_get_bitrate(struct media_transport *transport)
+{
+	switch (media_endpoint_get_codec(transport->endpoint)) {
+	case A2DP_CODEC_SBC:
+		if (transport->size < (int) sizeof(a2dp_sbc_t))
+			return 0;
+
+		return sbc_get_bitrate((void *) transport->configuration);
+	case A2DP_CODEC_MPEG24:
+		if (transport->size < (int) sizeof(a2dp_aac_t))
+			return 0;
+
+		return AAC_GET_BITRATE(*(a2dp_aac_t *) transport->configuration);
+	}
+
+	return 0;
+}
+
+static gboolean get_statistics(const GDBusPropertyTable *property,
+					DBusMessageIter *iter, void *data)
+{
+	struct media_transport *transport = data;
+	struct a2dp_transport *a2dp = transport->data;
+	struct transport_stats *stats = &transport->stats;
+	uint16_t delays[TRANSPORT_DELAY_HISTORY];
+	const uint16_t *history = delays;
+	dbus_uint32_t bitrate, value;
+	unsigned int i, count, first;
+	DBusMessageIter dict;
+	int outq;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	bitrate = transport_get_bitrate(transport);
+	if (bitrate)
+		dict_append_entry(&dict, "Bitrate", DBUS_TYPE_UINT32, &bitrate);
+
+	if (stats->sndbuf > 0) {
+		value = stats->sndbuf;
+		dict_append_entry(&dict, "SendBuffer", DBUS_TYPE_UINT32,
+								&value);
+	}
+
+	outq = state_in_use(transport->state) ?
+				transport_get_outq(transport) : -1;
+	if (outq >= 0) {
+		value = outq;
+		dict_append_entry(&dict, "OutgoingQueue", DBUS_TYPE_UINT32,
+								&value);
+	}
+
+	if (stats->samples) {
+		value = stats->outq_total / stats->samples;
+		dict_append_entry(&dict, "AverageOutgoingQueue",
+						DBUS_TYPE_UINT32, &value);
+
+		value = stats->outq_max;
+		dict_append_entry(&dict, "MaxOutgoingQueue",
+						DBUS_TYPE_UINT32, &value);
+
+		/* Worst amount of audio held in the queue, in ms */
+		if (bitrate) {
+			value = (uint64_t) stats->outq_max * 8000 / bitrate;
+			dict_append_entry(&dict, "MaxQueueDelay",
+						DBUS_TYPE_UINT32, &value);
+		}
+
+		value = stats->congestions;
+		dict_append_entry(&dict, "CongestionEvents",
+						DBUS_TYPE_UINT32, &value);
+	}
+
+	/* Delay reports, oldest first */
+	count = MIN(a2dp->delay_reports, TRANSPORT_DELAY_HISTORY);
+	first = a2dp->delay_reports - count;
+
+	for (i = 0; i < count; i++)
+		delays[i] = a2dp->delays[(first + i) %
+						TRANSPORT_DELAY_HISTORY];
+
+	dict_append_array(&dict, "DelayHistory", DBUS_TYPE_UINT16, &history,
+									count);
+
+	dbus_message_iter_close_container(iter, &dict);
+
+	return TRUE;
+}
+
 static const GDBusMethodTable transport_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Acquire",
 			NULL,
@@ -719,6 +1063,10 @@ static const GDBusPropertyTable transport_properties[] = {
 	{ "Volume", "q", get_volume, set_volume, volume_exists },
 	{ "Endpoint", "o", get_endpoint, NULL, endpoint_exists,
 				G_DBUS_PROPERTY_FLAG_EXPERIMENTAL },
+	{ "SignalingLatency", "a{sa{sv}}", get_latency, NULL, latency_exists,
+				G_DBUS_PROPERTY_FLAG_EXPERIMENTAL },
+	{ "Statistics", "a{sv}", get_statistics, NULL, NULL,
+				G_DBUS_PROPERTY_FLAG_EXPERIMENTAL },
 	{ }
 };
 
@@ -741,6 +1089,9 @@ static void media_transport_free(void *data)
 	if (transport->owner)
 		media_transport_remove_owner(transport);
 
+	if (transport->stats.timer)
+		g_source_remove(transport->stats.timer);
+
 	if (transport->destroy != NULL)
 		transport->destroy(transport->data);
 
@@ -901,6 +1252,8 @@ void media_transport_update_delay(struct media_transport *transport,
 {
 	struct a2dp_transport *a2dp = transport->data;
 
+	a2dp->delays[a2dp->delay_reports++ % TRANSPORT_DELAY_HISTORY] = delay;
+
 	/* Check if delay really changed */
 	if (a2dp->delay == delay)
 		return;
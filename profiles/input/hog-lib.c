@@ -15,6 +15,7 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <errno.h>
@@ -66,7 +67,6 @@
 
 #define HOG_REPORT_MAP_MAX_SIZE        512
 #define HID_INFO_SIZE			4
-#define ATT_NOTIFICATION_HEADER_SIZE	3
 
 struct bt_hog {
 	int			ref_count;
@@ -83,6 +83,10 @@ struct bt_hog {
 	bool			uhid_created;
 	bool			uhid_start;
 	uint64_t		uhid_flags;
+	bool			uhid_batching;
+	bool			uhid_addr_set;
+	bdaddr_t		uhid_src;
+	bdaddr_t		uhid_dst;
 	uint16_t		bcdhid;
 	uint8_t			bcountrycode;
 	uint16_t		proto_mode_handle;
@@ -101,6 +105,7 @@ struct bt_hog {
 	struct gatt_db		*gatt_db;
 	struct gatt_db_attribute	*report_map_attr;
 	struct queue		*input;
+	unsigned int		notify_id;
 };
 
 struct report_map {
@@ -117,7 +122,7 @@ struct report {
 	uint16_t		value_handle;
 	uint8_t			properties;
 	uint16_t		ccc_handle;
-	guint			notifyid;
+	bool			notify;
 	uint16_t		len;
 	uint8_t			*value;
 };
@@ -328,21 +333,12 @@ static void find_included(struct bt_hog *hog, GAttrib *attrib,
 	}
 }
 
-static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+static void report_queue(struct report *report, const uint8_t *pdu,
+								uint16_t len)
 {
-	struct report *report = user_data;
 	struct bt_hog *hog = report->hog;
 	struct uhid_event ev;
 	uint8_t *buf;
-	int err;
-
-	if (len < ATT_NOTIFICATION_HEADER_SIZE) {
-		error("Malformed ATT notification");
-		return;
-	}
-
-	pdu += ATT_NOTIFICATION_HEADER_SIZE;
-	len -= ATT_NOTIFICATION_HEADER_SIZE;
 
 	memset(&ev, 0, sizeof(ev));
 	ev.type = UHID_INPUT;
@@ -359,18 +355,74 @@ static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
 		ev.u.input.size = len;
 	}
 
+	if (!hog->input)
+		hog->input = queue_new();
+
+	queue_push_tail(hog->input, util_memdup(&ev, sizeof(ev)));
+}
+
+/* Input reports are taken directly from bt_att, without GAttrib rebuilding
+ * the PDU, and written to uHID without the full sized event.
+ */
+static void report_notify_cb(struct bt_att_chan *chan, uint8_t opcode,
+					const void *pdu, uint16_t length,
+					void *user_data)
+{
+	struct bt_hog *hog = user_data;
+	struct report *report;
+	const uint8_t *value = pdu;
+	uint16_t handle;
+	GSList *l;
+	int err;
+
+	if (length < 2) {
+		error("Malformed ATT notification");
+		return;
+	}
+
+	handle = get_le16(value);
+
+	for (l = hog->reports; l; l = l->next) {
+		report = l->data;
+
+		if (report->notify && report->value_handle == handle)
+			break;
+	}
+
+	if (!l)
+		return;
+
+	value += 2;
+	length -= 2;
+
 	/* If uhid had not sent UHID_START yet queue up the input */
 	if (!hog->uhid_created || !hog->uhid_start) {
-		if (!hog->input)
-			hog->input = queue_new();
-
-		queue_push_tail(hog->input, util_memdup(&ev, sizeof(ev)));
+		report_queue(report, value, length);
 		return;
 	}
 
-	err = bt_uhid_send(hog->uhid, &ev);
+	err = bt_uhid_input(hog->uhid, report->numbered ? report->id : 0,
+							value, length);
 	if (err < 0)
-		error("bt_uhid_send: %s (%d)", strerror(-err), -err);
+		error("bt_uhid_input: %s (%d)", strerror(-err), -err);
+}
+
+static void report_notify_enable(struct report *report)
+{
+	struct bt_hog *hog = report->hog;
+	struct bt_att *att;
+
+	report->notify = true;
+
+	if (hog->notify_id)
+		return;
+
+	att = g_attrib_get_att(hog->attrib);
+	if (!att)
+		return;
+
+	hog->notify_id = bt_att_register(att, BT_ATT_OP_HANDLE_NFY,
+						report_notify_cb, hog, NULL);
 }
 
 static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
@@ -378,7 +430,6 @@ static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
 {
 	struct gatt_request *req = user_data;
 	struct report *report = req->user_data;
-	struct bt_hog *hog = report->hog;
 
 	if (status != 0) {
 		error("Write report characteristic descriptor failed: %s",
@@ -386,13 +437,10 @@ static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
 		goto remove;
 	}
 
-	if (report->notifyid)
+	if (report->notify)
 		goto remove;
 
-	report->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					report->value_handle,
-					report_value_cb, report, NULL);
+	report_notify_enable(report);
 
 	DBG("Report characteristic descriptor written: notifications enabled");
 
@@ -1030,10 +1078,15 @@ static void uhid_create(struct bt_hog *hog, uint8_t *report_map,
 	memset(&ev, 0, sizeof(ev));
 	ev.type = UHID_CREATE2;
 
-	bt_io_get(g_attrib_get_channel(hog->attrib), &gerr,
-			BT_IO_OPT_SOURCE, ev.u.create2.phys,
-			BT_IO_OPT_DEST, ev.u.create2.uniq,
-			BT_IO_OPT_INVALID);
+	/* Addresses given by the user don't need an L2CAP bearer */
+	if (hog->uhid_addr_set) {
+		ba2str(&hog->uhid_src, (char *) ev.u.create2.phys);
+		ba2str(&hog->uhid_dst, (char *) ev.u.create2.uniq);
+	} else
+		bt_io_get(g_attrib_get_channel(hog->attrib), &gerr,
+				BT_IO_OPT_SOURCE, ev.u.create2.phys,
+				BT_IO_OPT_DEST, ev.u.create2.uniq,
+				BT_IO_OPT_INVALID);
 
 	if (gerr) {
 		error("Failed to connection details: %s", gerr->message);
@@ -1676,6 +1729,9 @@ static void hog_attach_hog(struct bt_hog *hog, struct gatt_primary *primary)
 	find_included(instance, hog->attrib, primary->range.start,
 			primary->range.end, find_included_cb, instance);
 
+	bt_hog_set_batching(instance, hog->uhid_batching);
+	if (hog->uhid_addr_set)
+		bt_hog_set_address(instance, &hog->uhid_src, &hog->uhid_dst);
 	bt_hog_attach(instance, hog->attrib);
 	hog->instances = g_slist_append(hog->instances, instance);
 }
@@ -1774,18 +1830,39 @@ bool bt_hog_attach(struct bt_hog *hog, void *gatt)
 	for (l = hog->reports; l; l = l->next) {
 		struct report *r = l->data;
 
-		if (r->notifyid)
+		if (r->notify)
 			continue;
 
-		r->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					r->value_handle,
-					report_value_cb, r, NULL);
+		report_notify_enable(r);
 	}
 
 	return true;
 }
 
+static void uhid_stats(struct bt_hog *hog)
+{
+	struct bt_uhid_stats stats;
+	char str[160];
+
+	if (!bt_uhid_get_stats(hog->uhid, &stats) || !stats.reports)
+		return;
+
+	snprintf(str, sizeof(str), "%" PRIu64 " reports (%u/s) in %" PRIu64
+			" writes, %" PRIu64 " dropped, latency p50 < %" PRIu64
+			" us p90 < %" PRIu64 " us p99 < %" PRIu64 " us",
+			stats.reports, bt_uhid_stats_rate(&stats),
+			stats.writes, stats.dropped,
+			bt_uhid_stats_latency(&stats, 50),
+			bt_uhid_stats_latency(&stats, 90),
+			bt_uhid_stats_latency(&stats, 99));
+
+	/* Batching is opt-in, show whether it pays off without debug logs */
+	if (hog->uhid_batching)
+		info("%s: %s", hog->name, str);
+	else
+		DBG("%s: %s", hog->name, str);
+}
+
 static void uhid_destroy(struct bt_hog *hog)
 {
 	int err;
@@ -1794,6 +1871,8 @@ static void uhid_destroy(struct bt_hog *hog)
 	if (!hog->uhid_created)
 		return;
 
+	uhid_stats(hog);
+
 	bt_uhid_unregister_all(hog->uhid);
 
 	memset(&ev, 0, sizeof(ev));
@@ -1827,10 +1906,13 @@ void bt_hog_detach(struct bt_hog *hog)
 	for (l = hog->reports; l; l = l->next) {
 		struct report *r = l->data;
 
-		if (r->notifyid > 0) {
-			g_attrib_unregister(hog->attrib, r->notifyid);
-			r->notifyid = 0;
-		}
+		r->notify = false;
+	}
+
+	if (hog->notify_id) {
+		bt_att_unregister(g_attrib_get_att(hog->attrib),
+							hog->notify_id);
+		hog->notify_id = 0;
 	}
 
 	if (hog->scpp)
@@ -1861,6 +1943,40 @@ int bt_hog_set_control_point(struct bt_hog *hog, bool suspend)
 	return 0;
 }
 
+bool bt_hog_set_batching(struct bt_hog *hog, bool enable)
+{
+	GSList *l;
+
+	if (!hog)
+		return false;
+
+	if (!bt_uhid_set_batching(hog->uhid, enable))
+		return false;
+
+	hog->uhid_batching = enable;
+
+	for (l = hog->instances; l; l = l->next) {
+		struct bt_hog *instance = l->data;
+
+		bt_hog_set_batching(instance, enable);
+	}
+
+	return true;
+}
+
+bool bt_hog_set_address(struct bt_hog *hog, const bdaddr_t *src,
+							const bdaddr_t *dst)
+{
+	if (!hog || !src || !dst)
+		return false;
+
+	bacpy(&hog->uhid_src, src);
+	bacpy(&hog->uhid_dst, dst);
+	hog->uhid_addr_set = true;
+
+	return true;
+}
+
 int bt_hog_send_report(struct bt_hog *hog, void *data, size_t size, int type)
 {
 	struct report *report;
@@ -25,4 +25,7 @@ bool bt_hog_attach(struct bt_hog *hog, void *gatt);
 void bt_hog_detach(struct bt_hog *hog);
 
 int bt_hog_set_control_point(struct bt_hog *hog, bool suspend);
+bool bt_hog_set_batching(struct bt_hog *hog, bool enable);
+bool bt_hog_set_address(struct bt_hog *hog, const bdaddr_t *src,
+							const bdaddr_t *dst);
 int bt_hog_send_report(struct bt_hog *hog, void *data, size_t size, int type);
@@ -54,6 +54,7 @@ struct hog_device {
 
 static gboolean suspend_supported = FALSE;
 static bool auto_sec = true;
+static bool batch_reports = false;
 static struct queue *devices = NULL;
 
 void input_set_auto_sec(bool state)
@@ -61,6 +62,11 @@ void input_set_auto_sec(bool state)
 	auto_sec = state;
 }
 
+void input_set_batch_reports(bool state)
+{
+	batch_reports = state;
+}
+
 static void hog_device_accept(struct hog_device *dev, struct gatt_db *db)
 {
 	char name[248];
@@ -82,6 +88,8 @@ static void hog_device_accept(struct hog_device *dev, struct gatt_db *db)
 							product, version);
 
 	dev->hog = bt_hog_new_default(name, vendor, product, version, db);
+	if (dev->hog && batch_reports)
+		bt_hog_set_batching(dev->hog, true);
 }
 
 static struct hog_device *hog_device_new(struct btd_device *device)
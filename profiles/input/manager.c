@@ -84,6 +84,7 @@ static int input_init(void)
 	if (config) {
 		int idle_timeout;
 		gboolean uhid_enabled, classic_bonded_only, auto_sec;
+		gboolean batch_reports;
 
 		idle_timeout = g_key_file_get_integer(config, "General",
 							"IdleTimeout", &err);
@@ -121,6 +122,15 @@ static int input_init(void)
 		} else
 			g_clear_error(&err);
 
+		batch_reports = g_key_file_get_boolean(config, "General",
+						"BatchInputReports", &err);
+		if (!err) {
+			DBG("input.conf: BatchInputReports=%s",
+					batch_reports ? "true" : "false");
+			input_set_batch_reports(batch_reports);
+		} else
+			g_clear_error(&err);
+
 	}
 
 	btd_profile_register(&input_profile);
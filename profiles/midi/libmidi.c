@@ -110,6 +110,7 @@ int midi_read_init(struct midi_read_parser *parser)
 	parser->timestamp = 0;
 	parser->timestamp_low = 0;
 	parser->timestamp_high = 0;
+	parser->ptime = -1;
 
 	parser->sysex_stream.data = malloc(MIDI_SYSEX_MAX_SIZE);
 	if (!parser->sysex_stream.data)
@@ -231,6 +232,23 @@ void midi_read_ev(struct midi_write_parser *parser, const snd_seq_event_t *ev,
 {
 	MIDI_ASSERT(write_cb);
 
+	/* Stamp every event with its own time so that events packed together
+	   keep their timing. timestampLow may only wrap once between two
+	   events, otherwise the current packet is sent first.
+	 */
+	if (midi_write_has_data(parser)) {
+		int64_t rtime = g_get_monotonic_time() / 1000;
+
+		if (rtime - parser->rtime > 0x7F) {
+			write_cb(parser, user_data);
+			midi_write_reset(parser);
+		} else if (rtime != parser->rtime) {
+			parser->rtime = rtime;
+			/* forces a new timestampLow */
+			parser->rstatus = SND_SEQ_EVENT_NONE;
+		}
+	}
+
 	append_timestamp_high_maybe(parser);
 
 	/* SysEx is special case:
@@ -261,9 +279,15 @@ static void update_ev_timestamp(struct midi_read_parser *parser,
 	if (parser->timestamp_low > ts_low)
 		parser->timestamp_high++;
 
-	timestamp = (parser->timestamp_high << 7) | parser->timestamp_low;
+	parser->timestamp_low = ts_low;
 
-	rtime_current = g_get_monotonic_time() / 1000; /* convert µs to ms */
+	timestamp = ((parser->timestamp_high << 7) | parser->timestamp_low) &
+	            MIDI_MAX_TIMESTAMP;
+
+	if (parser->ptime >= 0)
+		rtime_current = parser->ptime;
+	else
+		rtime_current = g_get_monotonic_time() / 1000; /* convert µs to ms */
 	delta_timestamp = timestamp - (int)parser->timestamp;
 	delta_rtime = rtime_current - parser->rtime;
 
@@ -290,12 +314,28 @@ static void update_ev_timestamp(struct midi_read_parser *parser,
 		parser->rtime += delta_timestamp;
 	}
 
+	/* An event cannot have been sent after it was received: the packet
+	   that set the reference time was delayed, so follow the one that was
+	   delayed the least instead.
+	 */
+	if (parser->rtime > rtime_current)
+		parser->rtime = rtime_current;
+
 	parser->timestamp += delta_timestamp;
 	if (parser->timestamp > MIDI_MAX_TIMESTAMP)
 		parser->timestamp %= MIDI_MAX_TIMESTAMP + 1;
+}
 
-	/* set event timestamp */
-	/* TODO: update event timestamp here! */
+static void set_ev_timestamp(struct midi_read_parser *parser,
+                             snd_seq_event_t *ev)
+{
+	if (parser->rtime < 0)
+		return;
+
+	ev->flags &= ~SND_SEQ_TIME_STAMP_MASK;
+	ev->flags |= SND_SEQ_TIME_STAMP_REAL;
+	ev->time.time.tv_sec = parser->rtime / 1000;
+	ev->time.time.tv_nsec = (parser->rtime % 1000) * 1000000;
 }
 
 static size_t handle_end_of_sysex(struct midi_read_parser *parser,
@@ -476,6 +516,23 @@ size_t midi_read_raw(struct midi_read_parser *parser, const uint8_t *data,
 _finish:
 	if (err)
 		ev->type = SND_SEQ_EVENT_NONE;
+	else
+		set_ev_timestamp(parser, ev);
 
 	return i + midi_size;
 }
+
+int64_t midi_read_ev_deadline(const snd_seq_event_t *ev, int64_t now,
+                              unsigned int delay)
+{
+	int64_t time;
+
+	if ((ev->flags & SND_SEQ_TIME_STAMP_MASK) != SND_SEQ_TIME_STAMP_REAL)
+		return now;
+
+	time = ev->time.time.tv_sec * 1000LL +
+	       ev->time.time.tv_nsec / 1000000 + delay;
+
+	/* Too late already, deliver right away */
+	return MAX(time, now);
+}
@@ -83,6 +83,7 @@ struct midi_read_parser {
 	int16_t timestamp;               /* last MIDI-BLE timestamp */
 	int8_t timestamp_low;            /* MIDI-BLE timestampLow from the current packet */
 	int8_t timestamp_high;           /* MIDI-BLE timestampHigh from the current packet */
+	int64_t ptime;                   /* arrival time of the current packet */
 	struct midi_buffer sysex_stream; /* SysEx stream */
 	snd_midi_event_t *midi_ev;       /* midi<->seq event */
 };
@@ -100,6 +101,16 @@ static inline void midi_read_reset(struct midi_read_parser *parser)
 	parser->rstatus = 0;
 	parser->timestamp_low = 0;
 	parser->timestamp_high = 0;
+	parser->ptime = -1;
+}
+
+/* Sets the time in ms at which the current packet was received, otherwise
+   the time it is parsed at is used to recover the sender's timing.
+ */
+static inline void midi_read_set_time(struct midi_read_parser *parser,
+                                      int64_t time)
+{
+	parser->ptime = time;
 }
 
 /* Parses raw BLE-MIDI messages and populates a sequencer event representing the
@@ -108,4 +119,11 @@ static inline void midi_read_reset(struct midi_read_parser *parser)
 size_t midi_read_raw(struct midi_read_parser *parser, const uint8_t *data,
                      size_t size, snd_seq_event_t *ev /* OUT */);
 
+/* Returns the time in ms at which an event parsed by midi_read_raw should be
+   delivered so that events play out with the sender's timing, delay being
+   how long events may be held back to absorb the transport jitter.
+ */
+int64_t midi_read_ev_deadline(const snd_seq_event_t *ev, int64_t now,
+                              unsigned int delay);
+
 #endif /* LIBMIDI_H */
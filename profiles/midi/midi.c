@@ -15,10 +15,13 @@
 #include <errno.h>
 #include <alsa/asoundlib.h>
 
+#include <glib.h>
+
 #include "lib/bluetooth.h"
 #include "lib/sdp.h"
 #include "lib/uuid.h"
 
+#include "src/btd.h"
 #include "src/plugin.h"
 #include "src/adapter.h"
 #include "src/device.h"
@@ -30,6 +33,7 @@
 #include "src/shared/gatt-db.h"
 #include "src/shared/gatt-client.h"
 #include "src/shared/io.h"
+#include "src/shared/timeout.h"
 #include "src/log.h"
 #include "attrib/att.h"
 
@@ -48,11 +52,38 @@ struct midi {
 	int seq_client_id;
 	int seq_port_id;
 
+	/* Jitter buffer queue, -1 if events are delivered directly */
+	int seq_queue;
+	int64_t seq_queue_time;
+
 	/* MIDI parser*/
 	struct midi_read_parser midi_in;
 	struct midi_write_parser midi_out;
+	unsigned int flush_id;
 };
 
+static void midi_write_flush(struct midi *midi)
+{
+	if (midi_write_has_data(&midi->midi_out))
+		bt_gatt_client_write_without_response(midi->client,
+		                                      midi->midi_io_handle,
+		                                      false,
+		                                      midi_write_data(&midi->midi_out),
+		                                      midi_write_data_size(&midi->midi_out));
+
+	midi_write_reset(&midi->midi_out);
+}
+
+static bool midi_flush_timeout(void *user_data)
+{
+	struct midi *midi = user_data;
+
+	midi->flush_id = 0;
+	midi_write_flush(midi);
+
+	return false;
+}
+
 static bool midi_write_cb(struct io *io, void *user_data)
 {
 	struct midi *midi = user_data;
@@ -79,24 +110,52 @@ static bool midi_write_cb(struct io *io, void *user_data)
 
 	} while (err > 0);
 
-	if (midi_write_has_data(&midi->midi_out))
-		bt_gatt_client_write_without_response(midi->client,
-		                                      midi->midi_io_handle,
-		                                      false,
-		                                      midi_write_data(&midi->midi_out),
-		                                      midi_write_data_size(&midi->midi_out));
+	if (!btd_opts.midi.packet_interval) {
+		midi_write_flush(midi);
+		return true;
+	}
 
-	midi_write_reset(&midi->midi_out);
+	/* Keep packing events, each with its own timestamp, until the
+	 * packet is due so that one packet is sent per interval.
+	 */
+	if (midi_write_has_data(&midi->midi_out) && !midi->flush_id)
+		midi->flush_id = timeout_add(btd_opts.midi.packet_interval,
+						midi_flush_timeout, midi, NULL);
 
 	return true;
 }
 
+static void midi_event_output(struct midi *midi, snd_seq_event_t *ev,
+								int64_t now)
+{
+	snd_seq_real_time_t time;
+	int64_t deadline;
+
+	if (midi->seq_queue < 0) {
+		snd_seq_event_output_direct(midi->seq_handle, ev);
+		return;
+	}
+
+	/* Play out with the sender's timing as given by the BLE-MIDI
+	 * timestamps, trading up to JitterBuffer ms of latency.
+	 */
+	deadline = midi_read_ev_deadline(ev, now, btd_opts.midi.jitter_buffer);
+	deadline -= midi->seq_queue_time;
+
+	time.tv_sec = deadline / 1000;
+	time.tv_nsec = (deadline % 1000) * 1000000;
+
+	snd_seq_ev_schedule_real(ev, midi->seq_queue, 0, &time);
+	snd_seq_event_output(midi->seq_handle, ev);
+}
+
 static void midi_io_value_cb(uint16_t value_handle, const uint8_t *value,
                              uint16_t length, void *user_data)
 {
 	struct midi *midi = user_data;
 	snd_seq_event_t ev;
 	unsigned int i = 0;
+	int64_t now = g_get_monotonic_time() / 1000;
 
 	if (length < 3) {
 		warn("MIDI I/O: Wrong packet format: length is %u bytes but it should "
@@ -110,6 +169,7 @@ static void midi_io_value_cb(uint16_t value_handle, const uint8_t *value,
 	snd_seq_ev_set_direct(&ev);
 
 	midi_read_reset(&midi->midi_in);
+	midi_read_set_time(&midi->midi_in, now);
 
 	while (i < length) {
 		size_t count = midi_read_raw(&midi->midi_in, value + i, length - i, &ev);
@@ -118,11 +178,14 @@ static void midi_io_value_cb(uint16_t value_handle, const uint8_t *value,
 			goto _err;
 
 		if (ev.type != SND_SEQ_EVENT_NONE)
-			snd_seq_event_output_direct(midi->seq_handle, &ev);
+			midi_event_output(midi, &ev, now);
 
 		i += count;
 	}
 
+	if (midi->seq_queue >= 0)
+		snd_seq_drain_output(midi->seq_handle);
+
 	return;
 
 _err:
@@ -256,6 +319,7 @@ static void midi_device_remove(struct btd_service *service)
 	}
 
 	if (midi->seq_handle) {
+		timeout_remove(midi->flush_id);
 		midi_read_free(&midi->midi_in);
 		midi_write_free(&midi->midi_out);
 		io_destroy(midi->io);
@@ -336,6 +400,20 @@ static int midi_accept(struct btd_service *service)
 	}
 	midi->seq_port_id = err;
 
+	midi->seq_queue = -1;
+	if (btd_opts.midi.jitter_buffer) {
+		err = snd_seq_alloc_named_queue(midi->seq_handle, device_name);
+		if (err < 0) {
+			error("Could not create ALSA queue: %s (%d)", snd_strerror(err), err);
+			goto _err_port;
+		}
+		midi->seq_queue = err;
+
+		snd_seq_start_queue(midi->seq_handle, midi->seq_queue, NULL);
+		snd_seq_drain_output(midi->seq_handle);
+		midi->seq_queue_time = g_get_monotonic_time() / 1000;
+	}
+
 	snd_seq_client_info_alloca(&info);
 	err = snd_seq_get_client_info(midi->seq_handle, info);
 	if (err < 0)
@@ -432,6 +510,8 @@ static int midi_disconnect(struct btd_service *service)
 		return -ENODEV;
 	}
 
+	timeout_remove(midi->flush_id);
+	midi->flush_id = 0;
 	midi_read_free(&midi->midi_in);
 	midi_write_free(&midi->midi_out);
 	io_destroy(midi->io);
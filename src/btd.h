@@ -89,6 +89,12 @@ struct btd_defaults {
 struct btd_avdtp_opts {
 	uint8_t  session_mode;
 	uint8_t  stream_mode;
+	uint8_t  pipeline;
+};
+
+struct btd_midi_opts {
+	uint16_t	jitter_buffer;
+	uint16_t	packet_interval;
 };
 
 struct btd_advmon_opts {
@@ -134,6 +140,8 @@ struct btd_opts {
 	enum jw_repairing_t jw_repairing;
 
 	struct btd_advmon_opts	advmon;
+
+	struct btd_midi_opts	midi;
 };
 
 extern struct btd_opts btd_opts;
@@ -147,6 +147,7 @@ static const char *gatt_options[] = {
 static const char *avdtp_options[] = {
 	"SessionMode",
 	"StreamMode",
+	"PipelineRequests",
 	NULL
 };
 
@@ -155,6 +156,12 @@ static const char *advmon_options[] = {
 	NULL
 };
 
+static const char *midi_options[] = {
+	"JitterBuffer",
+	"PacketInterval",
+	NULL
+};
+
 static const struct group_table {
 	const char *name;
 	const char **options;
@@ -166,6 +173,7 @@ static const struct group_table {
 	{ "GATT",	gatt_options },
 	{ "AVDTP",	avdtp_options },
 	{ "AdvMon",	advmon_options },
+	{ "MIDI",	midi_options },
 	{ }
 };
 
@@ -926,6 +934,19 @@ static void parse_config(GKeyFile *config)
 		g_free(str);
 	}
 
+	val = g_key_file_get_integer(config, "AVDTP", "PipelineRequests",
+									&err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		DBG("PipelineRequests=%d", val);
+		/* Ensure the pipeline depth is within a valid range. */
+		val = MIN(val, 15);
+		val = MAX(val, 1);
+		btd_opts.avdtp.pipeline = val;
+	}
+
 	val = g_key_file_get_integer(config, "AdvMon", "RSSISamplingPeriod",
 									&err);
 	if (err) {
@@ -938,6 +959,28 @@ static void parse_config(GKeyFile *config)
 		btd_opts.advmon.rssi_sampling_period = val;
 	}
 
+	val = g_key_file_get_integer(config, "MIDI", "JitterBuffer", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		val = MIN(val, 1000);
+		val = MAX(val, 0);
+		DBG("JitterBuffer=%d", val);
+		btd_opts.midi.jitter_buffer = val;
+	}
+
+	val = g_key_file_get_integer(config, "MIDI", "PacketInterval", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		val = MIN(val, 100);
+		val = MAX(val, 0);
+		DBG("PacketInterval=%d", val);
+		btd_opts.midi.packet_interval = val;
+	}
+
 	parse_br_config(config);
 	parse_le_config(config);
 }
@@ -978,6 +1021,7 @@ static void init_defaults(void)
 
 	btd_opts.avdtp.session_mode = BT_IO_MODE_BASIC;
 	btd_opts.avdtp.stream_mode = BT_IO_MODE_BASIC;
+	btd_opts.avdtp.pipeline = 1;
 
 	btd_opts.advmon.rssi_sampling_period = 0xFF;
 }
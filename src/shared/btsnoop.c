@@ -14,6 +14,7 @@
 
 #define _GNU_SOURCE
 #include <endian.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -22,6 +23,8 @@
 #include <limits.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #include "src/shared/btsnoop.h"
 
@@ -47,6 +50,37 @@ static const uint8_t btsnoop_id[] = { 0x62, 0x74, 0x73, 0x6e,
 
 static const uint32_t btsnoop_version = 1;
 
+/*
+ * Compressed container: the file header carries its own identification
+ * pattern and is followed by independent blocks. Each block holds a run
+ * of records with delta encoded headers, compressed with a simple LZ77
+ * scheme. Blocks are stored verbatim when compression does not help.
+ *
+ * A record header is a sequence of varints: timestamp delta, included
+ * length, flags and drops deltas, and the number of bytes the original
+ * packet had beyond the included ones.
+ */
+struct btsnoop_blk {
+	uint32_t	raw_len;	/* Decoded Length */
+	uint32_t	len;		/* Encoded Length */
+	uint32_t	count;		/* Number of Records */
+	uint64_t	ts;		/* Timestamp of first Record */
+} __attribute__ ((packed));
+#define BTSNOOP_BLK_SIZE (sizeof(struct btsnoop_blk))
+
+#define BTSNOOP_BLK_MAX_RAW	(64 * 1024)
+#define BTSNOOP_BLK_BOUND(len)	((len) + (len) / 255 + 16)
+
+/* Worst case size of a delta encoded record header */
+#define BTSNOOP_REC_MAX_HDR	30
+
+static const uint8_t btsnoopz_id[] = { 0x62, 0x74, 0x73, 0x6e,
+				       0x6f, 0x6f, 0x70, 0x7a };
+
+#define LZ_MIN_MATCH	4
+#define LZ_MAX_OFFSET	0xffff
+#define LZ_HASH_BITS	13
+
 struct pklg_pkt {
 	uint32_t	len;
 	uint64_t	ts;
@@ -54,6 +88,15 @@ struct pklg_pkt {
 } __attribute__ ((packed));
 #define PKLG_PKT_SIZE (sizeof(struct pklg_pkt))
 
+struct btsnoop_chunk {
+	off_t offset;		/* File offset of the encoded data */
+	uint32_t len;
+	uint32_t raw_len;
+	uint32_t count;
+	uint64_t ts;
+	unsigned long first;	/* First record, set when indexing */
+};
+
 struct btsnoop {
 	int ref_count;
 	int fd;
@@ -63,13 +106,447 @@ struct btsnoop {
 	bool aborted;
 	bool pklg_format;
 	bool pklg_v2;
+	bool compressed;
 	const char *path;
 	size_t max_size;
 	size_t cur_size;
 	unsigned int max_count;
 	unsigned int cur_count;
+	uint8_t *buf;
+	size_t buf_size;
+	size_t buf_len;
+	const uint8_t *map;
+	size_t map_size;
+	size_t map_pos;
+	bool map_alloc;
+	size_t map_alloc_size;
+	struct btsnoop_chunk *chunks;
+	unsigned long num_chunks;
+	unsigned long next_chunk;
+	uint8_t *blk_raw;
+	uint8_t *blk_out;
+	size_t blk_len;
+	uint32_t blk_count;
+	uint64_t blk_ts;
+	uint64_t last_ts;
+	uint32_t last_flags;
+	uint32_t last_drops;
+	struct btsnoop_record *records;
+	unsigned long num_records;
 };
 
+struct btsnoop_record {
+	size_t offset;
+	uint64_t ts;
+	uint16_t index;
+	uint16_t opcode;
+};
+
+static void map_file(struct btsnoop *btsnoop)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(btsnoop->fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+							!st.st_size)
+		return;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, btsnoop->fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	btsnoop->map = map;
+	btsnoop->map_size = st.st_size;
+	btsnoop->map_pos = lseek(btsnoop->fd, 0, SEEK_CUR);
+}
+
+static bool load_chunk(struct btsnoop *btsnoop, unsigned long chunk);
+
+/* Behaves like read() but is served from the mapping when available */
+static ssize_t read_data(struct btsnoop *btsnoop, void *buf, size_t len)
+{
+	size_t avail;
+
+	if (btsnoop->chunks) {
+		/* Records never span blocks, move on once one is used up */
+		if (btsnoop->map_pos == btsnoop->map_size &&
+				!load_chunk(btsnoop, btsnoop->next_chunk))
+			return 0;
+	} else if (!btsnoop->map)
+		return read(btsnoop->fd, buf, len);
+
+	avail = btsnoop->map_size - btsnoop->map_pos;
+	if (len > avail)
+		len = avail;
+
+	memcpy(buf, btsnoop->map + btsnoop->map_pos, len);
+	btsnoop->map_pos += len;
+
+	return len;
+}
+
+static size_t put_varint(uint8_t *buf, uint64_t val)
+{
+	size_t len = 0;
+
+	while (val >= 0x80) {
+		buf[len++] = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+
+	buf[len++] = val;
+
+	return len;
+}
+
+static bool get_varint(const uint8_t *buf, size_t len, size_t *pos,
+								uint64_t *val)
+{
+	unsigned int shift = 0;
+
+	*val = 0;
+
+	while (*pos < len && shift < 64) {
+		uint8_t byte = buf[(*pos)++];
+
+		*val |= (uint64_t) (byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+
+		shift += 7;
+	}
+
+	return false;
+}
+
+static size_t lz_put_length(uint8_t *buf, size_t len)
+{
+	size_t n = 0;
+
+	for (len -= 15; len >= 255; len -= 255)
+		buf[n++] = 255;
+
+	buf[n++] = len;
+
+	return n;
+}
+
+static size_t lz_put_sequence(uint8_t *buf, const uint8_t *lit,
+				size_t lit_len, size_t offset, size_t match)
+{
+	size_t n = 1;
+
+	buf[0] = (lit_len < 15 ? lit_len : 15) << 4;
+	if (lit_len >= 15)
+		n += lz_put_length(buf + n, lit_len);
+
+	memcpy(buf + n, lit, lit_len);
+	n += lit_len;
+
+	/* The last sequence of a block has literals only */
+	if (!match)
+		return n;
+
+	match -= LZ_MIN_MATCH;
+	buf[0] |= match < 15 ? match : 15;
+
+	buf[n++] = offset & 0xff;
+	buf[n++] = offset >> 8;
+
+	if (match >= 15)
+		n += lz_put_length(buf + n, match);
+
+	return n;
+}
+
+/* Output buffer has to hold at least BTSNOOP_BLK_BOUND(len) bytes */
+static size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	uint32_t table[1 << LZ_HASH_BITS];
+	size_t pos = 0, anchor = 0, out = 0;
+
+	memset(table, 0, sizeof(table));
+
+	while (pos + LZ_MIN_MATCH <= len) {
+		size_t ref, match;
+		uint32_t seq, hash;
+
+		memcpy(&seq, src + pos, sizeof(seq));
+		hash = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+
+		/* Table entries are stored off by one so zero means empty */
+		ref = table[hash];
+		table[hash] = pos + 1;
+
+		if (!ref || pos - (ref - 1) > LZ_MAX_OFFSET ||
+				memcmp(src + ref - 1, src + pos, LZ_MIN_MATCH)) {
+			pos++;
+			continue;
+		}
+
+		ref--;
+
+		for (match = LZ_MIN_MATCH; pos + match < len; match++) {
+			if (src[ref + match] != src[pos + match])
+				break;
+		}
+
+		out += lz_put_sequence(dst + out, src + anchor, pos - anchor,
+							pos - ref, match);
+
+		pos += match;
+		anchor = pos;
+	}
+
+	out += lz_put_sequence(dst + out, src + anchor, len - anchor, 0, 0);
+
+	return out;
+}
+
+static bool lz_get_length(const uint8_t *src, size_t len, size_t *pos,
+								size_t *val)
+{
+	uint8_t byte;
+
+	do {
+		if (*pos >= len)
+			return false;
+
+		byte = src[(*pos)++];
+		*val += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+static bool lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+							size_t dst_len)
+{
+	size_t in = 0, out = 0;
+
+	while (in < len) {
+		uint8_t token = src[in++];
+		size_t lit_len = token >> 4;
+		size_t match = (token & 0x0f) + LZ_MIN_MATCH;
+		size_t offset;
+
+		if (lit_len == 15 && !lz_get_length(src, len, &in, &lit_len))
+			return false;
+
+		if (lit_len > len - in || lit_len > dst_len - out)
+			return false;
+
+		memcpy(dst + out, src + in, lit_len);
+		in += lit_len;
+		out += lit_len;
+
+		if (in == len)
+			break;
+
+		if (len - in < 2)
+			return false;
+
+		offset = src[in] | (src[in + 1] << 8);
+		in += 2;
+
+		if (!offset || offset > out)
+			return false;
+
+		if (match == 15 + LZ_MIN_MATCH &&
+				!lz_get_length(src, len, &in, &match))
+			return false;
+
+		if (match > dst_len - out)
+			return false;
+
+		/* Matches may overlap with the output they produce */
+		for (; match > 0; match--, out++)
+			dst[out] = dst[out - offset];
+	}
+
+	return out == dst_len;
+}
+
+static bool decode_block(struct btsnoop *btsnoop, const uint8_t *raw,
+				size_t raw_len, uint32_t count, uint64_t ts)
+{
+	uint32_t flags = 0, drops = 0;
+	size_t pos = 0;
+
+	while (pos < raw_len) {
+		struct btsnoop_pkt pkt;
+		uint64_t delta, len, omitted, val;
+
+		if (!count)
+			return false;
+
+		if (!get_varint(raw, raw_len, &pos, &delta) ||
+				!get_varint(raw, raw_len, &pos, &len))
+			return false;
+
+		if (len > BTSNOOP_MAX_PACKET_SIZE || len > raw_len)
+			return false;
+
+		/* Timestamp delta is zigzag encoded since it may go back */
+		ts += (delta >> 1) ^ -(delta & 1);
+
+		if (!get_varint(raw, raw_len, &pos, &val))
+			return false;
+		flags ^= val;
+
+		if (!get_varint(raw, raw_len, &pos, &val))
+			return false;
+		drops += val;
+
+		if (!get_varint(raw, raw_len, &pos, &omitted) ||
+						omitted > UINT32_MAX - len)
+			return false;
+
+		if (len > raw_len - pos)
+			return false;
+
+		pkt.size  = htobe32(len + omitted);
+		pkt.len   = htobe32(len);
+		pkt.flags = htobe32(flags);
+		pkt.drops = htobe32(drops);
+		pkt.ts    = htobe64(ts);
+
+		memcpy((uint8_t *) btsnoop->map + btsnoop->map_size, &pkt,
+							BTSNOOP_PKT_SIZE);
+		memcpy((uint8_t *) btsnoop->map + btsnoop->map_size +
+					BTSNOOP_PKT_SIZE, raw + pos, len);
+
+		btsnoop->map_size += BTSNOOP_PKT_SIZE + len;
+		pos += len;
+		count--;
+	}
+
+	return !count;
+}
+
+/*
+ * Blocks of compressed files are decoded one at a time into an image of
+ * the plain format, so that reading shares the mapped file path. Record
+ * offsets of the index are relative to the image of their block.
+ */
+static bool load_chunk(struct btsnoop *btsnoop, unsigned long chunk)
+{
+	const struct btsnoop_chunk *c;
+	const uint8_t *raw;
+	size_t need;
+
+	if (chunk >= btsnoop->num_chunks)
+		return false;
+
+	c = &btsnoop->chunks[chunk];
+
+	if (pread(btsnoop->fd, btsnoop->blk_out, c->len, c->offset) !=
+							(ssize_t) c->len)
+		goto failed;
+
+	if (c->len == c->raw_len)
+		raw = btsnoop->blk_out;
+	else if (lz_decompress(btsnoop->blk_out, c->len, btsnoop->blk_raw,
+								c->raw_len))
+		raw = btsnoop->blk_raw;
+	else
+		goto failed;
+
+	need = c->raw_len + c->count * BTSNOOP_PKT_SIZE;
+	if (need > btsnoop->map_alloc_size) {
+		void *map;
+
+		map = realloc((void *) btsnoop->map, need);
+		if (!map)
+			goto failed;
+
+		btsnoop->map = map;
+		btsnoop->map_alloc_size = need;
+	}
+
+	btsnoop->map_size = 0;
+	btsnoop->map_pos = 0;
+
+	if (!decode_block(btsnoop, raw, c->raw_len, c->count, c->ts))
+		goto failed;
+
+	btsnoop->next_chunk = chunk + 1;
+
+	return true;
+
+failed:
+	/* A damaged block ends the trace like a short read */
+	btsnoop->num_chunks = chunk;
+	btsnoop->next_chunk = chunk;
+	btsnoop->map_size = 0;
+	btsnoop->map_pos = 0;
+
+	return false;
+}
+
+/* Only block headers are read here, blocks are decoded when reached */
+static bool load_compressed(struct btsnoop *btsnoop)
+{
+	unsigned long alloc = 16;
+	struct stat st;
+	off_t offset;
+
+	if (fstat(btsnoop->fd, &st) < 0)
+		return false;
+
+	btsnoop->blk_raw = malloc(BTSNOOP_BLK_MAX_RAW);
+	btsnoop->blk_out = malloc(BTSNOOP_BLK_BOUND(BTSNOOP_BLK_MAX_RAW));
+	btsnoop->chunks = malloc(alloc * sizeof(*btsnoop->chunks));
+
+	if (!btsnoop->blk_raw || !btsnoop->blk_out || !btsnoop->chunks)
+		return false;
+
+	btsnoop->map_alloc = true;
+	offset = BTSNOOP_HDR_SIZE;
+
+	/* A truncated block ends the trace like a short read */
+	while (offset + (off_t) BTSNOOP_BLK_SIZE <= st.st_size) {
+		struct btsnoop_chunk *c;
+		struct btsnoop_blk blk;
+
+		if (pread(btsnoop->fd, &blk, BTSNOOP_BLK_SIZE, offset) !=
+							BTSNOOP_BLK_SIZE)
+			break;
+
+		offset += BTSNOOP_BLK_SIZE;
+
+		if (btsnoop->num_chunks == alloc) {
+			alloc *= 2;
+			c = realloc(btsnoop->chunks, alloc * sizeof(*c));
+			if (!c)
+				return false;
+
+			btsnoop->chunks = c;
+		}
+
+		c = &btsnoop->chunks[btsnoop->num_chunks];
+		c->offset = offset;
+		c->raw_len = be32toh(blk.raw_len);
+		c->len = be32toh(blk.len);
+		c->count = be32toh(blk.count);
+		c->ts = be64toh(blk.ts);
+		c->first = 0;
+
+		if (c->raw_len > BTSNOOP_BLK_MAX_RAW ||
+				c->len > BTSNOOP_BLK_BOUND(c->raw_len) ||
+				c->count > c->raw_len ||
+				c->len > st.st_size - offset)
+			break;
+
+		offset += c->len;
+		btsnoop->num_chunks++;
+	}
+
+	return true;
+}
+
 struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 {
 	struct btsnoop *btsnoop;
@@ -99,6 +576,21 @@ struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 
 		btsnoop->format = be32toh(hdr.type);
 		btsnoop->index = 0xffff;
+	} else if (!memcmp(hdr.id, btsnoopz_id, sizeof(btsnoopz_id))) {
+		if (be32toh(hdr.version) != btsnoop_version)
+			goto failed;
+
+		btsnoop->format = be32toh(hdr.type);
+		btsnoop->index = 0xffff;
+
+		if (!load_compressed(btsnoop)) {
+			free(btsnoop->chunks);
+			free(btsnoop->blk_out);
+			free(btsnoop->blk_raw);
+			goto failed;
+		}
+
+		return btsnoop_ref(btsnoop);
 	} else {
 		if (!(btsnoop->flags & BTSNOOP_FLAG_PKLG_SUPPORT))
 			goto failed;
@@ -117,6 +609,8 @@ struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 		lseek(btsnoop->fd, 0, SEEK_SET);
 	}
 
+	map_file(btsnoop);
+
 	return btsnoop_ref(btsnoop);
 
 failed:
@@ -197,9 +691,21 @@ void btsnoop_unref(struct btsnoop *btsnoop)
 	if (__sync_sub_and_fetch(&btsnoop->ref_count, 1))
 		return;
 
-	if (btsnoop->fd >= 0)
+	if (btsnoop->fd >= 0) {
+		btsnoop_flush(btsnoop);
 		close(btsnoop->fd);
+	}
+
+	if (btsnoop->map_alloc)
+		free((void *) btsnoop->map);
+	else if (btsnoop->map)
+		munmap((void *) btsnoop->map, btsnoop->map_size);
 
+	free(btsnoop->records);
+	free(btsnoop->chunks);
+	free(btsnoop->blk_out);
+	free(btsnoop->blk_raw);
+	free(btsnoop->buf);
 	free(btsnoop);
 }
 
@@ -211,12 +717,196 @@ uint32_t btsnoop_get_format(struct btsnoop *btsnoop)
 	return btsnoop->format;
 }
 
+static bool write_all(int fd, const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t written;
+
+		written = write(fd, data, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		data += written;
+		len -= written;
+	}
+
+	return true;
+}
+
+static bool write_block(struct btsnoop *btsnoop)
+{
+	struct btsnoop_blk blk;
+	uint8_t *data = btsnoop->blk_out + BTSNOOP_BLK_SIZE;
+	size_t len;
+	bool result;
+
+	if (!btsnoop->blk_count)
+		return true;
+
+	len = lz_compress(btsnoop->blk_raw, btsnoop->blk_len, data);
+	if (len >= btsnoop->blk_len) {
+		memcpy(data, btsnoop->blk_raw, btsnoop->blk_len);
+		len = btsnoop->blk_len;
+	}
+
+	blk.raw_len = htobe32(btsnoop->blk_len);
+	blk.len     = htobe32(len);
+	blk.count   = htobe32(btsnoop->blk_count);
+	blk.ts      = htobe64(btsnoop->blk_ts);
+
+	memcpy(btsnoop->blk_out, &blk, BTSNOOP_BLK_SIZE);
+
+	result = write_all(btsnoop->fd, btsnoop->blk_out,
+						BTSNOOP_BLK_SIZE + len);
+
+	btsnoop->cur_size += BTSNOOP_BLK_SIZE + len;
+	btsnoop->blk_len = 0;
+	btsnoop->blk_count = 0;
+
+	return result;
+}
+
+static void append_block(struct btsnoop *btsnoop, uint64_t ts,
+				uint32_t flags, uint32_t drops,
+				const void *data, uint16_t len, uint16_t size)
+{
+	uint8_t *buf;
+	int64_t delta;
+
+	if (!btsnoop->blk_count) {
+		btsnoop->blk_ts = ts;
+		btsnoop->last_ts = ts;
+		btsnoop->last_flags = 0;
+		btsnoop->last_drops = 0;
+	}
+
+	buf = btsnoop->blk_raw + btsnoop->blk_len;
+	delta = ts - btsnoop->last_ts;
+
+	buf += put_varint(buf, ((uint64_t) delta << 1) ^ (delta >> 63));
+	buf += put_varint(buf, len);
+	buf += put_varint(buf, flags ^ btsnoop->last_flags);
+	buf += put_varint(buf, (uint32_t) (drops - btsnoop->last_drops));
+	buf += put_varint(buf, size - len);
+
+	if (len > 0) {
+		memcpy(buf, data, len);
+		buf += len;
+	}
+
+	btsnoop->blk_len = buf - btsnoop->blk_raw;
+	btsnoop->blk_count++;
+	btsnoop->last_ts = ts;
+	btsnoop->last_flags = flags;
+	btsnoop->last_drops = drops;
+}
+
+bool btsnoop_flush(struct btsnoop *btsnoop)
+{
+	bool result;
+
+	if (!btsnoop || btsnoop->fd < 0)
+		return false;
+
+	if (btsnoop->compressed)
+		return write_block(btsnoop);
+
+	if (!btsnoop->buf_len)
+		return true;
+
+	result = write_all(btsnoop->fd, btsnoop->buf, btsnoop->buf_len);
+
+	/* Records that failed to be written are dropped either way */
+	btsnoop->buf_len = 0;
+
+	return result;
+}
+
+bool btsnoop_set_buffer_size(struct btsnoop *btsnoop, size_t size)
+{
+	uint8_t *buf = NULL;
+
+	if (!btsnoop || btsnoop->fd < 0)
+		return false;
+
+	if (size && size < BTSNOOP_PKT_SIZE + BTSNOOP_MAX_PACKET_SIZE)
+		return false;
+
+	if (!btsnoop_flush(btsnoop))
+		return false;
+
+	if (size) {
+		buf = malloc(size);
+		if (!buf)
+			return false;
+	}
+
+	free(btsnoop->buf);
+	btsnoop->buf = buf;
+	btsnoop->buf_size = size;
+
+	return true;
+}
+
+bool btsnoop_set_compressed(struct btsnoop *btsnoop, bool compressed)
+{
+	struct btsnoop_hdr hdr;
+	uint8_t *raw = NULL, *out = NULL;
+
+	if (!btsnoop || btsnoop->fd < 0)
+		return false;
+
+	if (btsnoop->compressed == compressed)
+		return true;
+
+	/* The container can only be switched before any record is written */
+	if (btsnoop->cur_size != BTSNOOP_HDR_SIZE || btsnoop->buf_len)
+		return false;
+
+	if (compressed) {
+		raw = malloc(BTSNOOP_BLK_MAX_RAW);
+		out = malloc(BTSNOOP_BLK_SIZE +
+				BTSNOOP_BLK_BOUND(BTSNOOP_BLK_MAX_RAW));
+		if (!raw || !out)
+			goto failed;
+	}
+
+	memcpy(hdr.id, compressed ? btsnoopz_id : btsnoop_id,
+							sizeof(btsnoop_id));
+	hdr.version = htobe32(btsnoop_version);
+	hdr.type = htobe32(btsnoop->format);
+
+	if (pwrite(btsnoop->fd, &hdr, BTSNOOP_HDR_SIZE, 0) != BTSNOOP_HDR_SIZE)
+		goto failed;
+
+	free(btsnoop->blk_out);
+	free(btsnoop->blk_raw);
+
+	btsnoop->blk_raw = raw;
+	btsnoop->blk_out = out;
+	btsnoop->compressed = compressed;
+
+	return true;
+
+failed:
+	free(out);
+	free(raw);
+
+	return false;
+}
+
 static bool btsnoop_rotate(struct btsnoop *btsnoop)
 {
 	struct btsnoop_hdr hdr;
 	char path[PATH_MAX];
 	ssize_t written;
 
+	/* Pending records belong to the file that is being closed */
+	btsnoop_flush(btsnoop);
+
 	close(btsnoop->fd);
 
 	/* Check if max number of log files has been reached */
@@ -234,7 +924,8 @@ static bool btsnoop_rotate(struct btsnoop *btsnoop)
 	if (btsnoop->fd < 0)
 		return false;
 
-	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
+	memcpy(hdr.id, btsnoop->compressed ? btsnoopz_id : btsnoop_id,
+							sizeof(btsnoop_id));
 	hdr.version = htobe32(btsnoop_version);
 	hdr.type = htobe32(btsnoop->format);
 
@@ -252,38 +943,78 @@ bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t size)
 {
 	struct btsnoop_pkt pkt;
+	struct iovec iov[2];
+	uint16_t len = data ? size : 0;
 	uint64_t ts;
 	ssize_t written;
 
 	if (!btsnoop || !tv)
 		return false;
 
+	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
+
+	if (btsnoop->compressed) {
+		/* Pending raw data is an upper bound of its encoded size */
+		if (btsnoop->max_size && btsnoop->max_size <=
+				btsnoop->cur_size + BTSNOOP_BLK_SIZE +
+				btsnoop->blk_len + BTSNOOP_REC_MAX_HDR + len)
+			if (!btsnoop_rotate(btsnoop))
+				return false;
+
+		if (btsnoop->blk_len + BTSNOOP_REC_MAX_HDR + len >
+							BTSNOOP_BLK_MAX_RAW) {
+			if (!write_block(btsnoop))
+				return false;
+		}
+
+		append_block(btsnoop, ts + 0x00E03AB44A676000ll, flags, drops,
+							data, len, size);
+
+		return true;
+	}
+
 	if (btsnoop->max_size && btsnoop->max_size <=
 			btsnoop->cur_size + size + BTSNOOP_PKT_SIZE)
 		if (!btsnoop_rotate(btsnoop))
 			return false;
 
-	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
-
 	pkt.size  = htobe32(size);
-	pkt.len   = htobe32(size);
+	pkt.len   = htobe32(len);
 	pkt.flags = htobe32(flags);
 	pkt.drops = htobe32(drops);
 	pkt.ts    = htobe64(ts + 0x00E03AB44A676000ll);
 
-	written = write(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
-	if (written < 0)
-		return false;
+	if (btsnoop->buf && btsnoop->buf_len + BTSNOOP_PKT_SIZE + len >
+							btsnoop->buf_size) {
+		if (!btsnoop_flush(btsnoop))
+			return false;
+	}
 
-	btsnoop->cur_size += BTSNOOP_PKT_SIZE;
+	/* Oversized records bypass the buffer once it has been drained */
+	if (btsnoop->buf && BTSNOOP_PKT_SIZE + len <= btsnoop->buf_size) {
+		memcpy(btsnoop->buf + btsnoop->buf_len, &pkt, BTSNOOP_PKT_SIZE);
+		btsnoop->buf_len += BTSNOOP_PKT_SIZE;
 
-	if (data && size > 0) {
-		written = write(btsnoop->fd, data, size);
-		if (written < 0)
-			return false;
+		if (len > 0) {
+			memcpy(btsnoop->buf + btsnoop->buf_len, data, len);
+			btsnoop->buf_len += len;
+		}
+
+		btsnoop->cur_size += BTSNOOP_PKT_SIZE + size;
+
+		return true;
 	}
 
-	btsnoop->cur_size += size;
+	iov[0].iov_base = &pkt;
+	iov[0].iov_len = BTSNOOP_PKT_SIZE;
+	iov[1].iov_base = (void *) data;
+	iov[1].iov_len = len;
+
+	written = writev(btsnoop->fd, iov, len > 0 ? 2 : 1);
+	if (written < 0)
+		return false;
+
+	btsnoop->cur_size += BTSNOOP_PKT_SIZE + size;
 
 	return true;
 }
@@ -375,7 +1106,7 @@ static bool pklg_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	uint64_t ts;
 	ssize_t len;
 
-	len = read(btsnoop->fd, &pkt, PKLG_PKT_SIZE);
+	len = read_data(btsnoop, &pkt, PKLG_PKT_SIZE);
 	if (len == 0)
 		return false;
 
@@ -442,7 +1173,7 @@ static bool pklg_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		break;
 	}
 
-	len = read(btsnoop->fd, data, toread);
+	len = read_data(btsnoop, data, toread);
 	if (len < 0) {
 		btsnoop->aborted = true;
 		return false;
@@ -488,13 +1219,20 @@ static uint16_t get_opcode_from_flags(uint8_t type, uint32_t flags)
 	return 0xffff;
 }
 
+static void ts_to_timeval(uint64_t ts, struct timeval *tv)
+{
+	ts -= 0x00E03AB44A676000ll;
+
+	tv->tv_sec = (ts / 1000000ll) + 946684800ll;
+	tv->tv_usec = ts % 1000000ll;
+}
+
 bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 					uint16_t *index, uint16_t *opcode,
 					void *data, uint16_t *size)
 {
 	struct btsnoop_pkt pkt;
 	uint32_t toread, flags;
-	uint64_t ts;
 	uint8_t pkt_type;
 	ssize_t len;
 
@@ -504,7 +1242,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	if (btsnoop->pklg_format)
 		return pklg_read_hci(btsnoop, tv, index, opcode, data, size);
 
-	len = read(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
+	len = read_data(btsnoop, &pkt, BTSNOOP_PKT_SIZE);
 	if (len == 0)
 		return false;
 
@@ -513,7 +1251,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		return false;
 	}
 
-	toread = be32toh(pkt.size);
+	toread = be32toh(pkt.len);
 	if (toread > BTSNOOP_MAX_PACKET_SIZE) {
 		btsnoop->aborted = true;
 		return false;
@@ -521,9 +1259,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 
 	flags = be32toh(pkt.flags);
 
-	ts = be64toh(pkt.ts) - 0x00E03AB44A676000ll;
-	tv->tv_sec = (ts / 1000000ll) + 946684800ll;
-	tv->tv_usec = ts % 1000000ll;
+	ts_to_timeval(be64toh(pkt.ts), tv);
 
 	switch (btsnoop->format) {
 	case BTSNOOP_FORMAT_HCI:
@@ -532,7 +1268,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		break;
 
 	case BTSNOOP_FORMAT_UART:
-		len = read(btsnoop->fd, &pkt_type, 1);
+		len = read_data(btsnoop, &pkt_type, 1);
 		if (len < 0) {
 			btsnoop->aborted = true;
 			return false;
@@ -553,7 +1289,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		return false;
 	}
 
-	len = read(btsnoop->fd, data, toread);
+	len = read_data(btsnoop, data, toread);
 	if (len < 0) {
 		btsnoop->aborted = true;
 		return false;
@@ -564,6 +1300,268 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	return true;
 }
 
+bool btsnoop_read(struct btsnoop *btsnoop, struct timeval *tv,
+			uint32_t *flags, uint32_t *drops, void *data,
+			uint16_t *size)
+{
+	struct btsnoop_pkt pkt;
+	uint32_t toread;
+	ssize_t len;
+
+	if (!btsnoop || btsnoop->aborted || btsnoop->pklg_format)
+		return false;
+
+	len = read_data(btsnoop, &pkt, BTSNOOP_PKT_SIZE);
+	if (len == 0)
+		return false;
+
+	if (len < 0 || len != BTSNOOP_PKT_SIZE) {
+		btsnoop->aborted = true;
+		return false;
+	}
+
+	toread = be32toh(pkt.len);
+	if (toread > BTSNOOP_MAX_PACKET_SIZE) {
+		btsnoop->aborted = true;
+		return false;
+	}
+
+	len = read_data(btsnoop, data, toread);
+	if (len < 0 || len != (ssize_t) toread) {
+		btsnoop->aborted = true;
+		return false;
+	}
+
+	ts_to_timeval(be64toh(pkt.ts), tv);
+	*flags = be32toh(pkt.flags);
+	*drops = be32toh(pkt.drops);
+	*size = toread;
+
+	return true;
+}
+
+static bool index_records(struct btsnoop *btsnoop, size_t pos,
+							unsigned long *alloc)
+{
+	while (pos + BTSNOOP_PKT_SIZE <= btsnoop->map_size) {
+		struct btsnoop_record *rec;
+		struct btsnoop_pkt pkt;
+		uint32_t len, flags;
+		uint8_t type;
+
+		memcpy(&pkt, btsnoop->map + pos, BTSNOOP_PKT_SIZE);
+
+		len = be32toh(pkt.len);
+		if (len > BTSNOOP_MAX_PACKET_SIZE ||
+				len > btsnoop->map_size - pos - BTSNOOP_PKT_SIZE)
+			break;
+
+		if (btsnoop->num_records == *alloc) {
+			*alloc = *alloc ? *alloc * 2 : 4096;
+			rec = realloc(btsnoop->records, *alloc * sizeof(*rec));
+			if (!rec) {
+				free(btsnoop->records);
+				btsnoop->records = NULL;
+				btsnoop->num_records = 0;
+				return false;
+			}
+			btsnoop->records = rec;
+		}
+
+		rec = &btsnoop->records[btsnoop->num_records++];
+		rec->offset = pos;
+		rec->ts = be64toh(pkt.ts);
+
+		flags = be32toh(pkt.flags);
+
+		switch (btsnoop->format) {
+		case BTSNOOP_FORMAT_HCI:
+			rec->index = 0;
+			rec->opcode = get_opcode_from_flags(0xff, flags);
+			break;
+		case BTSNOOP_FORMAT_UART:
+			type = len ? btsnoop->map[pos + BTSNOOP_PKT_SIZE] : 0;
+			rec->index = 0;
+			rec->opcode = get_opcode_from_flags(type, flags);
+			break;
+		case BTSNOOP_FORMAT_MONITOR:
+			rec->index = flags >> 16;
+			rec->opcode = flags & 0xffff;
+			break;
+		default:
+			rec->index = 0xffff;
+			rec->opcode = 0xffff;
+			break;
+		}
+
+		pos += BTSNOOP_PKT_SIZE + len;
+	}
+
+	return true;
+}
+
+/* Every block is decoded once, keeping only one in memory at a time */
+static bool index_chunks(struct btsnoop *btsnoop, unsigned long *alloc)
+{
+	unsigned long next = btsnoop->next_chunk;
+	size_t pos = btsnoop->map_pos;
+	unsigned long i;
+
+	for (i = 0; i < btsnoop->num_chunks; i++) {
+		if (!load_chunk(btsnoop, i))
+			break;
+
+		btsnoop->chunks[i].first = btsnoop->num_records;
+
+		if (!index_records(btsnoop, 0, alloc))
+			return false;
+	}
+
+	/* Return to the block that was being read */
+	if (next && load_chunk(btsnoop, next - 1))
+		btsnoop->map_pos = pos;
+	else {
+		btsnoop->next_chunk = next ? btsnoop->num_chunks : 0;
+		btsnoop->map_size = 0;
+		btsnoop->map_pos = 0;
+	}
+
+	return true;
+}
+
+static bool build_index(struct btsnoop *btsnoop)
+{
+	unsigned long alloc = 0;
+
+	if (btsnoop->records)
+		return true;
+
+	if (btsnoop->chunks) {
+		if (!index_chunks(btsnoop, &alloc))
+			return false;
+	} else if (!btsnoop->map || btsnoop->pklg_format)
+		return false;
+	else if (!index_records(btsnoop, BTSNOOP_HDR_SIZE, &alloc))
+		return false;
+
+	/* Keep the index non-NULL for empty files to avoid rescanning */
+	if (!btsnoop->records)
+		btsnoop->records = calloc(1, sizeof(*btsnoop->records));
+
+	return !!btsnoop->records;
+}
+
+unsigned long btsnoop_get_record_count(struct btsnoop *btsnoop)
+{
+	if (!btsnoop || !build_index(btsnoop))
+		return 0;
+
+	return btsnoop->num_records;
+}
+
+bool btsnoop_get_record(struct btsnoop *btsnoop, unsigned long record,
+				struct timeval *tv, uint16_t *index,
+				uint16_t *opcode)
+{
+	struct btsnoop_record *rec;
+
+	if (!btsnoop || !build_index(btsnoop))
+		return false;
+
+	if (record >= btsnoop->num_records)
+		return false;
+
+	rec = &btsnoop->records[record];
+
+	if (tv)
+		ts_to_timeval(rec->ts, tv);
+
+	if (index)
+		*index = rec->index;
+
+	if (opcode)
+		*opcode = rec->opcode;
+
+	return true;
+}
+
+unsigned long btsnoop_find_record(struct btsnoop *btsnoop,
+						const struct timeval *tv)
+{
+	unsigned long lo = 0, hi;
+	uint64_t ts;
+
+	if (!btsnoop || !tv || !build_index(btsnoop))
+		return 0;
+
+	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
+	ts += 0x00E03AB44A676000ll;
+
+	/* Lower bound search, relies on records being stored in time order */
+	hi = btsnoop->num_records;
+
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+
+		if (btsnoop->records[mid].ts < ts)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static bool seek_chunk(struct btsnoop *btsnoop, unsigned long record)
+{
+	unsigned long lo = 0, hi = btsnoop->num_chunks;
+
+	if (record == btsnoop->num_records) {
+		btsnoop->next_chunk = btsnoop->num_chunks;
+		btsnoop->map_size = 0;
+		btsnoop->map_pos = 0;
+		return true;
+	}
+
+	/* Last block starting at or before the record */
+	while (hi - lo > 1) {
+		unsigned long mid = lo + (hi - lo) / 2;
+
+		if (btsnoop->chunks[mid].first <= record)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	if (btsnoop->next_chunk != lo + 1 && !load_chunk(btsnoop, lo))
+		return false;
+
+	btsnoop->map_pos = btsnoop->records[record].offset;
+
+	return true;
+}
+
+bool btsnoop_seek(struct btsnoop *btsnoop, unsigned long record)
+{
+	if (!btsnoop || !build_index(btsnoop))
+		return false;
+
+	if (record > btsnoop->num_records)
+		return false;
+
+	if (btsnoop->chunks) {
+		if (!seek_chunk(btsnoop, record))
+			return false;
+	} else if (record == btsnoop->num_records)
+		btsnoop->map_pos = btsnoop->map_size;
+	else
+		btsnoop->map_pos = btsnoop->records[record].offset;
+
+	btsnoop->aborted = false;
+
+	return true;
+}
+
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size)
 {
@@ -96,6 +96,10 @@ void btsnoop_unref(struct btsnoop *btsnoop);
 
 uint32_t btsnoop_get_format(struct btsnoop *btsnoop);
 
+bool btsnoop_set_buffer_size(struct btsnoop *btsnoop, size_t size);
+bool btsnoop_flush(struct btsnoop *btsnoop);
+bool btsnoop_set_compressed(struct btsnoop *btsnoop, bool compressed);
+
 bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv, uint32_t flags,
 			uint32_t drops, const void *data, uint16_t size);
 bool btsnoop_write_hci(struct btsnoop *btsnoop, struct timeval *tv,
@@ -104,8 +108,19 @@ bool btsnoop_write_hci(struct btsnoop *btsnoop, struct timeval *tv,
 bool btsnoop_write_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t frequency, const void *data, uint16_t size);
 
+bool btsnoop_read(struct btsnoop *btsnoop, struct timeval *tv,
+			uint32_t *flags, uint32_t *drops, void *data,
+			uint16_t *size);
 bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 					uint16_t *index, uint16_t *opcode,
 					void *data, uint16_t *size);
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size);
+
+unsigned long btsnoop_get_record_count(struct btsnoop *btsnoop);
+bool btsnoop_get_record(struct btsnoop *btsnoop, unsigned long record,
+				struct timeval *tv, uint16_t *index,
+				uint16_t *opcode);
+unsigned long btsnoop_find_record(struct btsnoop *btsnoop,
+						const struct timeval *tv);
+bool btsnoop_seek(struct btsnoop *btsnoop, unsigned long record);
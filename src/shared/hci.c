@@ -316,11 +316,19 @@ static struct bt_hci *create_hci(int fd)
 struct bt_hci *bt_hci_new(int fd)
 {
 	struct bt_hci *hci;
+	socklen_t len;
+	int type;
 
 	hci = create_hci(fd);
 	if (!hci)
 		return NULL;
 
+	/* Packet based sockets carry one H:4 packet per read */
+	len = sizeof(type);
+	if (!getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) &&
+							type != SOCK_STREAM)
+		hci->is_stream = false;
+
 	return hci;
 }
 
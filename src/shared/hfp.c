@@ -25,6 +25,39 @@
 #include "src/shared/io.h"
 #include "src/shared/hfp.h"
 
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * Longest line that can be assembled from the read buffer, which is also
+ * the size of the ring buffer since a line can never be longer than that.
+ */
+#define HFP_LINE_MAX	4096
+
+/*
+ * Registered AT command and result code prefixes are kept in a trie with
+ * one node per character, siblings chained through next, so dispatching
+ * a line costs one walk over its prefix regardless of how many handlers
+ * are registered.
+ */
+struct prefix_node {
+	char c;
+	void *handler;
+	struct prefix_node *next;
+	struct prefix_node *child;
+};
+
+/*
+ * Incoming data is split into lines in place in the read buffer. scan is
+ * the amount of buffered data already searched for the line terminator
+ * so a partial line is not searched again when more data arrives. Only a
+ * line wrapping around the end of the ring buffer is copied, into buf.
+ */
+struct hfp_reader {
+	struct ringbuf *buf;
+	size_t scan;
+	char line[HFP_LINE_MAX + 1];
+};
+
 struct hfp_gw {
 	int ref_count;
 	int fd;
@@ -32,7 +65,8 @@ struct hfp_gw {
 	struct io *io;
 	struct ringbuf *read_buf;
 	struct ringbuf *write_buf;
-	struct queue *cmd_handlers;
+	struct hfp_reader reader;
+	struct prefix_node *cmd_handlers;
 	bool writer_active;
 	bool result_pending;
 	hfp_command_func_t command_callback;
@@ -57,11 +91,12 @@ struct hfp_hf {
 	struct io *io;
 	struct ringbuf *read_buf;
 	struct ringbuf *write_buf;
+	struct hfp_reader reader;
 
 	bool writer_active;
 	struct queue *cmd_queue;
 
-	struct queue *event_handlers;
+	struct prefix_node *event_handlers;
 
 	hfp_debug_func_t debug_callback;
 	hfp_destroy_func_t debug_destroy;
@@ -76,7 +111,6 @@ struct hfp_hf {
 };
 
 struct cmd_handler {
-	char *prefix;
 	void *user_data;
 	hfp_destroy_func_t destroy;
 	hfp_result_func_t callback;
@@ -95,7 +129,6 @@ struct cmd_response {
 };
 
 struct event_handler {
-	char *prefix;
 	void *user_data;
 	hfp_destroy_func_t destroy;
 	hfp_hf_result_func_t callback;
@@ -108,22 +141,180 @@ static void destroy_cmd_handler(void *data)
 	if (handler->destroy)
 		handler->destroy(handler->user_data);
 
-	free(handler->prefix);
-
 	free(handler);
 }
 
-static bool match_handler_prefix(const void *a, const void *b)
+static struct prefix_node **prefix_find(struct prefix_node **node, char c)
+{
+	while (*node && (*node)->c != c)
+		node = &(*node)->next;
+
+	return node;
+}
+
+static bool prefix_insert(struct prefix_node **root, const char *prefix,
+								void *handler)
 {
-	const struct cmd_handler *handler = a;
-	const char *prefix = b;
+	struct prefix_node **node = root;
 
-	if (strcmp(handler->prefix, prefix) != 0)
+	if (!prefix || !prefix[0])
 		return false;
 
+	while (1) {
+		node = prefix_find(node, *prefix);
+		if (!*node) {
+			*node = new0(struct prefix_node, 1);
+			(*node)->c = *prefix;
+		}
+
+		if (!*++prefix)
+			break;
+
+		node = &(*node)->child;
+	}
+
+	if ((*node)->handler)
+		return false;
+
+	(*node)->handler = handler;
+
 	return true;
 }
 
+/* Matches the first len characters of prefix ignoring their case */
+static void *prefix_lookup(struct prefix_node *node, const char *prefix,
+								size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		char c = toupper(prefix[i]);
+
+		while (node && node->c != c)
+			node = node->next;
+
+		if (!node)
+			return NULL;
+
+		if (i + 1 == len)
+			return node->handler;
+
+		node = node->child;
+	}
+
+	return NULL;
+}
+
+static void *prefix_remove(struct prefix_node **root, const char *prefix)
+{
+	struct prefix_node **node, *n;
+	void *handler;
+
+	if (!prefix || !prefix[0])
+		return NULL;
+
+	node = prefix_find(root, *prefix);
+	n = *node;
+	if (!n)
+		return NULL;
+
+	if (prefix[1]) {
+		handler = prefix_remove(&n->child, prefix + 1);
+	} else {
+		handler = n->handler;
+		n->handler = NULL;
+	}
+
+	/* Prune nodes no longer leading to any handler */
+	if (!n->handler && !n->child) {
+		*node = n->next;
+		free(n);
+	}
+
+	return handler;
+}
+
+static void prefix_destroy(struct prefix_node *node,
+					void (*destroy)(void *handler))
+{
+	while (node) {
+		struct prefix_node *next = node->next;
+
+		prefix_destroy(node->child, destroy);
+
+		if (node->handler)
+			destroy(node->handler);
+
+		free(node);
+		node = next;
+	}
+}
+
+/*
+ * Returns the next line terminated by term, without the terminator and
+ * NUL terminated, or NULL if no complete line is buffered yet. The line
+ * has to be released with reader_drain once it has been processed.
+ */
+static char *reader_next(struct hfp_reader *reader, char term, size_t *len)
+{
+	size_t avail = ringbuf_len(reader->buf);
+	size_t seg, seg2;
+	char *str, *str2, *ptr;
+
+	while (reader->scan < avail) {
+		str = ringbuf_peek(reader->buf, reader->scan, &seg);
+		if (!str)
+			return NULL;
+
+		/* seg counts from the start of the buffered data */
+		seg = MIN(seg, avail - reader->scan);
+
+		ptr = memchr(str, term, seg);
+		if (ptr) {
+			reader->scan += ptr - str;
+			goto found;
+		}
+
+		reader->scan += seg;
+	}
+
+	/*
+	 * A full buffer without terminator can never complete a line, drop
+	 * it as trash so that reading can continue.
+	 */
+	if (!ringbuf_avail(reader->buf)) {
+		ringbuf_drain(reader->buf, avail);
+		reader->scan = 0;
+	}
+
+	return NULL;
+
+found:
+	*len = reader->scan;
+
+	str = ringbuf_peek(reader->buf, 0, &seg);
+	if (seg > *len) {
+		str[*len] = '\0';
+		return str;
+	}
+
+	/* Line wraps around the end of the ring buffer */
+	str2 = ringbuf_peek(reader->buf, seg, &seg2);
+
+	memcpy(reader->line, str, seg);
+	memcpy(reader->line + seg, str2, *len - seg);
+	reader->line[*len] = '\0';
+
+	return reader->line;
+}
+
+static void reader_drain(struct hfp_reader *reader, size_t len)
+{
+	/* Account for the line terminator */
+	ringbuf_drain(reader->buf, len + 1);
+	reader->scan = 0;
+}
+
 static void write_watch_destroy(void *user_data)
 {
 	struct hfp_gw *hfp = user_data;
@@ -184,10 +375,8 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 	const char *separators = ";?=\0";
 	struct hfp_context context;
 	enum hfp_gw_cmd_type type;
-	char lookup_prefix[18];
 	uint8_t pref_len = 0;
 	const char *prefix;
-	int i;
 
 	context.offset = 0;
 	context.data = data;
@@ -205,20 +394,16 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 	prefix = data + context.offset;
 
 	if (isalpha(prefix[0])) {
-		lookup_prefix[pref_len++] = toupper(prefix[0]);
+		pref_len = 1;
 	} else {
 		pref_len = strcspn(prefix, separators);
 		if (pref_len > 17 || pref_len < 2)
 			return false;
-
-		for (i = 0; i < pref_len; i++)
-			lookup_prefix[i] = toupper(prefix[i]);
 	}
 
-	lookup_prefix[pref_len] = '\0';
 	context.offset += pref_len;
 
-	if (lookup_prefix[0] == 'D') {
+	if (toupper(prefix[0]) == 'D') {
 		type = HFP_GW_CMD_TYPE_SET;
 		goto done;
 	}
@@ -244,8 +429,7 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 
 done:
 
-	handler = queue_find(hfp->cmd_handlers, match_handler_prefix,
-								lookup_prefix);
+	handler = prefix_lookup(hfp->cmd_handlers, prefix, pref_len);
 	if (!handler) {
 		handle_unknown_at_command(hfp, data);
 		return true;
@@ -462,53 +646,15 @@ failed:
 
 static void process_input(struct hfp_gw *hfp)
 {
-	char *str, *ptr;
-	size_t len, count;
-	bool free_ptr = false;
+	char *str;
+	size_t len;
 	bool read_again;
 
 	do {
-		str = ringbuf_peek(hfp->read_buf, 0, &len);
+		str = reader_next(&hfp->reader, '\r', &len);
 		if (!str)
 			return;
 
-		ptr = memchr(str, '\r', len);
-		if (!ptr) {
-			char *str2;
-			size_t len2;
-
-			/*
-			 * If there is no more data in ringbuffer,
-			 * it's just an incomplete command.
-			 */
-			if (len == ringbuf_len(hfp->read_buf))
-				return;
-
-			str2 = ringbuf_peek(hfp->read_buf, len, &len2);
-			if (!str2)
-				return;
-
-			ptr = memchr(str2, '\r', len2);
-			if (!ptr)
-				return;
-
-			*ptr = '\0';
-
-			count = len2 + len;
-			ptr = malloc(count);
-			if (!ptr)
-				return;
-
-			memcpy(ptr, str, len);
-			memcpy(ptr + len, str2, len2);
-
-			free_ptr = true;
-			str = ptr;
-		} else {
-			count = ptr - str;
-			*ptr = '\0';
-		}
-
 		if (!handle_at_command(hfp, str))
 			/*
 			 * Command is not handled that means that was some
@@ -526,11 +672,7 @@ static void process_input(struct hfp_gw *hfp)
 			 */
 			read_again = !hfp->result_pending;
 
-		ringbuf_drain(hfp->read_buf, count + 1);
-
-		if (free_ptr)
-			free(ptr);
-
+		reader_drain(&hfp->reader, len);
 	} while (read_again);
 }
 
@@ -587,11 +729,10 @@ struct hfp_gw *hfp_gw_new(int fd)
 		return NULL;
 	}
 
-	hfp->cmd_handlers = queue_new();
+	hfp->reader.buf = hfp->read_buf;
 
 	if (!io_set_read_handler(hfp->io, can_read_data, hfp,
 							read_watch_destroy)) {
-		queue_destroy(hfp->cmd_handlers, destroy_cmd_handler);
 		io_destroy(hfp->io);
 		ringbuf_free(hfp->write_buf);
 		ringbuf_free(hfp->read_buf);
@@ -643,8 +784,9 @@ void hfp_gw_unref(struct hfp_gw *hfp)
 	ringbuf_free(hfp->write_buf);
 	hfp->write_buf = NULL;
 
-	queue_destroy(hfp->cmd_handlers, destroy_cmd_handler);
+	prefix_destroy(hfp->cmd_handlers, destroy_cmd_handler);
 	hfp->cmd_handlers = NULL;
+	hfp->reader.buf = NULL;
 
 	if (!hfp->in_disconnect) {
 		free(hfp);
@@ -825,36 +967,21 @@ bool hfp_gw_register(struct hfp_gw *hfp, hfp_result_func_t callback,
 	handler->callback = callback;
 	handler->user_data = user_data;
 
-	handler->prefix = strdup(prefix);
-	if (!handler->prefix) {
+	if (!prefix_insert(&hfp->cmd_handlers, prefix, handler)) {
 		free(handler);
 		return false;
 	}
 
-	if (queue_find(hfp->cmd_handlers, match_handler_prefix,
-							handler->prefix)) {
-		destroy_cmd_handler(handler);
-		return false;
-	}
-
 	handler->destroy = destroy;
 
-	return queue_push_tail(hfp->cmd_handlers, handler);
+	return true;
 }
 
 bool hfp_gw_unregister(struct hfp_gw *hfp, const char *prefix)
 {
 	struct cmd_handler *handler;
-	char *lookup_prefix;
-
-	lookup_prefix = strdup(prefix);
-	if (!lookup_prefix)
-		return false;
-
-	handler = queue_remove_if(hfp->cmd_handlers, match_handler_prefix,
-								lookup_prefix);
-	free(lookup_prefix);
 
+	handler = prefix_remove(&hfp->cmd_handlers, prefix);
 	if (!handler)
 		return false;
 
@@ -922,17 +1049,6 @@ bool hfp_gw_disconnect(struct hfp_gw *hfp)
 	return io_shutdown(hfp->io);
 }
 
-static bool match_handler_event_prefix(const void *a, const void *b)
-{
-	const struct event_handler *handler = a;
-	const char *prefix = b;
-
-	if (strcmp(handler->prefix, prefix) != 0)
-		return false;
-
-	return true;
-}
-
 static void destroy_event_handler(void *data)
 {
 	struct event_handler *handler = data;
@@ -940,8 +1056,6 @@ static void destroy_event_handler(void *data)
 	if (handler->destroy)
 		handler->destroy(handler->user_data);
 
-	free(handler->prefix);
-
 	free(handler);
 }
 
@@ -1103,116 +1217,32 @@ static void hf_call_prefix_handler(struct hfp_hf *hfp, const char *data)
 		return;
 	}
 
-	handler = queue_find(hfp->event_handlers, match_handler_event_prefix,
-								lookup_prefix);
+	handler = prefix_lookup(hfp->event_handlers, lookup_prefix, pref_len);
 	if (!handler)
 		return;
 
 	handler->callback(&context, handler->user_data);
 }
 
-static char *find_cr_lf(char *str, size_t len)
-{
-	char *ptr;
-	size_t count, offset;
-
-	offset = 0;
-
-	ptr = memchr(str, '\r', len);
-	while (ptr) {
-		/*
-		 * Check if there is more data after '\r'. If so check for
-		 * '\n'
-		 */
-		count = ptr - str;
-		if ((count < (len - 1)) && *(ptr + 1) == '\n')
-			return ptr;
-
-		/* There is only '\r'? Let's try to find next one */
-		offset += count + 1;
-
-		if (offset >= len)
-			return NULL;
-
-		ptr = memchr(str + offset, '\r', len - offset);
-	}
-
-	return NULL;
-}
-
 static void hf_process_input(struct hfp_hf *hfp)
 {
-	char *str, *ptr, *str2, *tmp;
-	size_t len, count, offset, len2;
-	bool free_tmp = false;
-
-	str = ringbuf_peek(hfp->read_buf, 0, &len);
-	if (!str)
-		return;
-
-	offset = 0;
-
-	ptr = find_cr_lf(str, len);
-	while (ptr) {
-		count = ptr - (str + offset);
-		if (count == 0) {
-			/* 2 is for <cr><lf> */
-			offset += 2;
-		} else {
-			*ptr = '\0';
-			hf_call_prefix_handler(hfp, str + offset);
-			offset += count + 2;
-		}
-
-		ptr = find_cr_lf(str + offset, len - offset);
-	}
+	char *str;
+	size_t len, count;
 
 	/*
-	 * Just check if there is no wrapped data in ring buffer.
-	 * Should not happen too often
+	 * Lines are split on <lf> and a trailing <cr> is stripped, which
+	 * also skips the empty line of the leading <cr><lf> of a response.
 	 */
-	if (len == ringbuf_len(hfp->read_buf))
-		goto done;
-
-	str2 = ringbuf_peek(hfp->read_buf, len, &len2);
-	if (!str2)
-		goto done;
-
-	ptr = find_cr_lf(str2, len2);
-	if (!ptr) {
-		/* Might happen that we wrap between \r and \n */
-		ptr = memchr(str2, '\n', len2);
-		if (!ptr)
-			goto done;
-	}
+	while ((str = reader_next(&hfp->reader, '\n', &len))) {
+		count = len;
+		if (count && str[count - 1] == '\r')
+			str[--count] = '\0';
 
-	count = ptr - str2;
+		if (count)
+			hf_call_prefix_handler(hfp, str);
 
-	if (count) {
-		*ptr = '\0';
-
-		tmp = malloc(len + count);
-		if (!tmp)
-			goto done;
-
-		/* "str" here is not a string so we need to use memcpy */
-		memcpy(tmp, str, len);
-		memcpy(tmp + len, str2, count);
-
-		free_tmp = true;
-	} else {
-		str[len-1] = '\0';
-		tmp = str;
+		reader_drain(&hfp->reader, len);
 	}
-
-	hf_call_prefix_handler(hfp, tmp);
-	offset += count;
-
-done:
-	ringbuf_drain(hfp->read_buf, offset);
-
-	if (free_tmp)
-		free(tmp);
 }
 
 static bool hf_can_read_data(struct io *io, void *user_data)
@@ -1261,14 +1291,13 @@ struct hfp_hf *hfp_hf_new(int fd)
 		return NULL;
 	}
 
-	hfp->event_handlers = queue_new();
+	hfp->reader.buf = hfp->read_buf;
 	hfp->cmd_queue = queue_new();
 	hfp->writer_active = false;
 
 	if (!io_set_read_handler(hfp->io, hf_can_read_data, hfp,
 							read_watch_destroy)) {
-		queue_destroy(hfp->event_handlers,
-						destroy_event_handler);
+		queue_destroy(hfp->cmd_queue, NULL);
 		io_destroy(hfp->io);
 		ringbuf_free(hfp->write_buf);
 		ringbuf_free(hfp->read_buf);
@@ -1315,8 +1344,9 @@ void hfp_hf_unref(struct hfp_hf *hfp)
 	ringbuf_free(hfp->write_buf);
 	hfp->write_buf = NULL;
 
-	queue_destroy(hfp->event_handlers, destroy_event_handler);
+	prefix_destroy(hfp->event_handlers, destroy_event_handler);
 	hfp->event_handlers = NULL;
+	hfp->reader.buf = NULL;
 
 	queue_destroy(hfp->cmd_queue, free);
 	hfp->cmd_queue = NULL;
@@ -1435,32 +1465,21 @@ bool hfp_hf_register(struct hfp_hf *hfp, hfp_hf_result_func_t callback,
 	handler->callback = callback;
 	handler->user_data = user_data;
 
-	handler->prefix = strdup(prefix);
-	if (!handler->prefix) {
+	if (!prefix_insert(&hfp->event_handlers, prefix, handler)) {
 		free(handler);
 		return false;
 	}
 
-	if (queue_find(hfp->event_handlers, match_handler_event_prefix,
-							handler->prefix)) {
-		destroy_event_handler(handler);
-		return false;
-	}
-
 	handler->destroy = destroy;
 
-	return queue_push_tail(hfp->event_handlers, handler);
+	return true;
 }
 
 bool hfp_hf_unregister(struct hfp_hf *hfp, const char *prefix)
 {
-	struct cmd_handler *handler;
-
-	/* Cast to void as queue_remove needs that */
-	handler = queue_remove_if(hfp->event_handlers,
-						match_handler_event_prefix,
-						(void *) prefix);
+	struct event_handler *handler;
 
+	handler = prefix_remove(&hfp->event_handlers, prefix);
 	if (!handler)
 		return false;
 
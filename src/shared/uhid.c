@@ -14,10 +14,13 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/uio.h>
 
 #include "src/shared/io.h"
 #include "src/shared/util.h"
@@ -26,11 +29,28 @@
 
 #define UHID_DEVICE_FILE "/dev/uhid"
 
+#define UHID_INPUT2_HDR_SIZE offsetof(struct uhid_event, u.input2.data)
+
+#define UHID_BATCH_MAX 64
+#define UHID_BATCH_SIZE 4096
+
+struct uhid_batch {
+	uint8_t buf[UHID_BATCH_SIZE];
+	size_t len;
+	struct iovec iov[UHID_BATCH_MAX];
+	uint64_t time[UHID_BATCH_MAX];
+	unsigned int count;
+	bool writing;
+};
+
 struct bt_uhid {
 	int ref_count;
 	struct io *io;
 	unsigned int notify_id;
 	struct queue *notify_list;
+	struct uhid_batch *batch;
+	uint64_t first_input;
+	struct bt_uhid_stats stats;
 };
 
 struct uhid_notify {
@@ -40,14 +60,132 @@ struct uhid_notify {
 	void *user_data;
 };
 
+static uint64_t uhid_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void uhid_stats_update(struct bt_uhid *uhid, const uint64_t *time,
+					unsigned int count, bool written)
+{
+	struct bt_uhid_stats *stats = &uhid->stats;
+	uint64_t now;
+	unsigned int i;
+
+	stats->writes++;
+
+	if (!written) {
+		stats->dropped += count;
+		return;
+	}
+
+	now = uhid_time_us();
+
+	if (!stats->reports)
+		uhid->first_input = time[0];
+
+	stats->reports += count;
+	stats->duration = now - uhid->first_input;
+
+	for (i = 0; i < count; i++) {
+		uint64_t latency = now - time[i];
+		unsigned int bucket = 0;
+
+		/* Bucket n holds latencies below 2^n microseconds */
+		while (latency && bucket < BT_UHID_LATENCY_BUCKETS - 1) {
+			latency >>= 1;
+			bucket++;
+		}
+
+		stats->latency[bucket]++;
+	}
+}
+
+static void uhid_flush(struct bt_uhid *uhid)
+{
+	struct uhid_batch *batch = uhid->batch;
+	ssize_t len;
+
+	if (!batch || !batch->count)
+		return;
+
+	/* Each iovec holds exactly one event: uHID has no write_iter so the
+	 * kernel hands every iovec to its write handler separately.
+	 */
+	len = io_send(uhid->io, batch->iov, batch->count);
+
+	uhid_stats_update(uhid, batch->time, batch->count,
+					len == (ssize_t) batch->len);
+
+	batch->count = 0;
+	batch->len = 0;
+}
+
+static bool uhid_write_handler(struct io *io, void *user_data)
+{
+	struct bt_uhid *uhid = user_data;
+
+	uhid_flush(uhid);
+
+	return false;
+}
+
+static void uhid_write_destroy(void *user_data)
+{
+	struct bt_uhid *uhid = user_data;
+
+	if (uhid->batch)
+		uhid->batch->writing = false;
+}
+
+static bool uhid_batch_add(struct bt_uhid *uhid, const struct uhid_event *ev,
+						size_t size, uint64_t time)
+{
+	struct uhid_batch *batch = uhid->batch;
+	struct iovec *iov;
+
+	if (!batch || size > sizeof(batch->buf))
+		return false;
+
+	if (batch->count == UHID_BATCH_MAX ||
+				batch->len + size > sizeof(batch->buf))
+		uhid_flush(uhid);
+
+	iov = &batch->iov[batch->count];
+	iov->iov_base = batch->buf + batch->len;
+	iov->iov_len = size;
+	memcpy(iov->iov_base, ev, size);
+
+	batch->time[batch->count++] = time;
+	batch->len += size;
+
+	/* Flush once the main loop gets back to polling the device */
+	if (!batch->writing)
+		batch->writing = io_set_write_handler(uhid->io,
+					uhid_write_handler, uhid,
+					uhid_write_destroy);
+
+	if (!batch->writing)
+		uhid_flush(uhid);
+
+	return true;
+}
+
 static void uhid_free(struct bt_uhid *uhid)
 {
-	if (uhid->io)
+	if (uhid->io) {
+		uhid_flush(uhid);
 		io_destroy(uhid->io);
+	}
 
 	if (uhid->notify_list)
 		queue_destroy(uhid->notify_list, free);
 
+	free(uhid->batch);
 	free(uhid);
 }
 
@@ -160,6 +298,71 @@ bool bt_uhid_set_close_on_unref(struct bt_uhid *uhid, bool do_close)
 	return true;
 }
 
+bool bt_uhid_set_batching(struct bt_uhid *uhid, bool enable)
+{
+	if (!uhid || !uhid->io)
+		return false;
+
+	if (enable) {
+		if (!uhid->batch)
+			uhid->batch = new0(struct uhid_batch, 1);
+
+		return true;
+	}
+
+	if (!uhid->batch)
+		return true;
+
+	uhid_flush(uhid);
+	io_set_write_handler(uhid->io, NULL, NULL, NULL);
+
+	free(uhid->batch);
+	uhid->batch = NULL;
+
+	return true;
+}
+
+bool bt_uhid_get_stats(struct bt_uhid *uhid, struct bt_uhid_stats *stats)
+{
+	if (!uhid || !stats)
+		return false;
+
+	memcpy(stats, &uhid->stats, sizeof(*stats));
+
+	return true;
+}
+
+unsigned int bt_uhid_stats_rate(const struct bt_uhid_stats *stats)
+{
+	if (!stats->duration)
+		return 0;
+
+	return stats->reports * 1000000ULL / stats->duration;
+}
+
+uint64_t bt_uhid_stats_latency(const struct bt_uhid_stats *stats,
+						unsigned int percentile)
+{
+	uint64_t count = 0, target;
+	unsigned int i;
+
+	if (!stats->reports)
+		return 0;
+
+	target = (stats->reports * percentile + 99) / 100;
+
+	for (i = 0; i < BT_UHID_LATENCY_BUCKETS; i++) {
+		count += stats->latency[i];
+		if (count >= target)
+			break;
+	}
+
+	if (i == BT_UHID_LATENCY_BUCKETS)
+		i--;
+
+	return 1ULL << i;
+}
+
 unsigned int bt_uhid_register(struct bt_uhid *uhid, uint32_t event,
 				bt_uhid_callback_t func, void *user_data)
 {
@@ -215,7 +418,8 @@ bool bt_uhid_unregister_all(struct bt_uhid *uhid)
 	return true;
 }
 
-int bt_uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev)
+static int uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev,
+								size_t size)
 {
 	ssize_t len;
 	struct iovec iov;
@@ -223,13 +427,62 @@ int bt_uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev)
 	if (!uhid->io)
 		return -ENOTCONN;
 
+	/* Keep ordering with respect to any batched input reports */
+	uhid_flush(uhid);
+
 	iov.iov_base = (void *) ev;
-	iov.iov_len = sizeof(*ev);
+	iov.iov_len = size;
 
 	len = io_send(uhid->io, &iov, 1);
 	if (len < 0)
 		return -errno;
 
 	/* uHID kernel driver does not handle partial writes */
-	return len != sizeof(*ev) ? -EIO : 0;
+	return (size_t) len != size ? -EIO : 0;
+}
+
+int bt_uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev)
+{
+	return uhid_send(uhid, ev, sizeof(*ev));
+}
+
+int bt_uhid_input(struct bt_uhid *uhid, uint8_t number, const void *data,
+								size_t size)
+{
+	struct uhid_event ev;
+	struct uhid_input2_req *req = &ev.u.input2;
+	size_t len = 0;
+	uint64_t time;
+	int err;
+
+	if (!uhid)
+		return -EINVAL;
+
+	time = uhid_time_us();
+
+	/* Only the header and the report itself are initialized and written,
+	 * the kernel does not require the whole event for UHID_INPUT2.
+	 */
+	ev.type = UHID_INPUT2;
+
+	if (number)
+		req->data[len++] = number;
+
+	if (size > sizeof(req->data) - len)
+		size = sizeof(req->data) - len;
+
+	if (size)
+		memcpy(&req->data[len], data, size);
+
+	req->size = len + size;
+	len = UHID_INPUT2_HDR_SIZE + req->size;
+
+	if (uhid_batch_add(uhid, &ev, len, time))
+		return 0;
+
+	err = uhid_send(uhid, &ev, len);
+
+	uhid_stats_update(uhid, &time, 1, !err);
+
+	return err;
 }
@@ -14,6 +14,16 @@
 
 struct bt_uhid;
 
+#define BT_UHID_LATENCY_BUCKETS 16
+
+struct bt_uhid_stats {
+	uint64_t reports;
+	uint64_t dropped;
+	uint64_t writes;
+	uint64_t duration;
+	uint64_t latency[BT_UHID_LATENCY_BUCKETS];
+};
+
 struct bt_uhid *bt_uhid_new_default(void);
 struct bt_uhid *bt_uhid_new(int fd);
 
@@ -21,6 +31,12 @@ struct bt_uhid *bt_uhid_ref(struct bt_uhid *uhid);
 void bt_uhid_unref(struct bt_uhid *uhid);
 
 bool bt_uhid_set_close_on_unref(struct bt_uhid *uhid, bool do_close);
+bool bt_uhid_set_batching(struct bt_uhid *uhid, bool enable);
+
+bool bt_uhid_get_stats(struct bt_uhid *uhid, struct bt_uhid_stats *stats);
+unsigned int bt_uhid_stats_rate(const struct bt_uhid_stats *stats);
+uint64_t bt_uhid_stats_latency(const struct bt_uhid_stats *stats,
+						unsigned int percentile);
 
 typedef void (*bt_uhid_callback_t)(struct uhid_event *ev, void *user_data);
 unsigned int bt_uhid_register(struct bt_uhid *uhid, uint32_t event,
@@ -29,3 +45,5 @@ bool bt_uhid_unregister(struct bt_uhid *uhid, unsigned int id);
 bool bt_uhid_unregister_all(struct bt_uhid *uhid);
 
 int bt_uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev);
+int bt_uhid_input(struct bt_uhid *uhid, uint8_t number, const void *data,
+								size_t size);
@@ -22,6 +22,8 @@
 #include <time.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <libgen.h>
@@ -33,6 +35,7 @@
 #include "lib/hci.h"
 
 #include "src/shared/util.h"
+#include "src/shared/queue.h"
 #include "src/shared/mainloop.h"
 #include "src/shared/btsnoop.h"
 
@@ -44,7 +47,337 @@ struct monitor_hdr {
 	uint16_t len;
 } __attribute__ ((packed));
 
+/* Maximum time a buffered record may wait before reaching the file */
+#define FLUSH_INTERVAL 1000
+
+/* Triggers closer than this are covered by the previous snapshot */
+#define SNAPSHOT_HOLDOFF 1
+
+#define MAX_TRIGGERS 8
+
+/* Records are copied in and out, so the ring needs no alignment */
+struct ring_hdr {
+	struct timeval tv;
+	uint16_t index;
+	uint16_t opcode;
+	uint16_t len;
+};
+
+struct index_record {
+	struct ring_hdr hdr;
+	uint8_t data[];
+};
+
+struct trigger {
+	uint8_t event;
+	int reason;
+};
+
 static struct btsnoop *btsnoop_file = NULL;
+static const char *path = "hci.log";
+static bool compress;
+
+static uint8_t *ring_buf;
+static size_t ring_size;
+static size_t ring_head;
+static size_t ring_len;
+static unsigned long ring_count;
+static unsigned long ring_age;
+static struct queue *index_list;
+
+static struct trigger trigger_list[MAX_TRIGGERS];
+static unsigned int trigger_count;
+static time_t last_snapshot;
+
+static void flush_callback(int id, void *user_data)
+{
+	btsnoop_flush(btsnoop_file);
+
+	mainloop_modify_timeout(id, FLUSH_INTERVAL);
+}
+
+static void ring_copy_in(size_t offset, const void *data, size_t len)
+{
+	size_t len_nowrap;
+
+	offset %= ring_size;
+	len_nowrap = ring_size - offset;
+
+	if (len <= len_nowrap) {
+		memcpy(ring_buf + offset, data, len);
+		return;
+	}
+
+	memcpy(ring_buf + offset, data, len_nowrap);
+	memcpy(ring_buf, data + len_nowrap, len - len_nowrap);
+}
+
+static void ring_copy_out(size_t offset, void *data, size_t len)
+{
+	size_t len_nowrap;
+
+	offset %= ring_size;
+	len_nowrap = ring_size - offset;
+
+	if (len <= len_nowrap) {
+		memcpy(data, ring_buf + offset, len);
+		return;
+	}
+
+	memcpy(data, ring_buf + offset, len_nowrap);
+	memcpy(data + len_nowrap, ring_buf, len - len_nowrap);
+}
+
+static void ring_pop(void)
+{
+	struct ring_hdr hdr;
+	size_t size;
+
+	ring_copy_out(ring_head, &hdr, sizeof(hdr));
+
+	size = sizeof(hdr) + hdr.len;
+	ring_head = (ring_head + size) % ring_size;
+	ring_len -= size;
+	ring_count--;
+}
+
+static void ring_expire(const struct timeval *tv)
+{
+	struct ring_hdr hdr;
+
+	if (!ring_age)
+		return;
+
+	while (ring_count) {
+		ring_copy_out(ring_head, &hdr, sizeof(hdr));
+
+		if (tv->tv_sec - hdr.tv.tv_sec <= (time_t) ring_age)
+			break;
+
+		ring_pop();
+	}
+}
+
+static bool match_index(const void *a, const void *b)
+{
+	const struct index_record *rec = a;
+	uint32_t val = PTR_TO_UINT(b);
+
+	if ((val & 0xffff) != rec->hdr.index)
+		return false;
+
+	/* Without an opcode all records of the index match */
+	return !(val >> 16) || (val >> 16) == rec->hdr.opcode;
+}
+
+/*
+ * Keep the controller records around even once they fall out of the
+ * ring, snapshots can't be decoded without them.
+ */
+static void index_update(const struct ring_hdr *hdr, const void *data)
+{
+	struct index_record *rec;
+	uint32_t val = hdr->index;
+
+	switch (hdr->opcode) {
+	case BTSNOOP_OPCODE_NEW_INDEX:
+	case BTSNOOP_OPCODE_DEL_INDEX:
+		break;
+	case BTSNOOP_OPCODE_INDEX_INFO:
+		val |= hdr->opcode << 16;
+		break;
+	default:
+		return;
+	}
+
+	while ((rec = queue_remove_if(index_list, match_index,
+							UINT_TO_PTR(val))))
+		free(rec);
+
+	if (hdr->opcode == BTSNOOP_OPCODE_DEL_INDEX)
+		return;
+
+	rec = malloc(sizeof(*rec) + hdr->len);
+	if (!rec)
+		return;
+
+	rec->hdr = *hdr;
+	memcpy(rec->data, data, hdr->len);
+	queue_push_tail(index_list, rec);
+}
+
+static void ring_push(struct timeval *tv, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t len)
+{
+	struct ring_hdr hdr;
+	size_t size = sizeof(hdr) + len;
+
+	if (tv)
+		hdr.tv = *tv;
+	else
+		gettimeofday(&hdr.tv, NULL);
+
+	hdr.index = index;
+	hdr.opcode = opcode;
+	hdr.len = len;
+
+	index_update(&hdr, data);
+
+	if (size > ring_size)
+		return;
+
+	ring_expire(&hdr.tv);
+
+	while (ring_size - ring_len < size)
+		ring_pop();
+
+	ring_copy_in(ring_head + ring_len, &hdr, sizeof(hdr));
+	ring_copy_in(ring_head + ring_len + sizeof(hdr), data, len);
+	ring_len += size;
+	ring_count++;
+}
+
+static void ring_snapshot(const char *reason)
+{
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE];
+	char name[PATH_MAX + 32];
+	const struct queue_entry *entry;
+	struct btsnoop *btsnoop;
+	struct ring_hdr hdr;
+	struct timeval now;
+	size_t offset;
+	unsigned long i;
+	struct tm tm;
+
+	gettimeofday(&now, NULL);
+
+	if (now.tv_sec - last_snapshot < SNAPSHOT_HOLDOFF)
+		return;
+
+	last_snapshot = now.tv_sec;
+
+	ring_expire(&now);
+
+	localtime_r(&now.tv_sec, &tm);
+	snprintf(name, sizeof(name), "%s-%04d%02d%02d-%02d%02d%02d", path,
+				tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+				tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+	btsnoop = btsnoop_create(name, 0, 0, BTSNOOP_FORMAT_MONITOR);
+	if (!btsnoop) {
+		fprintf(stderr, "Failed to create snapshot %s\n", name);
+		return;
+	}
+
+	btsnoop_set_compressed(btsnoop, compress);
+
+	if (ring_count)
+		ring_copy_out(ring_head, &hdr, sizeof(hdr));
+
+	/* Controller records that already left the ring go first */
+	for (entry = queue_get_entries(index_list); entry;
+							entry = entry->next) {
+		struct index_record *rec = entry->data;
+
+		if (ring_count && !timercmp(&rec->hdr.tv, &hdr.tv, <))
+			continue;
+
+		btsnoop_write_hci(btsnoop, &rec->hdr.tv, rec->hdr.index,
+					rec->hdr.opcode, 0, rec->data,
+					rec->hdr.len);
+	}
+
+	for (i = 0, offset = ring_head; i < ring_count; i++) {
+		ring_copy_out(offset, &hdr, sizeof(hdr));
+		ring_copy_out(offset + sizeof(hdr), buf, hdr.len);
+
+		btsnoop_write_hci(btsnoop, &hdr.tv, hdr.index, hdr.opcode, 0,
+								buf, hdr.len);
+
+		offset += sizeof(hdr) + hdr.len;
+	}
+
+	btsnoop_unref(btsnoop);
+
+	printf("Saved snapshot %s with %lu packets (%s)\n", name,
+							ring_count, reason);
+}
+
+static void check_triggers(uint16_t opcode, const uint8_t *data,
+								uint16_t len)
+{
+	char reason[32];
+	unsigned int i;
+
+	if (opcode != BTSNOOP_OPCODE_EVENT_PKT || len < 2)
+		return;
+
+	for (i = 0; i < trigger_count; i++) {
+		struct trigger *trigger = &trigger_list[i];
+
+		if (trigger->event != data[0])
+			continue;
+
+		if (trigger->event == EVT_DISCONN_COMPLETE) {
+			/* Status, handle and reason */
+			if (len < 6 || data[2])
+				continue;
+
+			if (trigger->reason >= 0 && trigger->reason != data[5])
+				continue;
+
+			snprintf(reason, sizeof(reason),
+					"disconnect reason 0x%2.2x", data[5]);
+		} else
+			snprintf(reason, sizeof(reason), "event 0x%2.2x",
+								data[0]);
+
+		ring_snapshot(reason);
+		return;
+	}
+}
+
+static bool parse_trigger(const char *str)
+{
+	struct trigger *trigger;
+	const char *arg;
+	unsigned long val;
+	char *endptr;
+	size_t len;
+
+	if (trigger_count == MAX_TRIGGERS)
+		return false;
+
+	trigger = &trigger_list[trigger_count];
+	trigger->reason = -1;
+
+	arg = strchr(str, ':');
+	len = arg ? (size_t) (arg - str) : strlen(str);
+
+	if (len == 10 && !strncmp(str, "disconnect", len))
+		trigger->event = EVT_DISCONN_COMPLETE;
+	else if (len == 5 && !strncmp(str, "error", len) && !arg)
+		trigger->event = EVT_HARDWARE_ERROR;
+	else if (len == 5 && !strncmp(str, "event", len) && arg)
+		trigger->event = 0;
+	else
+		return false;
+
+	if (arg) {
+		val = strtoul(arg + 1, &endptr, 0);
+		if (!arg[1] || *endptr || val > 0xff)
+			return false;
+
+		if (trigger->event)
+			trigger->reason = val;
+		else
+			trigger->event = val;
+	}
+
+	trigger_count++;
+
+	return true;
+}
 
 static void data_callback(int fd, uint32_t events, void *user_data)
 {
@@ -99,6 +432,12 @@ static void data_callback(int fd, uint32_t events, void *user_data)
 		index  = le16_to_cpu(hdr.index);
 		pktlen = le16_to_cpu(hdr.len);
 
+		if (ring_buf) {
+			ring_push(tv, index, opcode, buf, pktlen);
+			check_triggers(opcode, buf, pktlen);
+			continue;
+		}
+
 		btsnoop_write_hci(btsnoop_file, tv, index, opcode, 0, buf,
 									pktlen);
 	}
@@ -150,6 +489,10 @@ static void signal_callback(int signum, void *user_data)
 	case SIGTERM:
 		mainloop_quit();
 		break;
+	case SIGUSR2:
+		if (ring_buf)
+			ring_snapshot("signal");
+		break;
 	}
 }
 
@@ -196,6 +539,12 @@ static void usage(void)
 		"\t-p, --parents          Create basename parent directories\n"
 		"\t-l, --limit <limit>    Limit traces file size (rotate)\n"
 		"\t-c, --count <count>    Limit number of rotated files\n"
+		"\t-s, --buffer <size>    Buffer traces before writing\n"
+		"\t-z, --compress         Write compressed traces\n"
+		"\t-r, --ring <size>      Keep traces in memory, save on trigger\n"
+		"\t-a, --age <secs>       Limit age of traces kept in memory\n"
+		"\t-t, --trigger <event>  Save traces on disconnect[:<reason>],\n"
+		"\t                       error or event:<code>\n"
 		"\t-v, --version          Show version\n"
 		"\t-h, --help             Show help options\n");
 }
@@ -205,6 +554,11 @@ static const struct option main_options[] = {
 	{ "parents",	no_argument,		NULL, 'p' },
 	{ "limit",	required_argument,	NULL, 'l' },
 	{ "count",	required_argument,	NULL, 'c' },
+	{ "buffer",	required_argument,	NULL, 's' },
+	{ "compress",	no_argument,		NULL, 'z' },
+	{ "ring",	required_argument,	NULL, 'r' },
+	{ "age",	required_argument,	NULL, 'a' },
+	{ "trigger",	required_argument,	NULL, 't' },
 	{ "version",	no_argument,		NULL, 'v' },
 	{ "help",	no_argument,		NULL, 'h' },
 	{ }
@@ -259,9 +613,9 @@ done:
 
 int main(int argc, char *argv[])
 {
-	const char *path = "hci.log";
 	unsigned long max_count = 0;
 	size_t size_limit = 0;
+	size_t buffer_size = 0;
 	bool parents = false;
 	int exit_status;
 	char *endptr;
@@ -273,8 +627,8 @@ int main(int argc, char *argv[])
 	while (true) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "b:l:c:vhp", main_options,
-									NULL);
+		opt = getopt_long(argc, argv, "b:l:c:s:zr:a:t:vhp",
+							main_options, NULL);
 		if (opt < 0)
 			break;
 
@@ -314,6 +668,52 @@ int main(int argc, char *argv[])
 		case 'c':
 			max_count = strtoul(optarg, &endptr, 10);
 			break;
+		case 's':
+			buffer_size = strtoul(optarg, &endptr, 10);
+
+			if (*endptr == 'K' || *endptr == 'k') {
+				buffer_size *= 1024;
+			} else if (*endptr == 'M' || *endptr == 'm') {
+				buffer_size *= 1024 * 1024;
+			} else if (*endptr != '\0') {
+				fprintf(stderr, "Invalid buffer size\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'z':
+			compress = true;
+			break;
+		case 'r':
+			ring_size = strtoul(optarg, &endptr, 10);
+
+			if (*endptr == 'K' || *endptr == 'k') {
+				ring_size *= 1024;
+			} else if (*endptr == 'M' || *endptr == 'm') {
+				ring_size *= 1024 * 1024;
+			} else if (*endptr != '\0') {
+				fprintf(stderr, "Invalid ring size\n");
+				return EXIT_FAILURE;
+			}
+
+			if (ring_size < BTSNOOP_MAX_PACKET_SIZE) {
+				fprintf(stderr, "Too small ring size\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'a':
+			ring_age = strtoul(optarg, &endptr, 10);
+
+			if (*endptr != '\0' || !ring_age) {
+				fprintf(stderr, "Invalid age\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			if (!parse_trigger(optarg)) {
+				fprintf(stderr, "Invalid trigger\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'p':
 			if (getppid() != 1) {
 				fprintf(stderr, "Parents option allowed only "
@@ -339,16 +739,53 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if ((ring_age || trigger_count) && !ring_size) {
+		fprintf(stderr, "Age and trigger options require ring\n");
+		return EXIT_FAILURE;
+	}
+
+	if (ring_size && (size_limit || max_count || buffer_size)) {
+		fprintf(stderr, "Ring can't be combined with limit, count "
+							"or buffer\n");
+		return EXIT_FAILURE;
+	}
+
 	if (!open_monitor_channel())
 		return EXIT_FAILURE;
 
 	if (parents && create_dir(path) < 0)
 		return EXIT_FAILURE;
 
-	btsnoop_file = btsnoop_create(path, size_limit, max_count,
+	if (ring_size) {
+		ring_buf = malloc(ring_size);
+		if (!ring_buf) {
+			fprintf(stderr, "Failed to allocate ring\n");
+			return EXIT_FAILURE;
+		}
+
+		index_list = queue_new();
+	} else {
+		btsnoop_file = btsnoop_create(path, size_limit, max_count,
 							BTSNOOP_FORMAT_MONITOR);
-	if (!btsnoop_file)
+		if (!btsnoop_file)
+			return EXIT_FAILURE;
+
+		if (!btsnoop_set_compressed(btsnoop_file, compress)) {
+			fprintf(stderr, "Failed to enable compression\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (buffer_size && !btsnoop_set_buffer_size(btsnoop_file,
+							buffer_size)) {
+		fprintf(stderr, "Invalid buffer size\n");
 		return EXIT_FAILURE;
+	}
+
+	/* Compressed records are held back until a block is complete */
+	if (btsnoop_file && (buffer_size || compress))
+		mainloop_add_timeout(FLUSH_INTERVAL, flush_callback, NULL,
+									NULL);
 
 	drop_capabilities();
 
@@ -363,5 +800,8 @@ int main(int argc, char *argv[])
 
 	btsnoop_unref(btsnoop_file);
 
+	queue_destroy(index_list, free);
+	free(ring_buf);
+
 	return exit_status;
 }
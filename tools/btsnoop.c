@@ -497,6 +497,66 @@ close_input:
 	close(fd);
 }
 
+static void command_convert(const char *output, const char *input,
+							bool compress)
+{
+	struct btsnoop *btsnoop_in, *btsnoop_out;
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned long count = 0;
+	struct stat st_in, st_out;
+	struct timeval tv;
+	uint32_t flags, drops;
+	uint16_t size;
+
+	btsnoop_in = btsnoop_open(input, 0);
+	if (!btsnoop_in) {
+		fprintf(stderr, "failed to open input file\n");
+		return;
+	}
+
+	btsnoop_out = btsnoop_create(output, 0, 0,
+					btsnoop_get_format(btsnoop_in));
+	if (!btsnoop_out) {
+		perror("failed to create output file");
+		btsnoop_unref(btsnoop_in);
+		return;
+	}
+
+	if (!btsnoop_set_compressed(btsnoop_out, compress) ||
+			!btsnoop_set_buffer_size(btsnoop_out, 64 * 1024)) {
+		fprintf(stderr, "failed to set up output file\n");
+		goto done;
+	}
+
+	while (btsnoop_read(btsnoop_in, &tv, &flags, &drops, buf, &size)) {
+		if (!btsnoop_write(btsnoop_out, &tv, flags, drops,
+							buf, size)) {
+			perror("failed to write output file");
+			goto done;
+		}
+
+		count++;
+	}
+
+	if (!btsnoop_flush(btsnoop_out)) {
+		perror("failed to write output file");
+		goto done;
+	}
+
+	if (stat(input, &st_in) < 0 || stat(output, &st_out) < 0)
+		goto done;
+
+	printf("%lu records, %lld -> %lld bytes (%.1f%%)\n", count,
+				(long long) st_in.st_size,
+				(long long) st_out.st_size,
+				st_in.st_size ? 100.0 * st_out.st_size /
+						st_in.st_size : 0.0);
+
+done:
+	btsnoop_unref(btsnoop_out);
+	btsnoop_unref(btsnoop_in);
+}
+
 static void usage(void)
 {
 	printf("btsnoop trace file handling tool\n"
@@ -505,19 +565,23 @@ static void usage(void)
 	printf("commands:\n"
 		"\t-m, --merge <output>   Merge multiple btsnoop files\n"
 		"\t-e, --extract <input>  Extract data from btsnoop file\n"
+		"\t-c, --convert <output> Convert btsnoop file format\n"
+		"\t-z, --compress         Write compressed file (convert)\n"
 		"\t-h, --help             Show help options\n");
 }
 
 static const struct option main_options[] = {
 	{ "merge",   required_argument, NULL, 'm' },
 	{ "extract", required_argument, NULL, 'e' },
+	{ "convert", required_argument, NULL, 'c' },
+	{ "compress", no_argument,      NULL, 'z' },
 	{ "type",    required_argument, NULL, 't' },
 	{ "version", no_argument,       NULL, 'v' },
 	{ "help",    no_argument,       NULL, 'h' },
 	{ }
 };
 
-enum { INVALID, MERGE, EXTRACT };
+enum { INVALID, MERGE, EXTRACT, CONVERT };
 
 int main(int argc, char *argv[])
 {
@@ -525,11 +589,12 @@ int main(int argc, char *argv[])
 	const char *input_path = NULL;
 	const char *type = NULL;
 	unsigned short command = INVALID;
+	bool compress = false;
 
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "m:e:t:vh", main_options, NULL);
+		opt = getopt_long(argc, argv, "m:e:c:zt:vh", main_options, NULL);
 		if (opt < 0)
 			break;
 
@@ -542,6 +607,13 @@ int main(int argc, char *argv[])
 			command = EXTRACT;
 			input_path = optarg;
 			break;
+		case 'c':
+			command = CONVERT;
+			output_path = optarg;
+			break;
+		case 'z':
+			compress = true;
+			break;
 		case 't':
 			type = optarg;
 			break;
@@ -587,6 +659,15 @@ int main(int argc, char *argv[])
 			fprintf(stderr, "extract type not supported\n");
 		break;
 
+	case CONVERT:
+		if (argc - optind != 1) {
+			fprintf(stderr, "one input file required\n");
+			return EXIT_FAILURE;
+		}
+
+		command_convert(output_path, argv[optind], compress);
+		break;
+
 	default:
 		usage();
 		return EXIT_FAILURE;
@@ -11,6 +11,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -680,6 +681,117 @@ static void test_hf_robustness(gconstpointer data)
 	context_quit(context);
 }
 
+#define BURST_LINES	3000
+#define BURST_CHUNK	1000
+
+static struct {
+	struct context *context;
+	char *data;
+	size_t size;
+	size_t offset;
+	unsigned int received;
+	gint64 start;
+} burst;
+
+static void hf_burst_done(void)
+{
+	int64_t elapsed;
+
+	if (++burst.received < BURST_LINES)
+		return;
+
+	elapsed = MAX(g_get_monotonic_time() - burst.start, 1);
+
+	tester_debug("%u lines, %zu bytes in %" PRId64 " us: %" PRId64
+			" lines/s", burst.received, burst.size, elapsed,
+			(int64_t) burst.received * 1000000 / elapsed);
+
+	g_free(burst.data);
+	burst.data = NULL;
+
+	hfp_hf_disconnect(burst.context->hfp_hf);
+}
+
+static void hf_burst_indexed(struct hfp_context *hf_context, void *user_data)
+{
+	unsigned int val;
+
+	/* Lines split across chunks or the ring buffer must arrive intact */
+	g_assert(hfp_context_get_number(hf_context, &val));
+	g_assert_cmpint(val, ==, burst.received);
+
+	hf_burst_done();
+}
+
+static void hf_burst_cind(struct hfp_context *hf_context, void *user_data)
+{
+	unsigned int val;
+
+	g_assert(hfp_context_get_number(hf_context, &val));
+	g_assert_cmpint(val, ==, 1);
+
+	hf_burst_done();
+}
+
+static gboolean send_burst(gpointer user_data)
+{
+	size_t len = MIN(burst.size - burst.offset, BURST_CHUNK);
+	ssize_t ret;
+
+	ret = write(burst.context->fd_server, burst.data + burst.offset, len);
+	g_assert_cmpint(ret, ==, len);
+
+	burst.offset += len;
+
+	return burst.offset < burst.size;
+}
+
+static void test_hf_burst(gconstpointer data)
+{
+	struct context *context = create_context(data);
+	GString *str;
+	unsigned int i;
+
+	context->hfp_hf = hfp_hf_new(context->fd_client);
+	g_assert(context->hfp_hf);
+	g_assert(hfp_hf_set_close_on_unref(context->hfp_hf, true));
+
+	g_assert(hfp_hf_register(context->hfp_hf, hf_burst_indexed, "+CLCC",
+								NULL, NULL));
+	g_assert(hfp_hf_register(context->hfp_hf, hf_burst_cind, "+CIND",
+								NULL, NULL));
+	g_assert(hfp_hf_register(context->hfp_hf, hf_burst_indexed, "+CPBR",
+								NULL, NULL));
+
+	/* Call list, indicator and phonebook responses as sent on sync */
+	str = g_string_new(NULL);
+
+	for (i = 0; i < BURST_LINES; i++) {
+		switch (i % 3) {
+		case 0:
+			g_string_append_printf(str, "\r\n+CLCC: %u,1,0,0,0,"
+					"\"+1555%07u\",145\r\n", i, i);
+			break;
+		case 1:
+			g_string_append(str, "\r\n+CIND: 1,0,0,3,0,5,0\r\n");
+			break;
+		case 2:
+			g_string_append_printf(str, "\r\n+CPBR: %u,"
+					"\"+1555%07u\",145,\"Contact %u\"\r\n",
+					i, i, i);
+			break;
+		}
+	}
+
+	memset(&burst, 0, sizeof(burst));
+	burst.context = context;
+	burst.size = str->len;
+	burst.data = g_string_free(str, FALSE);
+	burst.start = g_get_monotonic_time();
+
+	g_idle_add(send_burst, NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -850,5 +962,8 @@ int main(int argc, char *argv[])
 			frg_pdu('1', ',', '2', 'x', '\r', '\n'),
 			data_end());
 
+	define_hf_test("/hfp_hf/test_burst", test_hf_burst, NULL, NULL,
+			data_end());
+
 	return tester_run();
 }
@@ -15,6 +15,7 @@
 #define _GNU_SOURCE
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <fcntl.h>
 
@@ -28,6 +29,7 @@
 #include "src/shared/queue.h"
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
+#include "src/shared/uhid.h"
 
 #include "attrib/gattrib.h"
 
@@ -52,8 +54,19 @@ struct context {
 	int fd;
 	unsigned int pdu_offset;
 	const struct test_data *data;
+	guint uhid_source;
+	bool uhid_started;
+	bool attached;
+	unsigned int input_count;
+	struct timespec input_sent;
+	long latency_min;
+	long latency_max;
+	long latency_total;
 };
 
+#define INPUT_REPORTS		1000
+#define INPUT_REPORT_HANDLE	0x0005
+
 #define data(args...) ((const unsigned char[]) { args })
 
 #define raw_pdu(args...)					\
@@ -89,6 +102,9 @@ static gboolean context_quit(gpointer user_data)
 	if (context->source > 0)
 		g_source_remove(context->source);
 
+	if (context->uhid_source > 0)
+		g_source_remove(context->uhid_source);
+
 	bt_hog_unref(context->hog);
 
 	g_attrib_unref(context->attrib);
@@ -100,6 +116,27 @@ static gboolean context_quit(gpointer user_data)
 	return FALSE;
 }
 
+static void send_input(struct context *context)
+{
+	uint8_t pdu[6];
+	ssize_t len;
+
+	/* Wait for both the discovery to complete and uHID to be started */
+	if (!context->attached || !context->uhid_started)
+		return;
+
+	pdu[0] = 0x1b;
+	put_le16(INPUT_REPORT_HANDLE, &pdu[1]);
+	pdu[3] = 0x01;
+	put_le16(context->input_count, &pdu[4]);
+
+	clock_gettime(CLOCK_MONOTONIC, &context->input_sent);
+
+	len = write(context->fd, pdu, sizeof(pdu));
+
+	g_assert_cmpint(len, ==, sizeof(pdu));
+}
+
 static gboolean send_pdu(gpointer user_data)
 {
 	struct context *context = user_data;
@@ -116,8 +153,13 @@ static gboolean send_pdu(gpointer user_data)
 
 	context->process = 0;
 
-	if (!context->data->pdu_list[context->pdu_offset].valid)
-		context_quit(context);
+	if (!context->data->pdu_list[context->pdu_offset].valid) {
+		if (context->uhid_source > 0) {
+			context->attached = true;
+			send_input(context);
+		} else
+			context_quit(context);
+	}
 
 	return FALSE;
 }
@@ -156,7 +198,114 @@ static gboolean test_handler(GIOChannel *channel, GIOCondition cond,
 	return TRUE;
 }
 
-static struct context *create_context(gconstpointer data)
+static void input_received(struct context *context,
+					const struct uhid_event *ev)
+{
+	struct timespec now;
+	long latency;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	latency = (now.tv_sec - context->input_sent.tv_sec) * 1000000L +
+			(now.tv_nsec - context->input_sent.tv_nsec) / 1000L;
+
+	g_assert_cmpint(ev->u.input2.size, ==, 3);
+	g_assert_cmpint(ev->u.input2.data[0], ==, 0x01);
+	g_assert_cmpint(get_le16(&ev->u.input2.data[1]), ==,
+						context->input_count & 0xffff);
+
+	if (!context->input_count || latency < context->latency_min)
+		context->latency_min = latency;
+
+	if (latency > context->latency_max)
+		context->latency_max = latency;
+
+	context->latency_total += latency;
+
+	if (++context->input_count < INPUT_REPORTS) {
+		send_input(context);
+		return;
+	}
+
+	tester_debug("%u reports, notify to uHID latency min %ld us "
+			"avg %ld us max %ld us", context->input_count,
+			context->latency_min,
+			context->latency_total / context->input_count,
+			context->latency_max);
+
+	context_quit(context);
+}
+
+static gboolean uhid_handler(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct context *context = user_data;
+	struct uhid_event ev;
+	ssize_t len;
+	int fd;
+
+	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP)) {
+		context->uhid_source = 0;
+		return FALSE;
+	}
+
+	fd = g_io_channel_unix_get_fd(channel);
+
+	memset(&ev, 0, sizeof(ev));
+
+	len = read(fd, &ev, sizeof(ev));
+
+	g_assert(len > 0);
+
+	switch (ev.type) {
+	case UHID_CREATE2:
+		g_assert_cmpstr((char *) ev.u.create2.phys, ==,
+							"00:01:02:03:04:05");
+		g_assert_cmpstr((char *) ev.u.create2.uniq, ==,
+							"00:0a:0b:0c:0d:0e");
+
+		memset(&ev, 0, sizeof(ev));
+		ev.type = UHID_START;
+
+		len = write(fd, &ev, sizeof(ev));
+		g_assert_cmpint(len, ==, sizeof(ev));
+
+		context->uhid_started = true;
+		send_input(context);
+		break;
+	case UHID_INPUT2:
+		input_received(context, &ev);
+		break;
+	}
+
+	return TRUE;
+}
+
+static int create_uhid(struct context *context)
+{
+	GIOChannel *channel;
+	int err, sv[2];
+
+	err = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv);
+	g_assert(err == 0);
+
+	channel = g_io_channel_unix_new(sv[1]);
+
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+
+	context->uhid_source = g_io_add_watch(channel,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				uhid_handler, context);
+	g_assert(context->uhid_source > 0);
+
+	g_io_channel_unref(channel);
+
+	return sv[0];
+}
+
+static struct context *create_context(gconstpointer data, bool uhid)
 {
 	struct context *context;
 	GIOChannel *channel, *att_io;
@@ -165,6 +314,8 @@ static struct context *create_context(gconstpointer data)
 	uint16_t vendor = 0x0002;
 	uint16_t product = 0x0001;
 	uint16_t version = 0x0001;
+	bdaddr_t src = {{ 0x05, 0x04, 0x03, 0x02, 0x01, 0x00 }};
+	bdaddr_t dst = {{ 0x0e, 0x0d, 0x0c, 0x0b, 0x0a, 0x00 }};
 
 	context = g_new0(struct context, 1);
 	err = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv);
@@ -179,12 +330,19 @@ static struct context *create_context(gconstpointer data)
 
 	g_io_channel_unref(att_io);
 
-	fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (uhid)
+		fd = create_uhid(context);
+	else
+		fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
 	g_assert(fd > 0);
 
 	context->hog = bt_hog_new(fd, name, vendor, product, version, NULL);
 	g_assert(context->hog);
 
+	/* The ATT bearer is a socketpair, which has no L2CAP addresses */
+	if (uhid)
+		g_assert(bt_hog_set_address(context->hog, &src, &dst));
+
 	channel = g_io_channel_unix_new(sv[1]);
 
 	g_io_channel_set_close_on_unref(channel, TRUE);
@@ -206,7 +364,14 @@ static struct context *create_context(gconstpointer data)
 
 static void test_hog(gconstpointer data)
 {
-	struct context *context = create_context(data);
+	struct context *context = create_context(data, false);
+
+	g_assert(bt_hog_attach(context->hog, context->attrib));
+}
+
+static void test_hog_input(gconstpointer data)
+{
+	struct context *context = create_context(data, true);
 
 	g_assert(bt_hog_attach(context->hog, context->attrib));
 }
@@ -423,5 +588,35 @@ int main(int argc, char *argv[])
 		raw_pdu(0x0a, 0x0a, 0x00),
 		raw_pdu(0x0b, 0x19, 0x2a));
 
+	define_test("/HOG/Input/Latency", test_hog_input,
+		raw_pdu(0x10, 0x01, 0x00, 0xff, 0xff, 0x00, 0x28),
+		raw_pdu(0x11, 0x06, 0x01, 0x00, 0x08, 0x00, 0x12, 0x18),
+		raw_pdu(0x10, 0x09, 0x00, 0xff, 0xff, 0x00, 0x28),
+		raw_pdu(0x01, 0x10, 0x09, 0x00, 0x0a),
+		raw_pdu(0x08, 0x01, 0x00, 0x08, 0x00, 0x03, 0x28),
+		raw_pdu(0x09, 0x07, 0x02, 0x00, 0x02, 0x03, 0x00,
+			0x4b, 0x2a, 0x04, 0x00, 0x12, 0x05, 0x00,
+			0x4d, 0x2a),
+		raw_pdu(0x08, 0x01, 0x00, 0x08, 0x00, 0x02, 0x28),
+		raw_pdu(0x01, 0x08, 0x01, 0x00, 0x0a),
+		raw_pdu(0x08, 0x05, 0x00, 0x08, 0x00, 0x03, 0x28),
+		raw_pdu(0x01, 0x08, 0x05, 0x00, 0x0a),
+		raw_pdu(0x0a, 0x03, 0x00),
+		raw_pdu(0x0b, 0x05, 0x01, 0x09, 0x05, 0xa1, 0x01,
+			0x75, 0x08, 0x95, 0x03, 0x81, 0x02, 0xc0),
+		raw_pdu(0x0a, 0x05, 0x00),
+		raw_pdu(0x0b, 0x00, 0x00, 0x00),
+		raw_pdu(0x04, 0x06, 0x00, 0x08, 0x00),
+		raw_pdu(0x05, 0x01, 0x06, 0x00, 0x02, 0x29,
+			0x07, 0x00, 0x08, 0x29),
+		raw_pdu(0x04, 0x08, 0x00, 0x08, 0x00),
+		raw_pdu(0x01, 0x04, 0x08, 0x00, 0x0a),
+		raw_pdu(0x0a, 0x07, 0x00),
+		raw_pdu(0x0b, 0x00, 0x01),
+		raw_pdu(0x0a, 0x06, 0x00),
+		raw_pdu(0x0b, 0x00, 0x00),
+		raw_pdu(0x12, 0x06, 0x00, 0x01, 0x00),
+		raw_pdu(0x13));
+
 	return tester_run();
 }
@@ -0,0 +1,333 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ell/ell.h>
+
+#include "mesh/crypto.h"
+#include "mesh/crypto-pool.h"
+
+#define ORDER_JOBS		64
+#define DECODE_JOBS		2000
+
+/* Mesh Profile 8.3.1 Message #1 */
+#define NET_IV_INDEX		0x12345678
+#define NET_ENC_KEY		"0953fa93e7caac9638f58820220a398e"
+#define NET_PRIV_KEY		"8b84eedec100067d670971dd2aa700cf"
+#define NET_PACKET		"68eca487516765b5e5bfdacbaf6cb7fb" \
+				"6bff871f035444ce83a670df"
+#define NET_PLAIN		"68800000011201fffd034b50057e4000" \
+				"00010000"
+
+struct test_data {
+	unsigned int workers;
+	bool decode;
+	unsigned int total;
+	unsigned int queued;
+	unsigned int completed;
+	unsigned int destroyed;
+	uint64_t start;
+	uint8_t enc_key[16];
+	uint8_t priv_key[16];
+	uint8_t pkt[29];
+	uint8_t plain[29];
+	size_t pkt_len;
+	size_t plain_len;
+};
+
+struct test_job {
+	struct test_data *data;
+	unsigned int seq;
+	unsigned int delay;
+	uint8_t out[29];
+};
+
+static struct l_tester *tester;
+
+static bool test_done(void)
+{
+	return l_tester_get_stage(tester) != L_TESTER_STAGE_RUN;
+}
+
+static void job_destroy(void *user_data)
+{
+	struct test_job *job = user_data;
+
+	job->data->destroyed++;
+	l_free(job);
+}
+
+static void order_work(void *user_data)
+{
+	struct test_job *job = user_data;
+
+	usleep(job->delay);
+}
+
+static void order_done(void *user_data)
+{
+	struct test_job *job = user_data;
+	struct test_data *data = job->data;
+
+	if (test_done())
+		return;
+
+	if (job->seq != data->completed++) {
+		l_info("Job %u completed at %u", job->seq, data->completed - 1);
+		l_tester_test_failed(tester);
+		return;
+	}
+
+	if (data->completed == data->total)
+		l_tester_test_passed(tester);
+}
+
+static void decode_work(void *user_data)
+{
+	struct test_job *job = user_data;
+	struct test_data *data = job->data;
+
+	mesh_crypto_packet_decode(data->pkt, data->pkt_len, false, job->out,
+					NET_IV_INDEX, data->enc_key,
+					data->priv_key);
+}
+
+static void decode_done(void *user_data)
+{
+	struct test_job *job = user_data;
+	struct test_data *data = job->data;
+	uint64_t usec, rate;
+
+	if (test_done())
+		return;
+
+	if (memcmp(job->out, data->plain, data->plain_len)) {
+		l_info("Packet %u decoded wrong", job->seq);
+		l_tester_test_failed(tester);
+		return;
+	}
+
+	if (++data->completed < data->total)
+		return;
+
+	usec = l_time_diff(data->start, l_time_now());
+	rate = data->completed * 1000000 / (usec ? usec : 1);
+
+	l_info("%u workers: %u packets in %" PRIu64 " us, %" PRIu64
+			" packets/s", data->workers, data->completed, usec,
+			rate);
+
+	l_tester_test_passed(tester);
+}
+
+static bool queue_job(struct test_data *data)
+{
+	struct test_job *job = l_new(struct test_job, 1);
+	bool result;
+
+	job->data = data;
+	job->seq = data->queued++;
+
+	/* Without workers, decode on the main loop for a baseline */
+	if (data->decode && !data->workers) {
+		decode_work(job);
+		decode_done(job);
+		job_destroy(job);
+		return true;
+	}
+
+	if (data->decode)
+		result = crypto_pool_queue(decode_work, decode_done, job,
+								job_destroy);
+	else {
+		job->delay = l_getrandom_uint32() % 500;
+		result = crypto_pool_queue(order_work, order_done, job,
+								job_destroy);
+	}
+
+	if (!result) {
+		data->queued--;
+		l_free(job);
+		return false;
+	}
+
+	return true;
+}
+
+static bool decode_supported(void)
+{
+	return l_cipher_is_supported(L_CIPHER_AES) &&
+			l_aead_cipher_is_supported(L_AEAD_CIPHER_AES_CCM);
+}
+
+static bool load_hex(const char *str, uint8_t *buf, size_t size,
+								size_t *len)
+{
+	uint8_t *bytes;
+	size_t n;
+
+	bytes = l_util_from_hexstring(str, &n);
+	if (!bytes || n > size) {
+		l_free(bytes);
+		return false;
+	}
+
+	memcpy(buf, bytes, n);
+	l_free(bytes);
+
+	if (len)
+		*len = n;
+
+	return true;
+}
+
+static void test_order(const void *test_data)
+{
+	struct test_data *data = l_tester_get_data(tester);
+	unsigned int i;
+
+	if (!crypto_pool_init(data->workers)) {
+		l_tester_test_failed(tester);
+		return;
+	}
+
+	data->total = ORDER_JOBS;
+
+	for (i = 0; i < data->total; i++) {
+		if (!queue_job(data)) {
+			l_tester_test_failed(tester);
+			return;
+		}
+	}
+}
+
+static void test_cleanup(const void *test_data)
+{
+	struct test_data *data = l_tester_get_data(tester);
+	unsigned int i;
+
+	if (!crypto_pool_init(data->workers)) {
+		l_tester_test_failed(tester);
+		return;
+	}
+
+	data->total = ORDER_JOBS;
+
+	for (i = 0; i < data->total; i++)
+		queue_job(data);
+
+	/* Nothing may complete once the pool is gone */
+	crypto_pool_cleanup();
+
+	if (data->completed || data->destroyed != data->queued ||
+						crypto_pool_queue(order_work,
+						order_done, data, NULL)) {
+		l_tester_test_failed(tester);
+		return;
+	}
+
+	l_tester_test_passed(tester);
+}
+
+static void test_decode(const void *test_data)
+{
+	struct test_data *data = l_tester_get_data(tester);
+	unsigned int i;
+
+	if (!decode_supported()) {
+		l_info("AES-CCM not supported by the kernel");
+		l_tester_test_abort(tester);
+		return;
+	}
+
+	if (!load_hex(NET_ENC_KEY, data->enc_key, 16, NULL) ||
+			!load_hex(NET_PRIV_KEY, data->priv_key, 16, NULL) ||
+			!load_hex(NET_PACKET, data->pkt, sizeof(data->pkt),
+							&data->pkt_len) ||
+			!load_hex(NET_PLAIN, data->plain, sizeof(data->plain),
+							&data->plain_len) ||
+			(data->workers && !crypto_pool_init(data->workers))) {
+		l_tester_test_failed(tester);
+		return;
+	}
+
+	data->total = DECODE_JOBS;
+	data->start = l_time_now();
+
+	for (i = 0; i < data->total; i++) {
+		if (!queue_job(data)) {
+			l_tester_test_failed(tester);
+			return;
+		}
+	}
+}
+
+static void test_teardown(const void *test_data)
+{
+	crypto_pool_cleanup();
+
+	l_tester_teardown_complete(tester);
+}
+
+static void test_add(const char *name, unsigned int workers, bool decode,
+					l_tester_data_func_t func)
+{
+	struct test_data *data = l_new(struct test_data, 1);
+
+	data->workers = workers;
+	data->decode = decode;
+
+	l_tester_add_full(tester, name, NULL, NULL, NULL, func,
+					test_teardown, NULL, 10, data, l_free);
+}
+
+static void done_callback(struct l_tester *tester)
+{
+	l_main_quit();
+}
+
+int main(int argc, char *argv[])
+{
+	int status = EXIT_SUCCESS;
+
+	l_log_set_stderr();
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	tester = l_tester_new(NULL, NULL, false);
+
+	test_add("/mesh/crypto-pool/order", 4, false, test_order);
+	test_add("/mesh/crypto-pool/cleanup", 4, false, test_cleanup);
+	test_add("/mesh/crypto-pool/decode/inline", 0, true, test_decode);
+	test_add("/mesh/crypto-pool/decode/1", 1, true, test_decode);
+	test_add("/mesh/crypto-pool/decode/2", 2, true, test_decode);
+	test_add("/mesh/crypto-pool/decode/4", 4, true, test_decode);
+
+	l_tester_start(tester, done_callback);
+	l_main_run();
+
+	if (!l_tester_summarize(tester))
+		status = EXIT_FAILURE;
+
+	l_tester_destroy(tester);
+	mesh_crypto_cleanup();
+	l_main_exit();
+
+	return status;
+}
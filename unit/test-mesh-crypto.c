@@ -2075,5 +2075,7 @@ int main(int argc, char *argv[])
 	/* Section 8.6 Mesh Proxy Service sample data */
 	check_id_beacon(&s8_6_2);
 
+	mesh_crypto_cleanup();
+
 	return 0;
 }
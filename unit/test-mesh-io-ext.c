@@ -0,0 +1,364 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  BlueZ contributors
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <ell/ell.h>
+
+#include "monitor/bt.h"
+#include "src/shared/ad.h"
+#include "src/shared/hci.h"
+#include "emulator/btdev.h"
+
+#include "mesh/mesh-io.h"
+#include "mesh/mesh-io-api.h"
+#include "mesh/mesh-io-ext.h"
+
+#define UNLIMITED_PDUS		4
+#define THROUGHPUT_PDUS		30
+
+struct test_data {
+	uint8_t num_sets;
+	bool throughput;
+	void (*start)(struct test_data *data);
+	struct mesh_io io;
+	struct btdev *btdev;
+	struct l_io *l_io;
+	struct l_timeout *timeout;
+	unsigned int limited;
+	unsigned int unlimited[UNLIMITED_PDUS];
+	unsigned int cancelled;
+	uint8_t next_pdu;
+	uint8_t handles;
+};
+
+static struct l_tester *tester;
+
+static void test_send(const struct iovec *iov, int iovlen, void *user_data)
+{
+	int fd = L_PTR_TO_INT(user_data);
+
+	if (writev(fd, iov, iovlen) < 0)
+		l_error("writev: %s", strerror(errno));
+}
+
+static bool test_read(struct l_io *io, void *user_data)
+{
+	struct btdev *btdev = user_data;
+	uint8_t buf[512];
+	ssize_t len;
+
+	len = read(l_io_get_fd(io), buf, sizeof(buf));
+	if (len > 0)
+		btdev_receive_h4(btdev, buf, len);
+
+	return true;
+}
+
+static void test_command(uint16_t opcode, const void *data, uint8_t len,
+				btdev_callback callback, void *user_data)
+{
+	struct test_data *test_data = user_data;
+	struct bt_hci_rsp_le_read_num_supported_adv_sets rsp;
+
+	if (opcode != BT_HCI_CMD_LE_READ_NUM_SUPPORTED_ADV_SETS ||
+							!test_data->num_sets) {
+		btdev_command_default(callback);
+		return;
+	}
+
+	rsp.status = BT_HCI_ERR_SUCCESS;
+	rsp.num_of_sets = test_data->num_sets;
+
+	btdev_command_complete(callback, &rsp, sizeof(rsp));
+}
+
+static bool test_done(void)
+{
+	return l_tester_get_stage(tester) != L_TESTER_STAGE_RUN;
+}
+
+static void test_fail(struct test_data *data, const char *msg)
+{
+	if (test_done())
+		return;
+
+	l_info("%s", msg);
+	l_tester_test_failed(tester);
+}
+
+static void count_throughput(struct test_data *data,
+				const struct bt_hci_cmd_le_set_ext_adv_data *cmd)
+{
+	uint8_t id = cmd->data[2];
+
+	if (cmd->data[1] != BT_AD_MESH_DATA || test_done())
+		return;
+
+	data->handles |= 1 << cmd->handle;
+
+	/* PDUs are sent at least once, but may be repeated */
+	if (id + 1 == data->next_pdu)
+		return;
+
+	if (id != data->next_pdu) {
+		test_fail(data, "PDU loaded out of order");
+		return;
+	}
+
+	if (++data->next_pdu < THROUGHPUT_PDUS)
+		return;
+
+	/* Sets load in parallel unless only one is available */
+	if (data->num_sets == 1 && data->handles != 0x01)
+		test_fail(data, "More than one advertising set used");
+	else if (!data->num_sets && !(data->handles & ~0x01))
+		test_fail(data, "Only one advertising set used");
+	else
+		l_tester_test_passed(tester);
+}
+
+static bool adv_data_hook(const void *data, uint16_t len, void *user_data)
+{
+	const struct bt_hci_cmd_le_set_ext_adv_data *cmd = data;
+	struct test_data *test_data = user_data;
+
+	if (len < sizeof(*cmd) + 3)
+		return true;
+
+	if (test_data->throughput)
+		count_throughput(test_data, cmd);
+
+	if (cmd->data[1] == BT_AD_MESH_DATA)
+		test_data->limited++;
+	else if (cmd->data[1] == BT_AD_MESH_PROV &&
+					cmd->data[2] < UNLIMITED_PDUS)
+		test_data->unlimited[cmd->data[2]]++;
+
+	return true;
+}
+
+static struct bt_hci *test_hci_new(uint16_t index)
+{
+	struct test_data *data = l_tester_get_data(tester);
+	struct bt_hci *hci;
+	int fd[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK,
+								0, fd) < 0)
+		return NULL;
+
+	data->btdev = btdev_create(BTDEV_TYPE_BREDRLE50, index);
+	if (!data->btdev) {
+		close(fd[0]);
+		close(fd[1]);
+		return NULL;
+	}
+
+	btdev_set_send_handler(data->btdev, test_send, L_INT_TO_PTR(fd[1]));
+	btdev_set_command_handler(data->btdev, test_command, data);
+	btdev_add_hook(data->btdev, BTDEV_HOOK_PRE_CMD,
+					BT_HCI_CMD_LE_SET_EXT_ADV_DATA,
+					adv_data_hook, data);
+
+	data->l_io = l_io_new(fd[1]);
+	l_io_set_close_on_destroy(data->l_io, true);
+	l_io_set_read_handler(data->l_io, test_read, data->btdev, NULL);
+
+	hci = bt_hci_new(fd[0]);
+	if (!hci) {
+		close(fd[0]);
+		return NULL;
+	}
+
+	bt_hci_set_close_on_unref(hci, true);
+
+	return hci;
+}
+
+static void send_pdu(struct test_data *data, uint8_t type, uint8_t id,
+								uint8_t cnt)
+{
+	struct mesh_io_send_info info = {
+		.type = MESH_IO_TIMING_TYPE_GENERAL,
+		.u.gen.interval = 20,
+		.u.gen.cnt = cnt,
+	};
+	uint8_t pdu[] = { type, id, 0x00, 0x01, 0x02 };
+
+	if (!data->io.api->send(&data->io, &info, pdu, sizeof(pdu)))
+		test_fail(data, "Failed to queue PDU");
+}
+
+static unsigned int unlimited_loads(struct test_data *data)
+{
+	unsigned int i, count = 0;
+
+	for (i = 0; i < UNLIMITED_PDUS; i++)
+		count += data->unlimited[i];
+
+	return count;
+}
+
+static void rotation_cancelled(struct l_timeout *timeout, void *user_data)
+{
+	struct test_data *data = user_data;
+
+	if (unlimited_loads(data) > data->cancelled)
+		test_fail(data, "Cancelled PDUs still loaded");
+	else
+		l_tester_test_passed(tester);
+}
+
+static void rotation_check(struct l_timeout *timeout, void *user_data)
+{
+	struct test_data *data = user_data;
+	uint8_t type = BT_AD_MESH_PROV;
+	unsigned int i;
+
+	if (!data->limited) {
+		test_fail(data, "Limited PDU never loaded");
+		return;
+	}
+
+	/* Every unlimited PDU gets its turn, not only the first ones */
+	for (i = 0; i < UNLIMITED_PDUS; i++) {
+		if (data->unlimited[i] < 2) {
+			test_fail(data, "Unlimited PDU not rotated");
+			return;
+		}
+	}
+
+	data->io.api->cancel(&data->io, &type, 1);
+	data->cancelled = unlimited_loads(data);
+
+	l_timeout_remove(data->timeout);
+	data->timeout = l_timeout_create_ms(200, rotation_cancelled, data,
+									NULL);
+}
+
+static void start_rotation(struct test_data *data)
+{
+	uint8_t i;
+
+	/* More PDUs that never complete than there are advertising sets */
+	for (i = 0; i < UNLIMITED_PDUS; i++)
+		send_pdu(data, BT_AD_MESH_PROV, i, MESH_IO_TX_COUNT_UNLIMITED);
+
+	send_pdu(data, BT_AD_MESH_DATA, 0, 3);
+
+	data->timeout = l_timeout_create_ms(1000, rotation_check, data, NULL);
+}
+
+static void start_throughput(struct test_data *data)
+{
+	uint8_t i;
+
+	for (i = 0; i < THROUGHPUT_PDUS; i++)
+		send_pdu(data, BT_AD_MESH_DATA, i, 1);
+}
+
+static void test_ready(void *user_data, bool result)
+{
+	struct test_data *data = user_data;
+
+	if (!result) {
+		test_fail(data, "Mesh io failed to start");
+		return;
+	}
+
+	data->start(data);
+}
+
+static void test_io(const void *test_data)
+{
+	struct test_data *data = l_tester_get_data(tester);
+	int index = 0;
+
+	data->io.type = MESH_IO_TYPE_EXT;
+	data->io.api = &mesh_io_ext;
+
+	if (!data->io.api->init(&data->io, &index, test_ready, data))
+		l_tester_test_failed(tester);
+}
+
+static void test_teardown(const void *test_data)
+{
+	struct test_data *data = l_tester_get_data(tester);
+
+	l_timeout_remove(data->timeout);
+	data->timeout = NULL;
+
+	data->io.api->destroy(&data->io);
+	l_io_destroy(data->l_io);
+
+	if (data->btdev) {
+		btdev_del_hook(data->btdev, BTDEV_HOOK_PRE_CMD,
+					BT_HCI_CMD_LE_SET_EXT_ADV_DATA);
+		btdev_destroy(data->btdev);
+	}
+
+	l_tester_teardown_complete(tester);
+}
+
+static void test_add(const char *name, uint8_t num_sets, bool throughput)
+{
+	struct test_data *data = l_new(struct test_data, 1);
+
+	data->num_sets = num_sets;
+	data->throughput = throughput;
+	data->start = throughput ? start_throughput : start_rotation;
+
+	l_tester_add_full(tester, name, NULL, NULL, NULL, test_io,
+					test_teardown, NULL, 5, data, l_free);
+}
+
+static void done_callback(struct l_tester *tester)
+{
+	l_main_quit();
+}
+
+int main(int argc, char *argv[])
+{
+	int status = EXIT_SUCCESS;
+
+	l_log_set_stderr();
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	mesh_io_ext_set_hci_func(test_hci_new);
+
+	tester = l_tester_new(NULL, NULL, false);
+
+	test_add("/mesh/io-ext/unlimited-rotation", 0, false);
+	test_add("/mesh/io-ext/all-sets", 0, true);
+	test_add("/mesh/io-ext/one-set", 1, true);
+
+	l_tester_start(tester, done_callback);
+	l_main_run();
+
+	if (!l_tester_summarize(tester))
+		status = EXIT_FAILURE;
+
+	l_tester_destroy(tester);
+	l_main_exit();
+
+	return status;
+}
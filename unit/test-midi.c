@@ -12,10 +12,22 @@
 #include <config.h>
 #endif
 
+#include <inttypes.h>
+
 #include <glib.h>
 
 #define NUM_WRITE_TESTS 100
 
+/* Jitter buffer benchmark: a sender plays a note every EVENT_INTERVAL ms,
+   notes are packed per connection interval and delayed by up to
+   TRANSPORT_DELAY ms before being received.
+ */
+#define JITTER_EVENTS 1000
+#define JITTER_EVENT_INTERVAL 3
+#define JITTER_CONN_INTERVAL 15
+#define JITTER_TRANSPORT_DELAY 20
+#define JITTER_BUFFER (JITTER_CONN_INTERVAL + JITTER_TRANSPORT_DELAY)
+
 #include "src/shared/tester.h"
 #include "profiles/midi/libmidi.h"
 
@@ -600,6 +612,123 @@ static void test_midi_writer(gconstpointer data)
 	tester_test_passed();
 }
 
+struct jitter_stats {
+	int64_t min;
+	int64_t max;
+	int64_t total;
+};
+
+static void jitter_stats_update(struct jitter_stats *stats, int64_t latency)
+{
+	stats->min = MIN(stats->min, latency);
+	stats->max = MAX(stats->max, latency);
+	stats->total += latency;
+}
+
+static void jitter_stats_print(const char *name,
+                               const struct jitter_stats *stats)
+{
+	tester_debug("%s: latency min %" PRId64 " ms avg %" PRId64 " ms "
+	             "max %" PRId64 " ms, jitter %" PRId64 " ms", name,
+	             stats->min, stats->total / JITTER_EVENTS, stats->max,
+	             stats->max - stats->min);
+}
+
+static void test_midi_jitter(gconstpointer data)
+{
+	struct midi_read_parser midi;
+	struct jitter_stats direct = { INT64_MAX, INT64_MIN, 0 };
+	struct jitter_stats buffered = { INT64_MAX, INT64_MIN, 0 };
+	int64_t sent[JITTER_EVENTS];
+	/* keeps timestampHigh from being 0 for the whole run */
+	int64_t time = 1000;
+	int64_t arrival = 0;
+	size_t sender = 0, receiver = 0;
+	GRand *rand;
+	int err;
+
+	err = midi_read_init(&midi);
+	g_assert_cmpint(err, ==, 0);
+
+	rand = g_rand_new_with_seed(JITTER_EVENTS);
+
+	while (receiver < JITTER_EVENTS) {
+		uint8_t packet[64];
+		size_t len = 0, i = 0;
+
+		time += JITTER_CONN_INTERVAL;
+
+		/* Pack everything played since the last connection event */
+		while (sender < JITTER_EVENTS &&
+		       1000 + sender * JITTER_EVENT_INTERVAL <= time) {
+			int64_t t = 1000 + sender * JITTER_EVENT_INTERVAL;
+
+			if (!len)
+				packet[len++] = 0x80 | ((t >> 7) & 0x3F);
+
+			packet[len++] = 0x80 | (t & 0x7F);
+			packet[len++] = 0x90;
+			packet[len++] = sender & 0x7F;
+			packet[len++] = 0x40;
+
+			sent[sender++] = t;
+		}
+
+		if (!len)
+			continue;
+
+		/* Packets are delivered in order */
+		arrival = MAX(arrival, time + g_rand_int_range(rand, 0,
+		                                JITTER_TRANSPORT_DELAY + 1));
+
+		midi_read_reset(&midi);
+		midi_read_set_time(&midi, arrival);
+
+		while (i < len) {
+			snd_seq_event_t ev;
+			size_t count;
+
+			snd_seq_ev_clear(&ev);
+
+			count = midi_read_raw(&midi, packet + i, len - i, &ev);
+			g_assert_cmpuint(count, >, 0);
+
+			i += count;
+
+			if (ev.type == SND_SEQ_EVENT_NONE)
+				continue;
+
+			g_assert_cmpint(ev.type, ==, SND_SEQ_EVENT_NOTEON);
+			g_assert_cmpint(ev.data.note.note, ==, receiver & 0x7F);
+
+			jitter_stats_update(&direct, arrival - sent[receiver]);
+			jitter_stats_update(&buffered,
+			                    midi_read_ev_deadline(&ev, arrival,
+			                                          JITTER_BUFFER) -
+			                    sent[receiver]);
+			receiver++;
+		}
+	}
+
+	g_assert_cmpuint(sender, ==, JITTER_EVENTS);
+
+	jitter_stats_print("Direct", &direct);
+	jitter_stats_print("Jitter buffer", &buffered);
+
+	/* Events must keep the sender's timing, never play early, and not be
+	   held longer than the buffer.
+	 */
+	g_assert_cmpint(buffered.max - buffered.min, <,
+	                direct.max - direct.min);
+	g_assert_cmpint(buffered.min, >=, direct.min);
+	g_assert_cmpint(buffered.max, <=, direct.max + JITTER_BUFFER);
+
+	g_rand_free(rand);
+	midi_read_free(&midi);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -614,6 +743,8 @@ int main(int argc, char *argv[])
 	           &midi4, NULL, test_midi_writer, NULL);
 	tester_add("Split ALSA SysEx events to raw BLE packets",
 	           &midi5, NULL, test_midi_writer, NULL);
+	tester_add("BLE-MIDI jitter buffer",
+	           NULL, NULL, test_midi_jitter, NULL);
 
 	return tester_run();
 }
@@ -136,6 +136,24 @@ static void context_process(struct context *context)
 	context->process = g_idle_add(send_pdu, context);
 }
 
+static void check_batch_stats(struct context *context)
+{
+	struct bt_uhid_stats stats;
+	uint64_t latency = 0;
+	unsigned int i;
+
+	g_assert(bt_uhid_get_stats(context->uhid, &stats));
+
+	g_assert_cmpint(stats.reports, ==, 2);
+	g_assert_cmpint(stats.writes, ==, 1);
+	g_assert_cmpint(stats.dropped, ==, 0);
+
+	for (i = 0; i < BT_UHID_LATENCY_BUCKETS; i++)
+		latency += stats.latency[i];
+
+	g_assert_cmpint(latency, ==, 2);
+}
+
 static gboolean test_handler(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
@@ -170,7 +188,52 @@ static gboolean test_handler(GIOChannel *channel, GIOCondition cond,
 	return TRUE;
 }
 
-static struct context *create_context(gconstpointer data)
+static gboolean batch_handler(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct context *context = user_data;
+	const struct test_pdu *pdu;
+	unsigned char buf[sizeof(struct uhid_event)];
+	size_t offset = 0;
+	ssize_t len;
+	int fd;
+
+	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP)) {
+		context->source = 0;
+		g_print("%s: cond %x\n", __func__, cond);
+		return FALSE;
+	}
+
+	fd = g_io_channel_unix_get_fd(channel);
+
+	len = read(fd, buf, sizeof(buf));
+
+	g_assert(len > 0);
+
+	util_hexdump('>', buf, len, test_debug, "uHID: ");
+
+	/* All batched input events are received with a single read */
+	while (context->data->pdu_list[context->pdu_offset].valid) {
+		pdu = &context->data->pdu_list[context->pdu_offset++];
+
+		g_assert_cmpint(len, >=, pdu->size);
+		g_assert(memcmp(buf + offset, pdu->data, pdu->size) == 0);
+
+		offset += pdu->size;
+		len -= pdu->size;
+	}
+
+	g_assert_cmpint(len, ==, 0);
+
+	check_batch_stats(context);
+
+	context_quit(context);
+
+	return TRUE;
+}
+
+static struct context *create_context_full(gconstpointer data,
+							GIOFunc handler)
 {
 	struct context *context = g_new0(struct context, 1);
 	GIOChannel *channel;
@@ -190,7 +253,7 @@ static struct context *create_context(gconstpointer data)
 
 	context->source = g_io_add_watch(channel,
 				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-				test_handler, context);
+				handler, context);
 	g_assert(context->source > 0);
 
 	g_io_channel_unref(channel);
@@ -201,6 +264,11 @@ static struct context *create_context(gconstpointer data)
 	return context;
 }
 
+static struct context *create_context(gconstpointer data)
+{
+	return create_context_full(data, test_handler);
+}
+
 static const struct uhid_event ev_create = {
 	.type = UHID_CREATE,
 };
@@ -217,6 +285,14 @@ static const struct uhid_event ev_input = {
 	.type = UHID_INPUT,
 };
 
+static const uint8_t ev_input_batch1[] = {
+	0x0c, 0x00, 0x00, 0x00, 0x03, 0x00, 0x01, 0x02, 0x03,
+};
+
+static const uint8_t ev_input_batch2[] = {
+	0x0c, 0x00, 0x00, 0x00, 0x02, 0x00, 0x04, 0x05,
+};
+
 static const struct uhid_event ev_output = {
 	.type = UHID_OUTPUT,
 };
@@ -245,6 +321,28 @@ static void test_client(gconstpointer data)
 	context_quit(context);
 }
 
+static void test_input_batch(gconstpointer data)
+{
+	struct context *context = create_context_full(data, batch_handler);
+	static const uint8_t report1[] = { 0x02, 0x03 };
+	static const uint8_t report2[] = { 0x04, 0x05 };
+	struct bt_uhid_stats stats;
+
+	g_assert(bt_uhid_set_batching(context->uhid, true));
+
+	/* Both reports shall reach the device with a single write, one
+	 * UHID_INPUT2 event each, once the main loop runs again.
+	 */
+	g_assert(!bt_uhid_input(context->uhid, 0x01, report1,
+							sizeof(report1)));
+	g_assert(!bt_uhid_input(context->uhid, 0x00, report2,
+							sizeof(report2)));
+
+	g_assert(bt_uhid_get_stats(context->uhid, &stats));
+	g_assert_cmpint(stats.reports, ==, 0);
+	g_assert_cmpint(stats.writes, ==, 0);
+}
+
 static void handle_output(struct uhid_event *ev, void *user_data)
 {
 	g_assert_cmpint(ev->type, ==, UHID_OUTPUT);
@@ -278,6 +376,9 @@ int main(int argc, char *argv[])
 	define_test("/uhid/command/feature_answer", test_client,
 						event(&ev_feature_answer));
 	define_test("/uhid/command/input", test_client, event(&ev_input));
+	define_test("/uhid/command/input_batch", test_input_batch,
+						event(&ev_input_batch1),
+						event(&ev_input_batch2));
 
 	define_test("/uhid/event/output", test_server, event(&ev_output));
 	define_test("/uhid/event/feature", test_server, event(&ev_feature));